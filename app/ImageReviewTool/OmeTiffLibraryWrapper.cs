@@ -37,6 +37,7 @@ namespace ImageReviewTool
             TIFF_ERR_APPEND_TAG_NOT_ALLOWED = -25,
             TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED = -26,
             TIFF_ERR_BIGENDIAN_NOT_SUPPORT = -27,
+            TIFF_ERR_WRITE_DATA_TO_FILE_FAILED = -28,
 
             ERR_FILE_PATH_ERROR = -101,
             ERR_HANDLE_NOT_EXIST = -102,
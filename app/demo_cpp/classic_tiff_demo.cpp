@@ -66,6 +66,9 @@ void tiff_write_example()
         info.width = 512;
         info.height = 512;
         info.compress_mode = tiff::CompressionMode::COMPRESSIONMODE_NONE;
+        info.shuffle_mode = tiff::ShuffleMode::SHUFFLEMODE_NONE;
+        info.tile_width = 0;
+        info.tile_height = 0;
         info.image_type = tiff::ImageType::IMAGE_GRAY;
         info.pixel_type = tiff::PixelType::PIXEL_UINT16;
         info.valid_bits = 16;
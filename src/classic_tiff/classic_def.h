@@ -33,6 +33,7 @@ namespace tiff
 		TIFF_ERR_APPEND_TAG_NOT_ALLOWED = -25,
 		TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED = -26,
 		TIFF_ERR_BIGENDIAN_NOT_SUPPORT = -27,
+		TIFF_ERR_WRITE_DATA_TO_FILE_FAILED = -28,
 
 		ERR_FILE_PATH_ERROR = -101,
 		ERR_HANDLE_NOT_EXIST = -102,
@@ -51,6 +52,10 @@ namespace tiff
 		ERR_LZW_HORIZONTAL_DIFFERENCING = -163,
 		ERR_COMPRESS_LZW_ERROR = -164,
 		ERR_COMPRESS_JPEG_ERROR = -165,
+		ERR_SHUFFLE_FAILED = -166,
+		ERR_TILE_SIZE_NOT_SUPPORT = -167,
+		ERR_REGION_NOT_CORRECT = -168,
+		ERR_ROW_COUNT_NOT_CORRECT = -169,
 	};
 
 	enum class TiffTagDataType {
@@ -99,6 +104,14 @@ namespace tiff
 		COMPRESSIONMODE_LZW = 2,
 		COMPRESSIONMODE_JPEG = 3,
 		COMPRESSIONMODE_ZIP = 4,
+		COMPRESSIONMODE_AUTO = 5,		//lossless, chosen by trial compression of the image data : none, LZW or LZW with byte shuffle
+	};
+
+	//Pre-filter before compression, only useful when compress_mode is LZW or ZIP.
+	enum class ShuffleMode {
+		SHUFFLEMODE_NONE = 0,
+		SHUFFLEMODE_BYTE = 1,	//better for 16 bits and 32 bits data
+		SHUFFLEMODE_BIT = 2,
 	};
 
 	struct SingleImageInfo
@@ -110,5 +123,10 @@ namespace tiff
 		PixelType pixel_type;
 		ImageType image_type;
 		CompressionMode compress_mode;
+		ShuffleMode shuffle_mode = ShuffleMode::SHUFFLEMODE_NONE;
+		//Block layout. Both 0 : automatic, strips for usual images and 512 x 512 tiles for very large ones.
+		//tile_width 0 or not less than width : strips of tile_height rows. Otherwise tiles, both must be multiples of 16.
+		uint32_t tile_width = 0;
+		uint32_t tile_height = 0;
 	};
 }
\ No newline at end of file
@@ -2,9 +2,12 @@
 #include "..\micro_tiff\micro_tiff.h"
 #include "..\lzw\lzw.h"
 #include "..\common\data_predict.h"
+#include "..\common\data_shuffle.h"
+#include "..\common\jpeg_handler.h"
+#include "..\common\codec_probe.h"
+#include "..\common\thread_pool.h"
 #include "classic_def.h"
 
-#include <omp.h>
 #include <io.h>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -14,123 +17,485 @@
 #include <functional>
 #include <memory>
 #include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 #define OMP_COMPRESS_TILE_HEIGHT 32
+//compressed LZW blocks waiting to be written, per compressing thread
+#define LZW_WINDOW_BLOCKS_PER_THREAD 2
+//frames of save_image_stack saved at the same time : one is compressed while the other is written
+#define STACK_FRAMES_IN_FLIGHT 2
+//every jpeg strip carries its own tables, so use higher strips than LZW. Must be a multiple of 16 (MCU height of 4:2:0).
+#define OMP_COMPRESS_JPEG_STRIP_HEIGHT 256
+//row bands encoded on trial by COMPRESSIONMODE_AUTO, spread over the image
+#define AUTO_PROBE_BAND_COUNT 4
+#define AUTO_PROBE_BAND_HEIGHT 32
+//layout of images created with tile_width and tile_height 0 : strips up to this size, square tiles above
+#define AUTO_TILE_MIN_PIXELS (4096ull * 4096)
+#define AUTO_TILE_SIZE 512
 
 using namespace std;
 using namespace tiff;
 
-int32_t save_with_zlib(int32_t hdl, uint32_t ifd_no, void* buf, ImageInfo info)
+int32_t save_with_zlib(int32_t hdl, uint32_t ifd_no, const void* buf, uint32_t stride, ImageInfo info)
 {
 	int32_t status = ErrorCode::STATUS_OK;
 	return status;
 }
 
-int32_t save_with_lzw_horidif(int32_t hdl, uint32_t ifd_no, void* buf, ImageInfo info)
+//Strips (block_width == image_width) are slices of the image buffer, the last one may have less rows.
+//Tiles always have the complete tile size, the parts out of the image are zero.
+static bool is_strip_layout(const ImageInfo& info)
 {
-	int32_t status = ErrorCode::STATUS_OK;
+	return info.block_width == info.image_width;
+}
 
-	uint32_t block_pixel_width = info.image_width * info.samples_per_pixel;		//RGB(3), GRAY(1)
-	uint32_t block_stride = info.image_byte_count * block_pixel_width;
+static int32_t get_block_count(const ImageInfo& info)
+{
+	int32_t rows = (int32_t)ceil((double)info.image_height / info.block_height);
+	int32_t columns = (int32_t)ceil((double)info.image_width / info.block_width);
+	return rows * columns;
+}
 
-	int32_t strip_count = (int32_t)ceil((double)info.image_height / info.block_height);
-	int32_t threads = (min)(omp_get_num_procs() / 2, strip_count);
-	threads = (max)(1, threads);
+//Rows of block "block_no" to encode, each row has info.block_width pixels.
+static uint32_t get_block_rows(const ImageInfo& info, int32_t block_no)
+{
+	if (!is_strip_layout(info))
+		return info.block_height;
+	if ((block_no + 1) * info.block_height > info.image_height)
+		return info.image_height - block_no * info.block_height;
+	return info.block_height;
+}
+
+//Copy block "block_no" of the image "buf", which has "stride" bytes per row, into "block_buf" which must hold a complete block.
+static uint8_t* copy_block_data(const void* buf, uint32_t stride, const ImageInfo& info, int32_t block_no, uint8_t* block_buf)
+{
+	uint32_t bytes_per_pixel = info.image_byte_count * info.samples_per_pixel;
+	int32_t columns = (int32_t)ceil((double)info.image_width / info.block_width);
+	uint32_t x = (block_no % columns) * info.block_width;
+	uint32_t y = (block_no / columns) * info.block_height;
+	uint32_t copy_width = (min)(info.block_width, info.image_width - x);
+	uint32_t copy_height = (min)(info.block_height, info.image_height - y);
+	uint32_t block_stride = info.block_width * bytes_per_pixel;
+
+	if (!is_strip_layout(info) && (copy_width != info.block_width || copy_height != info.block_height))
+		memset(block_buf, 0, (size_t)block_stride * info.block_height);
+	for (uint32_t h = 0; h < copy_height; h++)
+	{
+		const uint8_t* src_ptr = (const uint8_t*)buf + (size_t)(y + h) * stride + (size_t)x * bytes_per_pixel;
+		memcpy(block_buf + (size_t)h * block_stride, src_ptr, (size_t)copy_width * bytes_per_pixel);
+	}
+	return block_buf;
+}
 
-	size_t header_size = sizeof(uint64_t);	 //first 8 bytes indicate the actual size
+//Save the image without compression in blocks of the IFD layout. Rows are written straight from "buf", whatever its stride.
+//"buf" may also be a band of whole block rows, info.image_height is then the band height and "first_block" its first block.
+static int32_t save_raw_blocks(int32_t hdl, uint32_t ifd_no, const void* buf, uint32_t stride, ImageInfo info, int32_t first_block = 0)
+{
+	uint32_t bytes_per_pixel = info.image_byte_count * info.samples_per_pixel;
+	uint32_t block_stride = info.block_width * bytes_per_pixel;
+	int32_t block_count = get_block_count(info);
+	int32_t columns = (int32_t)ceil((double)info.image_width / info.block_width);
 
-	size_t src_strip_size = info.block_height * (size_t)block_stride;
-	size_t strip_alloc_size = (size_t)(src_strip_size * 1.5);
-	uint8_t* total_buffer = (uint8_t*)calloc(strip_count, (strip_alloc_size + header_size));
-	if (total_buffer == nullptr) {
-		return ErrorCode::ERR_BUFFER_IS_NULL;
+	for (int32_t i = 0; i < block_count; i++)
+	{
+		uint32_t x = (i % columns) * info.block_width;
+		uint32_t y = (i / columns) * info.block_height;
+		uint32_t copy_width = (min)(info.block_width, info.image_width - x);
+		uint32_t copy_height = (min)(info.block_height, info.image_height - y);
+		const uint8_t* src_ptr = (const uint8_t*)buf + (size_t)y * stride + (size_t)x * bytes_per_pixel;
+		int32_t status = micro_tiff_SaveBlockRows(hdl, ifd_no, first_block + i, block_stride, get_block_rows(info, i),
+			src_ptr, (uint64_t)copy_width * bytes_per_pixel, copy_height, stride);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
 	}
+	return ErrorCode::STATUS_OK;
+}
 
-	if (!omp_in_parallel())
-		omp_set_num_threads(threads);
+//Scratch buffers of one encoding thread, the caller's image is never modified.
+struct lzw_encode_buffers
+{
+	unique_ptr<uint8_t[]> block_buf;
+	unique_ptr<uint8_t[]> shuffle_buf;
+};
+
+//Copy block "block_no" of "buf" into the scratch block, predict, shuffle and LZW encode it into "dst_buf".
+static int32_t encode_lzw_block(const void* buf, uint32_t stride, const ImageInfo& info, int32_t block_no, lzw_encode_buffers& buffers,
+	uint8_t* dst_buf, size_t dst_capacity, uint64_t& dst_len)
+{
+	uint32_t block_stride = info.image_byte_count * info.block_width * info.samples_per_pixel;
+	uint32_t block_height = get_block_rows(info, block_no);
+	uint64_t src_len = (uint64_t)block_height * block_stride;
 
-#pragma omp parallel for
-	for (int i = 0; i < strip_count; i++)
+	if (buffers.block_buf == nullptr)
 	{
-		if (status == ErrorCode::STATUS_OK)
+		buffers.block_buf.reset(new(nothrow) uint8_t[(size_t)block_stride * info.block_height]);
+		if (buffers.block_buf == nullptr)
+			return ErrorCode::ERR_BUFFER_IS_NULL;
+	}
+	uint8_t* src_buf = copy_block_data(buf, stride, info, block_no, buffers.block_buf.get());
+
+	int hori_status = 0;
+	if (info.predictor == PREDICTOR_FLOATINGPOINT)
+		hori_status = floating_point_differencing(src_buf, block_height, info.block_width, info.image_byte_count, info.samples_per_pixel);
+	else if (info.predictor == PREDICTOR_HORIZONTAL)
+		hori_status = horizontal_differencing(src_buf, block_height, info.block_width, info.image_byte_count, info.samples_per_pixel, false);
+	if (hori_status != 0)
+		return ErrorCode::ERR_LZW_HORIZONTAL_DIFFERENCING;
+
+	if (info.shuffle != SHUFFLE_NONE)
+	{
+		if (buffers.shuffle_buf == nullptr)
 		{
-			uint32_t strip_height = info.block_height;
-			if ((i + 1) * info.block_height > info.image_height) {
-				strip_height = (info.image_height - i * info.block_height);
-			}
+			buffers.shuffle_buf.reset(new(nothrow) uint8_t[(size_t)block_stride * info.block_height]);
+			if (buffers.shuffle_buf == nullptr)
+				return ErrorCode::ERR_BUFFER_IS_NULL;
+		}
+		if (data_shuffle(src_buf, buffers.shuffle_buf.get(), (size_t)src_len, info.image_byte_count, info.shuffle) != 0)
+			return ErrorCode::ERR_SHUFFLE_FAILED;
+		src_buf = buffers.shuffle_buf.get();
+	}
+
+	uint64_t raw_data_used_size;
+	int encode_status = LZWEncode(src_buf, src_len, &raw_data_used_size, dst_buf, dst_capacity, &dst_len);
+	if (encode_status != 1 || raw_data_used_size != src_len)
+		return ErrorCode::ERR_COMPRESS_LZW_ERROR;
+	return ErrorCode::STATUS_OK;
+}
+
+//A slot of the window of compressed blocks waiting to be written.
+struct lzw_block_slot
+{
+	uint8_t* data;
+	uint64_t size;
+	bool ready;
+};
+
+//Blocks are compressed by the worker threads into a window of LZW_WINDOW_BLOCKS_PER_THREAD slots per thread. Whichever thread
+//finds the next block in file order ready writes it, so writing overlaps compression and memory doesn't grow with the image.
+//The codec of "info" is changed to none when the data is saved raw, which is only done for the first blocks of the IFD.
+int32_t save_with_lzw_horidif(int32_t hdl, uint32_t ifd_no, const void* buf, uint32_t stride, ImageInfo& info, int32_t first_block, uint32_t max_threads)
+{
+	int32_t status = ErrorCode::STATUS_OK;
+
+	uint32_t block_pixel_width = info.block_width * info.samples_per_pixel;		//RGB(3), GRAY(1)
+	uint32_t block_stride = info.image_byte_count * block_pixel_width;
+
+	int32_t block_count = get_block_count(info);
+	int32_t threads = (min)((int32_t)thread_pool_get_threads(max_threads), block_count);
+	int32_t window = (min)(threads * LZW_WINDOW_BLOCKS_PER_THREAD, block_count);
+
+	size_t src_block_size = info.block_height * (size_t)block_stride;
+	size_t block_alloc_size = LZW_ENCODE_BOUND(src_block_size);
+	unique_ptr<uint8_t[]> window_buffer(new(nothrow) uint8_t[block_alloc_size * window]);
+	if (window_buffer == nullptr) {
+		return ErrorCode::ERR_BUFFER_IS_NULL;
+	}
+	vector<lzw_block_slot> slots(window);
+	for (int32_t i = 0; i < window; i++)
+		slots[i] = { window_buffer.get() + block_alloc_size * i, 0, false };
+	vector<lzw_encode_buffers> encode_buffers(threads);
+
+	//the first window is compressed before anything is written, it decides the raw fallback
+	atomic<int32_t> window_status(ErrorCode::STATUS_OK);
+	thread_pool_parallel_for(window, threads, [&](int32_t i, uint32_t participant) {
+		int32_t block_status = encode_lzw_block(buf, stride, info, i, encode_buffers[participant], slots[i].data, block_alloc_size, slots[i].size);
+		if (block_status != ErrorCode::STATUS_OK)
+			window_status = block_status;
+		slots[i].ready = true;
+	});
+	status = window_status;
+	if (status != ErrorCode::STATUS_OK)
+		return status;
 
-			uint64_t src_len = (uint64_t)strip_height * block_stride;
-			uint8_t* src_buf = (uint8_t*)buf + i * src_strip_size;
+	//incompressible data : LZW only costs CPU and space, save the image raw in the same blocks
+	//(once blocks are written the codec of the IFD can't change anymore)
+	uint64_t total_size = 0, total_raw_size = 0;
+	for (int32_t i = 0; i < window; i++)
+	{
+		total_size += slots[i].size;
+		total_raw_size += (uint64_t)get_block_rows(info, i) * block_stride;
+	}
+	if (first_block == 0 && total_size >= total_raw_size)
+	{
+		status = micro_tiff_SetCompression(hdl, ifd_no, COMPRESSION_NONE, PREDICTOR_NONE, SHUFFLE_NONE);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+		info.compression = COMPRESSION_NONE;
+		info.predictor = PREDICTOR_NONE;
+		info.shuffle = SHUFFLE_NONE;
+		return save_raw_blocks(hdl, ifd_no, buf, stride, info);
+	}
 
-			int hori_status = horizontal_differencing(src_buf, strip_height, info.image_width, info.image_byte_count, info.samples_per_pixel, false);
-			if (hori_status != 0) {
-				status = ErrorCode::ERR_LZW_HORIZONTAL_DIFFERENCING;
+	mutex window_mutex;
+	condition_variable window_cv;
+	int32_t next_block = window;	//next block to compress
+	int32_t written = 0;			//blocks written, block i can use the slot of block i - window when it is written
+	bool writing = false;
+
+	//every thread of the pool runs the compress and write loop until no block is left
+	thread_pool_parallel_for(threads, threads, [&](int32_t, uint32_t participant) {
+		unique_lock<mutex> lock(window_mutex);
+		while (status == ErrorCode::STATUS_OK)
+		{
+			//write the ready blocks in order, one thread at a time. The file is written without the lock, other threads go on compressing.
+			if (!writing)
+			{
+				writing = true;
+				while (status == ErrorCode::STATUS_OK && written < block_count && slots[written % window].ready)
+				{
+					lzw_block_slot& slot = slots[written % window];
+					lock.unlock();
+					int32_t save_status = micro_tiff_SaveBlock(hdl, (uint16_t)ifd_no, first_block + written, slot.size, slot.data);
+					lock.lock();
+					if (save_status != ErrorCode::STATUS_OK)
+						status = save_status;
+					slot.ready = false;
+					written++;
+					window_cv.notify_all();
+				}
+				writing = false;
+			}
+			//the blocks still being compressed are written by their threads
+			if (next_block >= block_count)
+				break;
+			if (next_block >= written + window)
+			{
+				window_cv.wait(lock);
 				continue;
 			}
 
-			uint8_t* dst_buf = total_buffer + i * (strip_alloc_size + header_size);
-			uint64_t raw_data_used_size, dst_len;
-			int encode_status = LZWEncode(src_buf, src_len, &raw_data_used_size, dst_buf + header_size, strip_alloc_size, &dst_len);
-			if (encode_status != 1 || raw_data_used_size != src_len) {
-				status = ErrorCode::ERR_COMPRESS_LZW_ERROR;
-			}
-			else {
-				*((uint64_t*)(dst_buf)) = dst_len;
+			int32_t i = next_block++;
+			lzw_block_slot& slot = slots[i % window];
+			lock.unlock();
+			int32_t block_status = encode_lzw_block(buf, stride, info, i, encode_buffers[participant], slot.data, block_alloc_size, slot.size);
+			lock.lock();
+			if (block_status != ErrorCode::STATUS_OK)
+				status = block_status;
+			slot.ready = true;
+		}
+		window_cv.notify_all();
+	});
+
+	return status;
+}
+
+int32_t save_with_jpeg(int32_t hdl, uint32_t ifd_no, const void* buf, uint32_t stride, ImageInfo info, int32_t first_block, uint32_t max_threads)
+{
+	atomic<int32_t> status(ErrorCode::STATUS_OK);
+
+	uint32_t block_stride = info.image_byte_count * info.block_width * info.samples_per_pixel;
+	bool is_strip = is_strip_layout(info);
+
+	int32_t block_count = get_block_count(info);
+
+	int pixel_format = info.samples_per_pixel == 3 ? JPEG_PIXEL_FORMAT_RGB : JPEG_PIXEL_FORMAT_GRAY;
+	int subsample = info.samples_per_pixel == 3 ? JPEG_SUBSAMPLE_420 : JPEG_SUBSAMPLE_GRAY;
+
+	//buffers are allocated by turbojpeg, must be released by jpeg_free
+	vector<unsigned char*> encoded_bufs(block_count, nullptr);
+	vector<unsigned long> encoded_sizes(block_count, 0);
+
+	//strips are compressed straight from the caller's rows, tiles from a copy
+	uint32_t threads = (min)(thread_pool_get_threads(max_threads), (uint32_t)block_count);
+	vector<unique_ptr<uint8_t[]>> tile_bufs(threads);
+	thread_pool_parallel_for(block_count, threads, [&](int32_t i, uint32_t participant) {
+		if (status != ErrorCode::STATUS_OK)
+			return;
+		uint32_t block_height = get_block_rows(info, i);
+		const uint8_t* src_buf = (const uint8_t*)buf + (size_t)i * info.block_height * stride;
+		int pitch = (int)stride;
+		if (!is_strip)
+		{
+			unique_ptr<uint8_t[]>& tile_buf = tile_bufs[participant];
+			if (tile_buf == nullptr)
+				tile_buf.reset(new(nothrow) uint8_t[(size_t)block_stride * info.block_height]);
+			if (tile_buf == nullptr) {
+				status = ErrorCode::ERR_BUFFER_IS_NULL;
+				return;
 			}
+			src_buf = copy_block_data(buf, stride, info, i, tile_buf.get());
+			pitch = (int)block_stride;
 		}
-	}
+		int jpeg_status = jpeg_compress((unsigned char*)src_buf, &encoded_bufs[i], &encoded_sizes[i], info.block_width, block_height, pitch, pixel_format, subsample);
+		if (jpeg_status != 0) {
+			status = ErrorCode::ERR_COMPRESS_JPEG_ERROR;
+		}
+	});
 
 	if (status == ErrorCode::STATUS_OK)
 	{
-		for (int32_t i = 0; i < strip_count; i++)
+		for (int32_t i = 0; i < block_count; i++)
 		{
-			uint8_t* dst_buf = total_buffer + i * (strip_alloc_size + header_size);
-			uint64_t size = *((uint64_t*)dst_buf);
-
-			status = micro_tiff_SaveBlock(hdl, (uint16_t)ifd_no, i, size, dst_buf + header_size);
+			status = micro_tiff_SaveBlock(hdl, (uint16_t)ifd_no, first_block + i, encoded_sizes[i], encoded_bufs[i]);
 			if (status != ErrorCode::STATUS_OK) {
 				break;
 			}
 		}
 	}
 
-	free(total_buffer);
+	for (int32_t i = 0; i < block_count; i++)
+	{
+		if (encoded_bufs[i] != nullptr)
+			jpeg_free(encoded_bufs[i]);
+	}
 	return status;
 }
 
+//COMPRESSIONMODE_AUTO : encode some row bands on trial, then switch the IFD (created for LZW) to the chosen codec before any block is written.
+static int32_t choose_auto_codec(int32_t hdl, uint32_t ifd_no, const void* buf, uint32_t stride, ImageInfo& info)
+{
+	uint32_t image_stride = info.image_byte_count * info.image_width * info.samples_per_pixel;
+	//bands of an image with padded rows are probed from a copy
+	unique_ptr<uint8_t[]> band_buf;
+	if (stride != image_stride)
+	{
+		band_buf.reset(new(nothrow) uint8_t[(size_t)image_stride * AUTO_PROBE_BAND_HEIGHT]);
+		if (band_buf == nullptr)
+			return ErrorCode::ERR_BUFFER_IS_NULL;
+	}
+	int32_t band_count = (int32_t)ceil((double)info.image_height / AUTO_PROBE_BAND_HEIGHT);
+	int32_t probe_count = (min)(AUTO_PROBE_BAND_COUNT, band_count);
+
+	codec_probe_result result = { 0 };
+	for (int32_t n = 0; n < probe_count; n++)
+	{
+		int32_t i = n * band_count / probe_count;
+		uint32_t band_height = (min)((uint32_t)AUTO_PROBE_BAND_HEIGHT, info.image_height - i * AUTO_PROBE_BAND_HEIGHT);
+		const uint8_t* src_buf = (const uint8_t*)buf + (size_t)i * AUTO_PROBE_BAND_HEIGHT * stride;
+		if (band_buf != nullptr)
+		{
+			for (uint32_t h = 0; h < band_height; h++)
+				memcpy(band_buf.get() + (size_t)h * image_stride, src_buf + (size_t)h * stride, image_stride);
+			src_buf = band_buf.get();
+		}
+		int probe_status = codec_probe_block(src_buf, band_height, info.image_width, info.image_byte_count, info.samples_per_pixel,
+			info.predictor == PREDICTOR_FLOATINGPOINT, &result);
+		if (probe_status != 0)
+			return probe_status == -2 ? ErrorCode::ERR_BUFFER_IS_NULL : ErrorCode::ERR_LZW_HORIZONTAL_DIFFERENCING;
+	}
+
+	switch (codec_probe_choose(&result))
+	{
+	case CODEC_PROBE_LZW:
+		info.shuffle = SHUFFLE_NONE;
+		break;
+	case CODEC_PROBE_LZW_SHUFFLE:
+		info.shuffle = SHUFFLE_BYTE;
+		break;
+	default:
+		info.compression = COMPRESSION_NONE;
+		info.predictor = PREDICTOR_NONE;
+		info.shuffle = SHUFFLE_NONE;
+		break;
+	}
+	return micro_tiff_SetCompression(hdl, ifd_no, info.compression, info.predictor, info.shuffle);
+}
+
+//Encode and save "buf", which has "stride" bytes per row, with the codec of "info". See save_raw_blocks for bands.
+static int32_t save_blocks(int32_t hdl, uint32_t ifd_no, const void* buf, uint32_t stride, ImageInfo& info, int32_t first_block, uint32_t max_threads)
+{
+	switch (info.compression)
+	{
+	case COMPRESSION_NONE:
+		return save_raw_blocks(hdl, ifd_no, buf, stride, info, first_block);
+	case COMPRESSION_LZW:
+		return save_with_lzw_horidif(hdl, ifd_no, buf, stride, info, first_block, max_threads);
+	case COMPRESSION_JPEG:
+		return save_with_jpeg(hdl, ifd_no, buf, stride, info, first_block, max_threads);
+	case  COMPRESSION_DEFLATE:
+		return save_with_zlib(hdl, ifd_no, buf, stride, info);
+	default:
+		return ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
+	}
+}
+
 int32_t info_conversion(tiff::SingleImageInfo& image_info, ImageInfo& info)
 {
 	uint16_t tiffCompression;
 	uint16_t tiffPredictor = PREDICTOR_NONE;
+	uint16_t tiffShuffle = SHUFFLE_NONE;
 	uint32_t block_height = OMP_COMPRESS_TILE_HEIGHT;
 	switch (image_info.compress_mode)
 	{
 	case tiff::CompressionMode::COMPRESSIONMODE_NONE:
+		//bounded strips like LZW, so "begin_image" holds a band of a few strips instead of the whole image
 		tiffCompression = COMPRESSION_NONE;
-		block_height = image_info.height;
 		break;
 	case tiff::CompressionMode::COMPRESSIONMODE_LZW:
+	case tiff::CompressionMode::COMPRESSIONMODE_AUTO:		//created as LZW, changed by choose_auto_codec when the data comes
 		tiffCompression = COMPRESSION_LZW;
-		tiffPredictor = PREDICTOR_HORIZONTAL;
+		tiffPredictor = image_info.pixel_type == tiff::PixelType::PIXEL_FLOAT32 ? PREDICTOR_FLOATINGPOINT : PREDICTOR_HORIZONTAL;
 		break;
 	case  tiff::CompressionMode::COMPRESSIONMODE_JPEG:
 		tiffCompression = COMPRESSION_JPEG;
-		block_height = image_info.height;
+		block_height = OMP_COMPRESS_JPEG_STRIP_HEIGHT;
 		break;
 	case  tiff::CompressionMode::COMPRESSIONMODE_ZIP:
 		tiffCompression = COMPRESSION_DEFLATE;
+		if (image_info.pixel_type == tiff::PixelType::PIXEL_FLOAT32)
+			tiffPredictor = PREDICTOR_FLOATINGPOINT;
 		break;
 	default:
 		return ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
 	}
 
+	switch (image_info.shuffle_mode)
+	{
+	case tiff::ShuffleMode::SHUFFLEMODE_NONE:
+		break;
+	case tiff::ShuffleMode::SHUFFLEMODE_BYTE:
+		tiffShuffle = SHUFFLE_BYTE;
+		break;
+	case tiff::ShuffleMode::SHUFFLEMODE_BIT:
+		tiffShuffle = SHUFFLE_BIT;
+		break;
+	default:
+		return ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
+	}
+	//shuffle only make sense before entropy coding, and byte shuffle of 8 bits data changes nothing
+	if ((tiffCompression != COMPRESSION_LZW && tiffCompression != COMPRESSION_DEFLATE) || image_info.compress_mode == tiff::CompressionMode::COMPRESSIONMODE_AUTO)
+		tiffShuffle = SHUFFLE_NONE;
+	if (tiffShuffle == SHUFFLE_BYTE && image_info.valid_bits <= 8)
+		tiffShuffle = SHUFFLE_NONE;
+
+	uint32_t block_width = image_info.width;
+	if (image_info.tile_width == 0 && image_info.tile_height == 0)
+	{
+		if ((uint64_t)image_info.width * image_info.height > AUTO_TILE_MIN_PIXELS)
+		{
+			block_width = AUTO_TILE_SIZE;
+			block_height = AUTO_TILE_SIZE;
+		}
+	}
+	else if (image_info.tile_width == 0 || image_info.tile_width >= image_info.width)
+	{
+		if (image_info.tile_height == 0)
+			return ErrorCode::ERR_TILE_SIZE_NOT_SUPPORT;
+		block_height = image_info.tile_height;
+	}
+	else
+	{
+		//TIFF tiles must be multiples of 16, which is also the MCU size of jpeg
+		if (image_info.tile_width % 16 != 0 || image_info.tile_height == 0 || image_info.tile_height % 16 != 0)
+			return ErrorCode::ERR_TILE_SIZE_NOT_SUPPORT;
+		block_width = image_info.tile_width;
+		block_height = image_info.tile_height;
+	}
+	//strips are never higher than the image
+	if (block_width == image_info.width)
+		block_height = (min)(block_height, image_info.height);
+
 	info.bits_per_sample = image_info.valid_bits;
-	info.block_width = image_info.width;
+	info.block_width = block_width;
 	info.block_height = block_height;
 	info.image_width = image_info.width;
 	info.image_height = image_info.height;
 	info.compression = tiffCompression;
 	info.predictor = tiffPredictor;
+	info.shuffle = tiffShuffle;
+	info.sample_format = image_info.pixel_type == tiff::PixelType::PIXEL_FLOAT32 ? SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT;
 	info.planarconfig = PLANARCONFIG_CONTIG;
 	info.photometric = PHOTOMETRIC_MINISBLACK;
 	info.image_byte_count = (image_info.valid_bits + 7) / 8;
@@ -211,6 +576,7 @@ int32_t tiff_single::close_tiff()
 		}
 	}
 	_infos.clear();
+	_writers.clear();
 	micro_tiff_Close(_hdl);
 	return ErrorCode::STATUS_OK;
 }
@@ -222,11 +588,18 @@ int32_t tiff_single::create_image(tiff::SingleImageInfo image_info)
 
 	if (image_info.compress_mode == tiff::CompressionMode::COMPRESSIONMODE_JPEG && image_info.pixel_type != tiff::PixelType::PIXEL_UINT8)
 		return ErrorCode::ERR_DATA_TYPE_NOTSUPPORT;
-	if (image_info.pixel_type != tiff::PixelType::PIXEL_UINT8 && image_info.pixel_type != tiff::PixelType::PIXEL_UINT16)
+	//jpeg only support gray and RGB
+	if (image_info.compress_mode == tiff::CompressionMode::COMPRESSIONMODE_JPEG && image_info.samples_per_pixel != 1 && image_info.samples_per_pixel != 3)
+		return ErrorCode::ERR_DATA_TYPE_NOTSUPPORT;
+	if (image_info.pixel_type != tiff::PixelType::PIXEL_UINT8 && image_info.pixel_type != tiff::PixelType::PIXEL_UINT16 && image_info.pixel_type != tiff::PixelType::PIXEL_FLOAT32)
+		return ErrorCode::ERR_DATA_TYPE_NOTSUPPORT;
+	if (image_info.pixel_type == tiff::PixelType::PIXEL_FLOAT32 && image_info.valid_bits != 32)
 		return ErrorCode::ERR_DATA_TYPE_NOTSUPPORT;
 
 	ImageInfo info;
-	info_conversion(image_info, info);
+	int32_t status = info_conversion(image_info, info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
 
 	int32_t ifd_no = micro_tiff_CreateIFD(_hdl, info);
 	if (ifd_no < 0)
@@ -239,7 +612,7 @@ int32_t tiff_single::create_image(tiff::SingleImageInfo image_info)
 	return ifd_no;
 }
 
-int32_t tiff_single::save_image_data(uint32_t image_number, void* image_data, uint32_t stride)
+int32_t tiff_single::save_image_data(uint32_t image_number, const void* image_data, uint32_t stride)
 {
 	if (_openMode == tiff::OpenMode::READ_ONLY_MODE)
 		return ErrorCode::ERR_OPENMODE;
@@ -247,10 +620,20 @@ int32_t tiff_single::save_image_data(uint32_t image_number, void* image_data, ui
 	auto iter = _infos.find(image_number);
 	if (iter == _infos.end())
 		return ErrorCode::ERR_SAVEDATA_WITHOUT_INFO;
+	if (_writers.find(image_number) != _writers.end())
+		return ErrorCode::TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED;
+
+	return save_frame(image_number, iter->second, image_data, stride);
+}
 
-	tiff::SingleImageInfo image_info = _infos[image_number];
+//Encode and save a whole frame. Only reads the members, frames of save_image_stack are saved concurrently.
+int32_t tiff_single::save_frame(uint32_t image_number, const tiff::SingleImageInfo& image_info, const void* image_data, uint32_t stride) const
+{
+	tiff::SingleImageInfo frame_info = image_info;
 	ImageInfo info;
-	info_conversion(image_info, info);
+	int32_t status = info_conversion(frame_info, info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
 
 	//size_t size = strlen(make);
 	//micro_tiff_tiffSetTag(_hdl, _ifd_no, TIFFTAG_MAKE, TagDataType::TIFF_ASCII, (uint32_t)size, (void*)make);
@@ -271,41 +654,189 @@ int32_t tiff_single::save_image_data(uint32_t image_number, void* image_data, ui
 		return ErrorCode::ERR_BUFFER_SIZE_ERROR;
 	}
 
-	void* buf = image_data;
-	if (block_stride != stride)
+	//the encoders read the caller's rows with their stride and never modify them
+	status = ErrorCode::STATUS_OK;
+	if (image_info.compress_mode == tiff::CompressionMode::COMPRESSIONMODE_AUTO)
+	{
+		status = choose_auto_codec(_hdl, image_number, image_data, stride, info);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+	}
+
+	return save_blocks(_hdl, image_number, image_data, stride, info, 0, _max_threads);
+}
+
+int32_t tiff_single::save_image_stack(const tiff::SingleImageInfo* infos, const void* const* frames, const uint32_t* strides, uint32_t count)
+{
+	if (_openMode == tiff::OpenMode::READ_ONLY_MODE)
+		return ErrorCode::ERR_OPENMODE;
+	if (count == 0)
+		return ErrorCode::TIFF_ERR_BAD_PARAMETER_VALUE;
+	for (uint32_t i = 0; i < count; i++)
 	{
-		buf = malloc(static_cast<size_t>(block_size));
-	if (buf == nullptr)
+		if (frames[i] == nullptr)
+			return ErrorCode::ERR_BUFFER_IS_NULL;
+	}
+
+	//all frames are created first, their blocks may then be written in any order
+	int32_t first_image = -1;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		int32_t image_number = create_image(infos[i]);
+		if (image_number < 0)
+			return image_number;
+		if (i == 0)
+			first_image = image_number;
+	}
+
+	//frames are taken in order, so frame N + 1 is compressed while the blocks of frame N are written.
+	//Each frame is encoded in parallel as by save_image_data, with the pool threads the other frame leaves idle.
+	uint32_t frame_threads = (min)(thread_pool_get_threads(_max_threads), (uint32_t)STACK_FRAMES_IN_FLIGHT);
+	atomic<int32_t> status(ErrorCode::STATUS_OK);
+	thread_pool_parallel_for((int32_t)count, frame_threads, [&](int32_t i, uint32_t) {
+		if (status != ErrorCode::STATUS_OK)
+			return;
+		uint32_t image_number = (uint32_t)(first_image + i);
+		int32_t frame_status = save_frame(image_number, infos[i], frames[i], strides == nullptr ? 0 : strides[i]);
+		if (frame_status != ErrorCode::STATUS_OK)
+			status = frame_status;
+	});
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	return first_image;
+}
+
+int32_t tiff_single::begin_image(uint32_t image_number)
+{
+	if (_openMode == tiff::OpenMode::READ_ONLY_MODE)
+		return ErrorCode::ERR_OPENMODE;
+
+	auto iter = _infos.find(image_number);
+	if (iter == _infos.end())
+		return ErrorCode::ERR_SAVEDATA_WITHOUT_INFO;
+	if (_writers.find(image_number) != _writers.end())
+		return ErrorCode::TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED;
+
+	ImageInfo info;
+	int32_t status = info_conversion(iter->second, info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	//a band holds whole block rows, strips are gathered by the encoding threads count so they are still encoded in parallel
+	uint32_t band_blocks = 1;
+	if (is_strip_layout(info))
+		band_blocks = thread_pool_get_threads(_max_threads);
+	uint32_t band_height = (uint32_t)(min)((uint64_t)info.block_height * band_blocks, (uint64_t)info.image_height);
+	size_t image_stride = (size_t)info.image_width * info.samples_per_pixel * info.image_byte_count;
+
+	row_band_writer writer;
+	writer.band.reset(new(nothrow) uint8_t[image_stride * band_height]);
+	if (writer.band == nullptr)
 		return ErrorCode::ERR_BUFFER_IS_NULL;
+	writer.band_height = band_height;
+	writer.band_rows = 0;
+	writer.band_y = 0;
+	writer.compression = info.compression;
+	writer.predictor = info.predictor;
+	writer.shuffle = info.shuffle;
+	_writers[image_number] = std::move(writer);
+	return ErrorCode::STATUS_OK;
+}
 
-		for (uint32_t i = 0; i < info.image_height; i++)
-		{
-			memcpy_s((uint8_t*)buf + (i * block_stride), block_stride, (uint8_t*)image_data + (i * stride), stride);
-		}
+//Encode and save the complete band of "writer", the first band chooses the codec of COMPRESSIONMODE_AUTO.
+int32_t tiff_single::save_band(uint32_t image_number, row_band_writer& writer)
+{
+	tiff::SingleImageInfo& image_info = _infos[image_number];
+	ImageInfo info;
+	int32_t status = info_conversion(image_info, info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	int32_t columns = (int32_t)ceil((double)info.image_width / info.block_width);
+	int32_t first_block = (int32_t)(writer.band_y / info.block_height) * columns;
+	uint32_t row_stride = info.image_width * info.samples_per_pixel * info.image_byte_count;
+	info.image_height = writer.band_rows;
+	info.compression = writer.compression;
+	info.predictor = writer.predictor;
+	info.shuffle = writer.shuffle;
+	if (writer.band_y == 0 && image_info.compress_mode == tiff::CompressionMode::COMPRESSIONMODE_AUTO)
+	{
+		status = choose_auto_codec(_hdl, image_number, writer.band.get(), row_stride, info);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
 	}
 
-	int32_t status = ErrorCode::STATUS_OK;
-	switch (info.compression)
+	status = save_blocks(_hdl, image_number, writer.band.get(), row_stride, info, first_block, _max_threads);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	//auto mode or raw fallback of the first band decide the codec of the whole image
+	writer.compression = info.compression;
+	writer.predictor = info.predictor;
+	writer.shuffle = info.shuffle;
+	writer.band_y += writer.band_rows;
+	writer.band_rows = 0;
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t tiff_single::append_rows(uint32_t image_number, const void* rows_data, uint32_t row_count, uint32_t stride)
+{
+	auto iter = _writers.find(image_number);
+	if (iter == _writers.end())
+		return ErrorCode::ERR_SAVEDATA_WITHOUT_INFO;
+	row_band_writer& writer = iter->second;
+
+	tiff::SingleImageInfo& image_info = _infos[image_number];
+	uint32_t row_stride = image_info.width * image_info.samples_per_pixel * ((image_info.valid_bits + 7) / 8);
+	if (stride == 0)
+		stride = row_stride;
+	if (stride < row_stride)
+		return ErrorCode::ERR_STRIDE_NOT_CORRECT;
+	if (row_count == 0 || row_count > image_info.height - writer.band_y - writer.band_rows)
+		return ErrorCode::ERR_ROW_COUNT_NOT_CORRECT;
+
+	const uint8_t* src_ptr = (const uint8_t*)rows_data;
+	while (row_count > 0)
 	{
-	case COMPRESSION_NONE:
-		status = micro_tiff_SaveBlock(_hdl, image_number, 0, block_size, buf);
-		break;
-	case COMPRESSION_LZW:
-		status = save_with_lzw_horidif(_hdl, image_number, buf, info);
-		break;
-	case COMPRESSION_JPEG:
-		break;
-	case  COMPRESSION_DEFLATE:
-		status = save_with_zlib(_hdl, image_number, buf, info);
-		break;
-	default:
-		status = ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
-		break;
+		uint32_t band_height = (min)(writer.band_height, image_info.height - writer.band_y);
+		uint32_t copy_rows = (min)(row_count, band_height - writer.band_rows);
+		uint8_t* dst_ptr = writer.band.get() + (size_t)writer.band_rows * row_stride;
+		if (stride == row_stride)
+		{
+			memcpy(dst_ptr, src_ptr, (size_t)copy_rows * row_stride);
+		}
+		else
+		{
+			for (uint32_t h = 0; h < copy_rows; h++)
+				memcpy(dst_ptr + (size_t)h * row_stride, src_ptr + (size_t)h * stride, row_stride);
+		}
+		src_ptr += (size_t)copy_rows * stride;
+		row_count -= copy_rows;
+		writer.band_rows += copy_rows;
+
+		if (writer.band_rows == band_height)
+		{
+			int32_t status = save_band(image_number, writer);
+			if (status != ErrorCode::STATUS_OK)
+			{
+				_writers.erase(iter);
+				return status;
+			}
+		}
 	}
+	return ErrorCode::STATUS_OK;
+}
 
-	if (buf != image_data)
-		free(buf);
-	return status;
+int32_t tiff_single::end_image(uint32_t image_number)
+{
+	auto iter = _writers.find(image_number);
+	if (iter == _writers.end())
+		return ErrorCode::ERR_SAVEDATA_WITHOUT_INFO;
+
+	//complete bands are saved as soon as their last row comes, nothing may be left
+	bool complete = iter->second.band_y == _infos[image_number].height;
+	_writers.erase(iter);
+	return complete ? ErrorCode::STATUS_OK : ErrorCode::ERR_ROW_COUNT_NOT_CORRECT;
 }
 
 int32_t tiff_single::get_image_info(uint32_t image_number, tiff::SingleImageInfo* info)
@@ -327,11 +858,13 @@ int32_t tiff_single::get_image_info(uint32_t image_number, tiff::SingleImageInfo
 		return status;
 	}
 
-	//only support uint8_t and uint16_t
+	//only support uint8_t, uint16_t and float
 	if (image_info.image_byte_count == 1)
 		info->pixel_type = tiff::PixelType::PIXEL_UINT8;
 	else if (image_info.image_byte_count == 2)
 		info->pixel_type = tiff::PixelType::PIXEL_UINT16;
+	else if (image_info.image_byte_count == 4 && image_info.sample_format == SAMPLEFORMAT_IEEEFP)
+		info->pixel_type = tiff::PixelType::PIXEL_FLOAT32;
 	else
 		return ErrorCode::ERR_DATA_TYPE_NOTSUPPORT;
 
@@ -339,6 +872,8 @@ int32_t tiff_single::get_image_info(uint32_t image_number, tiff::SingleImageInfo
 	info->width = image_info.image_width;
 	info->height = image_info.image_height;
 	info->samples_per_pixel = image_info.samples_per_pixel;
+	info->tile_width = image_info.block_width == image_info.image_width ? 0 : image_info.block_width;
+	info->tile_height = image_info.block_height;
 	if (image_info.samples_per_pixel == 1)
 	{
 		info->image_type = tiff::ImageType::IMAGE_GRAY;
@@ -371,147 +906,394 @@ int32_t tiff_single::get_image_info(uint32_t image_number, tiff::SingleImageInfo
 		return ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
 	}
 
+	switch (image_info.shuffle)
+	{
+	case SHUFFLE_BYTE:
+		info->shuffle_mode = tiff::ShuffleMode::SHUFFLEMODE_BYTE;
+		break;
+	case SHUFFLE_BIT:
+		info->shuffle_mode = tiff::ShuffleMode::SHUFFLEMODE_BIT;
+		break;
+	default:
+		info->shuffle_mode = tiff::ShuffleMode::SHUFFLEMODE_NONE;
+		break;
+	}
+
 	return ErrorCode::STATUS_OK;
 }
 
-int32_t tiff_single::load_image_data(uint32_t image_number, void* image_data, uint32_t stride)
+struct decode_row_context
 {
-	if (_openMode == tiff::OpenMode::CREATE_MODE) {
-		return ErrorCode::ERR_OPENMODE;
-	}
+	uint32_t width;
+	uint16_t image_byte_count;
+	uint16_t samples_per_pixel;
+	uint16_t predictor;
+	void* temp_row;
+};
+
+//Undo the predictor on a row as soon as LZW has written it into the destination, while it is still in cache.
+static int undo_predictor_of_row(void* row, uint64_t row_index, void* user_data)
+{
+	decode_row_context* context = (decode_row_context*)user_data;
+	int status = 0;
+	if (context->predictor == PREDICTOR_HORIZONTAL)
+		status = horizontal_acc(row, 1, context->width, context->image_byte_count, context->samples_per_pixel, false);
+	else if (context->predictor == PREDICTOR_FLOATINGPOINT)
+		status = floating_point_acc_row(row, context->width, context->image_byte_count, context->samples_per_pixel, context->temp_row);
+	return status == 0 ? 0 : -1;
+}
+
+//Rows of a block which only partly lies in the loaded region: every row is decoded into one scratch row,
+//only the rows and columns inside the region are accumulated and copied to the destination.
+struct copy_row_context
+{
+	decode_row_context decode;
+	uint8_t* dst;
+	uint32_t dst_stride;
+	uint32_t first_row;
+	uint32_t copy_offset;
+	uint32_t copy_bytes;
+};
+
+static int copy_row_to_region(void* row, uint64_t row_index, void* user_data)
+{
+	copy_row_context* context = (copy_row_context*)user_data;
+	//the predictors work row by row, rows above the region need not be undone
+	if (row_index < context->first_row)
+		return 0;
+	if (undo_predictor_of_row(row, row_index, &context->decode) != 0)
+		return -1;
+	uint8_t* dst_ptr = context->dst + (size_t)(row_index - context->first_row) * context->dst_stride;
+	memcpy(dst_ptr, (uint8_t*)row + context->copy_offset, context->copy_bytes);
+	return 0;
+}
+
+//Part of an image in pixels.
+struct image_region
+{
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+//Buffers of one decoding thread, allocated when a block needs them.
+struct block_decode_buffers
+{
+	void* encode_buf;
+	size_t encode_capacity;
+	void* shuffle_buf;
+	void* block_buf;
+	void* temp_row;
+};
+
+static void free_block_decode_buffers(block_decode_buffers& buffers)
+{
+	free(buffers.encode_buf);
+	free(buffers.shuffle_buf);
+	free(buffers.block_buf);
+	free(buffers.temp_row);
+	buffers = { 0 };
+}
 
+//Load and decode the part of one block which lies in "region" into its place of "image_data", which holds the region only.
+//Blocks are decoded straight into "image_data" when possible. The block buffer is only needed for
+//shuffled data (the whole block must be decoded before unshuffle) and blocks which are not contiguous in "image_data".
+static int32_t load_one_block(int32_t hdl, uint32_t image_number, const ImageInfo& image_info, uint32_t row, uint32_t column,
+	const image_region& region, void* image_data, uint32_t stride, block_decode_buffers& buffers)
+{
 	int32_t status = ErrorCode::STATUS_OK;
 	bool is_big_endian = false;
-	ImageInfo image_info;
-	auto iter = _infos.find(image_number);
-	if (iter == _infos.end())
-	{
-		status = micro_tiff_GetImageInfo(_hdl, image_number, image_info);
+
+	uint32_t pixel_bytes = image_info.samples_per_pixel * image_info.image_byte_count;
+	uint32_t complete_block_stride = image_info.block_width * pixel_bytes;
+	uint32_t complete_block_size = complete_block_stride * image_info.block_height;
+	uint32_t columns = (uint32_t)ceil((double)image_info.image_width / image_info.block_width);
+
+	uint32_t block_width = image_info.block_width * (column + 1) > image_info.image_width ? image_info.image_width - image_info.block_width * column : image_info.block_width;
+	uint32_t block_stride = block_width * pixel_bytes;
+	uint32_t block_height = image_info.block_height * (row + 1) > image_info.image_height ? image_info.image_height - image_info.block_height * row : image_info.block_height;
+	uint32_t block_size = block_height * block_stride;
+
+	//intersection of the block with the region, in pixels of the image
+	uint32_t block_x = column * image_info.block_width;
+	uint32_t block_y = row * image_info.block_height;
+	uint32_t left = (max)(block_x, region.x);
+	uint32_t right = (min)(block_x + block_width, region.x + region.width);
+	uint32_t top = (max)(block_y, region.y);
+	uint32_t bottom = (min)(block_y + block_height, region.y + region.height);
+	if (left >= right || top >= bottom)
+		return ErrorCode::STATUS_OK;
+	uint32_t first_row = top - block_y;
+	uint32_t copy_rows = bottom - top;
+	uint32_t copy_offset = (left - block_x) * pixel_bytes;
+	uint32_t copy_bytes = (right - left) * pixel_bytes;
+	bool whole_block = copy_rows == block_height && copy_bytes == block_stride;
+
+	uint8_t* dst_block = (uint8_t*)image_data + (size_t)(top - region.y) * stride + (size_t)(left - region.x) * pixel_bytes;
+	//set when the block is decoded into block_buf and still has to be copied into image_data
+	void* block_buf = nullptr;
+	//tiles are stored with the complete tile width, even at the right border of the image
+	uint32_t block_buf_stride = block_stride;
+	auto get_block_buffer = [&]() -> void* {
+		if (buffers.block_buf == nullptr)
+			buffers.block_buf = malloc(complete_block_size);
+		return buffers.block_buf;
+	};
+
+	uint64_t size;
+	uint32_t block_no = column + row * columns;
+
+	if (image_info.compression == COMPRESSION_NONE) {
+		status = micro_tiff_LoadBlock(hdl, image_number, block_no, size, nullptr);
 		if (status != ErrorCode::STATUS_OK) {
 			return status;
 		}
+		if (size < block_size || size > complete_block_size) {
+			return ErrorCode::ERR_BUFFER_SIZE_ERROR;
+		}
+		if (size >= (uint64_t)complete_block_stride * block_height)
+			block_buf_stride = complete_block_stride;
+		//read the part in the region straight into its rows of image_data
+		return micro_tiff_LoadBlockRows(hdl, image_number, block_no, block_buf_stride, first_row, copy_rows, copy_offset, copy_bytes, dst_block, stride);
 	}
-	else {
-		info_conversion(iter->second, image_info);
-	}
-
-	tiff::PixelType pixel_type = image_info.image_byte_count == 1 ? tiff::PixelType::PIXEL_UINT8 : tiff::PixelType::PIXEL_UINT16;
-
-	uint32_t buffer_pixel_width = image_info.image_width * image_info.samples_per_pixel;
-	uint32_t buffer_stride = buffer_pixel_width * image_info.image_byte_count;
-
-	uint32_t complete_block_pixel_width = image_info.block_width * image_info.samples_per_pixel;
-	uint32_t complete_block_stride = complete_block_pixel_width * image_info.image_byte_count;
-
-	uint32_t complete_block_size = complete_block_stride * image_info.block_height;
-
-	if (stride == 0)
-		stride = buffer_stride;
-
-	if (stride < buffer_stride)
-		return ErrorCode::ERR_STRIDE_NOT_CORRECT;
-
-	uint32_t dst_buffer_width = stride / image_info.image_byte_count;
-
-	uint32_t rows = (uint32_t)ceil((double)image_info.image_height / image_info.block_height);
-	uint32_t columns = (uint32_t)ceil(image_info.image_width / image_info.block_width);
-
-	unique_ptr<void, function<void(void*)>> auto_block_buffer(malloc(complete_block_size), free);
-	unique_ptr<void, function<void(void*)>> auto_encode_buffer(malloc((size_t)(complete_block_size * 1.5)), free);
-
-	void* block_buf = auto_block_buffer.get();
-	void* encode_buf = auto_encode_buffer.get();
-	if (block_buf == nullptr || encode_buf == nullptr)
-		return ErrorCode::ERR_BUFFER_IS_NULL;
-
-	for (uint32_t column = 0; column < columns; column++)
+	else
 	{
-		uint32_t block_width = image_info.block_width * (column + 1) > image_info.image_width ? image_info.image_width - image_info.block_width * column : image_info.block_width;
-		uint32_t block_stride = block_width * image_info.image_byte_count * image_info.samples_per_pixel;
-		for (uint32_t row = 0; row < rows; row++)
+		uint64_t encode_size;
+		status = micro_tiff_LoadBlock(hdl, image_number, block_no, encode_size, nullptr);
+		if (status != ErrorCode::STATUS_OK) {
+			return status;
+		}
+		//encoded data is not always smaller than raw data, e.g. jpeg headers of a small strip
+		if (buffers.encode_buf == nullptr || encode_size > buffers.encode_capacity)
 		{
-			uint32_t block_height = image_info.block_height * (row + 1) > image_info.image_height ? image_info.image_height - image_info.block_height * row : image_info.block_height;
-			uint32_t block_size = block_height * block_stride;
+			size_t capacity = (max)((size_t)encode_size, (size_t)(complete_block_size * 1.5));
+			free(buffers.encode_buf);
+			buffers.encode_buf = malloc(capacity);
+			if (buffers.encode_buf == nullptr)
+				return ErrorCode::ERR_BUFFER_IS_NULL;
+			buffers.encode_capacity = capacity;
+		}
+		void* encode_buf = buffers.encode_buf;
+		status = micro_tiff_LoadBlock(hdl, image_number, block_no, encode_size, encode_buf);
+		if (status != ErrorCode::STATUS_OK) {
+			return status;
+		}
 
-			uint64_t size;
-			uint32_t block_no = column + row * columns;
+		if (image_info.predictor == PREDICTOR_FLOATINGPOINT && buffers.temp_row == nullptr)
+		{
+			buffers.temp_row = malloc(complete_block_stride);
+			if (buffers.temp_row == nullptr)
+				return ErrorCode::ERR_BUFFER_IS_NULL;
+		}
 
-			if (image_info.compression == COMPRESSION_NONE) {
-				status = micro_tiff_LoadBlock(_hdl, image_number, block_no, size, block_buf);
+		switch (image_info.compression)
+		{
+		case COMPRESSION_JPEG:
+		{
+			int width, height, samples;
+			if (jpeg_decompress_header((unsigned char*)encode_buf, (unsigned long)encode_size, &width, &height, &samples) != 0
+				|| ((uint32_t)width != block_width && (uint32_t)width != image_info.block_width)
+				|| ((uint32_t)height != block_height && (uint32_t)height != image_info.block_height)
+				|| samples != image_info.samples_per_pixel)
+			{
+				status = ErrorCode::ERR_DECOMPRESS_JPEG_FAILED;
+				break;
 			}
-			else
+			//a border tile is larger than its part of the image and a block on the edge of the region is only partly copied, decode them aside
+			if (whole_block && (uint32_t)width == block_width && (uint32_t)height == block_height)
 			{
-				uint64_t encode_size;
-				status = micro_tiff_LoadBlock(_hdl, image_number, block_no, encode_size, encode_buf);
-				if (status != ErrorCode::STATUS_OK) {
-					return status;
+				if (jpeg_decompress(dst_block, (unsigned char*)encode_buf, (unsigned long)encode_size, &width, &height, &samples, (int)stride) != 0)
+					status = ErrorCode::ERR_DECOMPRESS_JPEG_FAILED;
+				break;
+			}
+			block_buf = get_block_buffer();
+			if (block_buf == nullptr)
+				return ErrorCode::ERR_BUFFER_IS_NULL;
+			block_buf_stride = complete_block_stride;
+			if (jpeg_decompress((unsigned char*)block_buf, (unsigned char*)encode_buf, (unsigned long)encode_size, &width, &height, &samples, (int)complete_block_stride) != 0)
+				status = ErrorCode::ERR_DECOMPRESS_JPEG_FAILED;
+		}
+			break;
+		case COMPRESSION_LZW:
+		{
+			if (image_info.shuffle == SHUFFLE_NONE)
+			{
+				decode_row_context context = { image_info.block_width, image_info.image_byte_count, image_info.samples_per_pixel, image_info.predictor, buffers.temp_row };
+				int64_t decode_size;
+				uint64_t decode_rows;
+				if (whole_block && block_width == image_info.block_width)
+				{
+					decode_rows = block_height;
+					decode_size = LZWDecodeRows(encode_buf, encode_size, dst_block, complete_block_stride, decode_rows, stride, undo_predictor_of_row, &context);
 				}
-
-				switch (image_info.compression)
+				else
 				{
-				case COMPRESSION_JPEG:
-					//int width, height, samples;
-					//status = jpeg_decompress((unsigned char*)block_buf, (unsigned char*)encode_buf, (unsigned long)encode_size, &width, &height, &samples);
-					//size = (uint64_t)width * height * samples;
-					break;
-				case COMPRESSION_LZW:
-					try
+					//rows of a border tile are wider than its part of the image, and a block on the edge of the region is only partly copied:
+					//decode row by row into one scratch row and stop after the last row of the region
+					void* scratch_row = get_block_buffer();
+					if (scratch_row == nullptr)
+						return ErrorCode::ERR_BUFFER_IS_NULL;
+					copy_row_context copy_context = { context, dst_block, stride, first_row, copy_offset, copy_bytes };
+					decode_rows = (uint64_t)first_row + copy_rows;
+					decode_size = LZWDecodeRows(encode_buf, encode_size, scratch_row, complete_block_stride, decode_rows, 0, copy_row_to_region, &copy_context);
+				}
+				if (decode_size < 0)
+					status = ErrorCode::ERR_DECOMPRESS_LZW_FAILED;
+				else if ((uint64_t)decode_size != decode_rows * complete_block_stride)
+					status = ErrorCode::ERR_BUFFER_SIZE_ERROR;
+				break;
+			}
+			if (buffers.shuffle_buf == nullptr)
+				buffers.shuffle_buf = malloc(complete_block_size);
+			void* shuffle_buf = buffers.shuffle_buf;
+			block_buf = get_block_buffer();
+			if (block_buf == nullptr || shuffle_buf == nullptr)
+				return ErrorCode::ERR_BUFFER_IS_NULL;
+			try
+			{
+				//the shuffle covers the whole stored block, which may be a complete tile at the bottom of the image
+				block_buf_stride = complete_block_stride;
+				size = LZWDecode(encode_buf, encode_size, shuffle_buf, complete_block_size);
+				if (size == (uint64_t)block_height * complete_block_stride || size == complete_block_size)
+					status = ErrorCode::STATUS_OK;
+				else
+					status = ErrorCode::ERR_BUFFER_SIZE_ERROR;
+				uint32_t decoded_rows = (uint32_t)(size / complete_block_stride);
+				if (status == ErrorCode::STATUS_OK)
+				{
+					if (data_unshuffle(shuffle_buf, block_buf, (size_t)size, image_info.image_byte_count, image_info.shuffle) != 0)
 					{
-						size = LZWDecode(encode_buf, encode_size, block_buf, block_size);
-						if (size == block_size)
-							status = ErrorCode::STATUS_OK;
-						else
-							status = ErrorCode::ERR_BUFFER_SIZE_ERROR;
-						if (status == ErrorCode::STATUS_OK && image_info.predictor == PREDICTOR_HORIZONTAL)
-						{
-							int hori_status = horizontal_acc(block_buf, block_height, block_width, image_info.image_byte_count, image_info.samples_per_pixel, is_big_endian);
-							if (hori_status != 0)
-							{
-								status = ErrorCode::ERR_DECOMPRESS_LZW_FAILED;
-								break;
-							}
-						}
+						status = ErrorCode::ERR_SHUFFLE_FAILED;
+						break;
 					}
-					catch (exception e)
+				}
+				if (status == ErrorCode::STATUS_OK && image_info.predictor == PREDICTOR_HORIZONTAL)
+				{
+					int hori_status = horizontal_acc(block_buf, decoded_rows, image_info.block_width, image_info.image_byte_count, image_info.samples_per_pixel, is_big_endian);
+					if (hori_status != 0)
 					{
 						status = ErrorCode::ERR_DECOMPRESS_LZW_FAILED;
 						break;
 					}
-					break;
-				case COMPRESSION_ADOBE_DEFLATE:
-				case COMPRESSION_DEFLATE:
-				{
-					//size = block_size;
-					//int zlib_status = uncompress((unsigned char*)block_buf, (unsigned long*)&size, (unsigned char*)encode_buf, (unsigned long)encode_size);
-					//if (zlib_status != 0)
-					//{
-					//	status = ErrorCode::ERR_DECOMPRESS_ZLIB_FAILED;
-					//	break;
-					//}
-				}
-					break;
-				default:
-					status = ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
-					break;
 				}
-			}
-			if (status == ErrorCode::STATUS_OK)
-			{
-				for (uint32_t h = 0; h < block_height; h++)
+				if (status == ErrorCode::STATUS_OK && image_info.predictor == PREDICTOR_FLOATINGPOINT)
 				{
-					uint8_t* src_ptr = (uint8_t*)block_buf + h * block_width * image_info.samples_per_pixel;
-					uint8_t* dst_ptr = (uint8_t*)image_data + (row * image_info.block_height + h) * stride + column * complete_block_pixel_width;
-					memcpy_s(dst_ptr, block_width * image_info.samples_per_pixel, src_ptr, block_width * image_info.samples_per_pixel);
+					int hori_status = floating_point_acc(block_buf, decoded_rows, image_info.block_width, image_info.image_byte_count, image_info.samples_per_pixel);
+					if (hori_status != 0)
+					{
+						status = ErrorCode::ERR_DECOMPRESS_LZW_FAILED;
+						break;
+					}
 				}
 			}
-			if (status != ErrorCode::STATUS_OK) {
-				return status;
+			catch (exception e)
+			{
+				status = ErrorCode::ERR_DECOMPRESS_LZW_FAILED;
+				break;
 			}
 		}
+			break;
+		case COMPRESSION_ADOBE_DEFLATE:
+		case COMPRESSION_DEFLATE:
+		{
+			//size = block_size;
+			//int zlib_status = uncompress((unsigned char*)block_buf, (unsigned long*)&size, (unsigned char*)encode_buf, (unsigned long)encode_size);
+			//if (zlib_status != 0)
+			//{
+			//	status = ErrorCode::ERR_DECOMPRESS_ZLIB_FAILED;
+			//	break;
+			//}
+		}
+			break;
+		default:
+			status = ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
+			break;
+		}
+	}
+	if (status == ErrorCode::STATUS_OK && block_buf != nullptr)
+	{
+		for (uint32_t h = 0; h < copy_rows; h++)
+		{
+			uint8_t* src_ptr = (uint8_t*)block_buf + (size_t)(first_row + h) * block_buf_stride + copy_offset;
+			uint8_t* dst_ptr = dst_block + (size_t)h * stride;
+			memcpy_s(dst_ptr, copy_bytes, src_ptr, copy_bytes);
+		}
 	}
 	return status;
 }
 
+int32_t tiff_single::load_image_data(uint32_t image_number, void* image_data, uint32_t stride)
+{
+	if (_openMode == tiff::OpenMode::CREATE_MODE) {
+		return ErrorCode::ERR_OPENMODE;
+	}
+
+	ImageInfo image_info;
+	int32_t status = micro_tiff_GetImageInfo(_hdl, image_number, image_info);
+	if (status != ErrorCode::STATUS_OK) {
+		return status;
+	}
+	return load_image_region(image_number, 0, 0, image_info.image_width, image_info.image_height, image_data, stride);
+}
+
+int32_t tiff_single::load_image_region(uint32_t image_number, uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* image_data, uint32_t stride)
+{
+	if (_openMode == tiff::OpenMode::CREATE_MODE) {
+		return ErrorCode::ERR_OPENMODE;
+	}
+
+	ImageInfo image_info;
+	//always ask the IFD, the codec of images created in this session may differ from _infos (auto mode or raw fallback)
+	int32_t status = micro_tiff_GetImageInfo(_hdl, image_number, image_info);
+	if (status != ErrorCode::STATUS_OK) {
+		return status;
+	}
+
+	if (width == 0 || height == 0 || x >= image_info.image_width || y >= image_info.image_height
+		|| width > image_info.image_width - x || height > image_info.image_height - y)
+		return ErrorCode::ERR_REGION_NOT_CORRECT;
+
+	uint32_t buffer_pixel_width = width * image_info.samples_per_pixel;
+	uint32_t buffer_stride = buffer_pixel_width * image_info.image_byte_count;
+
+	if (stride == 0)
+		stride = buffer_stride;
+
+	if (stride < buffer_stride)
+		return ErrorCode::ERR_STRIDE_NOT_CORRECT;
+
+	//only the blocks which intersect the region are read and decoded
+	image_region region = { x, y, width, height };
+	int32_t first_row = (int32_t)(y / image_info.block_height);
+	int32_t first_column = (int32_t)(x / image_info.block_width);
+	int32_t rows = (int32_t)((y + height - 1) / image_info.block_height) - first_row + 1;
+	int32_t columns = (int32_t)((x + width - 1) / image_info.block_width) - first_column + 1;
+	int32_t block_count = rows * columns;
+
+	//Every block is decoded by one thread with its own buffers into its own part of image_data.
+	//File reads are serialized by micro_tiff, so one thread reads while the others decode.
+	uint32_t threads = (min)(thread_pool_get_threads(_max_threads), (uint32_t)block_count);
+	vector<block_decode_buffers> thread_buffers(threads, block_decode_buffers{ 0 });
+	atomic<int32_t> load_status(ErrorCode::STATUS_OK);
+	thread_pool_parallel_for(block_count, threads, [&](int32_t i, uint32_t participant) {
+		if (load_status != ErrorCode::STATUS_OK)
+			return;
+		int32_t block_status = load_one_block(_hdl, image_number, image_info, first_row + i / columns, first_column + i % columns, region, image_data, stride, thread_buffers[participant]);
+		if (block_status != ErrorCode::STATUS_OK)
+			load_status = block_status;
+	});
+	for (block_decode_buffers& buffers : thread_buffers)
+		free_block_decode_buffers(buffers);
+	return load_status;
+}
+
+int32_t tiff_single::set_max_threads(uint32_t max_threads)
+{
+	_max_threads = max_threads;
+	return ErrorCode::STATUS_OK;
+}
+
 int32_t tiff_single::set_image_tag(uint32_t image_number, uint16_t tag_id, uint16_t tag_type, uint32_t tag_count, void* tag_value)
 {
 	if (_openMode == tiff::OpenMode::READ_ONLY_MODE)
@@ -2,6 +2,19 @@
 #include "classic_def.h"
 #include <map>
 #include <vector>
+#include <memory>
+
+//An image saved band by band with begin_image, append_rows and end_image.
+struct row_band_writer
+{
+	std::unique_ptr<uint8_t[]> band;	//whole block rows of the image, saved when complete
+	uint32_t band_height;		//rows of a complete band
+	uint32_t band_rows;			//rows received in the current band
+	uint32_t band_y;			//first image row of the current band
+	uint16_t compression;		//codec of the IFD, the first band may change it (auto mode or raw fallback)
+	uint16_t predictor;
+	uint16_t shuffle;
+};
 
 class tiff_single
 {
@@ -10,14 +23,25 @@ public:
 	int32_t close_tiff();
 	int32_t create_image(tiff::SingleImageInfo info);
 	int32_t get_image_info(uint32_t image_number, tiff::SingleImageInfo* info);
-	int32_t save_image_data(uint32_t image_number, void* image_data, uint32_t stride);
+	int32_t save_image_data(uint32_t image_number, const void* image_data, uint32_t stride);
+	int32_t save_image_stack(const tiff::SingleImageInfo* infos, const void* const* frames, const uint32_t* strides, uint32_t count);
+	int32_t begin_image(uint32_t image_number);
+	int32_t append_rows(uint32_t image_number, const void* rows_data, uint32_t row_count, uint32_t stride);
+	int32_t end_image(uint32_t image_number);
 	int32_t load_image_data(uint32_t image_number, void* image_data, uint32_t stride);
+	int32_t load_image_region(uint32_t image_number, uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* image_data, uint32_t stride);
 	int32_t set_image_tag(uint32_t image_number, uint16_t tag_id, uint16_t tag_type, uint32_t tag_count, void* tag_value);
 	int32_t get_image_tag(uint32_t image_number, uint16_t tag_id, uint32_t tag_size, void* tag_value);
 	int32_t get_image_count(uint32_t* image_count);
+	int32_t set_max_threads(uint32_t max_threads);
 
 private:
+	int32_t save_frame(uint32_t image_number, const tiff::SingleImageInfo& image_info, const void* image_data, uint32_t stride) const;
+	int32_t save_band(uint32_t image_number, row_band_writer& writer);
+
 	int32_t _hdl;
 	std::map<uint32_t, tiff::SingleImageInfo> _infos;
+	std::map<uint32_t, row_band_writer> _writers;
 	tiff::OpenMode _openMode;
+	uint32_t _max_threads = 0;		//threads of one save or load, 0 means the process limit
 };
\ No newline at end of file
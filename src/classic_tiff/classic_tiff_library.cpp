@@ -1,6 +1,7 @@
 #include "classic_tiff_library.h"
 #include "classic_tiff.h"
 #include "classic_def.h"
+#include "..\common\thread_pool.h"
 #include <vector>
 #include <mutex>
 
@@ -57,13 +58,40 @@ int32_t create_image(int32_t handle, tiff::SingleImageInfo image_info)
 	return vecSingleTiff[handle]->create_image(image_info);
 }
 
-int32_t save_image_data(int32_t handle, uint32_t image_number, void* image_data, uint32_t stride)
+int32_t save_image_data(int32_t handle, uint32_t image_number, const void* image_data, uint32_t stride)
 {
 	CHECK_TIFF_BUFFER(image_data);
 	CHECK_TIFF_HANDLE(handle);
 	return vecSingleTiff[handle]->save_image_data(image_number, image_data, stride);
 }
 
+int32_t save_image_stack(int32_t handle, const tiff::SingleImageInfo* image_infos, const void* const* frames, const uint32_t* strides, uint32_t count)
+{
+	CHECK_TIFF_BUFFER(image_infos);
+	CHECK_TIFF_BUFFER(frames);
+	CHECK_TIFF_HANDLE(handle);
+	return vecSingleTiff[handle]->save_image_stack(image_infos, frames, strides, count);
+}
+
+int32_t begin_image(int32_t handle, uint32_t image_number)
+{
+	CHECK_TIFF_HANDLE(handle);
+	return vecSingleTiff[handle]->begin_image(image_number);
+}
+
+int32_t append_rows(int32_t handle, uint32_t image_number, const void* rows_data, uint32_t row_count, uint32_t stride)
+{
+	CHECK_TIFF_BUFFER(rows_data);
+	CHECK_TIFF_HANDLE(handle);
+	return vecSingleTiff[handle]->append_rows(image_number, rows_data, row_count, stride);
+}
+
+int32_t end_image(int32_t handle, uint32_t image_number)
+{
+	CHECK_TIFF_HANDLE(handle);
+	return vecSingleTiff[handle]->end_image(image_number);
+}
+
 int32_t get_image_info(int32_t handle, uint32_t image_number, tiff::SingleImageInfo* image_info)
 {
 	CHECK_TIFF_BUFFER(image_info);
@@ -78,6 +106,13 @@ int32_t load_image_data(int32_t handle, uint32_t image_number, void* image_data,
 	return vecSingleTiff[handle]->load_image_data(image_number, image_data, stride);
 }
 
+int32_t load_image_region(int32_t handle, uint32_t image_number, uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* image_data, uint32_t stride)
+{
+	CHECK_TIFF_BUFFER(image_data);
+	CHECK_TIFF_HANDLE(handle);
+	return vecSingleTiff[handle]->load_image_region(image_number, x, y, width, height, image_data, stride);
+}
+
 int32_t set_image_tag(int32_t handle, uint32_t image_number, uint16_t tag_id, tiff::TiffTagDataType tag_type, uint32_t tag_count, void* tag_value)
 {
 	CHECK_TIFF_BUFFER(tag_value);
@@ -99,4 +134,16 @@ int32_t get_image_count(int32_t handle, uint32_t* image_count)
 	CHECK_TIFF_BUFFER(image_count);
 	CHECK_TIFF_HANDLE(handle);
 	return vecSingleTiff[handle]->get_image_count(image_count);
+}
+
+int32_t set_max_threads(int32_t handle, uint32_t max_threads)
+{
+	CHECK_TIFF_HANDLE(handle);
+	return vecSingleTiff[handle]->set_max_threads(max_threads);
+}
+
+int32_t set_process_max_threads(uint32_t max_threads)
+{
+	thread_pool_set_max_threads(max_threads);
+	return ErrorCode::STATUS_OK;
 }
\ No newline at end of file
@@ -48,6 +48,11 @@ CLASSIC_TIFF_LIBRARY_API int32_t close_tiff(int32_t handle);
  *
  * @note		You must call this before "save_image_data".
  *				A tiff file can hold many frame of images, these image can have different info.
+ *				Supported pixel types are PIXEL_UINT8, PIXEL_UINT16 and PIXEL_FLOAT32 (valid_bits must be 32).
+ *				PIXEL_FLOAT32 data compressed with LZW or ZIP uses the floating point predictor.
+ *				With COMPRESSIONMODE_AUTO, "shuffle_mode" is ignored and the codec is chosen when the data is saved.
+ *				LZW data whose first blocks don't get smaller than raw is saved without compression.
+ *				"tile_width" and "tile_height" choose the block layout, tiles let large images be read by region.
 */
 CLASSIC_TIFF_LIBRARY_API int32_t create_image(int32_t handle, tiff::SingleImageInfo image_info);
 
@@ -62,8 +67,67 @@ CLASSIC_TIFF_LIBRARY_API int32_t create_image(int32_t handle, tiff::SingleImageI
  * @return		Status code defines by "ErrorCode" in "error.h".
  *
  * @note		You must call this after "create_image" to make sure the image_number is exist.
+ *				"image_data" is read in place with its stride and is not modified.
 */
-CLASSIC_TIFF_LIBRARY_API int32_t save_image_data(int32_t handle, uint32_t image_number, void* image_data, uint32_t stride = 0);
+CLASSIC_TIFF_LIBRARY_API int32_t save_image_data(int32_t handle, uint32_t image_number, const void* image_data, uint32_t stride = 0);
+
+/**
+ * @brief		Add and save several frames at once, e.g. a Z-stack or a time-lapse.
+ *
+ * @param[in]	handle			The handle of an opened CLASSIC-TIFF file.
+ * @param[in]	image_infos		The image information of every frame, as given to "create_image".
+ * @param[in]	frames			The buffer of image data of every frame.
+ * @param[in]	strides			The buffer stride of every frame, or nullptr when all strides are the byte size of width.
+ * @param[in]	count			Number of frames.
+ *
+ * @return		Image frame number of the first frame or Error code.
+ *  @retval		>=0	Image frame number of the first frame, the others follow it.
+ *  @retval		<0	Error code defines by "ErrorCode" in "error.h".
+ *
+ * @note		Same result as "create_image" and "save_image_data" for each frame, but the next frame is compressed
+ *				while the current one is written, so the disk doesn't wait for the compression and the other way round.
+ *				The frames are created before any data is saved, they are left empty when an error is returned.
+*/
+CLASSIC_TIFF_LIBRARY_API int32_t save_image_stack(int32_t handle, const tiff::SingleImageInfo* image_infos, const void* const* frames, const uint32_t* strides, uint32_t count);
+
+/**
+ * @brief		Start saving an exist frame row by row, instead of "save_image_data".
+ *
+ * @param[in]	handle			The handle of an opened CLASSIC-TIFF file.
+ * @param[in]	image_number	The image frame number which you want to save data in.
+ *
+ * @return		Status code defines by "ErrorCode" in "error.h".
+ *
+ * @note		You must call this after "create_image", then "append_rows" until all rows are given, then "end_image".
+ *				Only a band of a few strips (or one row of tiles) is held in memory, it is compressed and written as soon as it is complete.
+ *				With COMPRESSIONMODE_AUTO the codec is chosen by the first band, and so is the raw fallback of LZW.
+*/
+CLASSIC_TIFF_LIBRARY_API int32_t begin_image(int32_t handle, uint32_t image_number);
+
+/**
+ * @brief		Append rows to a frame started by "begin_image".
+ *
+ * @param[in]	handle			The handle of an opened CLASSIC-TIFF file.
+ * @param[in]	image_number	The image frame number which you want to save data in.
+ * @param[in]	rows_data		The buffer of the rows to be stored, following the rows given before.
+ * @param[in]	row_count		Number of rows in "rows_data", any count up to the rows left in the image.
+ * @param[in]	stride			The buffer stride of "rows_data". Default parameter "0" means stride is equal with the byte size of width.
+ *
+ * @return		Status code defines by "ErrorCode" in "error.h". ERR_ROW_COUNT_NOT_CORRECT when the rows exceed the image height.
+ *
+ * @note		The frame can't be continued when an error is returned.
+*/
+CLASSIC_TIFF_LIBRARY_API int32_t append_rows(int32_t handle, uint32_t image_number, const void* rows_data, uint32_t row_count, uint32_t stride = 0);
+
+/**
+ * @brief		Finish a frame started by "begin_image".
+ *
+ * @param[in]	handle			The handle of an opened CLASSIC-TIFF file.
+ * @param[in]	image_number	The image frame number which you want to save data in.
+ *
+ * @return		Status code defines by "ErrorCode" in "error.h". ERR_ROW_COUNT_NOT_CORRECT when not all rows were given.
+*/
+CLASSIC_TIFF_LIBRARY_API int32_t end_image(int32_t handle, uint32_t image_number);
 
 /**
  * @brief		Get image frame count of an opened CLASSIC-TIFF file.
@@ -99,9 +163,29 @@ CLASSIC_TIFF_LIBRARY_API int32_t get_image_info(int32_t handle, uint32_t image_n
  * @return		Status code defines by "ErrorCode" in "error.h".
  *
  * @note		You must call this after "get_image_count" to make sure the image_number is exist.
+ *				Blocks are decoded in parallel by the library thread pool, see "set_max_threads".
 */
 CLASSIC_TIFF_LIBRARY_API int32_t load_image_data(int32_t handle, uint32_t image_number, void* image_data, uint32_t stride = 0);
 
+/**
+ * @brief		Get a rectangular region of the image data with specified image number.
+ *
+ * @param[in]	handle			The handle of an opened CLASSIC-TIFF file.
+ * @param[in]	image_number	The image frame number which you want to get data.
+ * @param[in]	x				The left of the region in pixels.
+ * @param[in]	y				The top of the region in pixels.
+ * @param[in]	width			The width of the region in pixels.
+ * @param[in]	height			The height of the region in pixels.
+ * @param[out]	image_data		The buffer of the region data to be loaded.
+ * @param[in]	stride			The buffer stride of "image_data". Default parameter "0" means stride is equal with the byte size of the region width.
+ *
+ * @return		Status code defines by "ErrorCode" in "error.h". ERR_REGION_NOT_CORRECT when the region is empty or exceeds the image.
+ *
+ * @note		Only the strips or tiles which intersect the region are read and decoded, and only the needed columns are copied.
+ *				LZW rows below the region are not decoded at all.
+*/
+CLASSIC_TIFF_LIBRARY_API int32_t load_image_region(int32_t handle, uint32_t image_number, uint32_t x, uint32_t y, uint32_t width, uint32_t height, void* image_data, uint32_t stride = 0);
+
 /**
  * @brief		Set tag with specified image number.
  *
@@ -131,4 +215,26 @@ CLASSIC_TIFF_LIBRARY_API int32_t set_image_tag(int32_t handle, uint32_t image_nu
  *
  * @note		You must call this after "get_image_count" to make sure the image_number is exist.
 */
-CLASSIC_TIFF_LIBRARY_API int32_t get_image_tag(int32_t handle, uint32_t image_number, uint16_t tag_id, uint32_t tag_size, void* tag_value);
\ No newline at end of file
+CLASSIC_TIFF_LIBRARY_API int32_t get_image_tag(int32_t handle, uint32_t image_number, uint16_t tag_id, uint32_t tag_size, void* tag_value);
+
+/**
+ * @brief		Set the most threads used by one save or load of an opened CLASSIC-TIFF file.
+ *
+ * @param[in]	handle			The handle of an opened CLASSIC-TIFF file.
+ * @param[in]	max_threads		Threads count, the calling thread included. "0" means the limit of the process.
+ *
+ * @return		Status code defines by "ErrorCode" in "error.h".
+ *
+ * @note		The library runs its work on its own thread pool and the calling thread, OpenMP settings of the process are not changed.
+ *				When the pool is busy with other handles, the calling thread does the work itself.
+*/
+CLASSIC_TIFF_LIBRARY_API int32_t set_max_threads(int32_t handle, uint32_t max_threads);
+
+/**
+ * @brief		Set the most threads used by one save or load of any file in this process.
+ *
+ * @param[in]	max_threads		Threads count, the calling thread included. "0" means one per processor, which is the default.
+ *
+ * @return		Status code defines by "ErrorCode" in "error.h".
+*/
+CLASSIC_TIFF_LIBRARY_API int32_t set_process_max_threads(uint32_t max_threads);
\ No newline at end of file
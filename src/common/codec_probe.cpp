@@ -0,0 +1,76 @@
+#include "codec_probe.h"
+#include "data_predict.h"
+#include "data_shuffle.h"
+#include "..\lzw\lzw.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Size of the LZW output, or "size" when the output would not be smaller than the input.
+static size_t probe_lzw_size(void* data, size_t size, void* out)
+{
+	//too small to gain anything, and the encoder needs some bytes of margin
+	if (size < 64)
+		return size;
+	uint64_t used_size = 0, out_size = 0;
+	if (LZWEncode(data, size, &used_size, out, size, &out_size) != 1 || used_size != size || out_size >= size)
+		return size;
+	return (size_t)out_size;
+}
+
+int codec_probe_block(const void* block, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel,
+	bool floating_point, codec_probe_result* result)
+{
+	if (block == nullptr || result == nullptr || height == 0 || width == 0)
+		return -1;
+
+	size_t size = (size_t)height * width * samples_per_pixel * data_bytes;
+	//predicted copy, shuffled copy, encoder output
+	uint8_t* buf = (uint8_t*)malloc(size * 3);
+	if (buf == nullptr)
+		return -2;
+	uint8_t* predict_buf = buf;
+	uint8_t* shuffle_buf = buf + size;
+	uint8_t* out_buf = buf + size * 2;
+
+	memcpy(predict_buf, block, size);
+	int status;
+	if (floating_point)
+		status = floating_point_differencing(predict_buf, height, width, data_bytes, samples_per_pixel);
+	else
+		status = horizontal_differencing(predict_buf, height, width, data_bytes, samples_per_pixel, false);
+	if (status != 0) {
+		free(buf);
+		return -3;
+	}
+
+	size_t lzw_size = probe_lzw_size(predict_buf, size, out_buf);
+	//byte shuffle of 8 bits data changes nothing
+	size_t lzw_shuffle_size = size;
+	if (data_bytes > 1 && byte_shuffle(predict_buf, shuffle_buf, size, data_bytes) == 0)
+		lzw_shuffle_size = probe_lzw_size(shuffle_buf, size, out_buf);
+
+	result->raw_size += size;
+	result->lzw_size += lzw_size;
+	result->lzw_shuffle_size += lzw_shuffle_size;
+	free(buf);
+	return 0;
+}
+
+int codec_probe_choose(const codec_probe_result* result)
+{
+	if (result == nullptr || result->raw_size == 0)
+		return CODEC_PROBE_RAW;
+
+	size_t raw_size = result->raw_size;
+	int codec = CODEC_PROBE_RAW;
+	size_t size = raw_size;
+	if (result->lzw_size + raw_size / 100 * CODEC_PROBE_MIN_GAIN_PERCENT <= size) {
+		codec = CODEC_PROBE_LZW;
+		size = result->lzw_size;
+	}
+	if (result->lzw_shuffle_size + raw_size / 100 * (codec == CODEC_PROBE_RAW ? CODEC_PROBE_MIN_GAIN_PERCENT : CODEC_PROBE_SHUFFLE_GAIN_PERCENT) <= size) {
+		codec = CODEC_PROBE_LZW_SHUFFLE;
+	}
+	return codec;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stddef.h>
+
+//Trial compression for the "auto" compression mode : encode some sample blocks with every candidate codec, then pick one for the whole image.
+//Candidates, from the cheapest to the most expensive.
+#define CODEC_PROBE_RAW				0	//no compression
+#define CODEC_PROBE_LZW				1	//predictor + LZW
+#define CODEC_PROBE_LZW_SHUFFLE		2	//predictor + byte shuffle + LZW, only for 16/32 bits data
+
+//A codec must save at least this part of the raw size to be worth its CPU time, a more expensive one must save this much more again.
+#define CODEC_PROBE_MIN_GAIN_PERCENT	10
+#define CODEC_PROBE_SHUFFLE_GAIN_PERCENT	5
+
+struct codec_probe_result
+{
+	size_t raw_size;
+	size_t lzw_size;
+	size_t lzw_shuffle_size;
+};
+
+//Encode one block of "height" rows and add the sizes to "result", which must be zeroed before the first block. The block is not modified.
+//The encoders stop as soon as the output reaches the raw size, so incompressible data costs little and counts as raw.
+//floating_point selects the floating point predictor instead of the horizontal one. Return 0 when success.
+int codec_probe_block(const void* block, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel,
+	bool floating_point, codec_probe_result* result);
+
+//Return the CODEC_PROBE_* codec to use for the probed blocks.
+int codec_probe_choose(const codec_probe_result* result);
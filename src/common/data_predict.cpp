@@ -1,5 +1,13 @@
 #include "data_predict.h"
+#include "data_predict_simd.h"
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PREDICT_USE_SSE2
+#endif
 
 #define REPEAT4(n, op)		\
     switch (n) {		\
@@ -261,9 +269,33 @@ int swab_horizontal_acc_32bits(void* data, unsigned long size, unsigned short st
 	return horizontal_acc_32bits(data, size, stride);
 }
 
+int predict_simd_level()
+{
+	static const int level = detect_simd_level();
+	return level;
+}
+
+bool predict_simd_supported(int simd_level)
+{
+	int level = predict_simd_level();
+	switch (simd_level)
+	{
+	case PREDICT_SIMD_SCALAR:
+		return true;
+	case PREDICT_SIMD_NEON:
+		return level == PREDICT_SIMD_NEON;
+	case PREDICT_SIMD_SSE2:
+	case PREDICT_SIMD_AVX2:
+	case PREDICT_SIMD_AVX512:
+		return level != PREDICT_SIMD_NEON && simd_level <= level;
+	default:
+		return false;
+	}
+}
+
 typedef int(*encodepfunc)(void* data, unsigned long size, unsigned short stride);
 //encode
-int horizontal_differencing(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian)
+int horizontal_differencing_with_level(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian, int simd_level)
 {
 	if (data == nullptr) return -1;
 	encodepfunc func;
@@ -275,12 +307,27 @@ int horizontal_differencing(void* data, unsigned int height, unsigned int width,
 	case 2:
 		func = is_big_endian ? swab_horizontal_differencing_16bits : horizontal_differencing_16bits;
 		break;
+	case 4:
+		func = is_big_endian ? swab_horizontal_differencing_32bits : horizontal_differencing_32bits;
+		break;
 	default:
 		return -2;
 	}
+	if (!predict_simd_supported(simd_level)) return -3;
 
 	uint32_t stride = width * data_bytes * samples_per_pixel;
 
+	rowsfunc kernel = get_differencing_kernel(simd_level, data_bytes, samples_per_pixel);
+	if (kernel != nullptr)
+	{
+		kernel(data, height, stride, samples_per_pixel);
+		if (is_big_endian && data_bytes == 2)
+			SwabArrayOfShort((uint16_t*)data, (unsigned long)height * stride / 2);
+		else if (is_big_endian && data_bytes == 4)
+			SwabArrayOfLong((uint32_t*)data, (unsigned long)height * stride / 4);
+		return 0;
+	}
+
 	for (unsigned int i = 0; i < height; ++i)
 	{
 		uint8_t* hori_buff = (uint8_t*)data + i * stride;
@@ -290,9 +337,14 @@ int horizontal_differencing(void* data, unsigned int height, unsigned int width,
 	return 0;
 }
 
+int horizontal_differencing(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian)
+{
+	return horizontal_differencing_with_level(data, height, width, data_bytes, samples_per_pixel, is_big_endian, predict_simd_level());
+}
+
 typedef int(*decodepfunc)(void* data, unsigned long size, unsigned short stride);
 //decode
-int horizontal_acc(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian)
+int horizontal_acc_with_level(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian, int simd_level)
 {
 	if (data == nullptr) return -1;
 	decodepfunc func;
@@ -304,12 +356,26 @@ int horizontal_acc(void* data, unsigned int height, unsigned int width, unsigned
 	case 2:
 		func = is_big_endian ? swab_horizontal_acc_16bits : horizontal_acc_16bits;
 		break;
+	case 4:
+		func = is_big_endian ? swab_horizontal_acc_32bits : horizontal_acc_32bits;
+		break;
 	default:
 		return -2;
 	}
+	if (!predict_simd_supported(simd_level)) return -3;
 
 	uint32_t stride = width * data_bytes * samples_per_pixel;
 
+	rowsfunc kernel = get_acc_kernel(simd_level, data_bytes, samples_per_pixel);
+	if (kernel != nullptr)
+	{
+		if (is_big_endian && data_bytes == 2)
+			SwabArrayOfShort((uint16_t*)data, (unsigned long)height * stride / 2);
+		else if (is_big_endian && data_bytes == 4)
+			SwabArrayOfLong((uint32_t*)data, (unsigned long)height * stride / 4);
+		return kernel(data, height, stride, samples_per_pixel);
+	}
+
 	for (unsigned int i = 0; i < height; ++i)
 	{
 		uint8_t* hori_acc_buff = (uint8_t*)data + i * stride;
@@ -317,4 +383,190 @@ int horizontal_acc(void* data, unsigned int height, unsigned int width, unsigned
 	}
 
 	return 0;
+}
+
+int horizontal_acc(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian)
+{
+	return horizontal_acc_with_level(data, height, width, data_bytes, samples_per_pixel, is_big_endian, predict_simd_level());
+}
+
+//Split "count" values of "bytes" bytes into byte planes, the most significant byte first. (little endian machine)
+static void split_byte_planes(const uint8_t* src, uint8_t* planes, size_t count, unsigned short bytes)
+{
+	size_t i = 0;
+#ifdef PREDICT_USE_SSE2
+	if (bytes == 4)
+	{
+		const __m128i mask = _mm_set1_epi32(0xFF);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i x0 = _mm_loadu_si128((const __m128i*)(src + i * 4));
+			__m128i x1 = _mm_loadu_si128((const __m128i*)(src + i * 4 + 16));
+			__m128i x2 = _mm_loadu_si128((const __m128i*)(src + i * 4 + 32));
+			__m128i x3 = _mm_loadu_si128((const __m128i*)(src + i * 4 + 48));
+			for (int b = 0; b < 4; b++)
+			{
+				__m128i shift = _mm_cvtsi32_si128(b * 8);
+				__m128i lo = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(x0, shift), mask), _mm_and_si128(_mm_srl_epi32(x1, shift), mask));
+				__m128i hi = _mm_packs_epi32(_mm_and_si128(_mm_srl_epi32(x2, shift), mask), _mm_and_si128(_mm_srl_epi32(x3, shift), mask));
+				_mm_storeu_si128((__m128i*)(planes + (3 - b) * count + i), _mm_packus_epi16(lo, hi));
+			}
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		for (unsigned short b = 0; b < bytes; b++)
+			planes[(bytes - b - 1) * count + i] = src[i * bytes + b];
+	}
+}
+
+//Reverse of split_byte_planes.
+static void merge_byte_planes(const uint8_t* planes, uint8_t* dst, size_t count, unsigned short bytes)
+{
+	size_t i = 0;
+#ifdef PREDICT_USE_SSE2
+	if (bytes == 4)
+	{
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i p3 = _mm_loadu_si128((const __m128i*)(planes + i));
+			__m128i p2 = _mm_loadu_si128((const __m128i*)(planes + count + i));
+			__m128i p1 = _mm_loadu_si128((const __m128i*)(planes + 2 * count + i));
+			__m128i p0 = _mm_loadu_si128((const __m128i*)(planes + 3 * count + i));
+			__m128i lo01 = _mm_unpacklo_epi8(p0, p1);
+			__m128i hi01 = _mm_unpackhi_epi8(p0, p1);
+			__m128i lo23 = _mm_unpacklo_epi8(p2, p3);
+			__m128i hi23 = _mm_unpackhi_epi8(p2, p3);
+			_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_unpacklo_epi16(lo01, lo23));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_unpackhi_epi16(lo01, lo23));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 32), _mm_unpacklo_epi16(hi01, hi23));
+			_mm_storeu_si128((__m128i*)(dst + i * 4 + 48), _mm_unpackhi_epi16(hi01, hi23));
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		for (unsigned short b = 0; b < bytes; b++)
+			dst[i * bytes + b] = planes[(bytes - b - 1) * count + i];
+	}
+}
+
+//dst[i] = src[i] - src[i - stride], the first "stride" bytes are copied.
+static void byte_differencing(const uint8_t* src, uint8_t* dst, size_t size, unsigned short stride)
+{
+	size_t i = 0;
+	for (; i < stride && i < size; i++)
+		dst[i] = src[i];
+#ifdef PREDICT_USE_SSE2
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i cur = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i prev = _mm_loadu_si128((const __m128i*)(src + i - stride));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(cur, prev));
+	}
+#endif
+	for (; i < size; i++)
+		dst[i] = (uint8_t)(src[i] - src[i - stride]);
+}
+
+#ifdef PREDICT_USE_SSE2
+//prefix sum of every "stride"-th byte inside one register
+static inline __m128i prefix_sum_epi8(__m128i x, unsigned short stride)
+{
+	switch (stride)
+	{
+	case 1:
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		break;
+	case 2:
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		break;
+	case 4:
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+		x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+		break;
+	}
+	return x;
+}
+#endif
+
+//dst[i] = src[i] + dst[i - stride], the first "stride" bytes are copied.
+static void byte_acc(const uint8_t* src, uint8_t* dst, size_t size, unsigned short stride)
+{
+	size_t i = 0;
+#ifdef PREDICT_USE_SSE2
+	if (stride == 1 || stride == 2 || stride == 4)
+	{
+		__m128i carry = _mm_setzero_si128();
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i x = _mm_add_epi8(prefix_sum_epi8(_mm_loadu_si128((const __m128i*)(src + i)), stride), carry);
+			_mm_storeu_si128((__m128i*)(dst + i), x);
+			//broadcast the last sample of this register
+			switch (stride)
+			{
+			case 1: carry = _mm_set1_epi8((char)dst[i + 15]); break;
+			case 2: carry = _mm_set1_epi16(*(const short*)(dst + i + 14)); break;
+			case 4: carry = _mm_set1_epi32(*(const int*)(dst + i + 12)); break;
+			}
+		}
+	}
+#endif
+	for (; i < stride && i < size; i++)
+		dst[i] = src[i];
+	for (; i < size; i++)
+		dst[i] = (uint8_t)(src[i] + dst[i - stride]);
+}
+
+static int floating_point_predict(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool encode, void* temp_row)
+{
+	if (data == nullptr) return -1;
+	if (data_bytes != 2 && data_bytes != 4 && data_bytes != 8) return -2;
+	if (samples_per_pixel == 0) return -2;
+
+	size_t count = (size_t)width * samples_per_pixel;
+	size_t row_size = count * data_bytes;
+	uint8_t* temp = temp_row != nullptr ? (uint8_t*)temp_row : (uint8_t*)malloc(row_size);
+	if (temp == nullptr) return -3;
+
+	for (unsigned int i = 0; i < height; ++i)
+	{
+		uint8_t* row = (uint8_t*)data + i * row_size;
+		if (encode)
+		{
+			split_byte_planes(row, temp, count, data_bytes);
+			byte_differencing(temp, row, row_size, samples_per_pixel);
+		}
+		else
+		{
+			byte_acc(row, temp, row_size, samples_per_pixel);
+			merge_byte_planes(temp, row, count, data_bytes);
+		}
+	}
+
+	if (temp != temp_row)
+		free(temp);
+	return 0;
+}
+
+int floating_point_differencing(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel)
+{
+	return floating_point_predict(data, height, width, data_bytes, samples_per_pixel, true, nullptr);
+}
+
+int floating_point_acc(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel)
+{
+	return floating_point_predict(data, height, width, data_bytes, samples_per_pixel, false, nullptr);
+}
+
+int floating_point_acc_row(void* row, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, void* temp_row)
+{
+	if (temp_row == nullptr) return -1;
+	return floating_point_predict(row, 1, width, data_bytes, samples_per_pixel, false, temp_row);
 }
\ No newline at end of file
@@ -1,6 +1,35 @@
 #pragma once
+//SIMD level of the horizontal predictor kernels.
+#define PREDICT_SIMD_SCALAR		0
+#define PREDICT_SIMD_SSE2		1
+#define PREDICT_SIMD_AVX2		2
+#define PREDICT_SIMD_AVX512		3	//AVX-512F and AVX-512BW
+#define PREDICT_SIMD_NEON		4
+
+//Highest level supported by this CPU, detected at the first call.
+int predict_simd_level();
+//Return true if "simd_level" can run on this CPU.
+bool predict_simd_supported(int simd_level);
+
+//Horizontal differencing predictor, for 8/16/32 bits integer data.
+//Vectorized for 1, 3 and 4 samples per pixel (differencing for any), other cases run the scalar code.
 //encode
 int horizontal_differencing(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian);
 
 //decode
-int horizontal_acc(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian);
\ No newline at end of file
+int horizontal_acc(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian);
+
+//Same as above with a given SIMD level instead of the detected one, for tests and benchmarks. Return -3 if the CPU doesn't support "simd_level".
+int horizontal_differencing_with_level(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian, int simd_level);
+int horizontal_acc_with_level(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian, int simd_level);
+
+//Floating point predictor (Adobe TIFF Technical Note 3), for 16/32/64 bits floating point data.
+//Every row is split into byte planes, most significant byte first, then the bytes are differenced with samples_per_pixel stride.
+//The encoded data doesn't depend on the byte order of the file.
+//encode
+int floating_point_differencing(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel);
+
+//decode
+int floating_point_acc(void* data, unsigned int height, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel);
+//Decode one row with a caller provided temporary buffer of the row size, for decoding row by row without allocation.
+int floating_point_acc_row(void* row, unsigned int width, unsigned short data_bytes, unsigned short samples_per_pixel, void* temp_row);
\ No newline at end of file
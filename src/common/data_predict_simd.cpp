@@ -0,0 +1,394 @@
+#include "data_predict_simd.h"
+#include "data_predict.h"
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PREDICT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+//MSVC accepts every intrinsic, other compilers only those enabled for the build.
+#if defined(_MSC_VER) || defined(__SSE2__)
+#define PREDICT_HAS_SSE2
+#endif
+#if defined(_MSC_VER) || defined(__AVX2__)
+#define PREDICT_HAS_AVX2
+#endif
+#if defined(_MSC_VER) || (defined(__AVX512F__) && defined(__AVX512BW__))
+#define PREDICT_HAS_AVX512
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#include <arm_neon.h>
+#define PREDICT_HAS_NEON
+#endif
+
+//Every instruction set is wrapped by an "ops" struct, the kernels below are written once against it.
+//Shifts work inside 128 bits lanes. Wider registers hold the same offset of several rows in their lanes
+//for accumulation (ROWS), because the prefix sum of one row can't be split.
+
+#ifdef PREDICT_HAS_SSE2
+struct sse2_ops
+{
+	typedef __m128i V;
+	static const int BYTES = 16;
+	static const int ROWS = 1;
+	static inline V load(const void* p) { return _mm_loadu_si128((const __m128i*)p); }
+	static inline void store(void* p, V v) { _mm_storeu_si128((__m128i*)p, v); }
+	static inline V load_rows(const uint8_t* p, size_t) { return load(p); }
+	static inline void store_rows(uint8_t* p, size_t, V v) { store(p, v); }
+	static inline V zero() { return _mm_setzero_si128(); }
+	static inline V or_(V a, V b) { return _mm_or_si128(a, b); }
+	template<int E> static inline V add(V a, V b)
+	{
+		if constexpr (E == 1) return _mm_add_epi8(a, b);
+		else if constexpr (E == 2) return _mm_add_epi16(a, b);
+		else return _mm_add_epi32(a, b);
+	}
+	template<int E> static inline V sub(V a, V b)
+	{
+		if constexpr (E == 1) return _mm_sub_epi8(a, b);
+		else if constexpr (E == 2) return _mm_sub_epi16(a, b);
+		else return _mm_sub_epi32(a, b);
+	}
+	template<int N> static inline V bslli(V a) { return _mm_slli_si128(a, N); }
+	template<int N> static inline V bsrli(V a) { return _mm_srli_si128(a, N); }
+};
+#endif
+
+#ifdef PREDICT_HAS_AVX2
+struct avx2_ops
+{
+	typedef __m256i V;
+	static const int BYTES = 32;
+	static const int ROWS = 2;
+	static inline V load(const void* p) { return _mm256_loadu_si256((const __m256i*)p); }
+	static inline void store(void* p, V v) { _mm256_storeu_si256((__m256i*)p, v); }
+	static inline V load_rows(const uint8_t* p, size_t row_size)
+	{
+		V v = _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)p));
+		return _mm256_inserti128_si256(v, _mm_loadu_si128((const __m128i*)(p + row_size)), 1);
+	}
+	static inline void store_rows(uint8_t* p, size_t row_size, V v)
+	{
+		_mm_storeu_si128((__m128i*)p, _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i*)(p + row_size), _mm256_extracti128_si256(v, 1));
+	}
+	static inline V zero() { return _mm256_setzero_si256(); }
+	static inline V or_(V a, V b) { return _mm256_or_si256(a, b); }
+	template<int E> static inline V add(V a, V b)
+	{
+		if constexpr (E == 1) return _mm256_add_epi8(a, b);
+		else if constexpr (E == 2) return _mm256_add_epi16(a, b);
+		else return _mm256_add_epi32(a, b);
+	}
+	template<int E> static inline V sub(V a, V b)
+	{
+		if constexpr (E == 1) return _mm256_sub_epi8(a, b);
+		else if constexpr (E == 2) return _mm256_sub_epi16(a, b);
+		else return _mm256_sub_epi32(a, b);
+	}
+	template<int N> static inline V bslli(V a) { return _mm256_slli_si256(a, N); }
+	template<int N> static inline V bsrli(V a) { return _mm256_srli_si256(a, N); }
+};
+#endif
+
+#ifdef PREDICT_HAS_AVX512
+struct avx512_ops
+{
+	typedef __m512i V;
+	static const int BYTES = 64;
+	static const int ROWS = 4;
+	static inline V load(const void* p) { return _mm512_loadu_si512(p); }
+	static inline void store(void* p, V v) { _mm512_storeu_si512(p, v); }
+	static inline V load_rows(const uint8_t* p, size_t row_size)
+	{
+		V v = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i*)p));
+		v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + row_size)), 1);
+		v = _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + 2 * row_size)), 2);
+		return _mm512_inserti32x4(v, _mm_loadu_si128((const __m128i*)(p + 3 * row_size)), 3);
+	}
+	static inline void store_rows(uint8_t* p, size_t row_size, V v)
+	{
+		_mm_storeu_si128((__m128i*)p, _mm512_castsi512_si128(v));
+		_mm_storeu_si128((__m128i*)(p + row_size), _mm512_extracti32x4_epi32(v, 1));
+		_mm_storeu_si128((__m128i*)(p + 2 * row_size), _mm512_extracti32x4_epi32(v, 2));
+		_mm_storeu_si128((__m128i*)(p + 3 * row_size), _mm512_extracti32x4_epi32(v, 3));
+	}
+	static inline V zero() { return _mm512_setzero_si512(); }
+	static inline V or_(V a, V b) { return _mm512_or_si512(a, b); }
+	template<int E> static inline V add(V a, V b)
+	{
+		if constexpr (E == 1) return _mm512_add_epi8(a, b);
+		else if constexpr (E == 2) return _mm512_add_epi16(a, b);
+		else return _mm512_add_epi32(a, b);
+	}
+	template<int E> static inline V sub(V a, V b)
+	{
+		if constexpr (E == 1) return _mm512_sub_epi8(a, b);
+		else if constexpr (E == 2) return _mm512_sub_epi16(a, b);
+		else return _mm512_sub_epi32(a, b);
+	}
+	template<int N> static inline V bslli(V a) { return _mm512_bslli_epi128(a, N); }
+	template<int N> static inline V bsrli(V a) { return _mm512_bsrli_epi128(a, N); }
+};
+#endif
+
+#ifdef PREDICT_HAS_NEON
+struct neon_ops
+{
+	typedef uint8x16_t V;
+	static const int BYTES = 16;
+	static const int ROWS = 1;
+	static inline V load(const void* p) { return vld1q_u8((const uint8_t*)p); }
+	static inline void store(void* p, V v) { vst1q_u8((uint8_t*)p, v); }
+	static inline V load_rows(const uint8_t* p, size_t) { return load(p); }
+	static inline void store_rows(uint8_t* p, size_t, V v) { store(p, v); }
+	static inline V zero() { return vdupq_n_u8(0); }
+	static inline V or_(V a, V b) { return vorrq_u8(a, b); }
+	template<int E> static inline V add(V a, V b)
+	{
+		if constexpr (E == 1) return vaddq_u8(a, b);
+		else if constexpr (E == 2) return vreinterpretq_u8_u16(vaddq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+		else return vreinterpretq_u8_u32(vaddq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)));
+	}
+	template<int E> static inline V sub(V a, V b)
+	{
+		if constexpr (E == 1) return vsubq_u8(a, b);
+		else if constexpr (E == 2) return vreinterpretq_u8_u16(vsubq_u16(vreinterpretq_u16_u8(a), vreinterpretq_u16_u8(b)));
+		else return vreinterpretq_u8_u32(vsubq_u32(vreinterpretq_u32_u8(a), vreinterpretq_u32_u8(b)));
+	}
+	template<int N> static inline V bslli(V a)
+	{
+		if constexpr (N == 0) return a;
+		else return vextq_u8(vdupq_n_u8(0), a, 16 - N);
+	}
+	template<int N> static inline V bsrli(V a)
+	{
+		if constexpr (N == 0) return a;
+		else return vextq_u8(a, vdupq_n_u8(0), N);
+	}
+};
+#endif
+
+//Differencing in place, from the end of the row, so every sample is read before it is overwritten.
+template<typename Ops, typename T>
+static int differencing_rows(void* data, unsigned int height, size_t row_size, unsigned short stride)
+{
+	const size_t lanes = Ops::BYTES / sizeof(T);
+	const size_t count = row_size / sizeof(T);
+
+	for (unsigned int h = 0; h < height; h++)
+	{
+		T* p = (T*)((uint8_t*)data + h * row_size);
+		size_t i = count;
+		while (i >= stride + lanes)
+		{
+			i -= lanes;
+			typename Ops::V cur = Ops::load(p + i);
+			typename Ops::V prev = Ops::load(p + i - stride);
+			Ops::store(p + i, Ops::template sub<sizeof(T)>(cur, prev));
+		}
+		while (i > stride)
+		{
+			i--;
+			p[i] = (T)(p[i] - p[i - stride]);
+		}
+	}
+	return 0;
+}
+
+//Prefix sum of every SB-th byte inside each 128 bits lane. (SB is the byte size of one pixel)
+template<typename Ops, int E, int SB>
+static inline typename Ops::V lane_prefix(typename Ops::V x)
+{
+	if constexpr (SB < 16) x = Ops::template add<E>(x, Ops::template bslli<SB>(x));
+	if constexpr (2 * SB < 16) x = Ops::template add<E>(x, Ops::template bslli<2 * SB>(x));
+	if constexpr (4 * SB < 16) x = Ops::template add<E>(x, Ops::template bslli<4 * SB>(x));
+	if constexpr (8 * SB < 16) x = Ops::template add<E>(x, Ops::template bslli<8 * SB>(x));
+	return x;
+}
+
+//Repeat the last pixel of each 128 bits lane over the whole lane, it is the carry of the next lane of the same row.
+template<typename Ops, int SB>
+static inline typename Ops::V lane_carry(typename Ops::V x)
+{
+	typename Ops::V c = Ops::template bsrli<16 - SB>(x);
+	if constexpr (SB < 16) c = Ops::or_(c, Ops::template bslli<SB>(c));
+	if constexpr (2 * SB < 16) c = Ops::or_(c, Ops::template bslli<2 * SB>(c));
+	if constexpr (4 * SB < 16) c = Ops::or_(c, Ops::template bslli<4 * SB>(c));
+	if constexpr (8 * SB < 16) c = Ops::or_(c, Ops::template bslli<8 * SB>(c));
+	return c;
+}
+
+//Accumulate Ops::ROWS rows starting from "base".
+template<typename Ops, typename T, int S>
+static inline void acc_rows_block(uint8_t* base, size_t row_size)
+{
+	const int SB = S * (int)sizeof(T);
+	const size_t lanes = 16 / sizeof(T);
+	const size_t count = row_size / sizeof(T);
+
+	typename Ops::V carry = Ops::zero();
+	size_t i = 0;
+	for (; i + lanes <= count; i += lanes)
+	{
+		typename Ops::V x = Ops::load_rows(base + i * sizeof(T), row_size);
+		x = Ops::template add<sizeof(T)>(lane_prefix<Ops, sizeof(T), SB>(x), carry);
+		Ops::store_rows(base + i * sizeof(T), row_size, x);
+		carry = lane_carry<Ops, SB>(x);
+	}
+
+	for (int r = 0; r < Ops::ROWS; r++)
+	{
+		T* p = (T*)(base + r * row_size);
+		for (size_t k = i > S ? i : S; k < count; k++)
+			p[k] = (T)(p[k] + p[k - S]);
+	}
+}
+
+//Rows which can't fill all lanes of Ops are done one by one with Rest.
+template<typename Ops, typename Rest, typename T, int S>
+static int acc_rows(void* data, unsigned int height, size_t row_size, unsigned short)
+{
+	static_assert(Rest::ROWS == 1, "Rest must work on one row");
+	uint8_t* p = (uint8_t*)data;
+	unsigned int h = 0;
+	for (; h + Ops::ROWS <= height; h += Ops::ROWS)
+		acc_rows_block<Ops, T, S>(p + h * row_size, row_size);
+	for (; h < height; h++)
+		acc_rows_block<Rest, T, S>(p + h * row_size, row_size);
+	return 0;
+}
+
+template<typename Ops>
+static rowsfunc select_differencing(unsigned short data_bytes)
+{
+	switch (data_bytes)
+	{
+	case 1: return differencing_rows<Ops, uint8_t>;
+	case 2: return differencing_rows<Ops, uint16_t>;
+	case 4: return differencing_rows<Ops, uint32_t>;
+	default: return nullptr;
+	}
+}
+
+template<typename Ops, typename Rest, typename T>
+static rowsfunc select_acc_stride(unsigned short stride)
+{
+	switch (stride)
+	{
+	case 1: return acc_rows<Ops, Rest, T, 1>;
+	case 3: return acc_rows<Ops, Rest, T, 3>;
+	case 4: return acc_rows<Ops, Rest, T, 4>;
+	default: return nullptr;
+	}
+}
+
+template<typename Ops, typename Rest>
+static rowsfunc select_acc(unsigned short data_bytes, unsigned short stride)
+{
+	switch (data_bytes)
+	{
+	case 1: return select_acc_stride<Ops, Rest, uint8_t>(stride);
+	case 2: return select_acc_stride<Ops, Rest, uint16_t>(stride);
+	case 4: return select_acc_stride<Ops, Rest, uint32_t>(stride);
+	default: return nullptr;
+	}
+}
+
+int detect_simd_level()
+{
+	int level = PREDICT_SIMD_SCALAR;
+#if defined(PREDICT_HAS_NEON)
+	level = PREDICT_SIMD_NEON;
+#elif defined(PREDICT_X86)
+#ifdef _MSC_VER
+	//MSVC builds every instruction set, see PREDICT_HAS_*
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+	__cpuid(info, 1);
+	bool sse2 = (info[3] & (1 << 26)) != 0;
+	bool avx2 = false, avx512 = false;
+	bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0;	//OSXSAVE and AVX
+	if (os_avx && max_leaf >= 7)
+	{
+		unsigned long long xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		//OS saves YMM (and ZMM, opmask) state
+		avx2 = (xcr0 & 0x06) == 0x06 && (info[1] & (1 << 5)) != 0;
+		avx512 = avx2 && (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0 && (info[1] & (1 << 30)) != 0;
+	}
+	if (sse2) level = PREDICT_SIMD_SSE2;
+	if (avx2) level = PREDICT_SIMD_AVX2;
+	if (avx512) level = PREDICT_SIMD_AVX512;
+#else
+	//only the instruction sets enabled for the build are checked
+	__builtin_cpu_init();
+#ifdef PREDICT_HAS_SSE2
+	if (__builtin_cpu_supports("sse2")) level = PREDICT_SIMD_SSE2;
+#endif
+#ifdef PREDICT_HAS_AVX2
+	if (__builtin_cpu_supports("avx2")) level = PREDICT_SIMD_AVX2;
+#endif
+#ifdef PREDICT_HAS_AVX512
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) level = PREDICT_SIMD_AVX512;
+#endif
+#endif
+#endif
+	return level;
+}
+
+rowsfunc get_differencing_kernel(int simd_level, unsigned short data_bytes, unsigned short stride)
+{
+	if (stride == 0)
+		return nullptr;
+
+	switch (simd_level)
+	{
+#ifdef PREDICT_HAS_SSE2
+	case PREDICT_SIMD_SSE2:
+		return select_differencing<sse2_ops>(data_bytes);
+#endif
+#ifdef PREDICT_HAS_AVX2
+	case PREDICT_SIMD_AVX2:
+		return select_differencing<avx2_ops>(data_bytes);
+#endif
+#ifdef PREDICT_HAS_AVX512
+	case PREDICT_SIMD_AVX512:
+		return select_differencing<avx512_ops>(data_bytes);
+#endif
+#ifdef PREDICT_HAS_NEON
+	case PREDICT_SIMD_NEON:
+		return select_differencing<neon_ops>(data_bytes);
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+rowsfunc get_acc_kernel(int simd_level, unsigned short data_bytes, unsigned short stride)
+{
+	switch (simd_level)
+	{
+#ifdef PREDICT_HAS_SSE2
+	case PREDICT_SIMD_SSE2:
+		return select_acc<sse2_ops, sse2_ops>(data_bytes, stride);
+#endif
+#if defined(PREDICT_HAS_AVX2) && defined(PREDICT_HAS_SSE2)
+	case PREDICT_SIMD_AVX2:
+		return select_acc<avx2_ops, sse2_ops>(data_bytes, stride);
+#endif
+#if defined(PREDICT_HAS_AVX512) && defined(PREDICT_HAS_SSE2)
+	case PREDICT_SIMD_AVX512:
+		return select_acc<avx512_ops, sse2_ops>(data_bytes, stride);
+#endif
+#ifdef PREDICT_HAS_NEON
+	case PREDICT_SIMD_NEON:
+		return select_acc<neon_ops, neon_ops>(data_bytes, stride);
+#endif
+	default:
+		return nullptr;
+	}
+}
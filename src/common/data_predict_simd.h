@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+
+//Vectorized kernels of the horizontal predictor, used by data_predict.cpp only.
+//A kernel handles "height" rows of "row_size" bytes, "stride" is samples per pixel.
+typedef int(*rowsfunc)(void* data, unsigned int height, size_t row_size, unsigned short stride);
+
+//Highest PREDICT_SIMD_* level of this CPU which has kernels compiled in.
+int detect_simd_level();
+
+//Return nullptr when "simd_level" has no kernel for the data_bytes/stride combination, the caller falls back to scalar code.
+rowsfunc get_differencing_kernel(int simd_level, unsigned short data_bytes, unsigned short stride);
+rowsfunc get_acc_kernel(int simd_level, unsigned short data_bytes, unsigned short stride);
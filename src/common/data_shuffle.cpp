@@ -0,0 +1,317 @@
+#include "data_shuffle.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SHUFFLE_USE_SSE2
+#endif
+
+//Transpose a 8x8 bit matrix, bit k of byte m <-> bit m of byte k. (Hacker's Delight, transpose8)
+static inline uint64_t transpose_bits_8x8(uint64_t x)
+{
+	uint64_t t;
+	t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAULL;
+	x = x ^ t ^ (t << 7);
+	t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL;
+	x = x ^ t ^ (t << 14);
+	t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL;
+	x = x ^ t ^ (t << 28);
+	return x;
+}
+
+static void byte_shuffle_generic(const uint8_t* src, uint8_t* dst, size_t count, unsigned short type_size, size_t start)
+{
+	for (size_t i = start; i < count; i++)
+	{
+		const uint8_t* sp = src + i * type_size;
+		for (unsigned short j = 0; j < type_size; j++)
+			dst[j * count + i] = sp[j];
+	}
+}
+
+static void byte_unshuffle_generic(const uint8_t* src, uint8_t* dst, size_t count, unsigned short type_size, size_t start)
+{
+	for (size_t i = start; i < count; i++)
+	{
+		uint8_t* dp = dst + i * type_size;
+		for (unsigned short j = 0; j < type_size; j++)
+			dp[j] = src[j * count + i];
+	}
+}
+
+#ifdef SHUFFLE_USE_SSE2
+//16 elements in every loop
+static size_t byte_shuffle_16bits_sse2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i * 2));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i * 2 + 16));
+		__m128i lo = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+		__m128i hi = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+		_mm_storeu_si128((__m128i*)(dst + i), lo);
+		_mm_storeu_si128((__m128i*)(dst + count + i), hi);
+	}
+	return i;
+}
+
+static size_t byte_unshuffle_16bits_sse2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i lo = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(src + count + i));
+		_mm_storeu_si128((__m128i*)(dst + i * 2), _mm_unpacklo_epi8(lo, hi));
+		_mm_storeu_si128((__m128i*)(dst + i * 2 + 16), _mm_unpackhi_epi8(lo, hi));
+	}
+	return i;
+}
+
+//low / high 16 bits of every 32 bits, sign extended so that _mm_packs_epi32 keeps the exact value
+#define LOW_WORDS(v) _mm_srai_epi32(_mm_slli_epi32(v, 16), 16)
+#define HIGH_WORDS(v) _mm_srai_epi32(v, 16)
+
+static size_t byte_shuffle_32bits_sse2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	const __m128i mask = _mm_set1_epi16(0x00ff);
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)(src + i * 4));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i * 4 + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + i * 4 + 32));
+		__m128i d = _mm_loadu_si128((const __m128i*)(src + i * 4 + 48));
+
+		__m128i l0 = _mm_packs_epi32(LOW_WORDS(a), LOW_WORDS(b));
+		__m128i l1 = _mm_packs_epi32(LOW_WORDS(c), LOW_WORDS(d));
+		__m128i h0 = _mm_packs_epi32(HIGH_WORDS(a), HIGH_WORDS(b));
+		__m128i h1 = _mm_packs_epi32(HIGH_WORDS(c), HIGH_WORDS(d));
+
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(_mm_and_si128(l0, mask), _mm_and_si128(l1, mask)));
+		_mm_storeu_si128((__m128i*)(dst + count + i), _mm_packus_epi16(_mm_srli_epi16(l0, 8), _mm_srli_epi16(l1, 8)));
+		_mm_storeu_si128((__m128i*)(dst + 2 * count + i), _mm_packus_epi16(_mm_and_si128(h0, mask), _mm_and_si128(h1, mask)));
+		_mm_storeu_si128((__m128i*)(dst + 3 * count + i), _mm_packus_epi16(_mm_srli_epi16(h0, 8), _mm_srli_epi16(h1, 8)));
+	}
+	return i;
+}
+
+static size_t byte_unshuffle_32bits_sse2(const uint8_t* src, uint8_t* dst, size_t count)
+{
+	size_t i = 0;
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(src + count + i));
+		__m128i b2 = _mm_loadu_si128((const __m128i*)(src + 2 * count + i));
+		__m128i b3 = _mm_loadu_si128((const __m128i*)(src + 3 * count + i));
+
+		__m128i w01_lo = _mm_unpacklo_epi8(b0, b1);
+		__m128i w01_hi = _mm_unpackhi_epi8(b0, b1);
+		__m128i w23_lo = _mm_unpacklo_epi8(b2, b3);
+		__m128i w23_hi = _mm_unpackhi_epi8(b2, b3);
+
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_unpacklo_epi16(w01_lo, w23_lo));
+		_mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_unpackhi_epi16(w01_lo, w23_lo));
+		_mm_storeu_si128((__m128i*)(dst + i * 4 + 32), _mm_unpacklo_epi16(w01_hi, w23_hi));
+		_mm_storeu_si128((__m128i*)(dst + i * 4 + 48), _mm_unpackhi_epi16(w01_hi, w23_hi));
+	}
+	return i;
+}
+#endif
+
+int byte_shuffle(const void* src, void* dst, size_t size, unsigned short type_size)
+{
+	if (src == nullptr || dst == nullptr) return -1;
+	if (type_size == 0) return -2;
+
+	const uint8_t* sp = (const uint8_t*)src;
+	uint8_t* dp = (uint8_t*)dst;
+	size_t count = size / type_size;
+	size_t done = 0;
+
+#ifdef SHUFFLE_USE_SSE2
+	if (type_size == 2)
+		done = byte_shuffle_16bits_sse2(sp, dp, count);
+	else if (type_size == 4)
+		done = byte_shuffle_32bits_sse2(sp, dp, count);
+#endif
+	byte_shuffle_generic(sp, dp, count, type_size, done);
+
+	size_t used = count * type_size;
+	if (size > used)
+		memcpy(dp + used, sp + used, size - used);
+	return 0;
+}
+
+int byte_unshuffle(const void* src, void* dst, size_t size, unsigned short type_size)
+{
+	if (src == nullptr || dst == nullptr) return -1;
+	if (type_size == 0) return -2;
+
+	const uint8_t* sp = (const uint8_t*)src;
+	uint8_t* dp = (uint8_t*)dst;
+	size_t count = size / type_size;
+	size_t done = 0;
+
+#ifdef SHUFFLE_USE_SSE2
+	if (type_size == 2)
+		done = byte_unshuffle_16bits_sse2(sp, dp, count);
+	else if (type_size == 4)
+		done = byte_unshuffle_32bits_sse2(sp, dp, count);
+#endif
+	byte_unshuffle_generic(sp, dp, count, type_size, done);
+
+	size_t used = count * type_size;
+	if (size > used)
+		memcpy(dp + used, sp + used, size - used);
+	return 0;
+}
+
+//bytes of one plane -> 8 bit planes, plane_size must be a multiple of 8
+static void bit_transpose_plane(const uint8_t* plane, uint8_t* dst, size_t plane_size)
+{
+	size_t bit_plane_size = plane_size / 8;
+	size_t i = 0;
+#ifdef SHUFFLE_USE_SSE2
+	for (; i + 16 <= plane_size; i += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i*)(plane + i));
+		for (int k = 7; k >= 0; k--)
+		{
+			int mask = _mm_movemask_epi8(x);
+			uint8_t* bp = dst + k * bit_plane_size + i / 8;
+			bp[0] = (uint8_t)(mask & 0xff);
+			bp[1] = (uint8_t)((mask >> 8) & 0xff);
+			x = _mm_add_epi8(x, x);
+		}
+	}
+#endif
+	for (; i < plane_size; i += 8)
+	{
+		uint64_t x;
+		memcpy(&x, plane + i, 8);
+		x = transpose_bits_8x8(x);
+		for (int k = 0; k < 8; k++)
+			dst[k * bit_plane_size + i / 8] = (uint8_t)(x >> (8 * k));
+	}
+}
+
+static void bit_untranspose_plane(const uint8_t* src, uint8_t* plane, size_t plane_size)
+{
+	size_t bit_plane_size = plane_size / 8;
+	for (size_t i = 0; i < plane_size; i += 8)
+	{
+		uint64_t x = 0;
+		for (int k = 0; k < 8; k++)
+			x |= (uint64_t)src[k * bit_plane_size + i / 8] << (8 * k);
+		x = transpose_bits_8x8(x);
+		memcpy(plane + i, &x, 8);
+	}
+}
+
+int bit_shuffle(const void* src, void* dst, size_t size, unsigned short type_size)
+{
+	if (src == nullptr || dst == nullptr) return -1;
+	if (type_size == 0) return -2;
+
+	const uint8_t* sp = (const uint8_t*)src;
+	uint8_t* dp = (uint8_t*)dst;
+	size_t count = size / type_size;
+	count -= count % 8;
+	size_t used = count * type_size;
+
+	if (count > 0)
+	{
+		uint8_t* planes = nullptr;
+		if (type_size > 1)
+		{
+			planes = (uint8_t*)malloc(used);
+			if (planes == nullptr) return -3;
+			byte_shuffle(sp, planes, used, type_size);
+		}
+
+		const uint8_t* pp = planes == nullptr ? sp : planes;
+		for (unsigned short j = 0; j < type_size; j++)
+			bit_transpose_plane(pp + j * count, dp + j * count, count);
+
+		if (planes != nullptr) free(planes);
+	}
+
+	if (size > used)
+		memcpy(dp + used, sp + used, size - used);
+	return 0;
+}
+
+int bit_unshuffle(const void* src, void* dst, size_t size, unsigned short type_size)
+{
+	if (src == nullptr || dst == nullptr) return -1;
+	if (type_size == 0) return -2;
+
+	const uint8_t* sp = (const uint8_t*)src;
+	uint8_t* dp = (uint8_t*)dst;
+	size_t count = size / type_size;
+	count -= count % 8;
+	size_t used = count * type_size;
+
+	if (count > 0)
+	{
+		uint8_t* planes = dp;
+		if (type_size > 1)
+		{
+			planes = (uint8_t*)malloc(used);
+			if (planes == nullptr) return -3;
+		}
+
+		for (unsigned short j = 0; j < type_size; j++)
+			bit_untranspose_plane(sp + j * count, planes + j * count, count);
+
+		if (planes != dp)
+		{
+			byte_unshuffle(planes, dp, used, type_size);
+			free(planes);
+		}
+	}
+
+	if (size > used)
+		memcpy(dp + used, sp + used, size - used);
+	return 0;
+}
+
+int data_shuffle(const void* src, void* dst, size_t size, unsigned short type_size, unsigned short mode)
+{
+	switch (mode)
+	{
+	case 0:
+		if (src == nullptr || dst == nullptr) return -1;
+		memcpy(dst, src, size);
+		return 0;
+	case 1:
+		return byte_shuffle(src, dst, size, type_size);
+	case 2:
+		return bit_shuffle(src, dst, size, type_size);
+	default:
+		return -4;
+	}
+}
+
+int data_unshuffle(const void* src, void* dst, size_t size, unsigned short type_size, unsigned short mode)
+{
+	switch (mode)
+	{
+	case 0:
+		if (src == nullptr || dst == nullptr) return -1;
+		memcpy(dst, src, size);
+		return 0;
+	case 1:
+		return byte_unshuffle(src, dst, size, type_size);
+	case 2:
+		return bit_unshuffle(src, dst, size, type_size);
+	default:
+		return -4;
+	}
+}
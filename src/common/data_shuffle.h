@@ -0,0 +1,19 @@
+#pragma once
+#include <stddef.h>
+
+//Byte shuffle : regroup the n-th byte of every element together, so the high (mostly equal) bytes of 16/32 bits data become long runs.
+//Bit shuffle : byte shuffle first, then regroup the same bit of every byte plane together.
+//Elements which can not fill a complete group are copied without change to the end of destination.
+//src and dst must not overlap. Return 0 when success.
+
+//encode
+int byte_shuffle(const void* src, void* dst, size_t size, unsigned short type_size);
+int bit_shuffle(const void* src, void* dst, size_t size, unsigned short type_size);
+
+//decode
+int byte_unshuffle(const void* src, void* dst, size_t size, unsigned short type_size);
+int bit_unshuffle(const void* src, void* dst, size_t size, unsigned short type_size);
+
+//mode : 0 copy only, 1 byte shuffle, 2 bit shuffle. Same value as SHUFFLE_* of TIFFTAG_SHUFFLE.
+int data_shuffle(const void* src, void* dst, size_t size, unsigned short type_size, unsigned short mode);
+int data_unshuffle(const void* src, void* dst, size_t size, unsigned short type_size, unsigned short mode);
@@ -0,0 +1,155 @@
+#include "image_reduce.h"
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+//MSVC accepts every intrinsic, other compilers only those enabled for the build.
+#if defined(_MSC_VER) || defined(__SSE2__)
+#define REDUCE_HAS_SSE2
+#endif
+#endif
+
+//Scalar kernel, from destination column "x" to the end of the row. row1 is row0 for an odd last row.
+template<typename T>
+static void reduce_row_int(const uint8_t* row0, const uint8_t* row1, unsigned int width, unsigned short samples, unsigned int x, uint8_t* dst)
+{
+	const T* src0 = (const T*)row0;
+	const T* src1 = (const T*)row1;
+	T* out = (T*)dst;
+	unsigned int dst_width = (width + 1) / 2;
+	for (; x < dst_width; x++)
+	{
+		size_t left = (size_t)x * 2 * samples;
+		size_t right = x * 2 + 1 < width ? left + samples : left;
+		for (unsigned short s = 0; s < samples; s++)
+		{
+			int32_t sum = (int32_t)src0[left + s] + src0[right + s] + src1[left + s] + src1[right + s];
+			out[(size_t)x * samples + s] = (T)((sum + 2) >> 2);
+		}
+	}
+}
+
+static void reduce_row_float(const uint8_t* row0, const uint8_t* row1, unsigned int width, unsigned short samples, unsigned int x, uint8_t* dst)
+{
+	const float* src0 = (const float*)row0;
+	const float* src1 = (const float*)row1;
+	float* out = (float*)dst;
+	unsigned int dst_width = (width + 1) / 2;
+	for (; x < dst_width; x++)
+	{
+		size_t left = (size_t)x * 2 * samples;
+		size_t right = x * 2 + 1 < width ? left + samples : left;
+		for (unsigned short s = 0; s < samples; s++)
+			out[(size_t)x * samples + s] = (src0[left + s] + src0[right + s] + src1[left + s] + src1[right + s]) * 0.25f;
+	}
+}
+
+#ifdef REDUCE_HAS_SSE2
+//Vector kernels for 1 sample per pixel, they only read whole pairs of source columns and return the first destination column left.
+static unsigned int reduce_row_u8_sse2(const uint8_t* row0, const uint8_t* row1, unsigned int width, uint8_t* dst)
+{
+	const __m128i low_mask = _mm_set1_epi16(0x00FF);
+	const __m128i round = _mm_set1_epi16(2);
+	unsigned int x = 0;
+	for (; (x + 16) * 2 <= width; x += 16)
+	{
+		__m128i sum[2];
+		for (int i = 0; i < 2; i++)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 2 + i * 16));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 2 + i * 16));
+			__m128i s = _mm_add_epi16(_mm_and_si128(a, low_mask), _mm_srli_epi16(a, 8));
+			s = _mm_add_epi16(s, _mm_add_epi16(_mm_and_si128(b, low_mask), _mm_srli_epi16(b, 8)));
+			sum[i] = _mm_srli_epi16(_mm_add_epi16(s, round), 2);
+		}
+		_mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(sum[0], sum[1]));
+	}
+	return x;
+}
+
+static unsigned int reduce_row_u16_sse2(const uint8_t* row0, const uint8_t* row1, unsigned int width, uint8_t* dst)
+{
+	const __m128i low_mask = _mm_set1_epi32(0xFFFF);
+	const __m128i round = _mm_set1_epi32(2);
+	//packs_epi32 saturates to signed, so the sums are moved to the signed range and back
+	const __m128i bias32 = _mm_set1_epi32(0x8000);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+	unsigned int x = 0;
+	for (; (x + 8) * 2 <= width; x += 8)
+	{
+		__m128i sum[2];
+		for (int i = 0; i < 2; i++)
+		{
+			__m128i a = _mm_loadu_si128((const __m128i*)(row0 + (x * 2 + i * 8) * 2));
+			__m128i b = _mm_loadu_si128((const __m128i*)(row1 + (x * 2 + i * 8) * 2));
+			__m128i s = _mm_add_epi32(_mm_and_si128(a, low_mask), _mm_srli_epi32(a, 16));
+			s = _mm_add_epi32(s, _mm_add_epi32(_mm_and_si128(b, low_mask), _mm_srli_epi32(b, 16)));
+			sum[i] = _mm_sub_epi32(_mm_srli_epi32(_mm_add_epi32(s, round), 2), bias32);
+		}
+		_mm_storeu_si128((__m128i*)(dst + x * 2), _mm_xor_si128(_mm_packs_epi32(sum[0], sum[1]), bias16));
+	}
+	return x;
+}
+
+static unsigned int reduce_row_f32_sse2(const uint8_t* row0, const uint8_t* row1, unsigned int width, uint8_t* dst)
+{
+	const float* src0 = (const float*)row0;
+	const float* src1 = (const float*)row1;
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	unsigned int x = 0;
+	for (; (x + 4) * 2 <= width; x += 4)
+	{
+		__m128 a0 = _mm_loadu_ps(src0 + x * 2);
+		__m128 a1 = _mm_loadu_ps(src0 + x * 2 + 4);
+		__m128 b0 = _mm_loadu_ps(src1 + x * 2);
+		__m128 b1 = _mm_loadu_ps(src1 + x * 2 + 4);
+		__m128 s = _mm_add_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3, 1, 3, 1)));
+		s = _mm_add_ps(s, _mm_add_ps(_mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3, 1, 3, 1))));
+		_mm_storeu_ps((float*)dst + x, _mm_mul_ps(s, quarter));
+	}
+	return x;
+}
+#endif
+
+int image_reduce_2x2(const void* src, unsigned int width, unsigned int height, size_t src_stride, unsigned short data_bytes, unsigned short samples_per_pixel,
+	int sample_format, void* dst, size_t dst_stride)
+{
+	if (src == nullptr || dst == nullptr || width == 0 || height == 0 || samples_per_pixel == 0)
+		return -1;
+	bool is_float = sample_format == IMAGE_REDUCE_FLOAT;
+	bool is_signed = sample_format == IMAGE_REDUCE_INT;
+	if (is_float ? data_bytes != 4 : (data_bytes != 1 && data_bytes != 2))
+		return -2;
+
+	unsigned int dst_height = (height + 1) / 2;
+	for (unsigned int y = 0; y < dst_height; y++)
+	{
+		const uint8_t* row0 = (const uint8_t*)src + (size_t)y * 2 * src_stride;
+		const uint8_t* row1 = y * 2 + 1 < height ? row0 + src_stride : row0;
+		uint8_t* out = (uint8_t*)dst + (size_t)y * dst_stride;
+
+		unsigned int x = 0;
+#ifdef REDUCE_HAS_SSE2
+		if (samples_per_pixel == 1 && !is_signed)
+		{
+			if (is_float)
+				x = reduce_row_f32_sse2(row0, row1, width, out);
+			else if (data_bytes == 1)
+				x = reduce_row_u8_sse2(row0, row1, width, out);
+			else
+				x = reduce_row_u16_sse2(row0, row1, width, out);
+		}
+#endif
+		if (is_float)
+			reduce_row_float(row0, row1, width, samples_per_pixel, x, out);
+		else if (data_bytes == 1 && is_signed)
+			reduce_row_int<int8_t>(row0, row1, width, samples_per_pixel, x, out);
+		else if (data_bytes == 1)
+			reduce_row_int<uint8_t>(row0, row1, width, samples_per_pixel, x, out);
+		else if (is_signed)
+			reduce_row_int<int16_t>(row0, row1, width, samples_per_pixel, x, out);
+		else
+			reduce_row_int<uint16_t>(row0, row1, width, samples_per_pixel, x, out);
+	}
+	return 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <stddef.h>
+
+//Sample formats, same values as the TIFF SampleFormat tag.
+#define IMAGE_REDUCE_UINT	1
+#define IMAGE_REDUCE_INT	2
+#define IMAGE_REDUCE_FLOAT	3
+
+//Halve an image in both directions, every destination pixel is the average of a 2x2 source pixels area.
+//The destination has (width + 1) / 2 columns and (height + 1) / 2 rows, an odd last column or row is averaged with itself.
+//Integers are rounded to the nearest value. 8/16 bits integer and 32 bits floating point data are supported,
+//1 sample per pixel is vectorized, other cases run the scalar code. Return 0 when success.
+int image_reduce_2x2(const void* src, unsigned int width, unsigned int height, size_t src_stride, unsigned short data_bytes, unsigned short samples_per_pixel,
+	int sample_format, void* dst, size_t dst_stride);
@@ -0,0 +1,167 @@
+#include "image_resample.h"
+#include <stdint.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+//MSVC accepts every intrinsic, other compilers only those enabled for the build.
+#if defined(_MSC_VER) || defined(__SSE2__)
+#define RESAMPLE_HAS_SSE2
+#endif
+#endif
+
+int image_resample_axis(unsigned int src_length, unsigned int dst_length, image_resample_tap* taps)
+{
+	if (src_length == 0 || dst_length == 0 || taps == nullptr)
+		return -1;
+
+	if (dst_length < src_length)
+	{
+		for (unsigned int i = 0; i < dst_length; i++)
+		{
+			unsigned int first = (unsigned int)((uint64_t)i * src_length / dst_length);
+			unsigned int end = (unsigned int)((uint64_t)(i + 1) * src_length / dst_length);
+			taps[i].first = first;
+			taps[i].count = end - first;
+			taps[i].first_weight = 1.0f / taps[i].count;
+			taps[i].weight = taps[i].first_weight;
+		}
+		return 0;
+	}
+
+	//pixel centers are aligned, positions out of the source take the edge pixel
+	double scale = (double)src_length / dst_length;
+	for (unsigned int i = 0; i < dst_length; i++)
+	{
+		double position = (i + 0.5) * scale - 0.5;
+		if (position < 0)
+			position = 0;
+		unsigned int first = (unsigned int)position;
+		if (first >= src_length - 1)
+		{
+			taps[i].first = src_length - 1;
+			taps[i].count = 1;
+			taps[i].first_weight = 1.0f;
+			taps[i].weight = 0.0f;
+			continue;
+		}
+		float fraction = (float)(position - first);
+		taps[i].first = first;
+		taps[i].count = fraction == 0.0f ? 1 : 2;
+		taps[i].first_weight = 1.0f - fraction;
+		taps[i].weight = fraction;
+	}
+	return 0;
+}
+
+template<typename T>
+static void resample_row(const T* src, unsigned short samples, const image_resample_tap* taps, unsigned int dst_width, float* dst)
+{
+	for (unsigned int x = 0; x < dst_width; x++)
+	{
+		const image_resample_tap& tap = taps[x];
+		const T* pixel = src + (size_t)tap.first * samples;
+		for (unsigned short s = 0; s < samples; s++)
+		{
+			float sum = 0;
+			for (unsigned int n = 1; n < tap.count; n++)
+				sum += (float)pixel[(size_t)n * samples + s];
+			dst[s] = (float)pixel[s] * tap.first_weight + sum * tap.weight;
+		}
+		dst += samples;
+	}
+}
+
+void image_resample_row(const void* src_row, unsigned short data_bytes, unsigned short samples_per_pixel, int sample_format,
+	const image_resample_tap* taps, unsigned int dst_width, float* dst_row)
+{
+	if (sample_format == IMAGE_REDUCE_FLOAT)
+		resample_row((const float*)src_row, samples_per_pixel, taps, dst_width, dst_row);
+	else if (data_bytes == 1 && sample_format == IMAGE_REDUCE_INT)
+		resample_row((const int8_t*)src_row, samples_per_pixel, taps, dst_width, dst_row);
+	else if (data_bytes == 1)
+		resample_row((const uint8_t*)src_row, samples_per_pixel, taps, dst_width, dst_row);
+	else if (sample_format == IMAGE_REDUCE_INT)
+		resample_row((const int16_t*)src_row, samples_per_pixel, taps, dst_width, dst_row);
+	else
+		resample_row((const uint16_t*)src_row, samples_per_pixel, taps, dst_width, dst_row);
+}
+
+void image_resample_add(float* dst, const float* src, float weight, size_t count)
+{
+	size_t i = 0;
+#ifdef RESAMPLE_HAS_SSE2
+	__m128 w = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), w)));
+#endif
+	for (; i < count; i++)
+		dst[i] += src[i] * weight;
+}
+
+template<typename T>
+static void store_int(const float* src, size_t i, size_t count, float min_value, float max_value, T* dst)
+{
+	for (; i < count; i++)
+	{
+		float v = floorf(src[i] + 0.5f);
+		dst[i] = (T)(v < min_value ? min_value : (v > max_value ? max_value : v));
+	}
+}
+
+void image_resample_store(const float* src, size_t count, unsigned short data_bytes, int sample_format, void* dst)
+{
+	size_t i = 0;
+	if (sample_format == IMAGE_REDUCE_FLOAT)
+	{
+		float* out = (float*)dst;
+		for (; i < count; i++)
+			out[i] = src[i];
+		return;
+	}
+	if (sample_format == IMAGE_REDUCE_INT)
+	{
+		if (data_bytes == 1)
+			store_int(src, 0, count, -128.0f, 127.0f, (int8_t*)dst);
+		else
+			store_int(src, 0, count, -32768.0f, 32767.0f, (int16_t*)dst);
+		return;
+	}
+
+#ifdef RESAMPLE_HAS_SSE2
+	//positive values : adding 0.5 and truncating rounds like the scalar code
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	if (data_bytes == 1)
+	{
+		const __m128 max_value = _mm_set1_ps(255.0f);
+		uint8_t* out = (uint8_t*)dst;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i a = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_loadu_ps(src + i), half), zero), max_value));
+			__m128i b = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_loadu_ps(src + i + 4), half), zero), max_value));
+			__m128i packed = _mm_packs_epi32(a, b);
+			_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(packed, packed));
+		}
+	}
+	else
+	{
+		//packs_epi32 saturates to signed, so the values are moved to the signed range and back
+		const __m128 max_value = _mm_set1_ps(65535.0f);
+		const __m128i bias32 = _mm_set1_epi32(0x8000);
+		const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+		uint16_t* out = (uint16_t*)dst;
+		for (; i + 8 <= count; i += 8)
+		{
+			__m128i a = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_loadu_ps(src + i), half), zero), max_value));
+			__m128i b = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_loadu_ps(src + i + 4), half), zero), max_value));
+			__m128i packed = _mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32));
+			_mm_storeu_si128((__m128i*)(out + i), _mm_xor_si128(packed, bias16));
+		}
+	}
+#endif
+	if (data_bytes == 1)
+		store_int(src, i, count, 0.0f, 255.0f, (uint8_t*)dst);
+	else
+		store_int(src, i, count, 0.0f, 65535.0f, (uint16_t*)dst);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stddef.h>
+#include "image_reduce.h"
+
+//Separable resampling of an image to another size, one row at a time so the source can be decoded band by band.
+//A smaller axis averages all the source pixels covered by each destination pixel (box filter),
+//a larger or equal axis interpolates between the 2 nearest source pixels (bilinear filter).
+//Rows are resampled horizontally into floats, then weighted rows are added into a destination row.
+
+//Source pixels of one destination pixel along an axis: "count" pixels from "first".
+//Box : all of them have the same weight. Bilinear : 1 or 2 pixels.
+struct image_resample_tap
+{
+	unsigned int first;
+	unsigned int count;
+	float first_weight;		//weight of the first pixel
+	float weight;			//weight of the other pixels
+};
+
+//Fill "taps" with "dst_length" taps. Return 0 when success.
+int image_resample_axis(unsigned int src_length, unsigned int dst_length, image_resample_tap* taps);
+
+//Resample one source row of any width into "dst_width" float pixels. sample_format is one of IMAGE_REDUCE_*.
+void image_resample_row(const void* src_row, unsigned short data_bytes, unsigned short samples_per_pixel, int sample_format,
+	const image_resample_tap* taps, unsigned int dst_width, float* dst_row);
+
+//dst[i] += src[i] * weight.
+void image_resample_add(float* dst, const float* src, float weight, size_t count);
+
+//Convert a float row to the sample type, integers are rounded and saturated.
+void image_resample_store(const float* src, size_t count, unsigned short data_bytes, int sample_format, void* dst);
@@ -1,9 +1,53 @@
+#include "jpeg_handler.h"
 #include "..\turbojpeg-2.0.6\turbojpeg.h"
 
-int jpeg_decompress(unsigned char* buf, unsigned char* encoded_buf, unsigned long encoded_size, int* width, int* height, int* samples)
+//Init a turbojpeg handle is not cheap (it allocates the whole libjpeg state), keep one of each kind per thread.
+class tj_thread_handle
+{
+public:
+	explicit tj_thread_handle(bool is_compress) : _is_compress(is_compress), _handle(nullptr) {}
+	~tj_thread_handle() { if (_handle != nullptr) tjDestroy(_handle); }
+
+	tjhandle get()
+	{
+		if (_handle == nullptr)
+			_handle = _is_compress ? tjInitCompress() : tjInitDecompress();
+		return _handle;
+	}
+
+private:
+	bool _is_compress;
+	tjhandle _handle;
+};
+
+static tjhandle get_compress_handle()
+{
+	thread_local tj_thread_handle handle(true);
+	return handle.get();
+}
+
+static tjhandle get_decompress_handle()
+{
+	thread_local tj_thread_handle handle(false);
+	return handle.get();
+}
+
+int jpeg_decompress_header(unsigned char* encoded_buf, unsigned long encoded_size, int* width, int* height, int* samples)
+{
+	tjhandle handle = get_decompress_handle();
+	if (handle == nullptr)
+		return -1;
+	int subsample, colorspace;
+	if (tjDecompressHeader3(handle, encoded_buf, encoded_size, width, height, &subsample, &colorspace) != 0)
+		return -1;
+	*samples = (subsample == TJSAMP_GRAY && colorspace == TJCS_GRAY) ? 1 : 3;
+	return 0;
+}
+
+int jpeg_decompress(unsigned char* buf, unsigned char* encoded_buf, unsigned long encoded_size, int* width, int* height, int* samples, int pitch)
 {
 	int ret = -1;
-	tjhandle handle = tjInitDecompress();
+	tjhandle handle = get_decompress_handle();
 	if (handle == nullptr)
 		return -1;
 	int subsample, colorspace;
@@ -16,21 +60,17 @@ int jpeg_decompress(unsigned char* buf, unsigned char* encoded_buf, unsigned lon
 			pixelFormat = TJPF_GRAY;
 			*samples = 1;
 		}
-		ret = tjDecompress2(handle, encoded_buf, encoded_size, buf, *width, 0, *height, pixelFormat, TJFLAG_ACCURATEDCT);
+		ret = tjDecompress2(handle, encoded_buf, encoded_size, buf, *width, pitch, *height, pixelFormat, TJFLAG_ACCURATEDCT);
 	}
-	tjDestroy(handle);
 	return ret;
 }
 
 int jpeg_compress(unsigned char* buf, unsigned char** encoded_buf, unsigned long* encoded_size, unsigned long width, unsigned long height, int pitch, int pixelFormat, int subsamples)
 {
-	int ret = -1;
-	tjhandle handle = tjInitCompress();
+	tjhandle handle = get_compress_handle();
 	if (handle == nullptr)
 		return -1;
-	ret = tjCompress2(handle, buf, width, pitch, height, pixelFormat, encoded_buf, encoded_size, subsamples, 99, TJFLAG_ACCURATEDCT);
-	tjDestroy(handle);
-	return ret;
+	return tjCompress2(handle, buf, width, pitch, height, pixelFormat, encoded_buf, encoded_size, subsamples, 99, TJFLAG_ACCURATEDCT);
 }
 
 void jpeg_free(unsigned char* buffer)
@@ -1,5 +1,16 @@
 #pragma once
-int jpeg_decompress(unsigned char* buf, unsigned char* encoded_buf, unsigned long encoded_size, int* width, int* height, int* samples);
+//Same value as TJPF_* and TJSAMP_* in turbojpeg.h, so that callers need not include it.
+#define JPEG_PIXEL_FORMAT_RGB		0	//TJPF_RGB
+#define JPEG_PIXEL_FORMAT_GRAY		6	//TJPF_GRAY
+#define JPEG_SUBSAMPLE_420			2	//TJSAMP_420
+#define JPEG_SUBSAMPLE_GRAY			3	//TJSAMP_GRAY
+
+//Compressor and decompressor handles are created once per thread and reused, these functions can be called from many threads at the same time.
+
+//pitch : byte count of one row in "buf", 0 means width * samples.
+int jpeg_decompress(unsigned char* buf, unsigned char* encoded_buf, unsigned long encoded_size, int* width, int* height, int* samples, int pitch = 0);
+//Only read the size of encoded image, no data is decompressed.
+int jpeg_decompress_header(unsigned char* encoded_buf, unsigned long encoded_size, int* width, int* height, int* samples);
 //Default : save gray image, pixelFormat --- 6 --- TJPF_GRAY; subsamples --- 3 ---TJSAMP_GRAY
 int jpeg_compress(unsigned char* buf, unsigned char** encoded_buf, unsigned long* encoded_size, unsigned long width, unsigned long height, int pitch = 0, int pixelFormat = 6, int subsamples = 3);
 
@@ -8,4 +19,4 @@ int jpeg_compress(unsigned char* buf, unsigned char** encoded_buf, unsigned long
 //If pass an allocated encoded_buf, then JpegLib may re-alloc encoded_buf, you must call tjFree(unsigned char* buffer) to free also.
 //If you really want manage encoded_buf yourself, you must setting #TJFLAG_NOREALLOC for JpegLib to guarantee JpegLib won't re-alloc buffer.
 //See document : turbojepeg.h --- Line:706~Line715 & Line:1633~Line:1637
-void jpeg_free(unsigned char* buffer);
\ No newline at end of file
+void jpeg_free(unsigned char* buffer);
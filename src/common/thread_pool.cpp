@@ -0,0 +1,210 @@
+#include "thread_pool.h"
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+//A running loop. Helpers hold it by shared_ptr as they may start after the caller has returned, they do nothing then.
+struct parallel_loop
+{
+	const function<void(int32_t, uint32_t)>* body;
+	int32_t count;
+	atomic<int32_t> next_index;
+	atomic<uint32_t> next_participant;
+	mutex loop_mutex;
+	condition_variable loop_cv;
+	bool closed;		//the caller ran out of indices, no helper may join anymore
+	uint32_t active;	//helpers running the body
+
+	void run(uint32_t participant)
+	{
+		for (int32_t i = next_index++; i < count; i = next_index++)
+			(*body)(i, participant);
+	}
+};
+
+typedef function<void()> pool_task;
+
+//Every worker has its own queue, it takes its newest task first and steals the oldest tasks of the others when idle.
+class thread_pool
+{
+public:
+	thread_pool(uint32_t worker_count) : _queues(worker_count), _next_queue(0), _pending(0), _idle(0)
+	{
+		for (uint32_t i = 0; i < worker_count; i++)
+			_queues[i].reset(new worker_queue());
+		for (uint32_t i = 0; i < worker_count; i++)
+			thread(&thread_pool::work, this, i).detach();
+	}
+
+	uint32_t worker_count() const { return (uint32_t)_queues.size(); }
+
+	//Number of helpers worth submitting now : more would only wait in the queues.
+	uint32_t idle_count() const { return _idle.load(); }
+
+	void submit(pool_task task)
+	{
+		worker_queue& queue = *_queues[_next_queue++ % _queues.size()];
+		{
+			lock_guard<mutex> lock(queue.queue_mutex);
+			queue.tasks.push_back(std::move(task));
+		}
+		{
+			lock_guard<mutex> lock(_idle_mutex);
+			_pending++;
+		}
+		_idle_cv.notify_one();
+	}
+
+private:
+	struct worker_queue
+	{
+		mutex queue_mutex;
+		deque<pool_task> tasks;
+	};
+
+	bool take(uint32_t worker, pool_task& task)
+	{
+		size_t queue_count = _queues.size();
+		for (size_t n = 0; n < queue_count; n++)
+		{
+			worker_queue& queue = *_queues[(worker + n) % queue_count];
+			lock_guard<mutex> lock(queue.queue_mutex);
+			if (queue.tasks.empty())
+				continue;
+			if (n == 0) {
+				task = std::move(queue.tasks.back());
+				queue.tasks.pop_back();
+			}
+			else {
+				task = std::move(queue.tasks.front());
+				queue.tasks.pop_front();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	void work(uint32_t worker)
+	{
+		while (true)
+		{
+			{
+				unique_lock<mutex> lock(_idle_mutex);
+				_idle++;
+				_idle_cv.wait(lock, [this] { return _pending > 0; });
+				_idle--;
+				_pending--;
+			}
+			pool_task task;
+			if (take(worker, task))
+				task();
+		}
+	}
+
+	vector<unique_ptr<worker_queue>> _queues;
+	atomic<uint32_t> _next_queue;
+	mutex _idle_mutex;
+	condition_variable _idle_cv;
+	uint32_t _pending;			//tasks submitted and not taken yet
+	atomic<uint32_t> _idle;
+};
+
+static atomic<uint32_t> g_max_threads(0);
+
+static uint32_t processor_count()
+{
+	uint32_t count = thread::hardware_concurrency();
+	return count == 0 ? 1 : count;
+}
+
+//Created on first use and never deleted : the workers are detached and end with the process,
+//joining them from static destructors could dead lock when a library is unloaded.
+//Loops are helped by one thread less than the processors, as their caller runs too, but at least one worker runs the submitted tasks.
+static thread_pool& get_pool()
+{
+	static thread_pool* pool = new thread_pool(processor_count() > 1 ? processor_count() - 1 : 1);
+	return *pool;
+}
+
+void thread_pool_set_max_threads(uint32_t max_threads)
+{
+	g_max_threads = max_threads;
+}
+
+uint32_t thread_pool_get_threads(uint32_t max_threads)
+{
+	uint32_t process_max = g_max_threads.load();
+	if (process_max == 0)
+		process_max = processor_count();
+	if (max_threads == 0 || max_threads > process_max)
+		max_threads = process_max;
+	return max_threads;
+}
+
+void thread_pool_submit(const function<void()>& task)
+{
+	get_pool().submit(task);
+}
+
+void thread_pool_parallel_for(int32_t count, uint32_t max_threads, const function<void(int32_t index, uint32_t participant)>& body)
+{
+	if (count <= 0)
+		return;
+	uint32_t threads = thread_pool_get_threads(max_threads);
+	if ((uint32_t)count < threads)
+		threads = (uint32_t)count;
+
+	uint32_t helpers = 0;
+	if (threads > 1)
+	{
+		thread_pool& pool = get_pool();
+		helpers = threads - 1;
+		if (helpers > pool.idle_count())
+			helpers = pool.idle_count();
+	}
+	if (helpers == 0)
+	{
+		for (int32_t i = 0; i < count; i++)
+			body(i, 0);
+		return;
+	}
+
+	shared_ptr<parallel_loop> loop = make_shared<parallel_loop>();
+	loop->body = &body;
+	loop->count = count;
+	loop->next_index = 0;
+	loop->next_participant = 1;
+	loop->closed = false;
+	loop->active = 0;
+
+	thread_pool& pool = get_pool();
+	for (uint32_t i = 0; i < helpers; i++)
+	{
+		pool.submit([loop]() {
+			{
+				lock_guard<mutex> lock(loop->loop_mutex);
+				if (loop->closed)
+					return;
+				loop->active++;
+			}
+			loop->run(loop->next_participant++);
+			{
+				lock_guard<mutex> lock(loop->loop_mutex);
+				loop->active--;
+			}
+			loop->loop_cv.notify_all();
+		});
+	}
+
+	loop->run(0);
+	unique_lock<mutex> lock(loop->loop_mutex);
+	loop->closed = true;
+	loop->loop_cv.wait(lock, [&loop] { return loop->active == 0; });
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <functional>
+
+//Worker threads shared by the libraries and codecs, instead of OpenMP which changes the thread settings of the whole host process.
+//A parallel loop is run by the calling thread, helped by the idle pool threads. When the pool is busy the caller runs the
+//whole loop itself, so concurrent or nested loops neither oversubscribe the CPU nor wait for each other.
+
+//Most threads, the caller included, one loop may use in this process. 0 means one per processor, which is the default.
+void thread_pool_set_max_threads(uint32_t max_threads);
+
+//Threads a loop with the limit "max_threads" may use: the process limit when "max_threads" is 0, never more than it.
+uint32_t thread_pool_get_threads(uint32_t max_threads);
+
+//Call body(index, participant) for every index of [0, count), with at most thread_pool_get_threads(max_threads) threads.
+//"participant" is unique among the threads running the loop and lower than that count, e.g. to use per thread buffers.
+//Return when all indices are done.
+void thread_pool_parallel_for(int32_t count, uint32_t max_threads, const std::function<void(int32_t index, uint32_t participant)>& body);
+
+//Run "task" on a pool thread and return at once, e.g. for background work which must not add threads of its own.
+//The caller must make sure the objects used by "task" live until it ends.
+void thread_pool_submit(const std::function<void()>& task);
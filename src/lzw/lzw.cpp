@@ -423,16 +423,50 @@ LZWPostEncode(LZWCodecState* sp, void* output_data, void* output_data_current_po
 //LZWDecode(uint8* op0, tmsize_t occ0, uint16 s)
 int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uint64_t max_output_size)
 {
-	char *op = (char*)output_data;
-	long occ = (long)max_output_size;
-	char *tp;
+	int64_t size = LZWDecodeRows(input_data, input_data_size, output_data, max_output_size, 1, 0, NULL, NULL);
+	return size < 0 ? 0 : (int)size;
+}
+
+int64_t LZWDecodeRows(void* input_data, uint64_t input_data_size, void* output_data, uint64_t row_size, uint64_t rows, uint64_t output_stride, LZWRowCallback row_callback, void* user_data)
+{
+	if (row_size == 0 || rows == 0)
+		return 0;
+
+	unsigned char* row_start = (unsigned char*)output_data;
+	unsigned char* op = row_start;
+	uint64_t row_left = row_size;
+	uint64_t row_index = 0;
+	uint64_t decoded_size = 0;
+	bool done = false, failed = false;
+
+	unsigned char *tp;
 	unsigned char *bp;
 	hcode_t code;
 	int len;
-	long nbits = 0, nextbits = BITS_MIN, nbitsmask = MAXCODE(BITS_MIN);;
+	long nbits = 0, nextbits = BITS_MIN, nbitsmask = MAXCODE(BITS_MIN);
 	unsigned long nextdata;
 	code_t *codep, *free_entp = NULL, *maxcodep = NULL, *oldcodep = NULL;
-	code_t* dec_codetab = (code_t*)malloc(CSIZE * sizeof(code_t));
+	//string buffer behind the table, for strings which cross the end of a row
+	code_t* dec_codetab = (code_t*)malloc(CSIZE * sizeof(code_t) + CSIZE);
+	if (dec_codetab == NULL)
+		return -1;
+	unsigned char* string_buf = (unsigned char*)(dec_codetab + CSIZE);
+
+	//hand the completed row to the callback and move to the next one
+	auto finish_row = [&]() {
+		decoded_size += row_size;
+		int cb_status = row_callback == NULL ? 0 : row_callback(row_start, row_index, user_data);
+		row_index++;
+		if (cb_status < 0)
+			failed = true;
+		if (cb_status != 0 || row_index == rows) {
+			done = true;
+			return;
+		}
+		row_start += output_stride;
+		op = row_start;
+		row_left = row_size;
+	};
 
 	/*
 	* Pre-load the table.
@@ -452,54 +486,6 @@ int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uin
 	free_entp = dec_codetab + CODE_FIRST;
 	oldcodep = &dec_codetab[-1];
 	maxcodep = &dec_codetab[nbitsmask - 1];
-	/*
-	Fail if value does not fit in long.
-	*/
-	//if ((tmsize_t)occ != occ0)
-	//	return (0);
-	/*
-	* Restart interrupted output operation.
-	*/
-	//if (sp->dec_restart) {
-	//	long residue;
-
-	//	codep = sp->dec_codep;
-	//	residue = codep->length - sp->dec_restart;
-	//	if (residue > occ) {
-	//		/*
-	//		* Residue from previous decode is sufficient
-	//		* to satisfy decode request.  Skip to the
-	//		* start of the decoded string, place decoded
-	//		* values in the output buffer, and return.
-	//		*/
-	//		sp->dec_restart += occ;
-	//		do {
-	//			codep = codep->next;
-	//		} while (--residue > occ && codep);
-	//		if (codep) {
-	//			tp = op + occ;
-	//			do {
-	//				*--tp = codep->value;
-	//				codep = codep->next;
-	//			} while (--occ && codep);
-	//		}
-	//		return (1);
-	//	}
-	//	/*
-	//	* Residue satisfies only part of the decode request.
-	//	*/
-	//	op += residue;
-	//	occ -= residue;
-	//	tp = op;
-	//	do {
-	//		int t;
-	//		--tp;
-	//		t = codep->value;
-	//		codep = codep->next;
-	//		*tp = (char)t;
-	//	} while (--residue && codep);
-	//	sp->dec_restart = 0;
-	//}
 
 	bp = (unsigned char *)input_data;
 #ifdef LZW_CHECKEOS
@@ -508,7 +494,7 @@ int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uin
 	nbits = BITS_MIN;
 	nextdata = 0;
 	nextbits = 0;
-	while (occ > 0) {
+	while (!done) {
 		NextCode(dec_bitsleft, bp, code, GetNextCode);
 		if (code == CODE_EOI)
 			break;
@@ -528,11 +514,12 @@ int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uin
 				/*			TIFFErrorExt(tif->tif_clientdata, tif->tif_name,
 								"LZWDecode: Corrupted LZW table at scanline %d",
 								tif->tif_row);*/
-				free(dec_codetab);
-				return (0);
+				failed = true;
+				break;
 			}
-			*op++ = (char)code;
-			occ--;
+			*op++ = (unsigned char)code;
+			if (--row_left == 0)
+				finish_row();
 			oldcodep = dec_codetab + code;
 			continue;
 		}
@@ -546,8 +533,8 @@ int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uin
 			//TIFFErrorExt(tif->tif_clientdata, module,
 			//	"Corrupted LZW table at scanline %d",
 			//	tif->tif_row);
-			free(dec_codetab);
-			return (0);
+			failed = true;
+			break;
 		}
 
 		free_entp->next = oldcodep;
@@ -556,8 +543,8 @@ int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uin
 			//TIFFErrorExt(tif->tif_clientdata, module,
 			//	"Corrupted LZW table at scanline %d",
 			//	tif->tif_row);
-			free(dec_codetab);
-			return (0);
+			failed = true;
+			break;
 		}
 		free_entp->firstchar = free_entp->next->firstchar;
 		free_entp->length = free_entp->next->length + 1;
@@ -575,82 +562,58 @@ int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uin
 			* Code maps to a string, copy string
 			* value to output (written in reverse).
 			*/
-			if (codep->length == 0) {
+			if (codep->length == 0 || codep->length > CSIZE) {
 				//TIFFErrorExt(tif->tif_clientdata, module,
 				//	"Wrong length of decoded string: "
 				//	"data probably corrupted at scanline %d",
 				//	tif->tif_row);
-				free(dec_codetab);
-				return (0);
+				failed = true;
+				break;
 			}
-			//if (codep->length > occ) {
-			//	/*
-			//	* String is too long for decode buffer,
-			//	* locate portion that will fit, copy to
-			//	* the decode buffer, and setup restart
-			//	* logic for the next decoding call.
-			//	*/
-			//	sp->dec_codep = codep;
-			//	do {
-			//		codep = codep->next;
-			//	} while (codep && codep->length > occ);
-			//	if (codep) {
-			//		sp->dec_restart = (long)occ;
-			//		tp = op + occ;
-			//		do {
-			//			*--tp = codep->value;
-			//			codep = codep->next;
-			//		} while (--occ && codep);
-			//		if (codep)
-			//			codeLoop(tif, module);
-			//	}
-			//	break;
-			//}
 			len = codep->length;
-			tp = op + len;
+			//the string fits in the current row, write it in place
+			unsigned char* string_start = (uint64_t)len <= row_left ? op : string_buf;
+			tp = string_start + len;
 			do {
 				int t;
 				--tp;
 				t = codep->value;
 				codep = codep->next;
-				*tp = (char)t;
-			} while (codep && tp > op);
-			//if (codep) {
-			//	codeLoop(tif, module);
-			//	break;
-			//}
-			//assert(occ >= len);
-			op += len;
-			occ -= len;
+				*tp = (unsigned char)t;
+			} while (codep && tp > string_start);
+
+			if (string_start == op) {
+				op += len;
+				row_left -= len;
+				if (row_left == 0)
+					finish_row();
+			}
+			else {
+				//split the string over the following rows
+				unsigned char* sp = string_buf;
+				while (len > 0 && !done) {
+					uint64_t n = (uint64_t)len < row_left ? (uint64_t)len : row_left;
+					memcpy(op, sp, (size_t)n);
+					op += n;
+					sp += n;
+					len -= (int)n;
+					row_left -= n;
+					if (row_left == 0)
+						finish_row();
+				}
+			}
 		}
 		else {
-			*op++ = (char)code;
-			occ--;
+			*op++ = (unsigned char)code;
+			if (--row_left == 0)
+				finish_row();
 		}
 	}
 
-	//tif->tif_rawcc -= (tmsize_t)((uint8*)bp - tif->tif_rawcp);
-	//tif->tif_rawcp = (uint8*)bp;
-	//sp->lzw_nbits = (unsigned short)nbits;
-	//sp->lzw_nextdata = nextdata;
-	//sp->lzw_nextbits = nextbits;
-	//sp->dec_nbitsmask = nbitsmask;
-	//sp->dec_oldcodep = oldcodep;
-	//sp->dec_free_entp = free_entp;
-	//sp->dec_maxcodep = maxcodep;
-
-//	if (occ > 0) {
-//#if defined(__WIN32__) && (defined(_MSC_VER) || defined(__MINGW32__))
-//		TIFFErrorExt(tif->tif_clientdata, module,
-//			"Not enough data at scanline %d (short %I64d bytes)",
-//			tif->tif_row, (unsigned __int64)occ);
-//#else
-//		TIFFErrorExt(tif->tif_clientdata, module,
-//			"Not enough data at scanline %d (short %llu bytes)",
-//			tif->tif_row, (unsigned long long) occ);
-//#endif
-//		return (0);
-//	}
 	free(dec_codetab);
-	return (int)(op - (char*)output_data);
+	if (failed)
+		return -1;
+	if (!done)
+		decoded_size += row_size - row_left;
+	return (int64_t)decoded_size;
 }
@@ -3,8 +3,18 @@
 #if defined (__cplusplus)
 extern "C" {
 #endif
+//Output size which is always enough for LZWEncode, incompressible data grows at most by half (12 bits codes for 8 bits input).
+#define LZW_ENCODE_BOUND(size) ((size) + (size) / 2 + 16)
+//Return 1 when all input is encoded, 0 when max_output_size is reached first.
 int LZWEncode(void* raw_data, uint64_t raw_data_size, uint64_t* raw_data_used_size, void* output_data, uint64_t max_output_size, uint64_t* output_data_used_size);
 int LZWDecode(void* input_data, uint64_t input_data_size, void* output_data, uint64_t max_output_size);
+
+//Called when a row is completely decoded. Return 0 to go on, >0 to stop decoding, <0 to stop with error.
+typedef int(*LZWRowCallback)(void* row, uint64_t row_index, void* user_data);
+//Decode "rows" rows of "row_size" bytes, row n is written at output_data + n * output_stride, so the rows can go straight into
+//a strided image buffer. With output_stride 0 every row reuses the same buffer, it is only valid inside the callback.
+//Return the decoded byte count, or -1 if the data is corrupted or the callback fails.
+int64_t LZWDecodeRows(void* input_data, uint64_t input_data_size, void* output_data, uint64_t row_size, uint64_t rows, uint64_t output_stride, LZWRowCallback row_callback, void* user_data);
 #if defined (__cplusplus)
 }
 #endif
\ No newline at end of file
@@ -2,54 +2,138 @@
 #include <string>
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
 #include "tiff_core.h"
 #include "micro_tiff.h"
 
 using namespace std;
 
-static vector<tiff_core*> g_tiff_array;
+//Handles index fixed size segments which are never moved, so a file is found without any lock while other
+//files are opened or closed : writers of different files share nothing. The mutex only serializes open and close.
+//Calls count themselves as users of the slot, a closed file is deleted once the calls which found it are done.
+#define TIFF_SEGMENT_BITS	8
+#define TIFF_SEGMENT_SIZE	(1 << TIFF_SEGMENT_BITS)
+#define TIFF_MAX_SEGMENTS	256
+
+struct tiff_slot
+{
+	atomic<tiff_core*> tiff;
+	atomic<int32_t> users;
+};
+
+struct tiff_segment
+{
+	tiff_slot items[TIFF_SEGMENT_SIZE];
+};
+
+static atomic<tiff_segment*> g_tiff_segments[TIFF_MAX_SEGMENTS];
+static unique_ptr<tiff_segment> g_tiff_segment_owners[TIFF_MAX_SEGMENTS];
+static int32_t g_tiff_size = 0;
 static mutex g_tiff_mutex;
 
+static tiff_slot* get_slot(int32_t hdl)
+{
+	if (hdl < 0 || hdl >= TIFF_MAX_SEGMENTS * TIFF_SEGMENT_SIZE)
+		return nullptr;
+	tiff_segment* segment = g_tiff_segments[hdl >> TIFF_SEGMENT_BITS].load(memory_order_acquire);
+	if (segment == nullptr)
+		return nullptr;
+	return &segment->items[hdl & (TIFF_SEGMENT_SIZE - 1)];
+}
+
+//only with g_tiff_mutex locked, the file may be closed as soon as it is returned otherwise
+static tiff_core* get_tiff(int32_t hdl)
+{
+	tiff_slot* slot = get_slot(hdl);
+	return slot == nullptr ? nullptr : slot->tiff.load(memory_order_acquire);
+}
+
+static void set_tiff(int32_t hdl, tiff_core* tiff)
+{
+	get_slot(hdl)->tiff.store(tiff);
+}
+
+//The file of a handle, not deleted before this is destroyed even when the handle is closed meanwhile.
+//The user is counted before the file is read, so micro_tiff_Close either sees it or this sees the slot emptied.
+class tiff_ref
+{
+public:
+	explicit tiff_ref(int32_t hdl) : _slot(get_slot(hdl)), _tiff(nullptr)
+	{
+		if (_slot == nullptr)
+			return;
+		_slot->users.fetch_add(1);
+		_tiff = _slot->tiff.load();
+		if (_tiff == nullptr) {
+			_slot->users.fetch_sub(1);
+			_slot = nullptr;
+		}
+	}
+	~tiff_ref(void)
+	{
+		if (_slot != nullptr)
+			_slot->users.fetch_sub(1, memory_order_release);
+	}
+	tiff_ref(const tiff_ref&) = delete;
+	tiff_ref& operator=(const tiff_ref&) = delete;
+	tiff_core* get(void) const { return _tiff; }
+	tiff_core* operator->(void) const { return _tiff; }
+private:
+	tiff_slot* _slot;
+	tiff_core* _tiff;
+};
+
+//a free handle, or a new one when all are used. Called with g_tiff_mutex locked.
 int32_t check_valid_hdl(void)
 {
-	size_t size = g_tiff_array.size();
-	tiff_core* a = nullptr;
-	for (size_t i = 0; i < size; i++) {
-		a = g_tiff_array.at(i);
-		if (a == nullptr) return (int32_t)i;
+	for (int32_t i = 0; i < g_tiff_size; i++) {
+		if (get_tiff(i) == nullptr) return i;
+	}
+	if (g_tiff_size >= TIFF_MAX_SEGMENTS * TIFF_SEGMENT_SIZE) return -1;
+
+	int32_t segment_no = g_tiff_size >> TIFF_SEGMENT_BITS;
+	if (g_tiff_segments[segment_no].load(memory_order_relaxed) == nullptr) {
+		tiff_segment* segment = new(nothrow) tiff_segment();
+		if (segment == nullptr) return -1;
+		for (int32_t i = 0; i < TIFF_SEGMENT_SIZE; i++) {
+			segment->items[i].tiff.store(nullptr, memory_order_relaxed);
+			segment->items[i].users.store(0, memory_order_relaxed);
+		}
+		g_tiff_segment_owners[segment_no].reset(segment);
+		g_tiff_segments[segment_no].store(segment, memory_order_release);
 	}
-	return -1;
+	return g_tiff_size++;
 }
 
 int32_t micro_tiff_Open(const wchar_t* full_name, uint8_t open_flag)
 {
+	tiff_core* tiff = new(nothrow) tiff_core();
+	if (tiff == nullptr) {
+		return TiffErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
+	}
+
+	unique_lock<mutex> lock(g_tiff_mutex);
 	if (open_flag & OPENFLAG_WRITE) {
 		wstring s = wstring(full_name);
-		size_t size = g_tiff_array.size();
-		tiff_core* a = nullptr;
-		for (size_t i = 0; i < size; i++) {
-			a = g_tiff_array.at(i);
+		for (int32_t i = 0; i < g_tiff_size; i++) {
+			tiff_core* a = get_tiff(i);
 			if (a != nullptr) {
 				if (a->get_full_path_name() == s) {
-					if (a->get_open_flag() & OPENFLAG_WRITE) return TIFF_ERR_WRONG_OPEN_MODE;
+					if (a->get_open_flag() & OPENFLAG_WRITE) {
+						delete tiff;
+						return TIFF_ERR_WRONG_OPEN_MODE;
+					}
 				}
 			}
 		}
 	}
 
-	tiff_core* tiff = new(nothrow) tiff_core();
-	if (tiff == nullptr) {
-		return TiffErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
-	}
-
-	unique_lock<mutex> lock(g_tiff_mutex);
 	int32_t hdl = check_valid_hdl();
 	if (hdl < 0) {
-		g_tiff_array.emplace_back(tiff);
-		hdl = (int32_t)g_tiff_array.size() - 1;
-	}
-	else {
-		g_tiff_array[hdl] = tiff;
+		delete tiff;
+		return TiffErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
 	}
 
 	TiffErrorCode status = tiff->open(full_name, open_flag);
@@ -57,87 +141,164 @@ int32_t micro_tiff_Open(const wchar_t* full_name, uint8_t open_flag)
 	{
 		tiff->close();
 		delete tiff;
-		g_tiff_array[hdl] = nullptr;
 		return status;
 	}
+	//published once opened, the slot stays empty until then
+	set_tiff(hdl, tiff);
 	return hdl;
 }
 
 int32_t micro_tiff_Close(int32_t hdl)
 {
 	unique_lock<mutex> lock(g_tiff_mutex);
-	tiff_core* tiff = nullptr;
-	if (hdl < 0 || hdl >= (int32_t)g_tiff_array.size()) {
-		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	tiff_core* tiff = get_tiff(hdl);
+	if (tiff == nullptr) {
+		return hdl < 0 || hdl >= g_tiff_size ? TiffErrorCode::TIFF_ERR_USELESS_HDL : TiffErrorCode::TIFF_STATUS_OK;
 	}
-	tiff = g_tiff_array[hdl];
-	if (tiff != nullptr) {
-		tiff->close();
-		delete tiff;
+	set_tiff(hdl, nullptr);
+	//calls which found the file before go on with it until they return
+	tiff_slot* slot = get_slot(hdl);
+	while (slot->users.load() != 0) {
+		this_thread::yield();
 	}
-	g_tiff_array[hdl] = nullptr;
-	return TiffErrorCode::TIFF_STATUS_OK;
+	TiffErrorCode status = tiff->close();
+	delete tiff;
+	return status;
 }
 
 int32_t micro_tiff_CreateIFD(int32_t hdl, ImageInfo& image_info)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->create_ifd(image_info);
 }
 
-int32_t micro_tiff_SaveBlock(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t actual_byte_size, void* buf)
+int32_t micro_tiff_CreateSubIFD(int32_t hdl, uint32_t parent_ifd_no, ImageInfo& image_info)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
+	return tiff->create_sub_ifd(parent_ifd_no, image_info);
+}
+
+int32_t micro_tiff_GetSubIFDs(int32_t hdl, uint32_t ifd_no, uint32_t* sub_ifd_nos, uint32_t max_count)
+{
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
+	return tiff->get_sub_ifds(ifd_no, sub_ifd_nos, max_count);
+}
+
+int32_t micro_tiff_SetCompression(int32_t hdl, uint32_t ifd_no, uint16_t compression, uint16_t predictor, uint16_t shuffle)
+{
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
+	return tiff->set_compression(ifd_no, compression, predictor, shuffle);
+}
+
+int32_t micro_tiff_SaveBlock(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t actual_byte_size, const void* buf)
+{
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->save_block(ifd_no, block_no, actual_byte_size, (uint8_t*)buf);
 }
 
 int32_t micro_tiff_LoadBlock(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t& actual_load_size, void* buf)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->load_block(ifd_no, block_no, actual_load_size, (uint8_t*)buf);
 }
 
+int32_t micro_tiff_LoadBlocks(int32_t hdl, uint32_t ifd_no, const uint32_t* block_nos, uint32_t count, uint64_t* sizes, void* buf)
+{
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
+	return tiff->load_blocks(ifd_no, block_nos, count, sizes, (uint8_t*)buf);
+}
+
+int32_t micro_tiff_SaveBlockRows(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t block_row_size, uint32_t block_rows,
+	const void* buf, uint64_t row_bytes, uint32_t rows, uint64_t stride)
+{
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
+	return tiff->save_block_rows(ifd_no, block_no, block_row_size, block_rows, (const uint8_t*)buf, row_bytes, rows, stride);
+}
+
+int32_t micro_tiff_LoadBlockRows(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t block_row_size, uint32_t first_row, uint32_t rows,
+	uint64_t row_offset, uint64_t row_bytes, void* buf, uint64_t stride)
+{
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
+	return tiff->load_block_rows(ifd_no, block_no, block_row_size, first_row, rows, row_offset, row_bytes, (uint8_t*)buf, stride);
+}
+
 int32_t micro_tiff_CloseIFD(int32_t hdl, int32_t ifd_no)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->close_ifd(ifd_no);
 }
 
 int32_t micro_tiff_GetImageInfo(int32_t hdl, uint32_t ifd_no, ImageInfo& image_info)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->get_image_info(ifd_no, image_info);
 }
 
 int32_t micro_tiff_SetTag(int32_t hdl, uint32_t ifd_no, uint16_t tag_id, uint16_t tag_data_type, uint32_t tag_count, void* buf)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->set_tag(ifd_no, tag_id, tag_data_type, tag_count, buf);
 }
 
 int32_t micro_tiff_GetTagInfo(int32_t hdl, uint32_t ifd_no, uint16_t tag_id, uint16_t& tag_data_type, uint32_t& tag_count)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->get_tag_info(ifd_no, tag_id, tag_data_type, tag_count);
 }
 
 int32_t micro_tiff_GetTag(int32_t hdl, uint32_t ifd_no, uint16_t tag_id, void* buf)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->get_tag(ifd_no, tag_id, buf);
 }
 
 int32_t micro_tiff_GetIFDSize(int32_t hdl)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_core>(hdl, g_tiff_array, TiffErrorCode::TIFF_ERR_USELESS_HDL));
-	tiff_core* tiff = g_tiff_array[hdl];
+	tiff_ref tiff(hdl);
+	if (tiff.get() == nullptr) {
+		return TiffErrorCode::TIFF_ERR_USELESS_HDL;
+	}
 	return tiff->get_ifd_size();
 }
\ No newline at end of file
@@ -41,12 +41,24 @@
 #define	TIFFTAG_TILELENGTH				323	/* !tile height in pixels */
 #define TIFFTAG_TILEOFFSETS				324	/* !offsets to data tiles */
 #define TIFFTAG_TILEBYTECOUNTS			325	/* !byte counts for tiles */
+#define	TIFFTAG_SUBIFDS					330	/* offsets of the sub IFDs, e.g. reduced resolutions */
+#define	TIFFTAG_SAMPLEFORMAT			339	/* !data sample format */
+#define	    SAMPLEFORMAT_UINT				1	/* !unsigned integer data */
+#define	    SAMPLEFORMAT_INT				2	/* !signed integer data */
+#define	    SAMPLEFORMAT_IEEEFP				3	/* !IEEE floating point data */
+#define TIFFTAG_SHUFFLE					65000	/* private : shuffle filter applied before entropy coding */
+#define	    SHUFFLE_NONE					0	/* no shuffle */
+#define	    SHUFFLE_BYTE					1	/* byte shuffle */
+#define	    SHUFFLE_BIT						2	/* bit shuffle */
 
 #define OPENFLAG_READ		0x00
 #define OPENFLAG_WRITE		0x01
 #define	OPENFLAG_CREATE		0x02
 #define OPENFLAG_BIGTIFF	0x04
 
+//numbers of sub IFDs, which are not counted by micro_tiff_GetIFDSize
+#define SUBIFD_NO_FLAG		0x40000000
+
 typedef struct 
 {
 	uint32_t image_width;
@@ -60,6 +72,8 @@ typedef struct
 	uint16_t photometric;
 	uint16_t planarconfig;
 	uint16_t predictor;
+	uint16_t shuffle;
+	uint16_t sample_format;
 }ImageInfo;
 
 typedef enum {
@@ -88,12 +102,32 @@ int32_t micro_tiff_Close(int32_t hdl);
 
 int32_t micro_tiff_CreateIFD(int32_t hdl, ImageInfo &image_info);
 int32_t micro_tiff_CloseIFD(int32_t hdl, int32_t ifd_no);
+//A sub IFD of "parent_ifd_no" (e.g. a reduced resolution), listed by its SubIFDs tag instead of the IFD chain.
+//The number returned is used like any IFD number. Closing the parent closes its sub IFDs first.
+int32_t micro_tiff_CreateSubIFD(int32_t hdl, uint32_t parent_ifd_no, ImageInfo &image_info);
+//Number of sub IFDs of "ifd_no", the first "max_count" of them are set to "sub_ifd_nos" when it isn't nullptr.
+int32_t micro_tiff_GetSubIFDs(int32_t hdl, uint32_t ifd_no, uint32_t* sub_ifd_nos, uint32_t max_count);
 
 int32_t micro_tiff_GetIFDSize(int32_t hdl);
 int32_t micro_tiff_GetImageInfo(int32_t hdl, uint32_t ifd_no, ImageInfo& image_info);
 
-int32_t micro_tiff_SaveBlock(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t actual_byte_size, void* buf);
+//Change the codec of an IFD which has no block written yet, e.g. after trial compression of the first data.
+int32_t micro_tiff_SetCompression(int32_t hdl, uint32_t ifd_no, uint16_t compression, uint16_t predictor, uint16_t shuffle);
+int32_t micro_tiff_SaveBlock(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t actual_byte_size, const void* buf);
 int32_t micro_tiff_LoadBlock(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t &actual_load_size, void* buf);
+//Load "count" blocks back to back into "buf", in the order of "block_nos", with one lock of the file.
+//Blocks which follow each other in the file are read at once. With "buf" nullptr only "sizes" are set.
+int32_t micro_tiff_LoadBlocks(int32_t hdl, uint32_t ifd_no, const uint32_t* block_nos, uint32_t count, uint64_t* sizes, void* buf);
+
+//Uncompressed blocks written from or read into a buffer with any row stride, without a contiguous copy of the block.
+//Save a block of "block_rows" rows of "block_row_size" bytes from "rows" rows of "row_bytes" bytes, "stride" bytes apart in "buf".
+//Each row is padded with zeros to "block_row_size" bytes and the block with zero rows to "block_rows" rows, e.g. for border tiles.
+int32_t micro_tiff_SaveBlockRows(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t block_row_size, uint32_t block_rows,
+	const void* buf, uint64_t row_bytes, uint32_t rows, uint64_t stride);
+//Load "row_bytes" bytes at "row_offset" of the rows [first_row, first_row + rows) of a block with rows of "block_row_size" bytes,
+//into rows "stride" bytes apart in "buf". Only these bytes are read from the file.
+int32_t micro_tiff_LoadBlockRows(int32_t hdl, uint32_t ifd_no, uint32_t block_no, uint64_t block_row_size, uint32_t first_row, uint32_t rows,
+	uint64_t row_offset, uint64_t row_bytes, void* buf, uint64_t stride);
 
 int32_t micro_tiff_SetTag(int32_t hdl, uint32_t ifd_no, uint16_t tag_id, uint16_t tag_data_type, uint32_t tag_count, void* buf);
 int32_t micro_tiff_GetTagInfo(int32_t hdl, uint32_t ifd_no, uint16_t tag_id, uint16_t &tag_data_type, uint32_t &tag_count);
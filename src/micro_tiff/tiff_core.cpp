@@ -26,6 +26,22 @@ void tiff_core::dispose(void)
 		}
 	}
 	_ifd_container.clear();
+	for (auto i : _sub_ifd_container) {
+		if (i != nullptr) {
+			delete(i);
+		}
+	}
+	_sub_ifd_container.clear();
+	_sub_ifds.clear();
+}
+
+tiff_ifd* tiff_core::find_ifd(const uint32_t ifd_no)
+{
+	if (ifd_no & SUBIFD_NO_FLAG) {
+		uint32_t index = ifd_no & ~SUBIFD_NO_FLAG;
+		return index < _sub_ifd_container.size() ? _sub_ifd_container[index] : nullptr;
+	}
+	return ifd_no < _ifd_container.size() ? _ifd_container[ifd_no] : nullptr;
 }
 
 TiffErrorCode tiff_core::open(const wchar_t* tiffFullName, const uint8_t open_flag)
@@ -138,10 +154,21 @@ TiffErrorCode tiff_core::read_header(void)
 
 TiffErrorCode tiff_core::close(void)
 {
+	//IFDs not closed yet are written now, in index order so the chain has no gap
+	TiffErrorCode ret = TiffErrorCode::TIFF_STATUS_OK;
+	if (_tiff_hdl != nullptr && (_open_flag & OPENFLAG_WRITE)) {
+		uint32_t ifd_size = get_ifd_size();
+		for (uint32_t i = 0; i < ifd_size; i++) {
+			int32_t err = close_ifd(i);
+			if (err != TiffErrorCode::TIFF_STATUS_OK && ret == TiffErrorCode::TIFF_STATUS_OK)
+				ret = (TiffErrorCode)err;
+		}
+	}
 	if (_tiff_hdl != nullptr)
 		fclose(_tiff_hdl);
+	_tiff_hdl = nullptr;
 	dispose();
-	return TiffErrorCode::TIFF_STATUS_OK;
+	return ret;
 }
 
 int32_t tiff_core::create_ifd(const ImageInfo& image_info)
@@ -153,12 +180,60 @@ int32_t tiff_core::create_ifd(const ImageInfo& image_info)
 	if (ifd == nullptr) {
 		return TiffErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
 	}
+	unique_lock<mutex> lck(_mutex);
 	_ifd_container.emplace_back(ifd);
+	int32_t ifd_no = (int32_t)(_ifd_container.size() - 1);
+	TiffErrorCode ret = ifd->wr_ifd_info(image_info);
+	if (ret != TiffErrorCode::TIFF_STATUS_OK) {
+		return ret;
+	}
+	return ifd_no;
+}
+
+int32_t tiff_core::create_sub_ifd(const uint32_t parent_ifd_no, const ImageInfo& image_info)
+{
+	if ((_open_flag & OPENFLAG_WRITE) == OPENFLAG_READ) {
+		return TiffErrorCode::TIFF_ERR_WRONG_OPEN_MODE;
+	}
+	unique_lock<mutex> lck(_mutex);
+	//only IFDs of the main chain have sub IFDs, and only until they are written
+	if ((parent_ifd_no & SUBIFD_NO_FLAG) || find_ifd(parent_ifd_no) == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
+	if (_ifd_container[parent_ifd_no]->get_is_purged())
+		return TiffErrorCode::TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED;
+	tiff_ifd* ifd = new(nothrow) tiff_ifd(_big_tiff, _big_endian, _tiff_hdl);
+	if (ifd == nullptr) {
+		return TiffErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
+	}
+	_sub_ifd_container.emplace_back(ifd);
+	int32_t ifd_no = (int32_t)((_sub_ifd_container.size() - 1) | SUBIFD_NO_FLAG);
+	_sub_ifds[parent_ifd_no].push_back(ifd_no);
 	TiffErrorCode ret = ifd->wr_ifd_info(image_info);
 	if (ret != TiffErrorCode::TIFF_STATUS_OK) {
 		return ret;
 	}
-	return (int32_t)(_ifd_container.size() - 1);
+	return ifd_no;
+}
+
+int32_t tiff_core::get_sub_ifds(const uint32_t ifd_no, uint32_t* sub_ifd_nos, const uint32_t max_count)
+{
+	unique_lock<mutex> lck(_mutex);
+	if (find_ifd(ifd_no) == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
+	auto it = _sub_ifds.find(ifd_no);
+	if (it == _sub_ifds.end())
+		return 0;
+	if (sub_ifd_nos != nullptr) {
+		for (size_t i = 0; i < it->second.size() && i < max_count; i++)
+			sub_ifd_nos[i] = it->second[i];
+	}
+	return (int32_t)it->second.size();
+}
+
+uint32_t tiff_core::get_ifd_size(void)
+{
+	unique_lock<mutex> lck(_mutex);
+	return (uint32_t)_ifd_container.size();
 }
 
 int32_t tiff_core::load_ifds(void)
@@ -185,74 +260,183 @@ int32_t tiff_core::load_ifds(void)
 		ifd_size++;
 	}
 
+	//reduced resolutions and other sub images are not in the chain, they are listed by the SubIFDs tag of their IFD
+	for (int32_t i = 0; i < ifd_size; i++) {
+		err = load_sub_ifds(i);
+		if (err != TiffErrorCode::TIFF_STATUS_OK)
+			return err;
+	}
+
 	return ifd_size;
 }
 
+int32_t tiff_core::load_sub_ifds(const uint32_t ifd_no)
+{
+	uint16_t tag_data_type = 0;
+	uint32_t tag_count = 0;
+	if (_ifd_container[ifd_no]->get_tag_info(TIFFTAG_SUBIFDS, tag_data_type, tag_count) != TiffErrorCode::TIFF_STATUS_OK || tag_count == 0)
+		return TiffErrorCode::TIFF_STATUS_OK;
+	bool is_long8 = tag_data_type == TIFF_LONG8 || tag_data_type == TIFF_IFD8;
+	if (!is_long8 && tag_data_type != TIFF_LONG && tag_data_type != TIFF_IFD)
+		return TiffErrorCode::TIFF_ERR_TAG_TYPE_INCORRECT;
+
+	vector<uint8_t> offsets((size_t)tag_count * (is_long8 ? 8 : 4));
+	int32_t err = _ifd_container[ifd_no]->get_tag(TIFFTAG_SUBIFDS, offsets.data());
+	if (err != TiffErrorCode::TIFF_STATUS_OK)
+		return err;
+	for (uint32_t i = 0; i < tag_count; i++) {
+		uint64_t offset = is_long8 ? read_uint64(&offsets[i * 8], _big_endian) : read_uint32(&offsets[i * 4], _big_endian);
+		tiff_ifd* ifd = new(nothrow) tiff_ifd(_big_tiff, _big_endian, _tiff_hdl);
+		if (ifd == nullptr) {
+			return TiffErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
+		}
+		err = ifd->load_ifd(offset);
+		if (err != TiffErrorCode::TIFF_STATUS_OK) {
+			delete ifd;
+			return err;
+		}
+		_sub_ifd_container.emplace_back(ifd);
+		_sub_ifds[ifd_no].push_back((uint32_t)(_sub_ifd_container.size() - 1) | SUBIFD_NO_FLAG);
+	}
+	return TiffErrorCode::TIFF_STATUS_OK;
+}
+
+int32_t tiff_core::set_compression(const uint32_t ifd_no, const uint16_t compression, const uint16_t predictor, const uint16_t shuffle)
+{
+	if ((_open_flag & OPENFLAG_WRITE) == OPENFLAG_READ) {
+		return TiffErrorCode::TIFF_ERR_WRONG_OPEN_MODE;
+	}
+	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
+	return ifd->wr_compression(compression, predictor, shuffle);
+}
+
 int32_t tiff_core::save_block(const uint32_t ifd_no, const uint32_t block_no, const uint64_t actual_byte_size, uint8_t* buf)
 {
 	if ((_open_flag & OPENFLAG_WRITE) == OPENFLAG_READ) {
 		return TiffErrorCode::TIFF_ERR_WRONG_OPEN_MODE;
 	}
-	CHECK_TIFF_ERROR(check_handle<tiff_ifd>(ifd_no, _ifd_container, TiffErrorCode::TIFF_ERR_NO_IFD_FOUND));
-	tiff_ifd* ifd = _ifd_container[ifd_no];
 	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
 	return ifd->wr_block(block_no, actual_byte_size, buf);
 }
 
 int32_t tiff_core::load_block(const uint32_t ifd_no, const uint32_t block_no, uint64_t& actual_byte_size, uint8_t* buf)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_ifd>(ifd_no, _ifd_container, TiffErrorCode::TIFF_ERR_NO_IFD_FOUND));
-	tiff_ifd* ifd = _ifd_container[ifd_no];
 	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
 	return ifd->rd_block(block_no, actual_byte_size, buf);
 }
 
+int32_t tiff_core::load_blocks(const uint32_t ifd_no, const uint32_t* block_nos, const uint32_t count, uint64_t* sizes, uint8_t* buf)
+{
+	if (block_nos == nullptr || sizes == nullptr)
+		return TiffErrorCode::TIFF_ERR_BAD_PARAMETER_VALUE;
+	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
+	return ifd->rd_blocks(block_nos, count, sizes, buf);
+}
+
+int32_t tiff_core::save_block_rows(const uint32_t ifd_no, const uint32_t block_no, const uint64_t block_row_size, const uint32_t block_rows,
+	const uint8_t* buf, const uint64_t row_bytes, const uint32_t rows, const uint64_t stride)
+{
+	if ((_open_flag & OPENFLAG_WRITE) == OPENFLAG_READ) {
+		return TiffErrorCode::TIFF_ERR_WRONG_OPEN_MODE;
+	}
+	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
+	return ifd->wr_block_rows(block_no, block_row_size, block_rows, buf, row_bytes, rows, stride);
+}
+
+int32_t tiff_core::load_block_rows(const uint32_t ifd_no, const uint32_t block_no, const uint64_t block_row_size, const uint32_t first_row, const uint32_t rows,
+	const uint64_t row_offset, const uint64_t row_bytes, uint8_t* buf, const uint64_t stride)
+{
+	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
+	return ifd->rd_block_rows(block_no, block_row_size, first_row, rows, row_offset, row_bytes, buf, stride);
+}
+
 int32_t tiff_core::close_ifd(const uint32_t ifd_no)
 {
 	if ((_open_flag & OPENFLAG_WRITE) == OPENFLAG_READ) {
 		return TiffErrorCode::TIFF_STATUS_OK;
 	}
-	CHECK_TIFF_ERROR(check_handle<tiff_ifd>(ifd_no, _ifd_container, TiffErrorCode::TIFF_ERR_NO_IFD_FOUND));
-	tiff_ifd* ifd = _ifd_container[ifd_no];
+	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
 
-	int64_t ifd_offset_pos;
-	size_t write_size;
-	if (_big_tiff) {
-		ifd_offset_pos = 8;
-		write_size = BIG_TIFF_OFFSET_SIZE;
-	}
-	else {
-		ifd_offset_pos = 4;
-		write_size = CLASSIC_TIFF_OFFSET_SIZE;
-	}
+	if (ifd->get_is_purged())
+		return TiffErrorCode::TIFF_STATUS_OK;
+	//a sub IFD is found through the SubIFDs tag of its parent, not through the chain
+	if (ifd_no & SUBIFD_NO_FLAG)
+		return ifd->wr_purge();
 
-	if (ifd_no > 0)
-	{
-		tiff_ifd* previous_ifd = _ifd_container[ifd_no - 1];
-		if (!previous_ifd->get_is_purged()) {
-			return TiffErrorCode::TIFF_ERR_PREVIOUS_IFD_NOT_CLOSED;
-		}
-		ifd_offset_pos = previous_ifd->get_next_ifd_pos();
-	}
-	if (!ifd->get_is_purged()) {
-		unique_lock<mutex> lck(_mutex);
-		TiffErrorCode code = ifd->wr_purge();
-		if (code != TiffErrorCode::TIFF_STATUS_OK)
-			return code;
+	int32_t err = purge_sub_ifds(ifd_no);
+	if (err != TiffErrorCode::TIFF_STATUS_OK)
+		return err;
+	TiffErrorCode code = ifd->wr_purge();
+	if (code != TiffErrorCode::TIFF_STATUS_OK)
+		return code;
 
-		uint64_t ifd_offset = ifd->get_current_ifd_offset();
+	//IFDs may be written in any order, but they are chained in index order :
+	//an IFD is linked once the previous one is written, then the following written ones are linked in turn
+	if (ifd_no > 0 && !_ifd_container[ifd_no - 1]->get_is_purged())
+		return TiffErrorCode::TIFF_STATUS_OK;
+	size_t write_size = _big_tiff ? BIG_TIFF_OFFSET_SIZE : CLASSIC_TIFF_OFFSET_SIZE;
+	for (size_t i = ifd_no; i < _ifd_container.size() && _ifd_container[i]->get_is_purged(); i++)
+	{
+		int64_t ifd_offset_pos = i == 0 ? (_big_tiff ? 8 : 4) : _ifd_container[i - 1]->get_next_ifd_pos();
+		uint64_t ifd_offset = _ifd_container[i]->get_current_ifd_offset();
 		_fseeki64(_tiff_hdl, ifd_offset_pos, SEEK_SET);
 		WriteSequence(&ifd_offset, write_size, 1);
-		_fseeki64(_tiff_hdl, 0, SEEK_END);
 	}
+	_fseeki64(_tiff_hdl, 0, SEEK_END);
 
 	return TiffErrorCode::TIFF_STATUS_OK;
 }
 
+int32_t tiff_core::purge_sub_ifds(const uint32_t ifd_no)
+{
+	auto it = _sub_ifds.find(ifd_no);
+	if (it == _sub_ifds.end())
+		return TiffErrorCode::TIFF_STATUS_OK;
+
+	//the sub IFDs are written first, their offsets are the values of the SubIFDs tag
+	vector<uint64_t> offsets;
+	for (uint32_t sub_ifd_no : it->second) {
+		tiff_ifd* sub_ifd = find_ifd(sub_ifd_no);
+		if (!sub_ifd->get_is_purged()) {
+			TiffErrorCode code = sub_ifd->wr_purge();
+			if (code != TiffErrorCode::TIFF_STATUS_OK)
+				return code;
+		}
+		offsets.push_back(sub_ifd->get_current_ifd_offset());
+	}
+	if (_big_tiff)
+		return _ifd_container[ifd_no]->set_tag(TIFFTAG_SUBIFDS, TIFF_IFD8, (uint32_t)offsets.size(), offsets.data());
+	vector<uint32_t> classic_offsets(offsets.begin(), offsets.end());
+	return _ifd_container[ifd_no]->set_tag(TIFFTAG_SUBIFDS, TIFF_IFD, (uint32_t)classic_offsets.size(), classic_offsets.data());
+}
+
 int32_t tiff_core::get_image_info(const uint32_t ifd_no, ImageInfo& image_info)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_ifd>(ifd_no, _ifd_container, TiffErrorCode::TIFF_ERR_NO_IFD_FOUND));
-	tiff_ifd* ifd = _ifd_container[ifd_no];
+	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
 	ifd->rd_ifd_info(image_info);
 	return TiffErrorCode::TIFF_STATUS_OK;
 }
@@ -262,23 +446,27 @@ int32_t tiff_core::set_tag(const uint32_t ifd_no, const uint16_t tag_id, const u
 	if ((_open_flag & OPENFLAG_WRITE) == OPENFLAG_READ) {
 		return TiffErrorCode::TIFF_ERR_WRONG_OPEN_MODE;
 	}
-	CHECK_TIFF_ERROR(check_handle<tiff_ifd>(ifd_no, _ifd_container, TiffErrorCode::TIFF_ERR_NO_IFD_FOUND));
-	tiff_ifd* ifd = _ifd_container[ifd_no];
 	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
 	return ifd->set_tag(tag_id, tag_data_type, tag_count, buf);
 }
 
 int32_t tiff_core::get_tag_info(const uint32_t ifd_no, const uint16_t tag_id, uint16_t& tag_data_type, uint32_t& tag_count)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_ifd>(ifd_no, _ifd_container, TiffErrorCode::TIFF_ERR_NO_IFD_FOUND));
-	tiff_ifd* ifd = _ifd_container[ifd_no];
+	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
 	return ifd->get_tag_info(tag_id, tag_data_type, tag_count);
 }
 
 int32_t tiff_core::get_tag(const uint32_t ifd_no, const uint16_t tag_id, void* buf)
 {
-	CHECK_TIFF_ERROR(check_handle<tiff_ifd>(ifd_no, _ifd_container, TiffErrorCode::TIFF_ERR_NO_IFD_FOUND));
-	tiff_ifd* ifd = _ifd_container[ifd_no];
 	unique_lock<mutex> lck(_mutex);
+	tiff_ifd* ifd = find_ifd(ifd_no);
+	if (ifd == nullptr)
+		return TiffErrorCode::TIFF_ERR_NO_IFD_FOUND;
 	return ifd->get_tag(tag_id, buf);
 }
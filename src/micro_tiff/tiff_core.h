@@ -2,6 +2,7 @@
 #include <vector>
 #include <string>
 #include <mutex>
+#include <map>
 #include "micro_tiff.h"
 #include "tiff_ifd.h"
 #include "tiff_err.h"
@@ -16,14 +17,20 @@ public:
 	//int32_t get_tiff_hdl(void) { return _tiff_hdl; }
 	uint8_t get_open_flag(void) const { return _open_flag; }
 	std::wstring get_full_path_name(void) const { return _full_path_name; }
-	uint32_t get_ifd_size(void) const { return (uint32_t)_ifd_container.size(); }
+	uint32_t get_ifd_size(void);
 	bool is_big_tiff(void) const { return _big_tiff; }
 	bool is_big_endian(void) const { return _big_endian; }
 
 	int32_t create_ifd(const ImageInfo& image_info);
+	int32_t create_sub_ifd(uint32_t parent_ifd_no, const ImageInfo& image_info);
+	int32_t get_sub_ifds(uint32_t ifd_no, uint32_t* sub_ifd_nos, uint32_t max_count);
 	int32_t close_ifd(uint32_t ifd_no);
+	int32_t set_compression(uint32_t ifd_no, uint16_t compression, uint16_t predictor, uint16_t shuffle);
 	int32_t save_block(uint32_t ifd_no, uint32_t block_no, uint64_t actual_byte_size, uint8_t* buf);
 	int32_t load_block(uint32_t ifd_no, uint32_t block_no, uint64_t& actual_byte_size, uint8_t* buf);
+	int32_t load_blocks(uint32_t ifd_no, const uint32_t* block_nos, uint32_t count, uint64_t* sizes, uint8_t* buf);
+	int32_t save_block_rows(uint32_t ifd_no, uint32_t block_no, uint64_t block_row_size, uint32_t block_rows, const uint8_t* buf, uint64_t row_bytes, uint32_t rows, uint64_t stride);
+	int32_t load_block_rows(uint32_t ifd_no, uint32_t block_no, uint64_t block_row_size, uint32_t first_row, uint32_t rows, uint64_t row_offset, uint64_t row_bytes, uint8_t* buf, uint64_t stride);
 	int32_t get_image_info(uint32_t ifd_no, ImageInfo& image_info);
 	int32_t set_tag(uint32_t ifd_no, uint16_t tag_id, uint16_t tag_data_type, uint32_t tag_count, void* buf);
 	int32_t get_tag_info(uint32_t ifd_no, uint16_t tag_id, uint16_t& tag_data_type, uint32_t& tag_count);
@@ -37,6 +44,8 @@ private:
 	bool _big_endian;
 	std::wstring _full_path_name;
 	std::vector<tiff_ifd*> _ifd_container;
+	std::vector<tiff_ifd*> _sub_ifd_container;
+	std::map<uint32_t, std::vector<uint32_t>> _sub_ifds;
 	std::mutex _mutex;
 
 	uint64_t _tif_first_ifd_position;
@@ -45,6 +54,9 @@ private:
 	TiffErrorCode write_header(void);
 	TiffErrorCode read_header(void);
 	int32_t load_ifds(void);
+	int32_t load_sub_ifds(uint32_t ifd_no);
+	int32_t purge_sub_ifds(uint32_t ifd_no);
+	tiff_ifd* find_ifd(uint32_t ifd_no);
 	void dispose(void);
 };
 
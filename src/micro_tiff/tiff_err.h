@@ -31,4 +31,5 @@ typedef enum
 	TIFF_ERR_APPEND_TAG_NOT_ALLOWED = -25,
 	TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED = -26,
 	TIFF_ERR_BIGENDIAN_NOT_SUPPORT = -27,
+	TIFF_ERR_WRITE_DATA_TO_FILE_FAILED = -28,
 }TiffErrorCode;
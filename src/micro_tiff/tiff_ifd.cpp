@@ -83,6 +83,24 @@ TiffErrorCode tiff_ifd::wr_ifd_info(const ImageInfo& image_info)
 	return TiffErrorCode::TIFF_STATUS_OK;
 }
 
+TiffErrorCode tiff_ifd::wr_compression(const uint16_t compression, const uint16_t predictor, const uint16_t shuffle)
+{
+	//blocks already written are encoded with the old codec
+	if (_is_purged)
+		return TiffErrorCode::TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED;
+	for (size_t i = 0; i < _block_count; i++)
+	{
+		uint64_t offset = _big_tiff ? _big_block_offset_array[i] : _classic_block_offset_array[i];
+		if (offset != 0)
+			return TiffErrorCode::TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED;
+	}
+
+	_info.compression = compression;
+	_info.predictor = predictor;
+	_info.shuffle = shuffle;
+	return TiffErrorCode::TIFF_STATUS_OK;
+}
+
 size_t tiff_ifd::get_block_count(void) const
 {
 	size_t r1 = _info.image_width / _info.block_width;
@@ -109,6 +127,10 @@ void tiff_ifd::generate_tag_list(const uint64_t pos_offset, const uint64_t pos_b
 		_big_tags[TIFFTAG_SAMPLESPERPIXEL] = { TIFFTAG_SAMPLESPERPIXEL,TIFF_LONG,1,_info.samples_per_pixel };
 		_big_tags[TIFFTAG_PLANARCONFIG] = { TIFFTAG_PLANARCONFIG, TIFF_LONG, 1, _info.planarconfig };
 		_big_tags[TIFFTAG_PREDICTOR] = { TIFFTAG_PREDICTOR, TIFF_LONG, 1, _info.predictor };
+		if (_info.shuffle != SHUFFLE_NONE)
+			_big_tags[TIFFTAG_SHUFFLE] = { TIFFTAG_SHUFFLE, TIFF_SHORT, 1, _info.shuffle };
+		if (_info.sample_format == SAMPLEFORMAT_INT || _info.sample_format == SAMPLEFORMAT_IEEEFP)
+			_big_tags[TIFFTAG_SAMPLEFORMAT] = { TIFFTAG_SAMPLEFORMAT, TIFF_SHORT, 1, _info.sample_format };
 
 		if (_block_count <= 1)
 		{
@@ -139,6 +161,10 @@ void tiff_ifd::generate_tag_list(const uint64_t pos_offset, const uint64_t pos_b
 		_classic_tag[TIFFTAG_SAMPLESPERPIXEL] = { TIFFTAG_SAMPLESPERPIXEL,TIFF_SHORT,1,_info.samples_per_pixel };
 		_classic_tag[TIFFTAG_PLANARCONFIG] = { TIFFTAG_PLANARCONFIG, TIFF_SHORT, 1, _info.planarconfig };
 		_classic_tag[TIFFTAG_PREDICTOR] = { TIFFTAG_PREDICTOR, TIFF_SHORT, 1, _info.predictor };
+		if (_info.shuffle != SHUFFLE_NONE)
+			_classic_tag[TIFFTAG_SHUFFLE] = { TIFFTAG_SHUFFLE, TIFF_SHORT, 1, _info.shuffle };
+		if (_info.sample_format == SAMPLEFORMAT_INT || _info.sample_format == SAMPLEFORMAT_IEEEFP)
+			_classic_tag[TIFFTAG_SAMPLEFORMAT] = { TIFFTAG_SAMPLEFORMAT, TIFF_SHORT, 1, _info.sample_format };
 
 
 		if (_block_count <= 1)
@@ -147,9 +173,19 @@ void tiff_ifd::generate_tag_list(const uint64_t pos_offset, const uint64_t pos_b
 			block_bytes = _classic_block_byte_size_array[0];
 		}
 
-		_classic_tag[TIFFTAG_ROWSPERSTRIP] = { TIFFTAG_ROWSPERSTRIP,TIFF_LONG,1,_info.block_height };
-		_classic_tag[TIFFTAG_STRIPOFFSETS] = { TIFFTAG_STRIPOFFSETS,TIFF_LONG,(uint32_t)_block_count, (uint32_t)block_offset };
-		_classic_tag[TIFFTAG_STRIPBYTECOUNTS] = { TIFFTAG_STRIPBYTECOUNTS,TIFF_LONG,(uint32_t)_block_count, (uint32_t)block_bytes };
+		if (is_width_eq_block)
+		{
+			_classic_tag[TIFFTAG_ROWSPERSTRIP] = { TIFFTAG_ROWSPERSTRIP,TIFF_LONG,1,_info.block_height };
+			_classic_tag[TIFFTAG_STRIPOFFSETS] = { TIFFTAG_STRIPOFFSETS,TIFF_LONG,(uint32_t)_block_count, (uint32_t)block_offset };
+			_classic_tag[TIFFTAG_STRIPBYTECOUNTS] = { TIFFTAG_STRIPBYTECOUNTS,TIFF_LONG,(uint32_t)_block_count, (uint32_t)block_bytes };
+		}
+		else
+		{
+			_classic_tag[TIFFTAG_TILEWIDTH] = { TIFFTAG_TILEWIDTH, TIFF_LONG, 1, _info.block_width };
+			_classic_tag[TIFFTAG_TILELENGTH] = { TIFFTAG_TILELENGTH, TIFF_LONG, 1, _info.block_height };
+			_classic_tag[TIFFTAG_TILEOFFSETS] = { TIFFTAG_TILEOFFSETS, TIFF_LONG, (uint32_t)_block_count, (uint32_t)block_offset };
+			_classic_tag[TIFFTAG_TILEBYTECOUNTS] = { TIFFTAG_TILEBYTECOUNTS, TIFF_LONG, (uint32_t)_block_count, (uint32_t)block_bytes };
+		}
 	}
 }
 
@@ -206,6 +242,8 @@ TiffErrorCode tiff_ifd::parse_ifd_info()
 		_info.photometric = (uint16_t)_big_tags[TIFFTAG_PHOTOMETRIC].value;
 		_info.planarconfig = (uint16_t)_big_tags[TIFFTAG_PLANARCONFIG].value;
 		_info.predictor = get_map_value<uint16_t, TagBigTiff>(_big_tags, TIFFTAG_PREDICTOR, 1);
+		_info.shuffle = get_map_value<uint16_t, TagBigTiff>(_big_tags, TIFFTAG_SHUFFLE, SHUFFLE_NONE);
+		_info.sample_format = get_map_value<uint16_t, TagBigTiff>(_big_tags, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
 
 		_big_block_offset_array = (uint64_t*)calloc(_block_count, sizeof(uint64_t));
 		_big_block_byte_size_array = (uint64_t*)calloc(_block_count, sizeof(uint64_t));
@@ -270,6 +308,8 @@ TiffErrorCode tiff_ifd::parse_ifd_info()
 		_info.photometric = (uint16_t)_classic_tag[TIFFTAG_PHOTOMETRIC].value;
 		_info.planarconfig = (uint16_t)_classic_tag[TIFFTAG_PLANARCONFIG].value;
 		_info.predictor = get_map_value<uint16_t, TagClassicTiff>(_classic_tag, TIFFTAG_PREDICTOR, 1);
+		_info.shuffle = get_map_value<uint16_t, TagClassicTiff>(_classic_tag, TIFFTAG_SHUFFLE, SHUFFLE_NONE);
+		_info.sample_format = get_map_value<uint16_t, TagClassicTiff>(_classic_tag, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT);
 
 		_classic_block_offset_array = (uint32_t*)calloc(_block_count, sizeof(uint32_t));
 		_classic_block_byte_size_array = (uint32_t*)calloc(_block_count, sizeof(uint32_t));
@@ -462,7 +502,61 @@ TiffErrorCode tiff_ifd::wr_block(const uint32_t block_no, const uint64_t buf_siz
 		_classic_block_offset_array[block_no] = (uint32_t)cur_offset;
 		_classic_block_byte_size_array[block_no] = (uint32_t)buf_size;
 	}
-	WriteSequence(buf, (size_t)buf_size, 1);
+	if (buf_size > 0 && WriteSequence(buf, (size_t)buf_size, 1) != 1)
+		return TiffErrorCode::TIFF_ERR_WRITE_DATA_TO_FILE_FAILED;
+	return TiffErrorCode::TIFF_STATUS_OK;
+}
+
+static bool write_zeros(FILE* hdl, uint64_t size)
+{
+	static const uint8_t zeros[4096] = { 0 };
+	while (size > 0)
+	{
+		size_t count = size > sizeof(zeros) ? sizeof(zeros) : (size_t)size;
+		if (fwrite(zeros, count, 1, hdl) != 1)
+			return false;
+		size -= count;
+	}
+	return true;
+}
+
+//Write the rows straight from the caller's buffer, padded with zeros to the block size.
+TiffErrorCode tiff_ifd::wr_block_rows(const uint32_t block_no, const uint64_t block_row_size, const uint32_t block_rows,
+	const uint8_t* buf, const uint64_t row_bytes, const uint32_t rows, const uint64_t stride)
+{
+	if (block_no >= _block_count) {
+		return TiffErrorCode::TIFF_ERR_BLOCK_OUT_OF_RANGE;
+	}
+	if (row_bytes > block_row_size || rows > block_rows || (rows > 1 && stride < row_bytes)) {
+		return TiffErrorCode::TIFF_ERR_BAD_PARAMETER_VALUE;
+	}
+	_fseeki64(_tiff_hdl, 0, SEEK_END);
+	uint64_t cur_offset = _ftelli64(_tiff_hdl);
+	uint64_t buf_size = block_row_size * block_rows;
+
+	if (_big_tiff) {
+		_big_block_offset_array[block_no] = cur_offset;
+		_big_block_byte_size_array[block_no] = buf_size;
+	}
+	else {
+		_classic_block_offset_array[block_no] = (uint32_t)cur_offset;
+		_classic_block_byte_size_array[block_no] = (uint32_t)buf_size;
+	}
+	if (row_bytes == block_row_size && stride == row_bytes) {
+		if (row_bytes * rows > 0 && WriteSequence(buf, (size_t)(row_bytes * rows), 1) != 1)
+			return TiffErrorCode::TIFF_ERR_WRITE_DATA_TO_FILE_FAILED;
+	}
+	else {
+		for (uint32_t i = 0; i < rows; i++)
+		{
+			if (row_bytes > 0 && WriteSequence(buf + i * stride, (size_t)row_bytes, 1) != 1)
+				return TiffErrorCode::TIFF_ERR_WRITE_DATA_TO_FILE_FAILED;
+			if (!write_zeros(_tiff_hdl, block_row_size - row_bytes))
+				return TiffErrorCode::TIFF_ERR_WRITE_DATA_TO_FILE_FAILED;
+		}
+	}
+	if (!write_zeros(_tiff_hdl, (uint64_t)(block_rows - rows) * block_row_size))
+		return TiffErrorCode::TIFF_ERR_WRITE_DATA_TO_FILE_FAILED;
 	return TiffErrorCode::TIFF_STATUS_OK;
 }
 
@@ -502,6 +596,87 @@ TiffErrorCode tiff_ifd::rd_block(const uint32_t block_no, uint64_t& buf_size, ui
 	return TiffErrorCode::TIFF_STATUS_OK;
 }
 
+//Runs of blocks which are contiguous in the file are read with one seek and one read.
+TiffErrorCode tiff_ifd::rd_blocks(const uint32_t* block_nos, const uint32_t count, uint64_t* sizes, uint8_t* buf)
+{
+	for (uint32_t i = 0; i < count; i++)
+	{
+		if (block_nos[i] >= _block_count)
+			return TiffErrorCode::TIFF_ERR_BLOCK_OUT_OF_RANGE;
+		sizes[i] = _big_tiff ? _big_block_byte_size_array[block_nos[i]] : _classic_block_byte_size_array[block_nos[i]];
+	}
+	if (buf == nullptr)
+		return TiffErrorCode::TIFF_STATUS_OK;
+
+	uint32_t i = 0;
+	while (i < count)
+	{
+		uint64_t run_offset = _big_tiff ? _big_block_offset_array[block_nos[i]] : _classic_block_offset_array[block_nos[i]];
+		uint64_t run_size = sizes[i];
+		uint32_t end = i + 1;
+		for (; end < count; end++)
+		{
+			uint64_t offset = _big_tiff ? _big_block_offset_array[block_nos[end]] : _classic_block_offset_array[block_nos[end]];
+			if (offset != run_offset + run_size)
+				break;
+			run_size += sizes[end];
+		}
+		if (run_size > 0)
+		{
+			if (_fseeki64(_tiff_hdl, run_offset, SEEK_SET) != 0)
+				return TiffErrorCode::TIFF_ERR_BLOCK_OFFSET_OUT_OF_RANGE;
+			if (ReadSequence(buf, (size_t)run_size, 1) != 1)
+				return TiffErrorCode::TIFF_ERR_READ_DATA_FROM_FILE_FAILED;
+			buf += run_size;
+		}
+		i = end;
+	}
+	return TiffErrorCode::TIFF_STATUS_OK;
+}
+
+//Read only the wanted part of the rows, each one straight into its row of the caller's buffer.
+TiffErrorCode tiff_ifd::rd_block_rows(const uint32_t block_no, const uint64_t block_row_size, const uint32_t first_row, const uint32_t rows,
+	const uint64_t row_offset, const uint64_t row_bytes, uint8_t* buf, const uint64_t stride)
+{
+	uint64_t cur_offset, buf_size;
+	if (block_no >= _block_count) {
+		return TiffErrorCode::TIFF_ERR_BLOCK_OUT_OF_RANGE;
+	}
+
+	if (_big_tiff) {
+		cur_offset = _big_block_offset_array[block_no];
+		buf_size = _big_block_byte_size_array[block_no];
+	}
+	else {
+		cur_offset = _classic_block_offset_array[block_no];
+		buf_size = _classic_block_byte_size_array[block_no];
+	}
+	if (rows == 0 || row_bytes == 0 || row_offset + row_bytes > block_row_size || ((uint64_t)first_row + rows) * block_row_size > buf_size
+		|| (rows > 1 && stride < row_bytes)) {
+		return TiffErrorCode::TIFF_ERR_BAD_PARAMETER_VALUE;
+	}
+
+	//whole rows are contiguous in the file, seek once
+	bool whole_rows = row_bytes == block_row_size;
+	if (whole_rows && stride == row_bytes) {
+		if (_fseeki64(_tiff_hdl, cur_offset + first_row * block_row_size, SEEK_SET) != 0)
+			return TiffErrorCode::TIFF_ERR_BLOCK_OFFSET_OUT_OF_RANGE;
+		if (ReadSequence(buf, (size_t)(row_bytes * rows), 1) != 1)
+			return TiffErrorCode::TIFF_ERR_READ_DATA_FROM_FILE_FAILED;
+		return TiffErrorCode::TIFF_STATUS_OK;
+	}
+	for (uint32_t i = 0; i < rows; i++)
+	{
+		if (i == 0 || !whole_rows) {
+			if (_fseeki64(_tiff_hdl, cur_offset + (first_row + i) * block_row_size + row_offset, SEEK_SET) != 0)
+				return TiffErrorCode::TIFF_ERR_BLOCK_OFFSET_OUT_OF_RANGE;
+		}
+		if (ReadSequence(buf + i * stride, (size_t)row_bytes, 1) != 1)
+			return TiffErrorCode::TIFF_ERR_READ_DATA_FROM_FILE_FAILED;
+	}
+	return TiffErrorCode::TIFF_STATUS_OK;
+}
+
 TiffErrorCode tiff_ifd::set_tag(const uint16_t tag_id, const uint16_t tag_data_type, const uint32_t tag_count, void* buf)
 {
 	if (tag_count < 1) {
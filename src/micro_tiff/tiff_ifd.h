@@ -12,15 +12,19 @@ public:
 	tiff_ifd(bool is_big_tiff, bool is_big_endian, FILE* hdl);
 	~tiff_ifd(void);
 	TiffErrorCode wr_ifd_info(const ImageInfo& image_info);
+	TiffErrorCode wr_compression(uint16_t compression, uint16_t predictor, uint16_t shuffle);
 	//TiffErrorCode wr_close(void);
 	TiffErrorCode wr_purge(void);
 	TiffErrorCode wr_block(uint32_t block_no, uint64_t buf_size, const uint8_t* buf);
+	TiffErrorCode wr_block_rows(uint32_t block_no, uint64_t block_row_size, uint32_t block_rows, const uint8_t* buf, uint64_t row_bytes, uint32_t rows, uint64_t stride);
 
 	//TiffErrorCode rd_init(FILE* hdl);
 	//TiffErrorCode rd_close(void);
 	TiffErrorCode load_ifd(uint64_t ifd_offset);
 	void rd_ifd_info(ImageInfo& image_info) const;
 	TiffErrorCode rd_block(uint32_t block_no, uint64_t& buf_size, uint8_t* buf);
+	TiffErrorCode rd_blocks(const uint32_t* block_nos, uint32_t count, uint64_t* sizes, uint8_t* buf);
+	TiffErrorCode rd_block_rows(uint32_t block_no, uint64_t block_row_size, uint32_t first_row, uint32_t rows, uint64_t row_offset, uint64_t row_bytes, uint8_t* buf, uint64_t stride);
 
 	TiffErrorCode set_tag(uint16_t tag_id, uint16_t tag_data_type, uint32_t tag_count, void* buf);
 	TiffErrorCode get_tag_info(uint16_t tag_id, uint16_t& tag_data_type, uint32_t& tag_count);
@@ -152,6 +152,7 @@ namespace ome
 		TIFF_ERR_APPEND_TAG_NOT_ALLOWED = -25,
 		TIFF_ERR_DUPLICATE_WRITE_NOT_ALLOWED = -26,
 		TIFF_ERR_BIGENDIAN_NOT_SUPPORT = -27,
+		TIFF_ERR_WRITE_DATA_TO_FILE_FAILED = -28,
 
 		ERR_FILE_PATH_ERROR = -101,
 		ERR_HANDLE_NOT_EXIST = -102,
@@ -215,6 +216,14 @@ namespace ome
 		ERR_CHANNEL_BIN_SIZE = -164,
 		ERR_CHANNEL_SAMPLES_PER_PIXEL = -165,
 		ERR_BOOT_IFD_ALREADY_EXIST = -166,
+		ERR_SHUFFLE_FAILED = -167,
+		ERR_COMPRESS_JPEG_FAILED = -168,
+		ERR_FLOATING_POINT_PREDICTOR_FAILED = -169,
+		ERR_PYRAMID_LEVEL_NOT_EXIST = -170,
+		ERR_SAVE_QUEUE_FULL = -171,
+		ERR_SAVE_PENDING = -172,
+		ERR_SAVE_TICKET_NOT_EXIST = -173,
+		ERR_METADATA_CACHE_INVALID = -174,
 	};
 
 	enum class DistanceUnit {
@@ -282,8 +291,35 @@ namespace ome
 		COMPRESSIONMODE_NONE = 0,
 		//COMPRESSIONMODE_LZ4 = 1,
 		COMPRESSIONMODE_LZW = 2,
-		//COMPRESSIONMODE_JPEG = 3,
+		COMPRESSIONMODE_JPEG = 3,		//only for 8 bits gray or RGB data
 		//COMPRESSIONMODE_ZIP = 4,
+		COMPRESSIONMODE_AUTO = 5,		//lossless, none, LZW or LZW with byte shuffle chosen per frame by trial compression of its first tiles
+	};
+
+	//Pre-filter before compression, only useful when CompressionMode is not COMPRESSIONMODE_NONE.
+	enum class ShuffleMode {
+		SHUFFLEMODE_NONE = 0,
+		SHUFFLEMODE_BYTE = 1,	//better for 16 bits and 32 bits data
+		SHUFFLEMODE_BIT = 2,
+	};
+
+	//Files the frames are saved in, the OME-XML tells the file and the IFD of every frame so reading needs nothing to set.
+	enum class FileLayout {
+		FILELAYOUT_SCAN_CHANNEL = 0,	//one "<name>_s<scan>c<channel>.tid" file per scan and channel next to the header file
+		FILELAYOUT_PACKED = 1,			//all frames in the header file, but frames of binned channels in one "<name>_b<bin>.tid" file per bin size
+	};
+
+	//What ome_save_tile_data_async does when the save queue is full.
+	enum class QueueFullMode {
+		QUEUEFULL_BLOCK = 0,	//wait until a worker takes a tile
+		QUEUEFULL_FAIL = 1,		//return ERR_SAVE_QUEUE_FULL at once
+	};
+
+	//Use of the binary metadata cache saved next to the OME-TIFF file ("<file name>.omecache").
+	enum class MetadataCacheMode {
+		METADATACACHE_OFF = 0,			//always parse the OME-XML
+		METADATACACHE_READ = 1,			//load a cache matching the OME-XML, parse the OME-XML otherwise
+		METADATACACHE_READ_WRITE = 2,	//also save the cache when it is missing or out of date
 	};
 
 	////User can define any custom tag id between (CustomTag_First, CustomTag_Last), CustomTag_First and CustomTag_Last are not valid tag id.
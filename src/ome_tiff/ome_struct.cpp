@@ -1,4 +1,5 @@
 #include "ome_struct.h"
+#include <algorithm>
 
 using namespace std;
 
@@ -27,31 +28,15 @@ namespace ome
 		return *this;
 	}
 
-	int32_t Well::add_well_sample(uint32_t plate_id, ScanRegionInfo& scan_region_info, string& well_sample_id, string& image_ref_id)
+	int32_t Well::create_well_sample(ScanRegionInfo& scan_region_info, uint32_t image_id, uint32_t& well_sample_id)
 	{
-		well_sample_id = "WellSample:" + to_string(plate_id) + "." + to_string(_info.id) + "." + to_string(_well_sample_id_index);
-		WellSample well_sample;
-		well_sample.position_x = scan_region_info.start_physical_x;
-		well_sample.position_y = scan_region_info.start_physical_y;
-		well_sample.position_z = scan_region_info.start_physical_z;
-		well_sample.physicalsize_unit_x = scan_region_info.start_unit_x;
-		well_sample.physicalsize_unit_y = scan_region_info.start_unit_y;
-		well_sample.physicalsize_unit_z = scan_region_info.start_unit_z;
-		well_sample.id = well_sample_id;
-		well_sample.image_ref_id = image_ref_id;
-		_well_sample_array[_well_sample_id_index] = well_sample;
-		_well_sample_id_index++;
-		return ErrorCode::STATUS_OK;
+		well_sample_id = _well_sample_id_index;
+		return add_well_sample(scan_region_info, well_sample_id, image_id);
 	}
 
-	int32_t Well::add_well_sample(ScanRegionInfo& scan_region_info, const string& well_sample_id, const string& image_ref_id)
+	int32_t Well::add_well_sample(ScanRegionInfo& scan_region_info, uint32_t well_sample_id, uint32_t image_id)
 	{
-		uint32_t well_sample_pure_id = 0;
-		int result_sscanf = sscanf_s(well_sample_id.c_str(), "WellSample:%*u.%*u.%u", &well_sample_pure_id);
-		if (result_sscanf <= 0)
-			return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-		auto it = _well_sample_array.find(well_sample_pure_id);
+		auto it = _well_sample_array.find(well_sample_id);
 		if (it != _well_sample_array.end())
 			return ErrorCode::ERR_WELL_SAMPLE_ID_EXIST;
 
@@ -62,46 +47,55 @@ namespace ome
 		well_sample.physicalsize_unit_x = scan_region_info.start_unit_x;
 		well_sample.physicalsize_unit_y = scan_region_info.start_unit_y;
 		well_sample.physicalsize_unit_z = scan_region_info.start_unit_z;
-		well_sample.id = well_sample_id;
-		well_sample.image_ref_id = image_ref_id;
-		_well_sample_array[well_sample_pure_id] = well_sample;
-		if (_well_sample_id_index <= well_sample_pure_id)
-			_well_sample_id_index = well_sample_pure_id + 1;
+		well_sample.image_id = image_id;
+		_well_sample_array[well_sample_id] = well_sample;
+		if (_well_sample_id_index <= well_sample_id)
+			_well_sample_id_index = well_sample_id + 1;
 		return ErrorCode::STATUS_OK;
 	}
 
 	PlateAcquisition::PlateAcquisition()
 	{
-		_id = "";
 		_well_sample_ref.clear();
+		_well_regions.clear();
 	}
 
 	PlateAcquisition::~PlateAcquisition()
 	{
-		_id = "";
 		_well_sample_ref.clear();
+		_well_regions.clear();
 	}
 
 	PlateAcquisition& PlateAcquisition::operator=(const PlateAcquisition& plate_acquisition)
 	{
 		if (this != &plate_acquisition)
 		{
-			this->_id = plate_acquisition._id;
 			this->_well_sample_ref = plate_acquisition._well_sample_ref;
+			this->_well_regions = plate_acquisition._well_regions;
 		}
 		return *this;
 	}
 
-	int32_t PlateAcquisition::add_well_sample_ref(uint32_t region_id, const string& well_sample_ref_id)
+	int32_t PlateAcquisition::add_well_sample_ref(uint32_t region_id, const WellSampleRef& well_sample_ref)
 	{
 		auto it = _well_sample_ref.find(region_id);
 		if (it != _well_sample_ref.end())
 			return ErrorCode::ERR_SCAN_REGION_ID_EXIST;
 
-		_well_sample_ref[region_id] = well_sample_ref_id;
+		_well_sample_ref[region_id] = well_sample_ref;
+		vector<uint32_t>& regions = _well_regions[well_sample_ref.well_id];
+		regions.insert(lower_bound(regions.begin(), regions.end(), region_id), region_id);
 		return ErrorCode::STATUS_OK;
 	}
 
+	const vector<uint32_t>* PlateAcquisition::get_well_regions(uint32_t well_id) const
+	{
+		auto it = _well_regions.find(well_id);
+		if (it == _well_regions.end())
+			return nullptr;
+		return &it->second;
+	}
+
 	Plate::Plate()
 	{
 		_info = { 0 };
@@ -369,7 +363,6 @@ namespace ome
 	{
 		if (this != &image)
 		{
-			this->_id = image._id;
 			this->_name = image._name;
 			this->_pixels = image._pixels;
 		}
@@ -2,6 +2,7 @@
 #include "ome_def.h"
 #include <string>
 #include <map>
+#include <vector>
 
 namespace ome
 {
@@ -12,41 +13,50 @@ namespace ome
 		DistanceUnit physicalsize_unit_x;
 		DistanceUnit physicalsize_unit_y;
 		DistanceUnit physicalsize_unit_z;
-		std::string id;
-		std::string image_ref_id;
+		uint32_t image_id;		//<ImageRef ID="Image:<image_id>" />
 	};
 
 	class Well
 	{
 	public:
 		WellInfo _info;
-		//key "WellSample ID"
+		//key: well sample id, "WellSample:<plate id>.<well id>.<well sample id>"
 		std::map<uint32_t, WellSample> _well_sample_array;
 
 		Well();
 		~Well();
 		Well& operator=(const Well& well);
 
-		int32_t add_well_sample(uint32_t plate_id, ScanRegionInfo& scan_region_info, std::string& well_sample_id, std::string& image_ref_id);
-		int32_t add_well_sample(ScanRegionInfo& scan_region_info, const std::string& well_sample_id, const std::string& image_ref_id);
+		int32_t create_well_sample(ScanRegionInfo& scan_region_info, uint32_t image_id, uint32_t& well_sample_id);
+		int32_t add_well_sample(ScanRegionInfo& scan_region_info, uint32_t well_sample_id, uint32_t image_id);
 
 	private:
 		uint32_t _well_sample_id_index;
 	};
 
+	//<WellSampleRef ID="WellSample:1.1.1" RegionID="0" / >, with the image of the well sample
+	struct WellSampleRef
+	{
+		uint32_t well_id;
+		uint32_t well_sample_id;
+		uint32_t image_id;
+	};
+
+	//ID "PlateAcquisition:<plate id>.<scan id>"
 	class PlateAcquisition
 	{
 	public:
-		std::string _id;
-		//<WellSampleRef ID="WellSample:1.1.1" RegionID="0" / >
-		//key "RegionID", value "ID"
-		std::map<uint32_t, std::string> _well_sample_ref;
+		//key "RegionID"
+		std::map<uint32_t, WellSampleRef> _well_sample_ref;
+		//key: well id, value: region ids in ascending order
+		std::map<uint32_t, std::vector<uint32_t>> _well_regions;
 
 		PlateAcquisition();
 		~PlateAcquisition();
 		PlateAcquisition& operator=(const PlateAcquisition& plate_acquisition);
 
-		int32_t add_well_sample_ref(uint32_t region_id, const std::string& well_sample_ref_id);
+		int32_t add_well_sample_ref(uint32_t region_id, const WellSampleRef& well_sample_ref);
+		const std::vector<uint32_t>* get_well_regions(uint32_t well_id) const;
 	private:
 	};
 
@@ -179,10 +189,10 @@ namespace ome
 		uint32_t _t_max;
 	};
 
+	//ID "Image:<key in the images map>"
 	class Image
 	{
 	public:
-		std::string _id;
 		std::string _name;
 		Pixels _pixels;
 		Image& operator=(const Image& image);
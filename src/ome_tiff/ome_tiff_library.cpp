@@ -3,6 +3,7 @@
 #include <vector>
 
 static std::vector<OmeTiff*> vecOmeTiff;
+static ome::MetadataCacheMode metadataCacheMode = ome::MetadataCacheMode::METADATACACHE_OFF;
 using namespace ome;
 
 #ifndef CHECK_HANDLE
@@ -35,6 +36,7 @@ int32_t ome_open_file(const wchar_t* file_name, OpenMode mode, CompressionMode c
 	if (tiff == nullptr) {
 		return ErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
 	}
+	tiff->SetMetadataCache(metadataCacheMode);
 	int32_t ret = tiff->Init(full_file_name, mode, cm);
 	if (ret == ErrorCode::STATUS_OK) {
 		for (size_t i = 0; i < vecOmeTiff.size(); i++)
@@ -62,6 +64,38 @@ int32_t ome_close_file(int32_t handle)
 	return status;
 }
 
+int32_t ome_set_metadata_cache(MetadataCacheMode mode)
+{
+	switch (mode)
+	{
+	case MetadataCacheMode::METADATACACHE_OFF:
+	case MetadataCacheMode::METADATACACHE_READ:
+	case MetadataCacheMode::METADATACACHE_READ_WRITE:
+		metadataCacheMode = mode;
+		return ErrorCode::STATUS_OK;
+	default:
+		return ErrorCode::ERR_PARAMETER_INVALID;
+	}
+}
+
+int32_t ome_set_shuffle_mode(int32_t handle, ShuffleMode sm)
+{
+	CHECK_HANDLE(handle);
+	return vecOmeTiff[handle]->SetShuffleMode(sm);
+}
+
+int32_t ome_set_pyramid_levels(int32_t handle, uint32_t levels)
+{
+	CHECK_HANDLE(handle);
+	return vecOmeTiff[handle]->SetPyramidLevels(levels);
+}
+
+int32_t ome_set_file_layout(int32_t handle, FileLayout layout)
+{
+	CHECK_HANDLE(handle);
+	return vecOmeTiff[handle]->SetFileLayout(layout);
+}
+
 int32_t ome_add_plate(int32_t handle, PlateInfo plates_info)
 {
 	CHECK_HANDLE(handle);
@@ -170,6 +204,35 @@ int32_t ome_save_tile_data(int32_t handle, void* image_data, FrameInfo frame, ui
 	return vecOmeTiff[handle]->SaveTileData(frame, row, column, image_data, stride);
 }
 
+int32_t ome_save_tile_data_async(int32_t handle, void* image_data, FrameInfo frame, uint32_t row, uint32_t column, uint32_t stride, uint64_t* ticket)
+{
+	CHECK_HANDLE(handle);
+	CHECK_BUFFER(image_data);
+	uint64_t tile_ticket = 0;
+	int32_t status = vecOmeTiff[handle]->SaveTileDataAsync(frame, row, column, image_data, stride, tile_ticket);
+	if (ticket != nullptr)
+		*ticket = tile_ticket;
+	return status;
+}
+
+int32_t ome_set_save_queue(int32_t handle, uint32_t capacity, QueueFullMode full_mode, uint32_t workers)
+{
+	CHECK_HANDLE(handle);
+	return vecOmeTiff[handle]->SetSaveQueue(capacity, full_mode, workers);
+}
+
+int32_t ome_get_save_status(int32_t handle, uint64_t ticket)
+{
+	CHECK_HANDLE(handle);
+	return vecOmeTiff[handle]->GetSaveStatus(ticket);
+}
+
+int32_t ome_flush(int32_t handle)
+{
+	CHECK_HANDLE(handle);
+	return vecOmeTiff[handle]->Flush();
+}
+
 int32_t ome_purge_frame(int32_t handle, FrameInfo frame)
 {
 	CHECK_HANDLE(handle);
@@ -184,6 +247,13 @@ int32_t ome_get_raw_data(int32_t handle, FrameInfo frame, OmeRect src_rect, void
 	return vecOmeTiff[handle]->LoadRawData(frame, dst_size, src_rect, image_data, stride);
 }
 
+int32_t ome_get_scaled_raw_data(int32_t handle, FrameInfo frame, OmeRect src_rect, OmeSize dst_size, void* image_data, uint32_t stride)
+{
+	CHECK_HANDLE(handle);
+	CHECK_BUFFER(image_data);
+	return vecOmeTiff[handle]->LoadRawData(frame, dst_size, src_rect, image_data, stride);
+}
+
 int32_t ome_get_raw_tile_data(int32_t handle, FrameInfo frame, uint32_t row, uint32_t column, void* image_data, uint32_t stride)
 {
 	CHECK_HANDLE(handle);
@@ -191,6 +261,19 @@ int32_t ome_get_raw_tile_data(int32_t handle, FrameInfo frame, uint32_t row, uin
 	return vecOmeTiff[handle]->LoadRawData(frame, row, column, image_data, stride);
 }
 
+int32_t ome_get_pyramid_levels(int32_t handle, FrameInfo frame)
+{
+	CHECK_HANDLE(handle);
+	return vecOmeTiff[handle]->GetPyramidLevels(frame);
+}
+
+int32_t ome_get_level_data(int32_t handle, FrameInfo frame, uint32_t level, OmeRect src_rect, void* image_data, uint32_t stride)
+{
+	CHECK_HANDLE(handle);
+	CHECK_BUFFER(image_data);
+	return vecOmeTiff[handle]->LoadLevelData(frame, level, src_rect, image_data, stride);
+}
+
 int32_t ome_get_tag(int32_t handle, FrameInfo frame, uint16_t tag_id, TiffTagDataType* tag_type, uint32_t* tag_count, void* tag_value)
 {
 	CHECK_HANDLE(handle);
@@ -27,6 +27,10 @@ Important Tips:
  * @note		"cm" is useful in write or create mode and only for raw data saved by function ome_save_tile_data.
  *				It need more CPU resource if you choose any compression mode. You should take care about that.
  *				In some extreme case, you can not save disk space when you choose an compression method such as LZW.
+ *				COMPRESSIONMODE_JPEG is lossy and only supports 8 bits gray or RGB data. Tiles saved from different threads are encoded in parallel.
+ *				COMPRESSIONMODE_AUTO encodes the first tiles saved into each frame (up to 4) with every lossless codec and keeps the best for the whole frame,
+ *				frames whose sample is noisy are saved without compression. These tiles are held in memory and written once the codec is chosen,
+ *				or when the frame is closed. Later tiles of an LZW frame are saved as LZW even when one of them doesn't shrink. The shuffle mode is ignored.
  */
 OME_TIFF_LIBRARY_API int32_t ome_open_file(const wchar_t* file_name, ome::OpenMode mode, 
 	ome::CompressionMode cm = ome::CompressionMode::COMPRESSIONMODE_NONE);
@@ -42,6 +46,68 @@ OME_TIFF_LIBRARY_API int32_t ome_open_file(const wchar_t* file_name, ome::OpenMo
  */
 OME_TIFF_LIBRARY_API int32_t ome_close_file(int32_t handle);
 
+/**
+ * @brief		Set how the files opened after this call use the binary metadata cache.
+ * 
+ * @param[in] mode					Metadata cache mode
+ * 
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ * 
+ * @note		Only useful in read only and read write mode, the default is METADATACACHE_OFF.
+ *				The cache is saved next to the header file as "<file name>.omecache" and holds the metadata model parsed from the OME-XML,
+ *				opening a file with a large plate then reads it at once instead of parsing the OME-XML.
+ *				A cache saved from another OME-XML, or before a container file was added or removed, is ignored and the OME-XML is parsed.
+ *				With METADATACACHE_READ_WRITE such a cache is saved again, the file is still opened if the cache can't be saved.
+ */
+OME_TIFF_LIBRARY_API int32_t ome_set_metadata_cache(ome::MetadataCacheMode mode);
+
+/**
+ * @brief		Set the shuffle filter applied to raw data before compression.
+ * 
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] sm					Shuffle mode
+ * 
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ * 
+ * @note		Only useful in create mode and when "cm" of "ome_open_file" is COMPRESSIONMODE_LZW.
+ *				Only affect the frames created after this call, the filter is recorded in each frame so reading needs nothing to set.
+ *				Byte shuffle usually makes 16 bits data smaller, it changes nothing for 8 bits data.
+ */
+OME_TIFF_LIBRARY_API int32_t ome_set_shuffle_mode(int32_t handle, ome::ShuffleMode sm);
+
+/**
+ * @brief		Set how many reduced resolution levels are built for the frames saved by ome_save_tile_data.
+ * 
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] levels				Most levels of each frame, "0" builds none, which is the default.
+ * 
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ * 
+ * @note		Only useful in create mode, only affect the frames created after this call.
+ *				Every level is half the width and height of the previous one, each pixel is the average of 2x2 pixels.
+ *				A level tile is saved as soon as its 4 tiles of the previous level are saved, the others when the frame is purged.
+ *				No more level is built once a level fits in one tile. Tile width and height must be even, otherwise no level is built.
+ *				Levels are saved with the compression of the frame and read with ome_get_level_data.
+ *				Levels are saved as SubIFDs of the frame's IFD, as other OME-TIFF readers expect for pyramids.
+ */
+OME_TIFF_LIBRARY_API int32_t ome_set_pyramid_levels(int32_t handle, uint32_t levels);
+
+/**
+ * @brief		Set the files the frames saved by ome_save_tile_data are saved in.
+ * 
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] layout				File layout, FILELAYOUT_SCAN_CHANNEL by default.
+ * 
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ * 
+ * @note		Only useful in create mode, only affect the frames created after this call.
+ *				FILELAYOUT_PACKED saves the frames in the opened file itself, a file of hundreds of scans and channels is then
+ *				one file to open or copy. Frames of channels with "bin_size" larger than 1 are saved in one file per bin size.
+ *				Tiles are still compressed in parallel, but the frames of one file are written one tile at a time.
+ *				Frames may be purged in any order.
+ */
+OME_TIFF_LIBRARY_API int32_t ome_set_file_layout(int32_t handle, ome::FileLayout layout);
+
 /**
  * @brief		Add plate info to an opened ome-tiff file.
  * @details		PlateInfo tells the total size of the experiment and it include one or more Well inside.
@@ -275,6 +341,69 @@ OME_TIFF_LIBRARY_API int32_t ome_get_scan_regions_num(int32_t handle, uint32_t p
 */
 OME_TIFF_LIBRARY_API int32_t ome_save_tile_data(int32_t handle, void* image_data, ome::FrameInfo frame, uint32_t row, uint32_t column, uint32_t stride = 0);
 
+/**
+ * @brief		Save one tile like ome_save_tile_data, but return as soon as the tile is copied to the save queue.
+ *				The shared threads of the library compress and write the queued tiles, they also run the parallel loops of the codecs.
+ *
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] image_data			The buffer which carry the image, it can be reused when this function returns.
+ * @param[in] frame					The information of current image.
+ * @param[in] row					The row index located.
+ * @param[in] column				The column index located.
+ * @param[in] stride				The buffer stride of "image_data". "0" means stride is equal with tile's byte size of width.
+ * @param[out] ticket				Ticket of the tile for ome_get_save_status, can be nullptr.
+ *
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ *  @retval		ERR_SAVE_QUEUE_FULL The queue is full and ome_set_save_queue chose QUEUEFULL_FAIL, the tile is not saved.
+ *
+ * @note		Errors of the frame or of the tile index are returned at once, errors of the compression or of the writing
+ *				are returned by ome_get_save_status, ome_flush and ome_close_file.
+ *				ome_purge_frame waits for the queued tiles of its frame, ome_flush and ome_close_file for all of them.
+ *				Tiles of one file may be saved by ome_save_tile_data and this function together.
+*/
+OME_TIFF_LIBRARY_API int32_t ome_save_tile_data_async(int32_t handle, void* image_data, ome::FrameInfo frame, uint32_t row, uint32_t column,
+	uint32_t stride = 0, uint64_t* ticket = nullptr);
+
+/**
+ * @brief		Set the size of the save queue used by ome_save_tile_data_async.
+ *
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] capacity				Most tiles waiting for a worker, 64 by default.
+ * @param[in] full_mode				Wait for room or fail when the queue is full, QUEUEFULL_BLOCK by default.
+ * @param[in] workers				Most tiles compressed at the same time, "0" means the thread limit of the process, which is the default.
+ *
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ *
+ * @note		Only useful in write or create mode. Wait for the queued tiles before the settings change.
+ *				The memory used by the queue is about ("capacity" + "workers") tiles.
+*/
+OME_TIFF_LIBRARY_API int32_t ome_set_save_queue(int32_t handle, uint32_t capacity, ome::QueueFullMode full_mode, uint32_t workers = 0);
+
+/**
+ * @brief		Get the result of a tile saved by ome_save_tile_data_async.
+ *
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] ticket				Ticket returned by ome_save_tile_data_async.
+ *
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ *  @retval		STATUS_OK The tile is saved.
+ *  @retval		ERR_SAVE_PENDING The tile is still in the queue or being saved.
+ *  @retval		ERR_SAVE_TICKET_NOT_EXIST No tile has this ticket.
+ *  @retval		<0 The error of the save.
+*/
+OME_TIFF_LIBRARY_API int32_t ome_get_save_status(int32_t handle, uint64_t ticket);
+
+/**
+ * @brief		Wait until all the tiles saved by ome_save_tile_data_async are written.
+ *
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ *
+ * @return		The first error of the tiles saved since the previous ome_flush, or STATUS_OK.
+ *
+ * @note		The error of each tile is still returned by ome_get_save_status.
+*/
+OME_TIFF_LIBRARY_API int32_t ome_flush(int32_t handle);
+
 /**
  * @brief		When all the tile data of a frame are saved, you must call this function to write its ifd.
  *
@@ -285,6 +414,7 @@ OME_TIFF_LIBRARY_API int32_t ome_save_tile_data(int32_t handle, void* image_data
  *
  * @note		If you call this function before all tile data saved, you can not save remaining tile data.
  *				Carefully call this function, if you never call this function, image data also saved after you call "ome_close_file".
+ *				Tiles of the frame still queued by ome_save_tile_data_async are written first.
 */
 OME_TIFF_LIBRARY_API int32_t ome_purge_frame(int32_t handle, ome::FrameInfo frame);
 
@@ -303,6 +433,25 @@ OME_TIFF_LIBRARY_API int32_t ome_purge_frame(int32_t handle, ome::FrameInfo fram
 */
 OME_TIFF_LIBRARY_API int32_t ome_get_raw_data(int32_t handle, ome::FrameInfo frame, ome::OmeRect src_rect, void* image_data, uint32_t stride = 0);
 
+/**
+ * @brief		Load raw data from OME-TIFF file and resample it to another size.
+ *
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] frame					The information of current image.
+ * @param[in] src_rect				The area you want to get in an image.
+ * @param[in] dst_size				Size of the data in "image_data".
+ * @param[out] image_data			Buffer to get the resampled area.
+ * @param[in] stride				The buffer stride of "image_data". Default parameter "0" means stride is equal with "dst_size" 's byte size of width.
+ *
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ *
+ * @note		A smaller size averages the pixels covered by each destination pixel, a larger size interpolates bilinearly.
+ *				The area is decoded tile row by tile row, no buffer of the whole area is needed.
+ *				When the frame has reduced resolution levels (ome_set_pyramid_levels), the smallest level still larger than "dst_size"
+ *				is read instead of the full resolution image.
+*/
+OME_TIFF_LIBRARY_API int32_t ome_get_scaled_raw_data(int32_t handle, ome::FrameInfo frame, ome::OmeRect src_rect, ome::OmeSize dst_size, void* image_data, uint32_t stride = 0);
+
 /**
  * @brief		Load raw data from OME-TIFF file with specific row index and column index.
  * @detail		Raw data is separate by tile width and tile height, use this function to get specific tile data.
@@ -319,6 +468,34 @@ OME_TIFF_LIBRARY_API int32_t ome_get_raw_data(int32_t handle, ome::FrameInfo fra
  */
 OME_TIFF_LIBRARY_API int32_t ome_get_raw_tile_data(int32_t handle, ome::FrameInfo frame, uint32_t row, uint32_t column, void* image_data, uint32_t stride = 0);
 
+/**
+ * @brief		Get the number of reduced resolution levels saved for a frame.
+ *
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] frame					The information of current image.
+ *
+ * @return		Number of levels or Error code.
+ *  @retval		>=0 Number of levels, not counting the full resolution image.
+ *  @retval		<0 Error code defines by "ErrorCode" in "ome.def.h".
+ */
+OME_TIFF_LIBRARY_API int32_t ome_get_pyramid_levels(int32_t handle, ome::FrameInfo frame);
+
+/**
+ * @brief		Load data of a reduced resolution level from OME-TIFF file.
+ *
+ * @param[in] handle				Handle of an opened ome-tiff file.
+ * @param[in] frame					The information of current image.
+ * @param[in] level					"0" is the full resolution image, level "n" is 2^n times smaller in width and height.
+ * @param[in] src_rect				The area you want to get, in pixels of the level.
+ * @param[out] image_data			Buffer to get the specific area of the level.
+ * @param[in] stride				The buffer stride of "image_data". Default parameter "0" means stride is equal with "src_rect" 's byte size of width.
+ *
+ * @return		Error code defines by "ErrorCode" in "ome.def.h".
+ *
+ * @note		The size of level "n" is the size of level "n-1" divided by 2 and rounded up.
+*/
+OME_TIFF_LIBRARY_API int32_t ome_get_level_data(int32_t handle, ome::FrameInfo frame, uint32_t level, ome::OmeRect src_rect, void* image_data, uint32_t stride = 0);
+
 /**
  * @brief		Get data of tag with specific frame saved in tiff file.
  *
@@ -1,6 +1,7 @@
 //#include "jpeg_handler.h"
 #include "ometiff.h"
 #include "ometiff_info.h"
+#include "ometiff_cache.h"
 #include <filesystem>
 #include <sstream>
 
@@ -16,6 +17,10 @@ OmeTiff::OmeTiff(void )
 {
 	_open_mode = OpenMode::READ_ONLY_MODE;
 	_compression_mode = CompressionMode::COMPRESSIONMODE_NONE;
+	_shuffle_mode = ShuffleMode::SHUFFLEMODE_NONE;
+	_file_layout = FileLayout::FILELAYOUT_SCAN_CHANNEL;
+	_metadata_cache = MetadataCacheMode::METADATACACHE_OFF;
+	_pyramid_levels = 0;
 	_images.clear();
 	_plates.clear();
 	_raw_file_containers.clear();
@@ -30,6 +35,9 @@ OmeTiff::OmeTiff(void )
 
 OmeTiff::~OmeTiff(void)
 {
+	//queued tiles are saved before their containers are deleted
+	_save_queue.Stop();
+
 	for (auto it = _plates.begin(); it != _plates.end(); it++)
 	{
 		if (it->second)
@@ -150,13 +158,51 @@ int32_t OmeTiff::Init(const wchar_t* file_name, const OpenMode mode, const Compr
 			return result;
 
 		_is_in_parsing = true;
-		result = parse_ome_xml((char*)xml, this);
+		result = LoadMetadata((char*)xml);
 		_is_in_parsing = false;
+		if (result == ErrorCode::STATUS_OK)
+			BuildFrameIndex();
 	}
 
 	return result;
 }
 
+int32_t OmeTiff::SetShuffleMode(const ShuffleMode sm)
+{
+	CHECK_OPENMODE(_open_mode);
+	switch (sm)
+	{
+	case ShuffleMode::SHUFFLEMODE_NONE:
+	case ShuffleMode::SHUFFLEMODE_BYTE:
+	case ShuffleMode::SHUFFLEMODE_BIT:
+		_shuffle_mode = sm;
+		return ErrorCode::STATUS_OK;
+	default:
+		return ErrorCode::ERR_PARAMETER_INVALID;
+	}
+}
+
+int32_t OmeTiff::SetPyramidLevels(const uint32_t levels)
+{
+	CHECK_OPENMODE(_open_mode);
+	_pyramid_levels = levels;
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t OmeTiff::SetFileLayout(const FileLayout layout)
+{
+	CHECK_OPENMODE(_open_mode);
+	switch (layout)
+	{
+	case FileLayout::FILELAYOUT_SCAN_CHANNEL:
+	case FileLayout::FILELAYOUT_PACKED:
+		_file_layout = layout;
+		return ErrorCode::STATUS_OK;
+	default:
+		return ErrorCode::ERR_PARAMETER_INVALID;
+	}
+}
+
 int32_t OmeTiff::SaveTileData(FrameInfo frame, uint32_t row, uint32_t column, void* image_data, uint32_t stride)
 {
 	CHECK_OPENMODE(_open_mode);
@@ -169,6 +215,57 @@ int32_t OmeTiff::SaveTileData(FrameInfo frame, uint32_t row, uint32_t column, vo
 	return container->SaveTileData(ifd_no, row, column, image_data, stride);
 }
 
+int32_t OmeTiff::SaveTileDataAsync(FrameInfo frame, uint32_t row, uint32_t column, void* image_data, uint32_t stride, uint64_t& ticket)
+{
+	CHECK_OPENMODE(_open_mode);
+	TiffContainer* container = nullptr;
+	uint32_t ifd_no;
+	int32_t status = GetRawContainer(frame, &container, ifd_no, false);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	OmeRect rect = { 0 };
+	ImageInfo image_info = { 0 };
+	status = container->GetTileRect(ifd_no, row, column, rect, image_info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	//copied to a whole tile width, so the worker compresses it without another copy
+	uint32_t bytes_per_pixel = image_info.image_byte_count * image_info.samples_per_pixel;
+	uint32_t buf_width = stride == 0 ? rect.width : stride / bytes_per_pixel;
+	uint32_t src_stride = stride == 0 ? buf_width * bytes_per_pixel : stride;
+	uint32_t copy_size = (min)(buf_width, rect.width) * bytes_per_pixel;
+	uint32_t tile_stride = image_info.block_width * bytes_per_pixel;
+	unique_ptr<uint8_t[]> tile(new(nothrow) uint8_t[(size_t)tile_stride * rect.height]);
+	if (tile == nullptr)
+		return ErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
+	for (uint32_t h = 0; h < rect.height; h++)
+	{
+		uint8_t* dst = tile.get() + (size_t)h * tile_stride;
+		memcpy(dst, (uint8_t*)image_data + (size_t)h * src_stride, copy_size);
+		memset(dst + copy_size, 0, tile_stride - copy_size);
+	}
+
+	return _save_queue.Push(container, ifd_no, row, column, std::move(tile), tile_stride, ticket);
+}
+
+int32_t OmeTiff::SetSaveQueue(uint32_t capacity, QueueFullMode full_mode, uint32_t workers)
+{
+	CHECK_OPENMODE(_open_mode);
+	return _save_queue.Configure(capacity, full_mode, workers);
+}
+
+int32_t OmeTiff::GetSaveStatus(uint64_t ticket)
+{
+	return _save_queue.GetStatus(ticket);
+}
+
+int32_t OmeTiff::Flush()
+{
+	CHECK_OPENMODE(_open_mode);
+	return _save_queue.Flush();
+}
+
 int32_t OmeTiff::PurgeFrame(FrameInfo frame)
 {
 	CHECK_OPENMODE(_open_mode);
@@ -178,6 +275,8 @@ int32_t OmeTiff::PurgeFrame(FrameInfo frame)
 	if (status != ErrorCode::STATUS_OK)
 		return status;
 
+	//tiles saved asynchronously must be in the frame before it is closed
+	_save_queue.WaitFrame(container, ifd_no);
 	return container->CloseIFD(ifd_no);
 }
 
@@ -186,9 +285,27 @@ int32_t OmeTiff::LoadRawData(FrameInfo frame, OmeSize dst_size, OmeRect src_rect
 	TiffContainer* container = nullptr;
 	uint32_t ifd_no;
 	int32_t status = GetRawContainer(frame, &container, ifd_no, true);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	vector<uint32_t> level_ifds;
+	status = container->GetPyramidIFDs(ifd_no, level_ifds);
 	if (status != ErrorCode::STATUS_OK)
 		return status;
 
+	//a reduced resolution level still as large as the destination is resampled instead of the full resolution image
+	uint32_t level = 0;
+	while (level < level_ifds.size() && (src_rect.width >> (level + 1)) >= dst_size.width && (src_rect.height >> (level + 1)) >= dst_size.height)
+		level++;
+	if (level > 0)
+	{
+		ifd_no = level_ifds[level - 1];
+		uint32_t round = (1u << level) - 1;
+		OmeRect level_rect = { src_rect.x >> level, src_rect.y >> level, 0, 0 };
+		level_rect.width = ((src_rect.x + src_rect.width + round) >> level) - level_rect.x;
+		level_rect.height = ((src_rect.y + src_rect.height + round) >> level) - level_rect.y;
+		src_rect = level_rect;
+	}
+
 	return container->LoadRectData(ifd_no, dst_size, src_rect, image_data, stride);
 }
 
@@ -203,6 +320,42 @@ int32_t OmeTiff::LoadRawData(FrameInfo frame, uint32_t row, uint32_t column, voi
 	return container->LoadTileData(ifd_no, row, column, image_data, stride);
 }
 
+int32_t OmeTiff::LoadLevelData(FrameInfo frame, uint32_t level, OmeRect src_rect, void* image_data, uint32_t stride)
+{
+	TiffContainer* container = nullptr;
+	uint32_t ifd_no;
+	int32_t status = GetRawContainer(frame, &container, ifd_no, true);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	vector<uint32_t> level_ifds;
+	status = container->GetPyramidIFDs(ifd_no, level_ifds);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	if (level > level_ifds.size())
+		return ErrorCode::ERR_PYRAMID_LEVEL_NOT_EXIST;
+	if (level > 0)
+		ifd_no = level_ifds[level - 1];
+
+	OmeSize dst_size = { src_rect.width, src_rect.height };
+	return container->LoadRectData(ifd_no, dst_size, src_rect, image_data, stride);
+}
+
+int32_t OmeTiff::GetPyramidLevels(FrameInfo frame)
+{
+	TiffContainer* container = nullptr;
+	uint32_t ifd_no;
+	int32_t status = GetRawContainer(frame, &container, ifd_no, true);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	vector<uint32_t> level_ifds;
+	status = container->GetPyramidIFDs(ifd_no, level_ifds);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	return (int32_t)level_ifds.size();
+}
+
 int32_t OmeTiff::AddPlate(PlateInfo& plate_info)
 {
 	if (!_is_in_parsing)
@@ -299,14 +452,11 @@ int32_t OmeTiff::AddScan(uint32_t plate_id, ScanInfo& scan_info)
 	if (status != ErrorCode::STATUS_OK)
 		return status;
 
-	PlateAcquisition plate_acquisition;
-	plate_acquisition._id = "PlateAcquisition:" + to_string(plate_id) + "." + to_string(scan_info.id);
-
 	auto it_plate_acquisition = it->second->_plate_acquisition_array.find(scan_info.id);
 	if (it_plate_acquisition != it->second->_plate_acquisition_array.end())
 		return ErrorCode::ERR_PLATE_ACQUISITION_ID_EXIST;
 
-	it->second->_plate_acquisition_array[scan_info.id] = plate_acquisition;
+	it->second->_plate_acquisition_array[scan_info.id] = PlateAcquisition();
 	return status;
 }
 
@@ -352,30 +502,11 @@ int32_t OmeTiff::AddChannel(uint32_t plate_id, uint32_t scan_id, ChannelInfo& ch
 	if (it_plate_acquisition == it_plate->second->_plate_acquisition_array.end())
 		return ErrorCode::ERR_PLATE_ACQUISITION_NOT_EXIST;
 
-	PlateAcquisition plate_acquisition = it_plate_acquisition->second;
+	const PlateAcquisition& plate_acquisition = it_plate_acquisition->second;
 
 	for (auto it_ref = plate_acquisition._well_sample_ref.begin(); it_ref != plate_acquisition._well_sample_ref.end(); it_ref++)
 	{
-		uint32_t well_id = 0;
-		uint32_t well_sample_id = 0;
-		int result_sscanf = sscanf_s(it_ref->second.c_str(), "WellSample:%*u.%u.%u", &well_id, &well_sample_id);
-		if (result_sscanf <= 0)
-			return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-		auto it_well = it_plate->second->_wells_array.find(well_id);
-		if (it_well == it_plate->second->_wells_array.end())
-			return ErrorCode::ERR_WELL_NOT_EXIST;
-
-	 	auto it_well_sample = it_well->second._well_sample_array.find(well_sample_id);
-		if (it_well_sample == it_well->second._well_sample_array.end())
-			return ErrorCode::ERR_WELL_SAMPLE_NOT_EXIST;
-
-		uint32_t image_id = 0;
-		result_sscanf = sscanf_s(it_well_sample->second.image_ref_id.c_str(), "Image:%u", &image_id);
-		if (result_sscanf <= 0)
-			return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-		auto it_image = _images.find(image_id);
+		auto it_image = _images.find(it_ref->second.image_id);
 		if (it_image != _images.end())
 		{
 			int32_t status = it_image->second->_pixels.add_channel(channel_info);
@@ -430,34 +561,11 @@ int32_t OmeTiff::RemoveChannel(uint32_t plate_id, uint32_t scan_id, uint32_t cha
 	if (it_plate_acquisition == it_plate->second->_plate_acquisition_array.end())
 		return ErrorCode::ERR_PLATE_ACQUISITION_NOT_EXIST;
 
-	PlateAcquisition plate_acquisition = it_plate_acquisition->second;
+	const PlateAcquisition& plate_acquisition = it_plate_acquisition->second;
 
 	for (auto it_ref = plate_acquisition._well_sample_ref.begin(); it_ref != plate_acquisition._well_sample_ref.end(); it_ref++)
 	{
-		uint32_t well_id = 0;
-		uint32_t well_sample_id = 0;
-		int result_sscanf = sscanf_s(it_ref->second.c_str(), "WellSample:%*u.%u.%u", &well_id, &well_sample_id);
-		if (result_sscanf <= 0)
-			return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-		auto it_well = it_plate->second->_wells_array.find(well_id);
-		if (it_well == it_plate->second->_wells_array.end())
-			return ErrorCode::ERR_WELL_NOT_EXIST;
-
-		Well well = it_well->second;
-
-		auto it_well_sample = well._well_sample_array.find(well_sample_id);
-		if (it_well_sample == well._well_sample_array.end())
-			return ErrorCode::ERR_WELL_SAMPLE_NOT_EXIST;
-
-		WellSample well_sample = it_well_sample->second;
-
-		uint32_t image_id;
-		result_sscanf = sscanf_s(well_sample.image_ref_id.c_str(), "Image:%u", &image_id);
-		if (result_sscanf <= 0)
-			return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-		auto it_image = _images.find(image_id);
+		auto it_image = _images.find(it_ref->second.image_id);
 		if (it_image != _images.end())
 		{
 			int32_t status = it_image->second->_pixels.remove_channel(channel_id);
@@ -466,10 +574,21 @@ int32_t OmeTiff::RemoveChannel(uint32_t plate_id, uint32_t scan_id, uint32_t cha
 		}
 	}
 
+	{
+		unique_lock<shared_mutex> lock(_mutex_frames);
+		for (auto it_frame = _frames.begin(); it_frame != _frames.end();)
+		{
+			if (it_frame->first.plate_id == plate_id && it_frame->first.scan_id == scan_id && it_frame->first.c_id == channel_id)
+				it_frame = _frames.erase(it_frame);
+			else
+				it_frame++;
+		}
+	}
+
 	return it_scan->second.remove_channel(channel_id);
 }
 
-int32_t OmeTiff::AddScanRegion(uint32_t plate_id, uint32_t scan_id, uint32_t well_id, ScanRegionInfo& scan_region_info, const string& well_sample_id, const string& image_ref_id)
+int32_t OmeTiff::AddScanRegion(uint32_t plate_id, uint32_t scan_id, uint32_t well_id, ScanRegionInfo& scan_region_info, uint32_t well_sample_id, uint32_t image_id)
 {
 	if (!_is_in_parsing)
 		CHECK_OPENMODE(_open_mode);
@@ -499,14 +618,14 @@ int32_t OmeTiff::AddScanRegion(uint32_t plate_id, uint32_t scan_id, uint32_t wel
 
 	if (_is_in_parsing)
 	{
-		if (well_sample_id.empty() || image_ref_id.empty())
+		if (well_sample_id == 0 || image_id == 0)
 			return ErrorCode::ERR_PARAMETER_INVALID;
 
-		result = it_well->second.add_well_sample(scan_region_info, well_sample_id, image_ref_id);
+		result = it_well->second.add_well_sample(scan_region_info, well_sample_id, image_id);
 		if (result != ErrorCode::STATUS_OK)
 			return result;
 
-		return it_plate_acquisition->second.add_well_sample_ref(scan_region_info.id, well_sample_id);
+		return it_plate_acquisition->second.add_well_sample_ref(scan_region_info.id, { well_id, well_sample_id, image_id });
 	}
 
 	//Image:0 is the boot file
@@ -518,19 +637,16 @@ int32_t OmeTiff::AddScanRegion(uint32_t plate_id, uint32_t scan_id, uint32_t wel
 			break;
 		index++;
 	}
-	string image_id = "Image:" + to_string(index);
 
-	string well_sample_ref_id = "";
-	result = it_well->second.add_well_sample(plate_id, scan_region_info, well_sample_ref_id, image_id);
+	result = it_well->second.create_well_sample(scan_region_info, index, well_sample_id);
 	if (result != ErrorCode::STATUS_OK)
 		return result;
 
-	result = it_plate_acquisition->second.add_well_sample_ref(scan_region_info.id, well_sample_ref_id);
+	result = it_plate_acquisition->second.add_well_sample_ref(scan_region_info.id, { well_id, well_sample_id, index });
 	if (result != ErrorCode::STATUS_OK)
 		return result;
 
 	Image* image = new Image();
-	image->_id = image_id;
 	image->_name = to_string(index);
 
 	image->_pixels._info.id = string("Pixels:0");
@@ -576,24 +692,15 @@ int32_t OmeTiff::GetScanRegions(uint32_t plate_id, uint32_t scan_id, uint32_t we
 	if (it_plate_acquisition == it_plate->second->_plate_acquisition_array.end())
 		return ErrorCode::ERR_PLATE_ACQUISITION_NOT_EXIST;
 
-	PlateAcquisition plate_acquisition = it_plate_acquisition->second;
+	const vector<uint32_t>* regions = it_plate_acquisition->second.get_well_regions(well_id);
+	if (regions == nullptr)
+		return ErrorCode::STATUS_OK;
 
-	uint32_t index = 0;
-	for (auto it_well_sample_ref = plate_acquisition._well_sample_ref.begin(); it_well_sample_ref != plate_acquisition._well_sample_ref.end(); it_well_sample_ref++)
+	for (size_t index = 0; index < regions->size(); index++)
 	{
-		uint32_t parse_well_id = 0;
-		int result_sscanf = sscanf_s(it_well_sample_ref->second.c_str(), "WellSample:%*u.%u.%*u", &parse_well_id);
-		if (result_sscanf <= 0)
-			return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-		if (parse_well_id == well_id)
-		{
-			int32_t result = it_scan->second.get_region(it_well_sample_ref->first, scan_regions_info[index]);
-			if (result != ErrorCode::STATUS_OK)
-				return result;
-
-			index++;
-		}
+		int32_t result = it_scan->second.get_region((*regions)[index], scan_regions_info[index]);
+		if (result != ErrorCode::STATUS_OK)
+			return result;
 	}
 
 	return ErrorCode::STATUS_OK;
@@ -609,21 +716,8 @@ int32_t OmeTiff::GetScanRegionsSize(uint32_t plate_id, uint32_t scan_id, uint32_
 	if (it_plate_acquisition == it_plate->second->_plate_acquisition_array.end())
 		return ErrorCode::ERR_PLATE_ACQUISITION_NOT_EXIST;
 
-	PlateAcquisition plate_acquisition = it_plate_acquisition->second;
-
-	int32_t count = 0;
-	for (auto it_well_sample_ref = plate_acquisition._well_sample_ref.begin(); it_well_sample_ref != plate_acquisition._well_sample_ref.end(); it_well_sample_ref++)
-	{
-		uint32_t parse_well_id;
-		int result_sscanf = sscanf_s(it_well_sample_ref->second.c_str(), "WellSample:%*u.%u.%*u", &parse_well_id);
-		if (result_sscanf <= 0)
-			return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-		if (parse_well_id == well_id)
-			count++;
-	}
-
-	return count;
+	const vector<uint32_t>* regions = it_plate_acquisition->second.get_well_regions(well_id);
+	return regions == nullptr ? 0 : (int32_t)regions->size();
 }
 
 string OmeTiff::GetUTF8FileName() const
@@ -646,6 +740,9 @@ int32_t OmeTiff::CreateOMEHeader()
 	if (_open_mode == OpenMode::READ_ONLY_MODE)
 		return ErrorCode::TIFF_ERR_WRONG_OPEN_MODE;
 
+	//the error of a tile saved asynchronously is returned unless the header fails
+	int32_t save_status = _save_queue.Flush();
+
 	FrameInfo header_frame = { 0 };
 	header_frame.plate_id = UINT32_MAX;
 
@@ -673,7 +770,9 @@ int32_t OmeTiff::CreateOMEHeader()
 		return status;
 
 	status = header_container->SetTag(header_ifd_no, TIFFTAG_IMAGEDESCRIPTION, TiffTagDataType::TIFF_ASCII, (uint32_t)xml_data.size(), (void*)xml_data.c_str());
-	return status;
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	return save_status;
 }
 
 int32_t OmeTiff::SetTag(FrameInfo frame, uint16_t tag_id, TiffTagDataType tag_type, uint32_t tag_count, void* tag_value)
@@ -702,8 +801,8 @@ int32_t OmeTiff::GetRawContainer(FrameInfo frame, TiffContainer** container, uin
 {
 	if (frame.plate_id == UINT32_MAX)
 	{
-		fs::path p{ _tiff_file_full_name };
-		string utf8_container_file_name = p.u8string();
+		//keyed by its short name like the other containers, the packed frames share it
+		string utf8_container_file_name = GetUTF8FileName();
 
 		{
 			unique_lock<mutex> lock(_mutex_raw);
@@ -735,6 +834,94 @@ int32_t OmeTiff::GetRawContainer(FrameInfo frame, TiffContainer** container, uin
 		return ErrorCode::STATUS_OK;
 	}
 
+	{
+		shared_lock<shared_mutex> lock(_mutex_frames);
+		auto it_frame = _frames.find(frame);
+		if (it_frame != _frames.end() && it_frame->second.container != nullptr)
+		{
+			*container = it_frame->second.container;
+			ifd_no = it_frame->second.tiff_data.IFD;
+			return ErrorCode::STATUS_OK;
+		}
+	}
+
+	//first access : a placeholder is inserted under the lock, then the container is opened or the frame created without it.
+	//Other threads accessing the same frame wait for the placeholder, the others go on.
+	unique_lock<shared_mutex> lock(_mutex_frames);
+	auto it_frame = _frames.find(frame);
+	if (it_frame != _frames.end() && it_frame->second.pending.valid())
+	{
+		shared_future<int32_t> pending = it_frame->second.pending;
+		lock.unlock();
+		int32_t result = pending.get();
+		if (result != ErrorCode::STATUS_OK)
+			return result;
+		return GetRawContainer(frame, container, ifd_no, is_read);
+	}
+	if (it_frame != _frames.end() && it_frame->second.container != nullptr)
+	{
+		*container = it_frame->second.container;
+		ifd_no = it_frame->second.tiff_data.IFD;
+		return ErrorCode::STATUS_OK;
+	}
+
+	bool is_new = it_frame == _frames.end();
+	FrameEntry entry = { nullptr, 1 };
+	FrameCreation creation = { nullptr };
+	if (is_new)
+	{
+		int32_t result = ResolveFrame(frame, is_read, entry, creation);
+		if (result != ErrorCode::STATUS_OK)
+			return result;
+	}
+	else
+	{
+		entry = it_frame->second;
+	}
+	promise<int32_t> done;
+	entry.pending = done.get_future().share();
+	_frames[frame] = entry;
+	lock.unlock();
+
+	int32_t result = ErrorCode::STATUS_OK;
+	if (creation.image != nullptr)
+	{
+		result = CreateFrame(frame, creation, entry);
+	}
+	else
+	{
+		fs::path p_full{ _tiff_file_dir };
+		p_full /= entry.tiff_data.FileName;
+		result = OpenRawContainer(entry.tiff_data.FileName, p_full.wstring(), entry.bin_size, &entry.container);
+	}
+
+	lock.lock();
+	if (result == ErrorCode::STATUS_OK && creation.image != nullptr)
+		result = creation.image->_pixels.add_tiff_data(entry.tiff_data);
+	entry.pending = shared_future<int32_t>();
+	//the channel may have been removed in the meantime
+	it_frame = _frames.find(frame);
+	if (it_frame != _frames.end())
+	{
+		if (result == ErrorCode::STATUS_OK)
+			it_frame->second = entry;
+		else if (is_new)
+			_frames.erase(it_frame);
+		else
+			it_frame->second.pending = shared_future<int32_t>();
+	}
+	lock.unlock();
+	done.set_value(result);
+	if (result != ErrorCode::STATUS_OK)
+		return result;
+
+	*container = entry.container;
+	ifd_no = entry.tiff_data.IFD;
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t OmeTiff::ResolveFrame(FrameInfo frame, bool is_read, FrameEntry& entry, FrameCreation& creation)
+{
 	auto it_plate = _plates.find(frame.plate_id);
 	if (it_plate == _plates.end())
 		return ErrorCode::ERR_PLATE_NOT_EXIST;
@@ -743,135 +930,167 @@ int32_t OmeTiff::GetRawContainer(FrameInfo frame, TiffContainer** container, uin
 	if (it_scan == it_plate->second->_scans_array.end())
 		return ErrorCode::ERR_SCAN_NOT_EXIST;
 
-	Scan scan = it_scan->second;
+	Scan& scan = it_scan->second;
 
 	auto it_channel = scan._channel_array.find(frame.c_id);
 	if (it_channel == scan._channel_array.end())
 		return ErrorCode::ERR_CHANNEL_NOT_EXIST;
 
-	ChannelInfo channel_info = it_channel->second._info;
+	const ChannelInfo& channel_info = it_channel->second._info;
 
 	auto it_plate_acquisition = it_plate->second->_plate_acquisition_array.find(frame.scan_id);
 	if (it_plate_acquisition == it_plate->second->_plate_acquisition_array.end())
 		return ErrorCode::ERR_PLATE_ACQUISITION_NOT_EXIST;
 
-	PlateAcquisition plate_acquisition = it_plate_acquisition->second;
+	const PlateAcquisition& plate_acquisition = it_plate_acquisition->second;
 
 	auto it_well_sample_ref = plate_acquisition._well_sample_ref.find(frame.region_id);
 	if (it_well_sample_ref == plate_acquisition._well_sample_ref.end())
 		return ErrorCode::ERR_NO_WELL_SAMPLE_MATCHS_REGION_ID;
 
-	string well_sample_ref_id = it_well_sample_ref->second;
-
-	uint32_t well_id = 0;
-	uint32_t well_sample_id = 0;
-	int result_sscanf = sscanf_s(well_sample_ref_id.c_str(), "WellSample:%*u.%u.%u", &well_id, &well_sample_id);
-	if (result_sscanf <= 0)
-		return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-
-	auto it_well = it_plate->second->_wells_array.find(well_id);
-	if (it_well == it_plate->second->_wells_array.end())
-		return ErrorCode::ERR_WELL_NOT_EXIST;
-
-	Well well = it_well->second;
-
-	auto it_well_sample = well._well_sample_array.find(well_sample_id);
-	if (it_well_sample == well._well_sample_array.end())
-		return ErrorCode::ERR_WELL_SAMPLE_NOT_EXIST;
-
-	WellSample well_sample = it_well_sample->second;
-
-	uint32_t image_id;
-	result_sscanf = sscanf_s(well_sample.image_ref_id.c_str(), "Image:%u", &image_id);
-	if (result_sscanf <= 0)
-		return ErrorCode::ERR_SCANF_ASSIGNED_ERROR;
-	auto it = _images.find(image_id);
+	auto it = _images.find(it_well_sample_ref->second.image_id);
 	if (it == _images.end())
 		return ErrorCode::ERR_CANNOT_FIND_IMAGE;
 
 	Image* image = it->second;
 
-	TiffData tiff_data;
-	int32_t result = image->_pixels.get_tiff_data(frame.c_id, frame.z_id, frame.t_id, tiff_data);
-	if (result != ErrorCode::STATUS_OK)
-	{
-		if (is_read)
-			return result;
+	entry.bin_size = channel_info.bin_size;
+	int32_t result = image->_pixels.get_tiff_data(frame.c_id, frame.z_id, frame.t_id, entry.tiff_data);
+	if (result == ErrorCode::STATUS_OK || is_read)
+		return result;
 
-		wstringstream stream_file_name;
+	//a container has one bin size, binned channels can't be packed with the header image
+	wstringstream stream_file_name;
+	if (_file_layout == FileLayout::FILELAYOUT_PACKED && channel_info.bin_size == 1)
+		stream_file_name << fs::path(_tiff_file_full_name).filename().wstring();
+	else if (_file_layout == FileLayout::FILELAYOUT_PACKED)
+		stream_file_name << _tiff_file_name << "_b" << to_wstring(channel_info.bin_size) << ".tid";
+	else
 		stream_file_name << _tiff_file_name << "_s" << to_wstring(frame.scan_id) << "c" << to_wstring(frame.c_id) << ".tid";
-		wstring w_file_name = stream_file_name.str();
-		fs::path p_full{ _tiff_file_dir };
-		p_full /= w_file_name;
-		wstring container_full_path = p_full.wstring();
-
-		fs::path p{ w_file_name };
-		string utf8_container_file_name = p.u8string();
+	wstring w_file_name = stream_file_name.str();
+	fs::path p_full{ _tiff_file_dir };
+	p_full /= w_file_name;
 
-		{
-			unique_lock<mutex> lock(_mutex_raw);
-			auto it_find = _raw_file_containers.find(utf8_container_file_name);
-			if (it_find == _raw_file_containers.end())
-			{
-				*container = new TiffContainer();
-				result = (*container)->Init(_open_mode, container_full_path, channel_info.bin_size);
-				if (result != ErrorCode::STATUS_OK)
-					return result;
-				_raw_file_containers.insert(make_pair(utf8_container_file_name, *container));
-			}
-			else
-			{
-				*container = it_find->second;
-			}
-		}
+	fs::path p{ w_file_name };
+	result = scan.get_region(frame.region_id, creation.region);
+	if (result != ErrorCode::STATUS_OK)
+		return result;
 
-		ScanRegionInfo scan_region_info;
-		result = scan.get_region(frame.region_id, scan_region_info);
-		if (result != ErrorCode::STATUS_OK)
-			return result;
+	creation.image = image;
+	creation.file_name = p.u8string();
+	creation.full_path = p_full.wstring();
+	creation.scan = scan._info;
+	creation.channel = channel_info;
+	return ErrorCode::STATUS_OK;
+}
 
-		int32_t created_ifd_no = (*container)->CreateIFD(scan_region_info.pixel_size_x * channel_info.bin_size, scan_region_info.pixel_size_y,
-			scan._info.tile_pixel_size_width * channel_info.bin_size, scan._info.tile_pixel_size_height, 
-			scan._info.pixel_type, (uint16_t)it_channel->second._info.samples_per_pixel, _compression_mode);
-		if (created_ifd_no < 0)
-			return created_ifd_no;
+int32_t OmeTiff::CreateFrame(FrameInfo frame, const FrameCreation& creation, FrameEntry& entry)
+{
+	int32_t result = OpenRawContainer(creation.file_name, creation.full_path, creation.channel.bin_size, &entry.container);
+	if (result != ErrorCode::STATUS_OK)
+		return result;
 
-		ifd_no = created_ifd_no;
-		tiff_data.FirstC = frame.c_id;
-		tiff_data.FirstT = frame.t_id;
-		tiff_data.FirstZ = frame.z_id;
-		tiff_data.IFD = created_ifd_no;
-		tiff_data.FileName = utf8_container_file_name;
+	const ScanInfo& scan = creation.scan;
+	const ChannelInfo& channel_info = creation.channel;
+	int32_t created_ifd_no = entry.container->CreateIFD(creation.region.pixel_size_x * channel_info.bin_size, creation.region.pixel_size_y,
+		scan.tile_pixel_size_width * channel_info.bin_size, scan.tile_pixel_size_height, 
+		scan.pixel_type, (uint16_t)channel_info.samples_per_pixel, _compression_mode, _shuffle_mode, _pyramid_levels);
+	if (created_ifd_no < 0)
+		return created_ifd_no;
+
+	TiffData& tiff_data = entry.tiff_data;
+	tiff_data.FirstC = frame.c_id;
+	tiff_data.FirstT = frame.t_id;
+	tiff_data.FirstZ = frame.z_id;
+	tiff_data.IFD = created_ifd_no;
+	tiff_data.FileName = creation.file_name;
+	return ErrorCode::STATUS_OK;
+}
 
-		result = image->_pixels.add_tiff_data(tiff_data);
-		if (result != ErrorCode::STATUS_OK)
-			return result;
+int32_t OmeTiff::OpenRawContainer(const string& utf8_file_name, const wstring& full_path, uint32_t bin_size, TiffContainer** container)
+{
+	unique_lock<mutex> lock(_mutex_raw);
+	auto it_find = _raw_file_containers.find(utf8_file_name);
+	if (it_find != _raw_file_containers.end())
+	{
+		*container = it_find->second;
+		return ErrorCode::STATUS_OK;
 	}
-	else
+
+	TiffContainer* new_container = new TiffContainer();
+	int32_t result = new_container->Init(_open_mode, full_path, bin_size);
+	if (result != ErrorCode::STATUS_OK)
 	{
-		fs::path p_full{ _tiff_file_dir };
-		p_full /= tiff_data.FileName;
-		wstring container_full_path = p_full.wstring();
+		delete new_container;
+		return result;
+	}
+	_raw_file_containers.insert(make_pair(utf8_file_name, new_container));
+	*container = new_container;
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t OmeTiff::LoadMetadata(const string& xml)
+{
+	if (_metadata_cache == MetadataCacheMode::METADATACACHE_OFF)
+		return parse_ome_xml(xml, this);
 
+	wstring cache_name = _tiff_file_full_name + L".omecache";
+	if (load_ome_cache(cache_name, xml, this) == ErrorCode::STATUS_OK)
+		return ErrorCode::STATUS_OK;
+
+	map<string, bool> checked_files;
+	int32_t result = parse_ome_xml(xml, this, &checked_files);
+	//the file is opened anyway when the cache can't be saved, e.g. in a read only folder
+	if (result == ErrorCode::STATUS_OK && _metadata_cache == MetadataCacheMode::METADATACACHE_READ_WRITE)
+		save_ome_cache(cache_name, xml, this, checked_files);
+	return result;
+}
+
+void OmeTiff::BuildFrameIndex()
+{
+	//every TiffData of the parsed metadata, the container files are opened on their first access
+	unique_lock<shared_mutex> lock(_mutex_frames);
+	for (auto it_plate = _plates.begin(); it_plate != _plates.end(); it_plate++)
+	{
+		Plate* plate = it_plate->second;
+		for (auto it_acquisition = plate->_plate_acquisition_array.begin(); it_acquisition != plate->_plate_acquisition_array.end(); it_acquisition++)
 		{
-			unique_lock<mutex> lock(_mutex_raw);
-			auto it_find = _raw_file_containers.find(tiff_data.FileName);
-			if (it_find == _raw_file_containers.end())
-			{
-				*container = new TiffContainer();
-				result = (*container)->Init(_open_mode, container_full_path, channel_info.bin_size);
-				if (result != ErrorCode::STATUS_OK)
-					return result;
-				_raw_file_containers.insert(make_pair(tiff_data.FileName, *container));
-			}
-			else
+			auto it_scan = plate->_scans_array.find(it_acquisition->first);
+			if (it_scan == plate->_scans_array.end())
+				continue;
+
+			const map<uint32_t, WellSampleRef>& refs = it_acquisition->second._well_sample_ref;
+			for (auto it_ref = refs.begin(); it_ref != refs.end(); it_ref++)
 			{
-				*container = it_find->second;
+				auto it_image = _images.find(it_ref->second.image_id);
+				if (it_image == _images.end())
+					continue;
+
+				const map<uint64_t, TiffData>& tiff_datas = it_image->second->_pixels._tiff_datas;
+				for (auto it_data = tiff_datas.begin(); it_data != tiff_datas.end(); it_data++)
+				{
+					auto it_channel = it_scan->second._channel_array.find(it_data->second.FirstC);
+					if (it_channel == it_scan->second._channel_array.end())
+						continue;
+
+					FrameInfo frame = { it_plate->first, it_scan->first, it_ref->first, it_data->second.FirstC, it_data->second.FirstZ, it_data->second.FirstT };
+					FrameEntry entry = { nullptr, it_channel->second._info.bin_size, it_data->second };
+					_frames[frame] = move(entry);
+				}
 			}
 		}
-
-		ifd_no = tiff_data.IFD;
 	}
+}
 
-	return result;
+size_t OmeTiff::FrameHash::operator()(const FrameInfo& frame) const
+{
+	uint64_t key = ((uint64_t)frame.plate_id << 48) ^ ((uint64_t)frame.scan_id << 40) ^ ((uint64_t)frame.region_id << 24) ^
+		((uint64_t)frame.c_id << 56) ^ ((uint64_t)frame.t_id << 16) ^ (uint64_t)frame.z_id;
+	return hash<uint64_t>()(key);
+}
+
+bool OmeTiff::FrameEqual::operator()(const FrameInfo& a, const FrameInfo& b) const
+{
+	return a.plate_id == b.plate_id && a.scan_id == b.scan_id && a.region_id == b.region_id &&
+		a.c_id == b.c_id && a.z_id == b.z_id && a.t_id == b.t_id;
 }
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 #include "ometiff_container.h"
+#include "ometiff_queue.h"
 #include <mutex>
+#include <shared_mutex>
+#include <future>
+#include <unordered_map>
 
 #ifndef HEADERIMAGESIZE
 #define HEADERIMAGESIZE 64
@@ -13,12 +17,21 @@ public:
 	~OmeTiff(void);
 
 	int32_t Init(const wchar_t* file_name, ome::OpenMode mode, ome::CompressionMode cm);
+	int32_t SetShuffleMode(ome::ShuffleMode sm);
+	int32_t SetPyramidLevels(uint32_t levels);
+	int32_t SetFileLayout(ome::FileLayout layout);
 
 	int32_t SaveTileData(ome::FrameInfo frame, uint32_t row, uint32_t column, void* image_data, uint32_t stride);
+	int32_t SaveTileDataAsync(ome::FrameInfo frame, uint32_t row, uint32_t column, void* image_data, uint32_t stride, uint64_t& ticket);
+	int32_t SetSaveQueue(uint32_t capacity, ome::QueueFullMode full_mode, uint32_t workers);
+	int32_t GetSaveStatus(uint64_t ticket);
+	int32_t Flush();
 	int32_t PurgeFrame(ome::FrameInfo frame);
 
 	int32_t LoadRawData(ome::FrameInfo frame, ome::OmeSize dst_size, ome::OmeRect src_rect, void* image_data, uint32_t stride);
 	int32_t LoadRawData(ome::FrameInfo frame, uint32_t row, uint32_t column, void* image_data, uint32_t stride);
+	int32_t LoadLevelData(ome::FrameInfo frame, uint32_t level, ome::OmeRect src_rect, void* image_data, uint32_t stride);
+	int32_t GetPyramidLevels(ome::FrameInfo frame);
 
 	int32_t AddPlate(ome::PlateInfo& plate_info);
 	int32_t GetPlates(ome::PlateInfo* plates_info);
@@ -39,7 +52,7 @@ public:
 	int32_t RemoveChannel(uint32_t plate_id, uint32_t scan_id, uint32_t channel_id);
 
 	int32_t AddScanRegion(uint32_t plate_id, uint32_t scan_id, uint32_t well_id, ome::ScanRegionInfo& scan_region_info, 
-						  const std::string& well_sample_id = "", const std::string& image_ref_id = "");
+						  uint32_t well_sample_id = 0, uint32_t image_id = 0);
 	int32_t GetScanRegions(uint32_t plate_id, uint32_t scan_id, uint32_t well_id, ome::ScanRegionInfo* scan_regions_info);
 	int32_t GetScanRegionsSize(uint32_t plate_id, uint32_t scan_id, uint32_t well_id);
 
@@ -52,13 +65,20 @@ public:
 	std::string GetUTF8FileName() const;
 	std::string GetFullPathWithFileName(std::string& utf8_file_name);
 	ome::OpenMode GetOpenMode() const { return _open_mode; }
+	void SetMetadataCache(ome::MetadataCacheMode mode) { _metadata_cache = mode; }
 
 	std::map<uint32_t, ome::Image*> _images;
 	std::map<uint32_t, ome::Plate*> _plates;
 
 private:
 	ome::CompressionMode _compression_mode;
+	ome::ShuffleMode _shuffle_mode;
+	uint32_t _pyramid_levels;
+	ome::FileLayout _file_layout;
 	ome::OpenMode _open_mode;
+	ome::MetadataCacheMode _metadata_cache;
+
+	TileSaveQueue _save_queue;
 
 	std::mutex _mutex_raw;
 	std::map<std::string, TiffContainer*> _raw_file_containers;
@@ -70,6 +90,41 @@ private:
 
 	bool _is_in_parsing;
 
+	//Frames already resolved to their container and IFD, a tile access is one hash probe instead of a metadata walk.
+	//Hits only take the shared lock, so writers of different containers don't wait for each other.
+	struct FrameEntry
+	{
+		TiffContainer* container;	//nullptr until the container file is opened
+		uint32_t bin_size;
+		ome::TiffData tiff_data;
+		std::shared_future<int32_t> pending;	//valid while the container is opened or the frame created by another thread
+	};
+	//A frame not in the metadata yet, found with _mutex_frames locked and created without it.
+	struct FrameCreation
+	{
+		ome::Image* image;
+		std::string file_name;
+		std::wstring full_path;
+		ome::ScanRegionInfo region;
+		ome::ScanInfo scan;
+		ome::ChannelInfo channel;
+	};
+	struct FrameHash
+	{
+		size_t operator()(const ome::FrameInfo& frame) const;
+	};
+	struct FrameEqual
+	{
+		bool operator()(const ome::FrameInfo& a, const ome::FrameInfo& b) const;
+	};
+	std::shared_mutex _mutex_frames;
+	std::unordered_map<ome::FrameInfo, FrameEntry, FrameHash, FrameEqual> _frames;
+
 	int32_t GetRawContainer(ome::FrameInfo frame, TiffContainer** container, uint32_t& ifd_no, bool is_read);
+	int32_t ResolveFrame(ome::FrameInfo frame, bool is_read, FrameEntry& entry, FrameCreation& creation);
+	int32_t CreateFrame(ome::FrameInfo frame, const FrameCreation& creation, FrameEntry& entry);
+	int32_t OpenRawContainer(const std::string& utf8_file_name, const std::wstring& full_path, uint32_t bin_size, TiffContainer** container);
+	void BuildFrameIndex();
+	int32_t LoadMetadata(const std::string& xml);
 };
 
@@ -0,0 +1,460 @@
+#include "ometiff_cache.h"
+#include <filesystem>
+#include <memory>
+
+using namespace std;
+using namespace ome;
+namespace fs = filesystem;
+
+//Layout: CacheHeader, then the payload : checked files, plates, images.
+//Info structs are saved as they are in memory, bump the version when one of them changes.
+#define CACHE_VERSION 2
+static const char CACHE_MAGIC[4] = { 'O', 'M', 'E', 'C' };
+
+struct CacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t xml_size;
+	uint64_t xml_hash;
+	uint64_t payload_size;
+	uint64_t payload_hash;
+};
+
+//FNV-1a
+static uint64_t hash_bytes(const void* data, size_t size)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+class CacheWriter
+{
+public:
+	template<typename T>
+	void Put(const T& value)
+	{
+		_buffer.append((const char*)&value, sizeof(T));
+	}
+
+	void PutString(const string& str)
+	{
+		Put((uint32_t)str.size());
+		_buffer.append(str);
+	}
+
+	const string& Buffer() const { return _buffer; }
+
+private:
+	string _buffer;
+};
+
+class CacheReader
+{
+public:
+	CacheReader(const uint8_t* data, size_t size) : _cur(data), _end(data + size) {}
+
+	template<typename T>
+	bool Get(T& value)
+	{
+		if ((size_t)(_end - _cur) < sizeof(T))
+			return false;
+		memcpy(&value, _cur, sizeof(T));
+		_cur += sizeof(T);
+		return true;
+	}
+
+	bool GetString(string& str)
+	{
+		uint32_t size = 0;
+		if (!Get(size) || (size_t)(_end - _cur) < size)
+			return false;
+		str.assign((const char*)_cur, size);
+		_cur += size;
+		return true;
+	}
+
+	//Number of the following items, each one at least "item_size" bytes.
+	bool GetCount(uint32_t& count, size_t item_size)
+	{
+		return Get(count) && (size_t)(_end - _cur) / item_size >= count;
+	}
+
+	bool AtEnd() const { return _cur == _end; }
+
+private:
+	const uint8_t* _cur;
+	const uint8_t* _end;
+};
+
+static void put_pixels_info(CacheWriter& writer, const PixelsInfo& pix)
+{
+	writer.Put(pix.physical_size_per_pixel_x);
+	writer.Put(pix.physical_size_per_pixel_y);
+	writer.Put(pix.physical_size_per_pixel_z);
+	writer.Put(pix.time_increment);
+	writer.Put(pix.physical_x_unit);
+	writer.Put(pix.physical_y_unit);
+	writer.Put(pix.physical_z_unit);
+	writer.Put(pix.time_increment_unit);
+	writer.Put(pix.pixel_type);
+	writer.Put(pix.significant_bits);
+	writer.Put(pix.size_x);
+	writer.Put(pix.size_y);
+	writer.Put(pix.size_z);
+	writer.Put(pix.size_t);
+	writer.Put(pix.tile_pixel_width);
+	writer.Put(pix.tile_pixel_height);
+	writer.PutString(pix.id);
+	writer.PutString(pix.dimension_order);
+}
+
+static bool get_pixels_info(CacheReader& reader, PixelsInfo& pix)
+{
+	return reader.Get(pix.physical_size_per_pixel_x) && reader.Get(pix.physical_size_per_pixel_y) &&
+		reader.Get(pix.physical_size_per_pixel_z) && reader.Get(pix.time_increment) &&
+		reader.Get(pix.physical_x_unit) && reader.Get(pix.physical_y_unit) && reader.Get(pix.physical_z_unit) &&
+		reader.Get(pix.time_increment_unit) && reader.Get(pix.pixel_type) && reader.Get(pix.significant_bits) &&
+		reader.Get(pix.size_x) && reader.Get(pix.size_y) && reader.Get(pix.size_z) && reader.Get(pix.size_t) &&
+		reader.Get(pix.tile_pixel_width) && reader.Get(pix.tile_pixel_height) &&
+		reader.GetString(pix.id) && reader.GetString(pix.dimension_order);
+}
+
+static int32_t put_plate(CacheWriter& writer, Plate* plate)
+{
+	writer.Put(plate->_info);
+
+	writer.Put((uint32_t)plate->_wells_array.size());
+	for (auto it_well = plate->_wells_array.begin(); it_well != plate->_wells_array.end(); it_well++)
+	{
+		writer.Put(it_well->second._info);
+		const map<uint32_t, WellSample>& samples = it_well->second._well_sample_array;
+		writer.Put((uint32_t)samples.size());
+		for (auto it_sample = samples.begin(); it_sample != samples.end(); it_sample++)
+		{
+			writer.Put(it_sample->first);
+			writer.Put(it_sample->second);
+		}
+	}
+
+	writer.Put((uint32_t)plate->_scans_array.size());
+	for (auto it_scan = plate->_scans_array.begin(); it_scan != plate->_scans_array.end(); it_scan++)
+	{
+		writer.Put(it_scan->second._info);
+		const map<uint32_t, Channel>& channels = it_scan->second._channel_array;
+		writer.Put((uint32_t)channels.size());
+		for (auto it_channel = channels.begin(); it_channel != channels.end(); it_channel++)
+			writer.Put(it_channel->second._info);
+	}
+
+	//the scan regions are saved with the references to them
+	writer.Put((uint32_t)plate->_plate_acquisition_array.size());
+	for (auto it_acquisition = plate->_plate_acquisition_array.begin(); it_acquisition != plate->_plate_acquisition_array.end(); it_acquisition++)
+	{
+		auto it_scan = plate->_scans_array.find(it_acquisition->first);
+		if (it_scan == plate->_scans_array.end())
+			return ErrorCode::ERR_METADATA_CACHE_INVALID;
+
+		writer.Put(it_acquisition->first);
+		const map<uint32_t, WellSampleRef>& refs = it_acquisition->second._well_sample_ref;
+		writer.Put((uint32_t)refs.size());
+		for (auto it_ref = refs.begin(); it_ref != refs.end(); it_ref++)
+		{
+			ScanRegionInfo region_info;
+			int32_t status = it_scan->second.get_region(it_ref->first, region_info);
+			if (status != ErrorCode::STATUS_OK)
+				return status;
+
+			writer.Put(it_ref->first);
+			writer.Put(it_ref->second);
+			writer.Put(region_info);
+		}
+	}
+	return ErrorCode::STATUS_OK;
+}
+
+static bool get_plate(CacheReader& reader, Plate* plate)
+{
+	if (!reader.Get(plate->_info))
+		return false;
+
+	uint32_t well_count = 0;
+	if (!reader.GetCount(well_count, sizeof(WellInfo)))
+		return false;
+	for (uint32_t i = 0; i < well_count; i++)
+	{
+		WellInfo well_info;
+		uint32_t sample_count = 0;
+		if (!reader.Get(well_info) || plate->add_well(well_info) != ErrorCode::STATUS_OK ||
+			!reader.GetCount(sample_count, sizeof(uint32_t) + sizeof(WellSample)))
+			return false;
+
+		Well& well = plate->_wells_array[well_info.id];
+		for (uint32_t j = 0; j < sample_count; j++)
+		{
+			uint32_t sample_id = 0;
+			WellSample sample;
+			if (!reader.Get(sample_id) || !reader.Get(sample))
+				return false;
+
+			//added as the parsing does, so the next new well sample gets a free id
+			ScanRegionInfo region_info = { 0 };
+			region_info.start_physical_x = sample.position_x;
+			region_info.start_physical_y = sample.position_y;
+			region_info.start_physical_z = sample.position_z;
+			region_info.start_unit_x = sample.physicalsize_unit_x;
+			region_info.start_unit_y = sample.physicalsize_unit_y;
+			region_info.start_unit_z = sample.physicalsize_unit_z;
+			if (well.add_well_sample(region_info, sample_id, sample.image_id) != ErrorCode::STATUS_OK)
+				return false;
+		}
+	}
+
+	uint32_t scan_count = 0;
+	if (!reader.GetCount(scan_count, sizeof(ScanInfo)))
+		return false;
+	for (uint32_t i = 0; i < scan_count; i++)
+	{
+		ScanInfo scan_info;
+		uint32_t channel_count = 0;
+		if (!reader.Get(scan_info) || plate->add_scan(scan_info) != ErrorCode::STATUS_OK ||
+			!reader.GetCount(channel_count, sizeof(ChannelInfo)))
+			return false;
+
+		Scan& scan = plate->_scans_array[scan_info.id];
+		for (uint32_t j = 0; j < channel_count; j++)
+		{
+			ChannelInfo channel_info;
+			if (!reader.Get(channel_info) || scan.add_channel(channel_info) != ErrorCode::STATUS_OK)
+				return false;
+		}
+	}
+
+	uint32_t acquisition_count = 0;
+	if (!reader.GetCount(acquisition_count, sizeof(uint32_t) * 2))
+		return false;
+	for (uint32_t i = 0; i < acquisition_count; i++)
+	{
+		uint32_t scan_id = 0;
+		uint32_t ref_count = 0;
+		if (!reader.Get(scan_id) || !reader.GetCount(ref_count, sizeof(uint32_t) + sizeof(WellSampleRef) + sizeof(ScanRegionInfo)))
+			return false;
+
+		auto it_scan = plate->_scans_array.find(scan_id);
+		if (it_scan == plate->_scans_array.end())
+			return false;
+
+		PlateAcquisition& acquisition = plate->_plate_acquisition_array[scan_id];
+		for (uint32_t j = 0; j < ref_count; j++)
+		{
+			uint32_t region_id = 0;
+			WellSampleRef ref;
+			ScanRegionInfo region_info;
+			if (!reader.Get(region_id) || !reader.Get(ref) || !reader.Get(region_info))
+				return false;
+			if (it_scan->second.add_region(region_info) != ErrorCode::STATUS_OK ||
+				acquisition.add_well_sample_ref(region_id, ref) != ErrorCode::STATUS_OK)
+				return false;
+		}
+	}
+	return true;
+}
+
+static void put_image(CacheWriter& writer, const Image* image)
+{
+	writer.PutString(image->_name);
+	const Pixels& pixels = image->_pixels;
+	put_pixels_info(writer, pixels._info);
+
+	writer.Put((uint32_t)pixels._channels.size());
+	for (auto it_channel = pixels._channels.begin(); it_channel != pixels._channels.end(); it_channel++)
+		writer.Put(it_channel->second._info);
+
+	writer.Put((uint32_t)pixels._tiff_datas.size());
+	for (auto it_data = pixels._tiff_datas.begin(); it_data != pixels._tiff_datas.end(); it_data++)
+	{
+		const TiffData& tiff_data = it_data->second;
+		writer.Put(tiff_data.FirstC);
+		writer.Put(tiff_data.FirstT);
+		writer.Put(tiff_data.FirstZ);
+		writer.Put(tiff_data.IFD);
+		writer.PutString(tiff_data.FileName);
+	}
+}
+
+static bool get_image(CacheReader& reader, Image* image)
+{
+	Pixels& pixels = image->_pixels;
+	uint32_t channel_count = 0;
+	if (!reader.GetString(image->_name) || !get_pixels_info(reader, pixels._info) ||
+		!reader.GetCount(channel_count, sizeof(ChannelInfo)))
+		return false;
+
+	for (uint32_t i = 0; i < channel_count; i++)
+	{
+		ChannelInfo channel_info;
+		if (!reader.Get(channel_info) || pixels.add_channel(channel_info) != ErrorCode::STATUS_OK)
+			return false;
+	}
+
+	uint32_t data_count = 0;
+	if (!reader.GetCount(data_count, sizeof(uint32_t) * 5))
+		return false;
+	for (uint32_t i = 0; i < data_count; i++)
+	{
+		TiffData tiff_data;
+		if (!reader.Get(tiff_data.FirstC) || !reader.Get(tiff_data.FirstT) || !reader.Get(tiff_data.FirstZ) ||
+			!reader.Get(tiff_data.IFD) || !reader.GetString(tiff_data.FileName))
+			return false;
+
+		if (pixels.add_tiff_data(tiff_data) != ErrorCode::STATUS_OK)
+			return false;
+	}
+	return true;
+}
+
+int32_t load_ome_cache(const wstring& cache_name, const string& xml, OmeTiff* tiff_obj)
+{
+	FILE* file = _wfsopen(cache_name.c_str(), L"rb", _SH_DENYWR);
+	if (file == nullptr)
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+
+	int64_t file_size = -1;
+	if (_fseeki64(file, 0, SEEK_END) == 0)
+		file_size = _ftelli64(file);
+	if (file_size < (int64_t)sizeof(CacheHeader) || _fseeki64(file, 0, SEEK_SET) != 0)
+	{
+		fclose(file);
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+	}
+
+	unique_ptr<uint8_t[]> data(new(nothrow) uint8_t[(size_t)file_size]);
+	size_t read_size = data == nullptr ? 0 : fread(data.get(), 1, (size_t)file_size, file);
+	fclose(file);
+	if (read_size != (size_t)file_size)
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+
+	CacheHeader header;
+	memcpy(&header, data.get(), sizeof(CacheHeader));
+	const uint8_t* payload = data.get() + sizeof(CacheHeader);
+	if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+		header.payload_size != (uint64_t)file_size - sizeof(CacheHeader) ||
+		header.xml_size != xml.size() || header.xml_hash != hash_bytes(xml.c_str(), xml.size()) ||
+		header.payload_hash != hash_bytes(payload, (size_t)header.payload_size))
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+
+	CacheReader reader(payload, (size_t)header.payload_size);
+
+	//parsing drops the channels whose file is missing, the cache only holds while no file came or went
+	uint32_t file_count = 0;
+	if (!reader.GetCount(file_count, sizeof(uint32_t) + sizeof(uint8_t)))
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+	for (uint32_t i = 0; i < file_count; i++)
+	{
+		string file_name;
+		uint8_t exists = 0;
+		if (!reader.GetString(file_name) || !reader.Get(exists))
+			return ErrorCode::ERR_METADATA_CACHE_INVALID;
+
+		fs::path p_full{ tiff_obj->GetFullPathWithFileName(file_name) };
+		if (fs::exists(p_full) != (exists != 0))
+			return ErrorCode::ERR_METADATA_CACHE_INVALID;
+	}
+
+	//nothing is given to "tiff_obj" before the whole cache is read, it falls back to the OME-XML untouched
+	map<uint32_t, unique_ptr<Plate>> plates;
+	uint32_t plate_count = 0;
+	if (!reader.GetCount(plate_count, sizeof(PlateInfo)))
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+	for (uint32_t i = 0; i < plate_count; i++)
+	{
+		unique_ptr<Plate> plate(new Plate());
+		if (!get_plate(reader, plate.get()) || plates.count(plate->_info.id) != 0)
+			return ErrorCode::ERR_METADATA_CACHE_INVALID;
+		uint32_t plate_id = plate->_info.id;
+		plates[plate_id] = std::move(plate);
+	}
+
+	map<uint32_t, unique_ptr<Image>> images;
+	uint32_t image_count = 0;
+	if (!reader.GetCount(image_count, sizeof(uint32_t)))
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+	for (uint32_t i = 0; i < image_count; i++)
+	{
+		uint32_t image_id = 0;
+		unique_ptr<Image> image(new Image());
+		if (!reader.Get(image_id) || !get_image(reader, image.get()) || images.count(image_id) != 0)
+			return ErrorCode::ERR_METADATA_CACHE_INVALID;
+		images[image_id] = std::move(image);
+	}
+
+	if (!reader.AtEnd())
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+
+	for (auto it = plates.begin(); it != plates.end(); it++)
+		tiff_obj->_plates[it->first] = it->second.release();
+	for (auto it = images.begin(); it != images.end(); it++)
+		tiff_obj->_images[it->first] = it->second.release();
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t save_ome_cache(const wstring& cache_name, const string& xml, const OmeTiff* tiff_obj, const map<string, bool>& checked_files)
+{
+	CacheWriter writer;
+	writer.Put((uint32_t)checked_files.size());
+	for (auto it = checked_files.begin(); it != checked_files.end(); it++)
+	{
+		writer.PutString(it->first);
+		writer.Put((uint8_t)(it->second ? 1 : 0));
+	}
+
+	writer.Put((uint32_t)tiff_obj->_plates.size());
+	for (auto it = tiff_obj->_plates.begin(); it != tiff_obj->_plates.end(); it++)
+	{
+		int32_t status = put_plate(writer, it->second);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+	}
+
+	writer.Put((uint32_t)tiff_obj->_images.size());
+	for (auto it = tiff_obj->_images.begin(); it != tiff_obj->_images.end(); it++)
+	{
+		writer.Put(it->first);
+		put_image(writer, it->second);
+	}
+
+	const string& payload = writer.Buffer();
+	CacheHeader header;
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.xml_size = xml.size();
+	header.xml_hash = hash_bytes(xml.c_str(), xml.size());
+	header.payload_size = payload.size();
+	header.payload_hash = hash_bytes(payload.c_str(), payload.size());
+
+	//written aside then renamed, a reader never sees half a cache
+	wstring temp_name = cache_name + L".tmp";
+	FILE* file = _wfsopen(temp_name.c_str(), L"wb", _SH_DENYWR);
+	if (file == nullptr)
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+
+	bool written = fwrite(&header, sizeof(CacheHeader), 1, file) == 1 &&
+		fwrite(payload.c_str(), 1, payload.size(), file) == payload.size();
+	written = fclose(file) == 0 && written;
+
+	error_code ec;
+	if (written)
+		fs::rename(fs::path(temp_name), fs::path(cache_name), ec);
+	if (!written || ec)
+	{
+		fs::remove(fs::path(temp_name), ec);
+		return ErrorCode::ERR_METADATA_CACHE_INVALID;
+	}
+	return ErrorCode::STATUS_OK;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include "ometiff.h"
+
+//Binary copy of the metadata model parsed from the OME-XML, read back in one read without any parsing.
+//The cache is only used when it was saved from the same OME-XML and the container files it depends on
+//are found (or missing) as they were, so a stale cache is never loaded.
+int32_t load_ome_cache(const std::wstring& cache_name, const std::string& xml, OmeTiff* tiff_obj);
+int32_t save_ome_cache(const std::wstring& cache_name, const std::string& xml, const OmeTiff* tiff_obj, const std::map<std::string, bool>& checked_files);
@@ -1,11 +1,17 @@
 #include <fstream>
 #include <filesystem>
 #include <sstream>
+#include <atomic>
 #include "ometiff_container.h"
-//#include "jpeg_handler.h"
+#include "../common/jpeg_handler.h"
 //#include "..\lz4-1.9.2\lz4.h"
 #include "../lzw/lzw.h"
 #include "../common/data_predict.h"
+#include "../common/data_shuffle.h"
+#include "../common/codec_probe.h"
+#include "../common/image_reduce.h"
+#include "../common/image_resample.h"
+#include "../common/thread_pool.h"
 //#include "..\p2d\p2d_lib.h"
 //#include "..\p2d\img.h"
 //#include "..\p2d\p2d_basic.h"
@@ -14,6 +20,11 @@
 using namespace std;
 using namespace ome;
 
+//most compressed bytes read at once by GetRectData
+#define LOAD_BATCH_BYTES	((uint64_t)64 << 20)
+//first tiles of a COMPRESSIONMODE_AUTO frame probed together before its codec is chosen
+#define AUTO_PROBE_TILE_COUNT	4
+
 namespace fs = filesystem;
 
 inline static uint8_t GetBits(PixelType type) {
@@ -111,6 +122,32 @@ int32_t TiffContainer::CloseFile()
 {
 	if (_open_mode != OpenMode::READ_ONLY_MODE)
 	{
+		vector<uint32_t> pyramid_ifds;
+		{
+			lock_guard<mutex> lock(_pyramid_mutex);
+			for (auto it = _pyramids.begin(); it != _pyramids.end(); it++)
+				pyramid_ifds.push_back(it->first);
+		}
+		for (uint32_t ifd_no : pyramid_ifds)
+			FlushPyramid(ifd_no);
+		{
+			lock_guard<mutex> lock(_pyramid_mutex);
+			_pyramids.clear();
+		}
+
+		vector<uint32_t> auto_codec_ifds;
+		{
+			lock_guard<mutex> lock(_auto_codec_mutex);
+			for (auto it = _auto_codec_ifds.begin(); it != _auto_codec_ifds.end(); it++)
+				auto_codec_ifds.push_back(it->first);
+		}
+		for (uint32_t ifd_no : auto_codec_ifds)
+			FlushAutoCodec(ifd_no);
+		{
+			lock_guard<mutex> lock(_auto_codec_mutex);
+			_auto_codec_ifds.clear();
+		}
+
 		int32_t ifd_size = micro_tiff_GetIFDSize(_hdl);
 		for (int32_t i = 0; i < ifd_size; i++)
 		{
@@ -136,7 +173,188 @@ int32_t TiffContainer::SaveTileData(const uint32_t ifd_no, const uint32_t row, c
 	if (status != ErrorCode::STATUS_OK)
 		return status;
 
-	return SaveTileData(ifd_no, rect, image_info, image_data, stride);
+	status = SaveTileData(ifd_no, rect, image_info, image_data, stride);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	return AddToPyramid(ifd_no, 0, rect, image_info, image_data, stride);
+}
+
+int32_t TiffContainer::GetTileRect(const uint32_t ifd_no, const uint32_t row, const uint32_t column, OmeRect& rect, ImageInfo& image_info)
+{
+	int32_t status = micro_tiff_GetImageInfo(_hdl, ifd_no, image_info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	OmeSize image_size = { image_info.image_width, image_info.image_height };
+	OmeSize tile_size = { image_info.block_width, image_info.block_height };
+	return convert_tileIndex_to_rect(row, column, image_size, tile_size, rect);
+}
+
+int32_t TiffContainer::AddToPyramid(const uint32_t base_ifd_no, const uint32_t level, const OmeRect rect, const ImageInfo& image_info, const void* image_data, const uint32_t stride)
+{
+	uint32_t bytes_per_pixel = image_info.image_byte_count * image_info.samples_per_pixel;
+	uint32_t block_width = image_info.block_width;
+	uint32_t block_height = image_info.block_height;
+	size_t tile_stride = (size_t)block_width * bytes_per_pixel;
+
+	uint32_t column = rect.x / block_width;
+	uint32_t row = rect.y / block_height;
+	uint32_t child_bit = 1u << ((row % 2) * 2 + column % 2);
+	PyramidTile* tile = nullptr;
+	uint32_t parent_block_no = 0;
+	{
+		lock_guard<mutex> lock(_pyramid_mutex);
+		auto it = _pyramids.find(base_ifd_no);
+		if (it == _pyramids.end() || level >= it->second.size())
+			return ErrorCode::STATUS_OK;
+
+		vector<PyramidLevel>& levels = it->second;
+		uint32_t child_width = level == 0 ? image_info.image_width : levels[level - 1].width;
+		uint32_t child_height = level == 0 ? image_info.image_height : levels[level - 1].height;
+		PyramidLevel& parent = levels[level];
+
+		uint32_t parent_columns = (parent.width + block_width - 1) / block_width;
+		parent_block_no = row / 2 * parent_columns + column / 2;
+
+		auto it_tile = parent.pending.find(parent_block_no);
+		if (it_tile == parent.pending.end())
+		{
+			PyramidTile new_tile;
+			int32_t status = convert_tileIndex_to_rect(row / 2, column / 2, { parent.width, parent.height }, { block_width, block_height }, new_tile.rect);
+			if (status != ErrorCode::STATUS_OK)
+				return status;
+			new_tile.data.reset(new uint8_t[tile_stride * block_height]{ 0 });
+			//tiles at the right and bottom edges have less children
+			uint32_t child_columns = (child_width + block_width - 1) / block_width;
+			uint32_t child_rows = (child_height + block_height - 1) / block_height;
+			new_tile.expected = 0;
+			for (uint32_t y = 0; y < 2; y++)
+				for (uint32_t x = 0; x < 2; x++)
+					if (row / 2 * 2 + y < child_rows && column / 2 * 2 + x < child_columns)
+						new_tile.expected |= 1u << (y * 2 + x);
+			new_tile.arrived = 0;
+			new_tile.writers = 0;
+			it_tile = parent.pending.insert(make_pair(parent_block_no, std::move(new_tile))).first;
+		}
+		//a child saved again is only reduced once, or the parent would be completed before its other children
+		if ((it_tile->second.arrived & child_bit) != 0)
+			return ErrorCode::STATUS_OK;
+		tile = &it_tile->second;
+		tile->arrived |= child_bit;
+		tile->writers++;
+		parent.in_flight++;
+	}
+
+	//every child fills its own quarter of the parent tile, they are reduced at the same time out of the lock.
+	//The tile stays in the level while it has writers, FlushPyramid waits for them.
+	uint8_t* dst = tile->data.get() + (row % 2) * tile_stride * (block_height / 2) + (size_t)(column % 2) * (block_width / 2) * bytes_per_pixel;
+	uint32_t src_stride = stride == 0 ? rect.width * bytes_per_pixel : stride;
+	uint32_t src_width = (min)(src_stride / bytes_per_pixel, rect.width);
+	int reduce_status = image_reduce_2x2(image_data, src_width / _bin_size, rect.height, src_stride, image_info.image_byte_count,
+		(unsigned short)(image_info.samples_per_pixel * _bin_size), image_info.sample_format, dst, tile_stride);
+
+	PyramidTile done_tile;
+	{
+		lock_guard<mutex> lock(_pyramid_mutex);
+		PyramidLevel& parent = _pyramids[base_ifd_no][level];
+		tile->writers--;
+		if (reduce_status != 0 || tile->writers != 0 || tile->arrived != tile->expected)
+		{
+			parent.in_flight--;
+			_pyramid_cv.notify_all();
+			return reduce_status == 0 ? ErrorCode::STATUS_OK : ErrorCode::ERR_PARAMETER_INVALID;
+		}
+		done_tile = std::move(*tile);
+		parent.pending.erase(parent_block_no);
+	}
+	//the level is left once its completed tile is saved, which may reduce it into the next level
+	int32_t status = SavePyramidTile(base_ifd_no, level, done_tile);
+	LeavePyramidLevel(base_ifd_no, level);
+	return status;
+}
+
+void TiffContainer::LeavePyramidLevel(const uint32_t base_ifd_no, const uint32_t level)
+{
+	lock_guard<mutex> lock(_pyramid_mutex);
+	auto it = _pyramids.find(base_ifd_no);
+	if (it != _pyramids.end() && level < it->second.size())
+		it->second[level].in_flight--;
+	_pyramid_cv.notify_all();
+}
+
+int32_t TiffContainer::SavePyramidTile(const uint32_t base_ifd_no, const uint32_t level, PyramidTile& tile)
+{
+	uint32_t level_ifd_no;
+	{
+		lock_guard<mutex> lock(_pyramid_mutex);
+		auto it = _pyramids.find(base_ifd_no);
+		if (it == _pyramids.end() || level >= it->second.size())
+			return ErrorCode::STATUS_OK;
+		level_ifd_no = it->second[level].ifd_no;
+	}
+
+	ImageInfo level_info = { 0 };
+	int32_t status = micro_tiff_GetImageInfo(_hdl, level_ifd_no, level_info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	uint32_t tile_stride = level_info.block_width * level_info.image_byte_count * level_info.samples_per_pixel;
+	status = SaveTileData(level_ifd_no, tile.rect, level_info, tile.data.get(), tile_stride);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	return AddToPyramid(base_ifd_no, level + 1, tile.rect, level_info, tile.data.get(), tile_stride);
+}
+
+int32_t TiffContainer::FlushPyramid(const uint32_t base_ifd_no)
+{
+	//level by level, a flushed tile adds to the pending tiles of the next level
+	for (uint32_t level = 0; ; level++)
+	{
+		map<uint32_t, PyramidTile> pending;
+		{
+			//children still being reduced complete their tiles first, and carry them on to the next levels
+			unique_lock<mutex> lock(_pyramid_mutex);
+			auto it = _pyramids.end();
+			_pyramid_cv.wait(lock, [&]() {
+				it = _pyramids.find(base_ifd_no);
+				return it == _pyramids.end() || level >= it->second.size() || it->second[level].in_flight == 0;
+			});
+			if (it == _pyramids.end() || level >= it->second.size())
+				return ErrorCode::STATUS_OK;
+			pending.swap(it->second[level].pending);
+		}
+		for (auto it_tile = pending.begin(); it_tile != pending.end(); it_tile++)
+		{
+			int32_t status = SavePyramidTile(base_ifd_no, level, it_tile->second);
+			if (status != ErrorCode::STATUS_OK)
+				return status;
+		}
+	}
+}
+
+int32_t TiffContainer::GetPyramidIFDs(const uint32_t ifd_no, vector<uint32_t>& level_ifds)
+{
+	level_ifds.clear();
+	{
+		lock_guard<mutex> lock(_pyramid_mutex);
+		auto it = _pyramids.find(ifd_no);
+		if (it != _pyramids.end())
+		{
+			for (const PyramidLevel& level : it->second)
+				level_ifds.push_back(level.ifd_no);
+			return ErrorCode::STATUS_OK;
+		}
+	}
+
+	//levels of a frame already saved are the sub IFDs found in the file
+	int32_t level_count = micro_tiff_GetSubIFDs(_hdl, ifd_no, nullptr, 0);
+	if (level_count <= 0)
+		return level_count;
+	level_ifds.resize(level_count);
+	level_count = micro_tiff_GetSubIFDs(_hdl, ifd_no, level_ifds.data(), (uint32_t)level_ifds.size());
+	if (level_count < 0)
+		return level_count;
+	level_ifds.resize((min)((size_t)level_count, level_ifds.size()));
+	return ErrorCode::STATUS_OK;
 }
 
 static int32_t BufferCopy(void* src_buffer, const uint32_t src_stride, void* dst_buffer, const uint32_t dst_stride, 
@@ -153,8 +371,9 @@ static int32_t BufferCopy(void* src_buffer, const uint32_t src_stride, void* dst
 	return ErrorCode::STATUS_OK;
 }
 
-int32_t TiffContainer::SaveTileData(const uint32_t ifd_no, const OmeRect rect, const ImageInfo& image_info, void* image_data, const uint32_t stride)
+int32_t TiffContainer::SaveTileData(const uint32_t ifd_no, const OmeRect rect, const ImageInfo& ifd_info, void* image_data, const uint32_t stride)
 {
+	ImageInfo image_info = ifd_info;
 	uint32_t tile_width = image_info.block_width;
 	uint32_t tile_height = image_info.block_height;
 
@@ -164,6 +383,14 @@ int32_t TiffContainer::SaveTileData(const uint32_t ifd_no, const OmeRect rect, c
 	uint32_t buf_width = stride == 0 ? rect.width : stride / bytes_per_pixel;
 
 	uint64_t block_byte_size = rect.height * tile_width * bytes_per_pixel;
+	//uncompressed rows are written straight from the caller's buffer, padded to the tile width
+	if (image_info.compression == COMPRESSION_NONE)
+	{
+		uint32_t src_stride = stride == 0 ? buf_width * bytes_per_pixel : stride;
+		return micro_tiff_SaveBlockRows(_hdl, ifd_no, block_no, tile_width * bytes_per_pixel, rect.height,
+			image_data, (min)(buf_width, rect.width) * bytes_per_pixel, rect.height, src_stride);
+	}
+
 	//when rect.width != tileWidth, expand to a whole tile width
 
 	void* buf = nullptr;
@@ -189,11 +416,24 @@ int32_t TiffContainer::SaveTileData(const uint32_t ifd_no, const OmeRect rect, c
 		buf = image_data;
 	}
 
+	if (image_info.compression == COMPRESSION_LZW)
+	{
+		bool held = false;
+		int32_t status = ChooseAutoCodec(ifd_no, block_no, buf, rect.height, block_byte_size, image_info, held);
+		if (status != ErrorCode::STATUS_OK || held)
+			return status;
+	}
+	return SaveEncodedTile(ifd_no, block_no, buf, rect.height, block_byte_size, image_info);
+}
+
+//Encode one tile of "tile_height" rows, padded to the tile width, with the codec of "image_info" and save it.
+int32_t TiffContainer::SaveEncodedTile(const uint32_t ifd_no, const uint32_t block_no, void* tile, const uint32_t tile_height, const uint64_t tile_size, const ImageInfo& image_info)
+{
 	int32_t status = ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
 	switch (image_info.compression)
 	{
 	case COMPRESSION_NONE:
-		status = micro_tiff_SaveBlock(_hdl, ifd_no, block_no, block_byte_size, buf);
+		status = micro_tiff_SaveBlock(_hdl, ifd_no, block_no, tile_size, tile);
 		break;
 	case COMPRESSION_LZW:
 	{
@@ -204,7 +444,7 @@ int32_t TiffContainer::SaveTileData(const uint32_t ifd_no, const OmeRect rect, c
 		//		return ErrorCode::ERR_LZW_HORIZONTAL_DIFFERENCING;
 		//	}
 		//}
-		status = SaveTileLZW(buf, ifd_no, block_no, block_byte_size);
+		status = SaveTileLZW(tile, ifd_no, block_no, tile_size, image_info);
 		break;
 	}
 	//case COMPRESSION_LZ4:
@@ -213,34 +453,10 @@ int32_t TiffContainer::SaveTileData(const uint32_t ifd_no, const OmeRect rect, c
 	//case COMPRESSION_DEFLATE:
 	//	status = SaveTileZlib(buf, ifd_no, block_no, block_byte_size);
 	//	break;
-	//case COMPRESSION_JPEG:
-	//	//for saving not uint8_t data, shift to uint8_t
-	//	void* shift_buf = nullptr;
-	//	if (_info.pixel_type == PixelType::PIXEL_UINT16)
-	//	{
-	//		shift_buf = calloc((size_t)tile_width * rect.height, 1);
-	//		if (shift_buf == nullptr) {
-	//			status = ErrorCode::ERR_BUFFER_IS_NULL;
-	//			break;
-	//		}
-	//		uint32_t source_stride = stride == 0 ? tile_width * 2 : stride;
-	//		p2d_region region = { (int32_t)tile_width, rect.height };
-	//		int32_t p2d_status = p2d_img_shift(buf, source_stride, _info.significant_bits, shift_buf, tile_width, 8, region);
-	//		if (p2d_status != ErrorCode::STATUS_OK)
-	//		{
-	//			free(shift_buf);
-	//			status = ErrorCode::ERR_P2D_SHIFT_FAILED;
-	//			break;
-	//		}
-	//	}
-	//	else
-	//	{
-	//		shift_buf = buf;
-	//	}
-	//	status = SaveTileJpeg(shift_buf, ifd_no, block_no, block_byte_size, tile_width, rect.height);
-	//	if (shift_buf != buf)
-	//		free(shift_buf);
-	//	break;
+	case COMPRESSION_JPEG:
+		//CreateIFD makes sure the data is 8 bits gray or RGB
+		status = SaveTileJpeg(tile, ifd_no, block_no, image_info.block_width, tile_height, image_info.samples_per_pixel);
+		break;
 	default:
 		break;
 	}
@@ -254,28 +470,75 @@ int32_t TiffContainer::LoadRectData(const uint32_t ifd_no, const OmeSize dst_siz
 	{
 		return GetRectData(ifd_no, src_rect, image_data, stride);
 	}
-	else
-	{
-		//size_t buf_size = (size_t)src_rect.height * src_rect.width;
-		//uint32_t src_stride = src_rect.width * _image_bytes;
-		//void* imageBuf = calloc((size_t)src_rect.height * src_rect.width, _image_bytes);
-		//if (imageBuf == nullptr)
-		//	return ErrorCode::ERR_BUFFER_IS_NULL;
-		//int32_t status = GetRectData(ifd_no, &src_rect, imageBuf, src_stride);
-		//if (status != ErrorCode::STATUS_OK)
-		//{
-		//	free(imageBuf);
-		//	return status;
-		//}
+	return GetResampledRectData(ifd_no, dst_size, src_rect, image_data, stride);
+}
+
+int32_t TiffContainer::GetResampledRectData(const uint32_t ifd_no, const OmeSize dst_size, const OmeRect src_rect, void* image_data, uint32_t stride)
+{
+	if (dst_size.width == 0 || dst_size.height == 0 || src_rect.width == 0 || src_rect.height == 0)
+		return ErrorCode::TIFF_ERR_BAD_PARAMETER_VALUE;
 
-		//p2d_region srcRegion = { src_rect.width, src_rect.height };
-		//p2d_region dstRegion = { dst_size.width, dst_size.height };
-		//uint32_t dst_stride = stride == 0 ? dst_size.width * _image_bytes : stride;
-		//int32_t p2d_status = p2d_img_resize(imageBuf, srcRegion, src_stride, buffer, dstRegion, dst_stride, (p2d_data_format)(_info.pixel_type));
-		//free(imageBuf);
-		//if (p2d_status != ErrorCode::STATUS_OK)
-		//	return ErrorCode::ERR_P2D_RESIZE_FAILED;
-		return ErrorCode::ERR_RESIZE_NOT_SUPPORT_NOW;
+	ImageInfo image_info;
+	int32_t status = micro_tiff_GetImageInfo(_hdl, ifd_no, image_info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	if ((uint64_t)(src_rect.x + src_rect.width) * _bin_size > image_info.image_width || src_rect.y + src_rect.height > image_info.image_height)
+		return ErrorCode::TIFF_ERR_BAD_PARAMETER_VALUE;
+
+	//all the samples of a binned pixel are resampled together
+	uint16_t samples = (uint16_t)(image_info.samples_per_pixel * _bin_size);
+	uint32_t bytes_per_pixel = image_info.image_byte_count * samples;
+	if (stride != 0 && stride / bytes_per_pixel < dst_size.width)
+		return ErrorCode::ERR_STRIDE_NOT_CORRECT;
+	if (stride == 0)
+		stride = dst_size.width * bytes_per_pixel;
+
+	vector<image_resample_tap> taps_x(dst_size.width), taps_y(dst_size.height);
+	image_resample_axis(src_rect.width, dst_size.width, taps_x.data());
+	image_resample_axis(src_rect.height, dst_size.height, taps_y.data());
+
+	//the source is decoded one band of tile rows at a time, so every tile is decoded once and only
+	//one band and a few resampled rows are held, never the whole source rect
+	uint32_t band_stride = src_rect.width * bytes_per_pixel;
+	unique_ptr<uint8_t[]> band(new uint8_t[(size_t)band_stride * image_info.block_height]);
+	uint32_t band_first = 0, band_rows = 0;
+
+	//horizontally resampled source rows, the last 2 are kept for bilinear interpolation
+	size_t row_samples = (size_t)dst_size.width * samples;
+	unique_ptr<float[]> rows(new float[row_samples * 3]);
+	float* resampled[2] = { rows.get(), rows.get() + row_samples };
+	uint32_t resampled_y[2] = { UINT32_MAX, UINT32_MAX };
+	float* sum = rows.get() + row_samples * 2;
+
+	for (uint32_t dst_y = 0; dst_y < dst_size.height; dst_y++)
+	{
+		const image_resample_tap& tap = taps_y[dst_y];
+		memset(sum, 0, row_samples * sizeof(float));
+		for (uint32_t n = 0; n < tap.count; n++)
+		{
+			uint32_t src_y = tap.first + n;
+			int cached = resampled_y[0] == src_y ? 0 : (resampled_y[1] == src_y ? 1 : -1);
+			if (cached < 0)
+			{
+				if (src_y < band_first || src_y >= band_first + band_rows)
+				{
+					//from this row to the end of its tile row
+					band_first = src_y;
+					band_rows = image_info.block_height - (src_rect.y + src_y) % image_info.block_height;
+					band_rows = (min)(band_rows, src_rect.height - src_y);
+					status = GetRectData(ifd_no, { src_rect.x, src_rect.y + band_first, src_rect.width, band_rows }, band.get(), band_stride);
+					if (status != ErrorCode::STATUS_OK)
+						return status;
+				}
+				//rows are used in increasing order, replace the older one
+				cached = resampled_y[0] == UINT32_MAX || (resampled_y[1] != UINT32_MAX && resampled_y[0] < resampled_y[1]) ? 0 : 1;
+				image_resample_row(band.get() + (size_t)(src_y - band_first) * band_stride, image_info.image_byte_count, samples,
+					image_info.sample_format, taps_x.data(), dst_size.width, resampled[cached]);
+				resampled_y[cached] = src_y;
+			}
+			image_resample_add(sum, resampled[cached], n == 0 ? tap.first_weight : tap.weight, row_samples);
+		}
+		image_resample_store(sum, row_samples, image_info.image_byte_count, image_info.sample_format, (uint8_t*)image_data + (size_t)dst_y * stride);
 	}
 	return ErrorCode::STATUS_OK;
 }
@@ -302,6 +565,43 @@ int32_t TiffContainer::LoadTileData(const uint32_t ifd_no, const uint32_t row, c
 //int32_t DecompressJPEGData(void* encode_data, uint64_t encode_size, void* decode_data, uint64_t* decode_size, int32_t* width);
 //int32_t DecompressZlibData(void* encode_data, uint64_t encode_size, void* decode_data, uint64_t* decode_size);
 
+struct DecodeRowContext
+{
+	const ImageInfo* image_info;
+	uint8_t* temp_row;
+	OmeRect copy_rect;			//part of the tile to copy, in tile coordinates
+	uint8_t* dst;				//first byte of the paste position
+	uint32_t dst_stride;
+	uint32_t copy_bytes;
+	uint32_t copied_rows;
+};
+
+//Called by the LZW decoder for every tile row : undo the predictor and copy the wanted part into the caller's buffer
+//while the row is still in cache. Rows before the rect are skipped, decoding stops after its last row.
+static int DecodeRowToRect(void* row, uint64_t row_index, void* user_data)
+{
+	DecodeRowContext* context = (DecodeRowContext*)user_data;
+	const ImageInfo* info = context->image_info;
+	if (row_index < context->copy_rect.y)
+		return 0;
+
+	int status = 0;
+	if (info->predictor == PREDICTOR_HORIZONTAL)
+		status = horizontal_acc(row, 1, info->block_width, info->image_byte_count, info->samples_per_pixel, false);
+	else if (info->predictor == PREDICTOR_FLOATINGPOINT)
+		status = floating_point_acc_row(row, info->block_width, info->image_byte_count, info->samples_per_pixel, context->temp_row);
+	if (status != 0)
+		return -1;
+
+	uint32_t bytes_per_pixel = info->image_byte_count * info->samples_per_pixel;
+	uint8_t* src_ptr = (uint8_t*)row + context->copy_rect.x * bytes_per_pixel;
+	uint8_t* dst_ptr = context->dst + (size_t)(row_index - context->copy_rect.y) * context->dst_stride;
+	memcpy(dst_ptr, src_ptr, context->copy_bytes);
+
+	context->copied_rows++;
+	return context->copied_rows == context->copy_rect.height ? 1 : 0;
+}
+
 int32_t TiffContainer::GetOneBlockData(const uint32_t ifd_no, const OmeRect rect, const ImageInfo& image_info, void* image_data, const uint32_t stride, OmeSize paste_start)
 {
 	if (rect.y +rect.height > image_info.image_height ||rect.x +rect.width > image_info.image_width)
@@ -311,19 +611,6 @@ int32_t TiffContainer::GetOneBlockData(const uint32_t ifd_no, const OmeRect rect
 
 	uint32_t block_no = GetBlockId(rect.x, rect.y, image_info.block_width, image_info.block_height, image_info.image_width);
 
-	uint32_t height = image_info.block_height;
-	uint32_t row_tail = image_info.image_height % image_info.block_height;
-	uint32_t row_count = image_info.image_height / image_info.block_height;
-	if (row_tail > 0)
-	{
-		double count = (double)(rect.y + rect.height) / image_info.block_height;
-		if (count > (double)row_count && count < (double)row_count + 1)
-			height = row_tail;
-	}
-
-	uint32_t block_actual_byte_size = height * image_info.block_width * bytes_per_pixel;
-	uint32_t block_full_byte_size = image_info.block_height * image_info.block_width * bytes_per_pixel;
-
 	//Get compressed data size
 	uint64_t buffer_size;
 	int32_t status = micro_tiff_LoadBlock(_hdl, ifd_no, block_no, buffer_size, nullptr);
@@ -332,6 +619,15 @@ int32_t TiffContainer::GetOneBlockData(const uint32_t ifd_no, const OmeRect rect
 	if (buffer_size == 0)
 		return ErrorCode::TIFF_ERR_READ_DATA_FROM_FILE_FAILED;
 
+	//uncompressed rows of the rect are read straight into the caller's buffer
+	if (image_info.compression == COMPRESSION_NONE)
+	{
+		uint32_t dst_stride = stride == 0 ? rect.width * bytes_per_pixel : stride;
+		uint8_t* dst = (uint8_t*)image_data + (size_t)paste_start.height * dst_stride + paste_start.width * bytes_per_pixel;
+		return micro_tiff_LoadBlockRows(_hdl, ifd_no, block_no, image_info.block_width * bytes_per_pixel, rect.y % image_info.block_height, rect.height,
+			(rect.x % image_info.block_width) * bytes_per_pixel, (min)(rect.width * bytes_per_pixel, dst_stride), dst, dst_stride);
+	}
+
 	unique_ptr<uint8_t[]> auto_load_block_buf = make_unique<uint8_t[]>(buffer_size);
 	uint8_t* load_block_buf = auto_load_block_buf.get();
 	if (load_block_buf == nullptr)
@@ -342,24 +638,72 @@ int32_t TiffContainer::GetOneBlockData(const uint32_t ifd_no, const OmeRect rect
 	if (status != ErrorCode::STATUS_OK)
 		return status;
 
+	BlockDecodeBuffers buffers;
+	return DecodeBlockData(rect, image_info, load_block_buf, buffer_size, image_data, stride, paste_start, buffers);
+}
+
+static uint8_t* ReserveBuffer(unique_ptr<uint8_t[]>& buffer, size_t& capacity, const size_t size)
+{
+	if (capacity < size)
+	{
+		buffer.reset(new uint8_t[size]);
+		capacity = size;
+	}
+	return buffer.get();
+}
+
+int32_t TiffContainer::DecodeBlockData(const OmeRect rect, const ImageInfo& image_info, uint8_t* block, const uint64_t block_size,
+	void* image_data, const uint32_t stride, const OmeSize paste_start, BlockDecodeBuffers& buffers)
+{
+	uint32_t bytes_per_pixel = image_info.image_byte_count * image_info.samples_per_pixel;
+	uint32_t dst_stride = stride == 0 ? rect.width * bytes_per_pixel : stride;
+
+	//LZW without shuffle : decode row by row into a single row buffer, no whole tile buffer and no extra pass over it
+	if (image_info.compression == COMPRESSION_LZW && image_info.shuffle == SHUFFLE_NONE)
+	{
+		uint32_t row_bytes = image_info.block_width * bytes_per_pixel;
+		uint8_t* row_buf = ReserveBuffer(buffers.row, buffers.row_size, image_info.predictor == PREDICTOR_FLOATINGPOINT ? row_bytes * 2 : row_bytes);
+
+		DecodeRowContext context = { 0 };
+		context.image_info = &image_info;
+		context.temp_row = row_buf + row_bytes;
+		context.copy_rect = { rect.x % image_info.block_width, rect.y % image_info.block_height, rect.width, rect.height };
+		context.dst_stride = dst_stride;
+		context.dst = (uint8_t*)image_data + (size_t)paste_start.height * dst_stride + paste_start.width * bytes_per_pixel;
+		context.copy_bytes = (min)(rect.width * bytes_per_pixel, dst_stride);
+
+		int64_t decode_size = LZWDecodeRows(block, block_size, row_buf, row_bytes, (uint64_t)context.copy_rect.y + rect.height, 0, DecodeRowToRect, &context);
+		if (decode_size < 0 || context.copied_rows != rect.height)
+			return ErrorCode::ERR_DECOMPRESS_LZW_FAILED;
+		return ErrorCode::STATUS_OK;
+	}
+
+	uint32_t height = image_info.block_height;
+	uint32_t row_tail = image_info.image_height % image_info.block_height;
+	uint32_t row_count = image_info.image_height / image_info.block_height;
+	if (row_tail > 0)
+	{
+		double count = (double)(rect.y + rect.height) / image_info.block_height;
+		if (count > (double)row_count && count < (double)row_count + 1)
+			height = row_tail;
+	}
+
+	uint32_t block_actual_byte_size = height * image_info.block_width * bytes_per_pixel;
+	uint32_t block_full_byte_size = image_info.block_height * image_info.block_width * bytes_per_pixel;
+
 	//decompress data information
 	int32_t decompress_width = image_info.block_width;
 	int32_t decompress_height = height;
 
+	int32_t status = ErrorCode::STATUS_OK;
 	uint8_t* decompress_buf = nullptr;
-	unique_ptr<uint8_t[]> auto_decompress_buf = make_unique<uint8_t[]>(0);
-
 	if (image_info.compression == COMPRESSION_NONE) {
-		decompress_buf = load_block_buf;
+		decompress_buf = block;
 	}
 	else
 	{
-		auto_decompress_buf.reset(new uint8_t[block_full_byte_size]{ 0 });
-		decompress_buf = auto_decompress_buf.get();
-		if (decompress_buf == nullptr)
-			return ErrorCode::ERR_BUFFER_IS_NULL;
+		decompress_buf = ReserveBuffer(buffers.block, buffers.block_size, block_full_byte_size);
 
-		//uint64_t actual_read_size = 0;
 		switch (image_info.compression)
 		{
 			//case COMPRESSION_LZ4:
@@ -367,7 +711,11 @@ int32_t TiffContainer::GetOneBlockData(const uint32_t ifd_no, const OmeRect rect
 			//	break;
 		case COMPRESSION_LZW:
 		{
-			int32_t decode_size = LZWDecode(load_block_buf, buffer_size, decompress_buf, block_full_byte_size);
+			uint8_t* decode_buf = decompress_buf;
+			if (image_info.shuffle != SHUFFLE_NONE)
+				decode_buf = ReserveBuffer(buffers.shuffle, buffers.shuffle_size, block_full_byte_size);
+
+			int32_t decode_size = LZWDecode(block, block_size, decode_buf, block_full_byte_size);
 			if (decode_size == block_full_byte_size)
 				decompress_height = image_info.block_height;
 			else if (decode_size == block_actual_byte_size)
@@ -378,17 +726,47 @@ int32_t TiffContainer::GetOneBlockData(const uint32_t ifd_no, const OmeRect rect
 				break;
 			}
 
+			if (decode_buf != decompress_buf)
+			{
+				if (data_unshuffle(decode_buf, decompress_buf, decode_size, image_info.image_byte_count, image_info.shuffle) != 0)
+				{
+					status = ErrorCode::ERR_SHUFFLE_FAILED;
+					break;
+				}
+			}
+
 			if (image_info.predictor == PREDICTOR_HORIZONTAL)
 			{
 				status = horizontal_acc(decompress_buf, decompress_height, decompress_width, image_info.image_byte_count, image_info.samples_per_pixel, false);
 				if (status != 0)
 					status = ErrorCode::ERR_HORIZONTAL_ACC_FAILED;
 			}
+			else if (image_info.predictor == PREDICTOR_FLOATINGPOINT)
+			{
+				status = floating_point_acc(decompress_buf, decompress_height, decompress_width, image_info.image_byte_count, image_info.samples_per_pixel);
+				if (status != 0)
+					status = ErrorCode::ERR_FLOATING_POINT_PREDICTOR_FAILED;
+			}
+			break;
+		}
+		case COMPRESSION_JPEG:
+		{
+			int width, jpeg_height, samples;
+			if (jpeg_decompress_header(block, (unsigned long)block_size, &width, &jpeg_height, &samples) != 0
+				|| (uint64_t)width * jpeg_height * samples > block_full_byte_size || samples != image_info.samples_per_pixel)
+			{
+				status = ErrorCode::ERR_DECOMPRESS_JPEG_FAILED;
+				break;
+			}
+			if (jpeg_decompress(decompress_buf, block, (unsigned long)block_size, &width, &jpeg_height, &samples) != 0)
+			{
+				status = ErrorCode::ERR_DECOMPRESS_JPEG_FAILED;
+				break;
+			}
+			decompress_width = width;
+			decompress_height = jpeg_height;
 			break;
 		}
-			//case COMPRESSION_JPEG:
-			//	decompress_status = DecompressJPEGData(load_block_buf, count, decompress_buf, &actual_read_size, &decompress_width);
-			//	break;
 			//case COMPRESSION_DEFLATE:
 			//case COMPRESSION_ADOBE_DEFLATE:
 			//	actual_read_size = block_full_byte_size;
@@ -402,23 +780,13 @@ int32_t TiffContainer::GetOneBlockData(const uint32_t ifd_no, const OmeRect rect
 	if (status != ErrorCode::STATUS_OK)
 		return status;
 
-	//get target rect data from whole block data
-	if (rect.width != decompress_width || rect.height != decompress_height || (stride != 0 && stride != rect.width * bytes_per_pixel))
-	{
-		uint32_t src_stride = decompress_width * bytes_per_pixel;
-		uint32_t dst_stride = stride == 0 ? rect.width * bytes_per_pixel : stride;
-
-		OmeRect copy_rect = { 0 };
-		copy_rect.x = rect.x % image_info.block_width;
-		copy_rect.y = rect.y % image_info.block_height;
-		copy_rect.width = rect.width;
-		copy_rect.height = rect.height;
-		BufferCopy(decompress_buf, src_stride, image_data, dst_stride, bytes_per_pixel, copy_rect, paste_start);
-	}
-	else
-	{
-		memcpy_s(image_data, block_actual_byte_size, decompress_buf, block_actual_byte_size);
-	}
+	//get target rect data from whole block data, at its place in image_data
+	OmeRect copy_rect = { 0 };
+	copy_rect.x = rect.x % image_info.block_width;
+	copy_rect.y = rect.y % image_info.block_height;
+	copy_rect.width = rect.width;
+	copy_rect.height = rect.height;
+	BufferCopy(decompress_buf, decompress_width * bytes_per_pixel, image_data, dst_stride, bytes_per_pixel, copy_rect, paste_start);
 
 	return ErrorCode::STATUS_OK;
 }
@@ -451,50 +819,152 @@ int32_t TiffContainer::GetRectData(const uint32_t ifd_no, const OmeRect rect, vo
 
 	int32_t status = ErrorCode::STATUS_OK;
 
+	//the covered tiles first, in block order : their part of the rect and its position in image_data
+	vector<OmeRect> tile_rects;
+	vector<OmeSize> paste_starts;
+	vector<uint32_t> block_nos;
 	OmeRect tile_rect = { 0 };
-	uint32_t x = 0;
+	uint32_t y = 0;
 	while (true)
 	{
-		tile_rect.x = x + rect_with_bin.x;
-		uint32_t x_remainder = tile_rect.x % image_info.block_width;
-		if (x_remainder + (rect_with_bin.width - x) < image_info.block_width)
-			tile_rect.width = rect_with_bin.width - x;
+		tile_rect.y = y + rect_with_bin.y;
+		uint32_t y_remainder = tile_rect.y % image_info.block_height;
+		if (y_remainder + (rect_with_bin.height - y) < image_info.block_height)
+			tile_rect.height = rect_with_bin.height - y;
 		else
-			tile_rect.width = image_info.block_width - x_remainder;
+			tile_rect.height = image_info.block_height - y_remainder;
 
-		uint32_t y = 0;
+		uint32_t x = 0;
 		while (true)
 		{
-			tile_rect.y = y + rect_with_bin.y;
-			uint32_t y_remainder = tile_rect.y % image_info.block_height;
-			if (y_remainder + (rect_with_bin.height - y) < image_info.block_height)
-				tile_rect.height = rect_with_bin.height - y;
+			tile_rect.x = x + rect_with_bin.x;
+			uint32_t x_remainder = tile_rect.x % image_info.block_width;
+			if (x_remainder + (rect_with_bin.width - x) < image_info.block_width)
+				tile_rect.width = rect_with_bin.width - x;
 			else
-				tile_rect.height = image_info.block_height - y_remainder;
+				tile_rect.width = image_info.block_width - x_remainder;
 
-			status = GetOneBlockData(ifd_no, tile_rect, image_info, image_data, stride, {x, y});
-			if (status != ErrorCode::STATUS_OK)
-				return status;
+			tile_rects.push_back(tile_rect);
+			paste_starts.push_back({ x, y });
+			block_nos.push_back(GetBlockId(tile_rect.x, tile_rect.y, image_info.block_width, image_info.block_height, image_info.image_width));
 
-			y += tile_rect.height;
-			if (y == rect_with_bin.height)
+			x += tile_rect.width;
+			if (x == rect_with_bin.width)
 				break;
-			else if (y > rect_with_bin.height)
+			else if (x > rect_with_bin.width)
 				return ErrorCode::ERR_PARAMETER_INVALID;
 		}
-		x += tile_rect.width;
-		if (x == rect_with_bin.width)
+		y += tile_rect.height;
+		if (y == rect_with_bin.height)
 			break;
-		else if (x > rect_with_bin.width)
+		else if (y > rect_with_bin.height)
 			return ErrorCode::ERR_PARAMETER_INVALID;
 	}
+	uint32_t count = (uint32_t)tile_rects.size();
+
+	//uncompressed rows are read straight into image_data, there is nothing to decode
+	if (image_info.compression == COMPRESSION_NONE)
+	{
+		for (uint32_t i = 0; i < count; i++)
+		{
+			status = GetOneBlockData(ifd_no, tile_rects[i], image_info, image_data, stride, paste_starts[i]);
+			if (status != ErrorCode::STATUS_OK)
+				return status;
+		}
+		return status;
+	}
+
+	vector<uint64_t> sizes(count);
+	status = micro_tiff_LoadBlocks(_hdl, ifd_no, block_nos.data(), count, sizes.data(), nullptr);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	for (uint64_t size : sizes)
+	{
+		if (size == 0)
+			return ErrorCode::TIFF_ERR_READ_DATA_FROM_FILE_FAILED;
+	}
+
+	//Payloads are read in batches with one call, then every tile is decoded by one thread with its own buffers
+	//into its own part of image_data.
+	uint32_t threads = (min)(thread_pool_get_threads(0), count);
+	vector<BlockDecodeBuffers> thread_buffers(threads);
+	vector<uint64_t> offsets(count);
+	unique_ptr<uint8_t[]> batch;
+	size_t batch_capacity = 0;
+	for (uint32_t first = 0; first < count;)
+	{
+		uint32_t end = first;
+		uint64_t batch_size = 0;
+		while (end < count && (end == first || batch_size + sizes[end] <= LOAD_BATCH_BYTES))
+		{
+			offsets[end] = batch_size;
+			batch_size += sizes[end++];
+		}
+		uint8_t* batch_buf = ReserveBuffer(batch, batch_capacity, (size_t)batch_size);
+		status = micro_tiff_LoadBlocks(_hdl, ifd_no, &block_nos[first], end - first, &sizes[first], batch_buf);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+
+		atomic<int32_t> decode_status(ErrorCode::STATUS_OK);
+		thread_pool_parallel_for((int32_t)(end - first), threads, [&](int32_t i, uint32_t participant) {
+			if (decode_status != ErrorCode::STATUS_OK)
+				return;
+			uint32_t n = first + i;
+			int32_t block_status = DecodeBlockData(tile_rects[n], image_info, batch_buf + offsets[n], sizes[n], image_data, stride, paste_starts[n], thread_buffers[participant]);
+			if (block_status != ErrorCode::STATUS_OK)
+				decode_status = block_status;
+		});
+		if (decode_status != ErrorCode::STATUS_OK)
+			return decode_status;
+		first = end;
+	}
 
 	return status;
 }
 
 int32_t TiffContainer::CreateIFD(const uint32_t width, const uint32_t height, 
 	const uint32_t block_width, const uint32_t block_height,
-	const PixelType pixel_type, const uint16_t samples_per_pixel, const CompressionMode compress_mode)
+	const PixelType pixel_type, const uint16_t samples_per_pixel, const CompressionMode compress_mode, const ShuffleMode shuffle_mode,
+	const uint32_t pyramid_levels)
+{
+	//the levels are SubIFDs of their frame, so readers of OME-TIFF only find the frames in the IFD chain
+	lock_guard<mutex> lock(_pyramid_mutex);
+	int32_t ifd_no = CreateOneIFD(width, height, block_width, block_height, pixel_type, samples_per_pixel, compress_mode, shuffle_mode);
+	if (ifd_no < 0 || pyramid_levels == 0)
+		return ifd_no;
+
+	//a parent tile holds exactly 2x2 child tiles only when the tile sizes are even
+	uint32_t logical_width = width / _bin_size;
+	uint32_t logical_block_width = block_width / _bin_size;
+	if (logical_block_width % 2 != 0 || block_height % 2 != 0)
+		return ifd_no;
+
+	vector<PyramidLevel> levels;
+	uint32_t level_height = height;
+	while (levels.size() < pyramid_levels && (logical_width > logical_block_width || level_height > block_height))
+	{
+		logical_width = (logical_width + 1) / 2;
+		level_height = (level_height + 1) / 2;
+		int32_t level_ifd_no = CreateOneIFD(logical_width * _bin_size, level_height, block_width, block_height,
+			pixel_type, samples_per_pixel, compress_mode, shuffle_mode, ifd_no);
+		if (level_ifd_no < 0)
+			return level_ifd_no;
+		PyramidLevel level;
+		level.ifd_no = level_ifd_no;
+		level.width = logical_width * _bin_size;
+		level.height = level_height;
+		level.in_flight = 0;
+		levels.push_back(std::move(level));
+	}
+	if (!levels.empty())
+		_pyramids[ifd_no] = std::move(levels);
+	return ifd_no;
+}
+
+int32_t TiffContainer::CreateOneIFD(const uint32_t width, const uint32_t height,
+	const uint32_t block_width, const uint32_t block_height,
+	const PixelType pixel_type, const uint16_t samples_per_pixel, const CompressionMode compress_mode, const ShuffleMode shuffle_mode,
+	const int32_t parent_ifd_no)
 {
 	ImageInfo info = { 0 };
 	info.image_width = width;
@@ -507,6 +977,19 @@ int32_t TiffContainer::CreateIFD(const uint32_t width, const uint32_t height,
 	info.planarconfig = PLANARCONFIG_CONTIG;
 	info.predictor = PREDICTOR_NONE;
 	info.samples_per_pixel = samples_per_pixel;
+	switch (pixel_type)
+	{
+	case PixelType::PIXEL_INT8:
+	case PixelType::PIXEL_INT16:
+		info.sample_format = SAMPLEFORMAT_INT;
+		break;
+	case PixelType::PIXEL_FLOAT32:
+		info.sample_format = SAMPLEFORMAT_IEEEFP;
+		break;
+	default:
+		info.sample_format = SAMPLEFORMAT_UINT;
+		break;
+	}
 
 	switch (compress_mode)
 	{
@@ -516,6 +999,20 @@ int32_t TiffContainer::CreateIFD(const uint32_t width, const uint32_t height,
 	case CompressionMode::COMPRESSIONMODE_LZW:
 		info.compression = COMPRESSION_LZW;
 		//info.predictor = PREDICTOR_HORIZONTAL;
+		if (pixel_type == PixelType::PIXEL_FLOAT32)
+			info.predictor = PREDICTOR_FLOATINGPOINT;
+		break;
+	case CompressionMode::COMPRESSIONMODE_AUTO:
+		//created as LZW, ChooseAutoCodec changes it before the first tile is written
+		info.compression = COMPRESSION_LZW;
+		info.predictor = pixel_type == PixelType::PIXEL_FLOAT32 ? PREDICTOR_FLOATINGPOINT : PREDICTOR_HORIZONTAL;
+		break;
+	case CompressionMode::COMPRESSIONMODE_JPEG:
+		info.compression = COMPRESSION_JPEG;
+		if (samples_per_pixel == 3)
+			info.photometric = PHOTOMETRIC_YCBCR;
+		else if (samples_per_pixel != 1)
+			return ErrorCode::ERR_COMPRESS_TYPE_NOTSUPPORT;
 		break;
 	default:
 		info.compression = COMPRESSION_NONE;
@@ -526,7 +1023,149 @@ int32_t TiffContainer::CreateIFD(const uint32_t width, const uint32_t height,
 		return ErrorCode::ERR_JEPG_ONLY_SUPPORT_8BITS;
 	}
 
-	return micro_tiff_CreateIFD(_hdl, info);
+	info.shuffle = SHUFFLE_NONE;
+	if (info.compression == COMPRESSION_LZW && compress_mode != CompressionMode::COMPRESSIONMODE_AUTO)
+	{
+		switch (shuffle_mode)
+		{
+		case ShuffleMode::SHUFFLEMODE_BYTE:
+			//byte shuffle of 8 bits data changes nothing
+			if (info.image_byte_count > 1)
+				info.shuffle = SHUFFLE_BYTE;
+			break;
+		case ShuffleMode::SHUFFLEMODE_BIT:
+			info.shuffle = SHUFFLE_BIT;
+			break;
+		default:
+			break;
+		}
+	}
+
+	int32_t ifd_no = parent_ifd_no < 0 ? micro_tiff_CreateIFD(_hdl, info) : micro_tiff_CreateSubIFD(_hdl, (uint32_t)parent_ifd_no, info);
+	if (ifd_no >= 0 && compress_mode == CompressionMode::COMPRESSIONMODE_AUTO)
+	{
+		uint64_t tile_count = (uint64_t)((width + block_width - 1) / block_width) * ((height + block_height - 1) / block_height);
+		AutoCodecState state;
+		state.decided = false;
+		state.sample_count = (uint32_t)(min)(tile_count, (uint64_t)AUTO_PROBE_TILE_COUNT);
+		state.result = { 0 };
+		lock_guard<mutex> lock(_auto_codec_mutex);
+		_auto_codec_ifds[ifd_no] = std::move(state);
+	}
+	return ifd_no;
+}
+
+int32_t TiffContainer::ChooseAutoCodec(const uint32_t ifd_no, const uint32_t block_no, void* tile, const uint32_t tile_height, const uint64_t tile_size,
+	ImageInfo& image_info, bool& held)
+{
+	held = false;
+	{
+		lock_guard<mutex> lock(_auto_codec_mutex);
+		auto iter = _auto_codec_ifds.find(ifd_no);
+		if (iter == _auto_codec_ifds.end())
+			return ErrorCode::STATUS_OK;
+		//chosen by other tiles, image_info may have been read before
+		if (iter->second.decided)
+			return micro_tiff_GetImageInfo(_hdl, ifd_no, image_info);
+	}
+
+	//probe and copy without the lock, tiles of other frames are not held up by it
+	codec_probe_result result = { 0 };
+	int probe_status = codec_probe_block(tile, tile_height, image_info.block_width, image_info.image_byte_count, image_info.samples_per_pixel,
+		image_info.predictor == PREDICTOR_FLOATINGPOINT, &result);
+	if (probe_status != 0)
+		return probe_status == -2 ? ErrorCode::ERR_BUFFER_IS_NULL : ErrorCode::ERR_COMPRESS_LZW_FAILED;
+	AutoCodecSample sample;
+	sample.block_no = block_no;
+	sample.height = tile_height;
+	sample.size = tile_size;
+	sample.data.reset(new(nothrow) uint8_t[(size_t)tile_size]);
+	if (sample.data == nullptr)
+		return ErrorCode::ERR_BUFFER_IS_NULL;
+	memcpy(sample.data.get(), tile, (size_t)tile_size);
+
+	//the tile is held until the sample is complete, the tile which completes it chooses the codec and saves the held tiles
+	vector<AutoCodecSample> samples;
+	{
+		lock_guard<mutex> lock(_auto_codec_mutex);
+		auto iter = _auto_codec_ifds.find(ifd_no);
+		if (iter == _auto_codec_ifds.end())
+			return ErrorCode::STATUS_OK;
+		AutoCodecState& state = iter->second;
+		if (state.decided)
+			return micro_tiff_GetImageInfo(_hdl, ifd_no, image_info);
+		state.result.raw_size += result.raw_size;
+		state.result.lzw_size += result.lzw_size;
+		state.result.lzw_shuffle_size += result.lzw_shuffle_size;
+		state.samples.push_back(std::move(sample));
+		held = true;
+		if (state.samples.size() < state.sample_count)
+			return ErrorCode::STATUS_OK;
+		int32_t status = DecideAutoCodec(ifd_no, state, image_info);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+		samples.swap(state.samples);
+	}
+	return SaveAutoCodecSamples(ifd_no, samples, image_info);
+}
+
+//Choose the codec of the probed sample of "state" and set it to the IFD, called with _auto_codec_mutex locked.
+int32_t TiffContainer::DecideAutoCodec(const uint32_t ifd_no, AutoCodecState& state, ImageInfo& image_info)
+{
+	ImageInfo chosen_info = image_info;
+	switch (codec_probe_choose(&state.result))
+	{
+	case CODEC_PROBE_LZW:
+		chosen_info.shuffle = SHUFFLE_NONE;
+		break;
+	case CODEC_PROBE_LZW_SHUFFLE:
+		chosen_info.shuffle = SHUFFLE_BYTE;
+		break;
+	default:
+		chosen_info.compression = COMPRESSION_NONE;
+		chosen_info.predictor = PREDICTOR_NONE;
+		chosen_info.shuffle = SHUFFLE_NONE;
+		break;
+	}
+	int32_t status = micro_tiff_SetCompression(_hdl, ifd_no, chosen_info.compression, chosen_info.predictor, chosen_info.shuffle);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	state.decided = true;
+	image_info = chosen_info;
+	return ErrorCode::STATUS_OK;
+}
+
+//Choose the codec of an IFD closed before its sample is complete from the tiles held so far, and save them.
+int32_t TiffContainer::FlushAutoCodec(const uint32_t ifd_no)
+{
+	ImageInfo image_info = { 0 };
+	vector<AutoCodecSample> samples;
+	{
+		lock_guard<mutex> lock(_auto_codec_mutex);
+		auto iter = _auto_codec_ifds.find(ifd_no);
+		if (iter == _auto_codec_ifds.end() || iter->second.decided || iter->second.samples.empty())
+			return ErrorCode::STATUS_OK;
+		int32_t status = micro_tiff_GetImageInfo(_hdl, ifd_no, image_info);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+		status = DecideAutoCodec(ifd_no, iter->second, image_info);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+		samples.swap(iter->second.samples);
+	}
+	return SaveAutoCodecSamples(ifd_no, samples, image_info);
+}
+
+int32_t TiffContainer::SaveAutoCodecSamples(const uint32_t ifd_no, vector<AutoCodecSample>& samples, const ImageInfo& image_info)
+{
+	//in the order they were saved, the last one wins when a tile was saved twice
+	for (AutoCodecSample& sample : samples)
+	{
+		int32_t status = SaveEncodedTile(ifd_no, sample.block_no, sample.data.get(), sample.height, sample.size, image_info);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+	}
+	return ErrorCode::STATUS_OK;
 }
 
 int32_t TiffContainer::SetTag(const uint32_t ifd_no, const uint16_t tag_id, const TiffTagDataType tag_type, const uint32_t tag_size, void* tag_value)
@@ -555,35 +1194,65 @@ int32_t TiffContainer::GetTag(const uint32_t ifd_no, const uint16_t tag_id, Tiff
 	return micro_tiff_GetTag(_hdl, ifd_no, tag_id, tag_value);
 }
 
-//int32_t TiffContainer::SaveTileJpeg(void* image_data, uint32_t ifd_no, uint32_t block_no, uint64_t block_size, int32_t image_width, int32_t image_height)
-//{
-//	unsigned long dst_size = 0;
-//	unsigned char* dst_buf = nullptr;
-//
-//	long compress_status = jpeg_compress((unsigned char*)image_data, &dst_buf, &dst_size, image_width, image_height);
-//
-//	int32_t status;
-//	if (compress_status == 0)
-//		status = ThortiffSaveBlock(_hdl, ifd_no, block_no, (uint64_t)dst_size, (void*)dst_buf);
-//	else
-//		status = ThortiffSaveBlock(_hdl, ifd_no, block_no, block_size, image_data);
-//
-//	jpeg_free(dst_buf);
-//	if (status != ErrorCode::STATUS_OK)
-//		return ErrorCode::ERR_SAVE_BLOCK_FAILED;
-//
-//	return ErrorCode::STATUS_OK;
-//}
+int32_t TiffContainer::SaveTileJpeg(void* image_data, const uint32_t ifd_no, const uint32_t block_no, const int32_t image_width, const int32_t image_height, const uint16_t samples_per_pixel)
+{
+	unsigned long dst_size = 0;
+	unsigned char* dst_buf = nullptr;
+
+	//compress outside of the file lock, tiles saved from different threads are encoded at the same time
+	int pixel_format = samples_per_pixel == 3 ? JPEG_PIXEL_FORMAT_RGB : JPEG_PIXEL_FORMAT_GRAY;
+	int subsample = samples_per_pixel == 3 ? JPEG_SUBSAMPLE_420 : JPEG_SUBSAMPLE_GRAY;
+	int compress_status = jpeg_compress((unsigned char*)image_data, &dst_buf, &dst_size, image_width, image_height, 0, pixel_format, subsample);
 
-int32_t TiffContainer::SaveTileLZW(void* image_data, const uint32_t ifd_no, const uint32_t block_no, const uint64_t block_size)
+	int32_t status = ErrorCode::ERR_COMPRESS_JPEG_FAILED;
+	if (compress_status == 0)
+		status = micro_tiff_SaveBlock(_hdl, ifd_no, block_no, (uint64_t)dst_size, (void*)dst_buf);
+
+	if (dst_buf != nullptr)
+		jpeg_free(dst_buf);
+	return status;
+}
+
+int32_t TiffContainer::SaveTileLZW(void* image_data, const uint32_t ifd_no, const uint32_t block_no, const uint64_t block_size, const ImageInfo& image_info)
 {
-	size_t dst_size = (size_t)(block_size * 1.5);
+	//the codec is fixed for the whole IFD, a tile which doesn't shrink is still saved as LZW (at most LZW_ENCODE_BOUND).
+	//COMPRESSIONMODE_AUTO estimates from a sample of the first tiles that LZW pays off for the frame
+	size_t dst_size = (size_t)LZW_ENCODE_BOUND(block_size);
 	unique_ptr<uint8_t[]> auto_dst_buf = make_unique<uint8_t[]>(dst_size);
 	uint8_t* dst_buf = auto_dst_buf.get();
 	if (dst_buf == nullptr) {
 		return ErrorCode::ERR_BUFFER_IS_NULL;
 	}
 
+	//predictor works on a copy, image_data may be the caller's buffer
+	unique_ptr<uint8_t[]> auto_predict_buf = make_unique<uint8_t[]>(0);
+	if (image_info.predictor == PREDICTOR_FLOATINGPOINT || image_info.predictor == PREDICTOR_HORIZONTAL)
+	{
+		uint32_t tile_stride = image_info.block_width * image_info.image_byte_count * image_info.samples_per_pixel;
+		uint32_t tile_height = (uint32_t)(block_size / tile_stride);
+		auto_predict_buf.reset(new uint8_t[block_size]);
+		memcpy(auto_predict_buf.get(), image_data, (size_t)block_size);
+		if (image_info.predictor == PREDICTOR_FLOATINGPOINT)
+		{
+			if (floating_point_differencing(auto_predict_buf.get(), tile_height, image_info.block_width, image_info.image_byte_count, image_info.samples_per_pixel) != 0)
+				return ErrorCode::ERR_FLOATING_POINT_PREDICTOR_FAILED;
+		}
+		else if (horizontal_differencing(auto_predict_buf.get(), tile_height, image_info.block_width, image_info.image_byte_count, image_info.samples_per_pixel, false) != 0)
+		{
+			return ErrorCode::ERR_LZW_HORIZONTAL_DIFFERENCING;
+		}
+		image_data = auto_predict_buf.get();
+	}
+
+	unique_ptr<uint8_t[]> auto_shuffle_buf = make_unique<uint8_t[]>(0);
+	if (image_info.shuffle != SHUFFLE_NONE)
+	{
+		auto_shuffle_buf.reset(new uint8_t[block_size]);
+		if (data_shuffle(image_data, auto_shuffle_buf.get(), (size_t)block_size, image_info.image_byte_count, image_info.shuffle) != 0)
+			return ErrorCode::ERR_SHUFFLE_FAILED;
+		image_data = auto_shuffle_buf.get();
+	}
+
 	uint64_t raw_data_used_size;
 	uint64_t output_data_used_size;
 	int compress_status = LZWEncode(image_data, block_size, &raw_data_used_size, dst_buf, dst_size, &output_data_used_size);
@@ -691,7 +1360,40 @@ int32_t TiffContainer::CloseIFD(const uint32_t ifd_no)
 {
 	if (_hdl < 0)
 		return ErrorCode::STATUS_OK;
-	return micro_tiff_CloseIFD(_hdl, ifd_no);
+	int32_t status = FlushPyramid(ifd_no);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	//the levels are written before the frame, which lists them in its SubIFDs tag
+	vector<uint32_t> level_ifds;
+	GetPyramidIFDs(ifd_no, level_ifds);
+	for (uint32_t level_ifd_no : level_ifds)
+	{
+		status = FlushAutoCodec(level_ifd_no);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+		{
+			lock_guard<mutex> lock(_auto_codec_mutex);
+			_auto_codec_ifds.erase(level_ifd_no);
+		}
+		status = micro_tiff_CloseIFD(_hdl, level_ifd_no);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+	}
+
+	status = FlushAutoCodec(ifd_no);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	{
+		lock_guard<mutex> lock(_auto_codec_mutex);
+		_auto_codec_ifds.erase(ifd_no);
+	}
+	status = micro_tiff_CloseIFD(_hdl, ifd_no);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+	lock_guard<mutex> lock(_pyramid_mutex);
+	_pyramids.erase(ifd_no);
+	return ErrorCode::STATUS_OK;
 }
 
 int32_t TiffContainer::RemoveFile()
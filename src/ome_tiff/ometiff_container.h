@@ -1,6 +1,10 @@
 #pragma once
 #include "ome_struct.h"
 #include "../micro_tiff/micro_tiff.h"
+#include "../common/codec_probe.h"
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
 class TiffContainer
 {
@@ -12,14 +16,81 @@ private:
 	std::wstring _file_full_path;
 	std::string _utf8_short_name;
 
-	//int32_t SaveTileJpeg(void* image_data, uint32_t ifd_no, uint32_t block_no, uint64_t block_size, int32_t image_width, int32_t image_height);
-	int32_t SaveTileLZW(void* image_data, uint32_t ifd_no, uint32_t block_no, uint64_t block_size);
+	//IFDs created with COMPRESSIONMODE_AUTO. Their first tiles are probed and held until a sample of AUTO_PROBE_TILE_COUNT
+	//tiles is complete, or the IFD is closed, then the codec is chosen for the whole IFD and the held tiles are saved with it.
+	struct AutoCodecSample
+	{
+		uint32_t block_no;
+		uint32_t height;
+		uint64_t size;
+		std::unique_ptr<uint8_t[]> data;
+	};
+	struct AutoCodecState
+	{
+		bool decided;
+		uint32_t sample_count;
+		codec_probe_result result;
+		std::vector<AutoCodecSample> samples;
+	};
+	std::map<uint32_t, AutoCodecState> _auto_codec_ifds;
+	std::mutex _auto_codec_mutex;
+	int32_t ChooseAutoCodec(uint32_t ifd_no, uint32_t block_no, void* tile, uint32_t tile_height, uint64_t tile_size, ImageInfo& image_info, bool& held);
+	int32_t DecideAutoCodec(uint32_t ifd_no, AutoCodecState& state, ImageInfo& image_info);
+	int32_t FlushAutoCodec(uint32_t ifd_no);
+	int32_t SaveAutoCodecSamples(uint32_t ifd_no, std::vector<AutoCodecSample>& samples, const ImageInfo& image_info);
+
+	//Reduced resolution levels built while the tiles of a frame are saved. A parent tile is saved as soon as
+	//all its child tiles are reduced into it, the last ones are saved when the frame is closed.
+	struct PyramidTile
+	{
+		std::unique_ptr<uint8_t[]> data;
+		ome::OmeRect rect;
+		uint32_t arrived;		//bit (row % 2) * 2 + column % 2 of every child reduced into the tile
+		uint32_t expected;		//bits of the children inside the child level
+		uint32_t writers;		//children being reduced into the tile
+	};
+	struct PyramidLevel
+	{
+		uint32_t ifd_no;
+		uint32_t width;
+		uint32_t height;
+		std::map<uint32_t, PyramidTile> pending;	//key is the block number
+		uint32_t in_flight;		//children being reduced into the level, until their completed parent is saved
+	};
+	//key is the IFD of the full resolution image, levels are from the largest to the smallest
+	std::map<uint32_t, std::vector<PyramidLevel>> _pyramids;
+	std::mutex _pyramid_mutex;
+	std::condition_variable _pyramid_cv;
+	void LeavePyramidLevel(uint32_t base_ifd_no, uint32_t level);
+	int32_t CreateOneIFD(uint32_t width, uint32_t height, uint32_t block_width, uint32_t block_height,
+		ome::PixelType pixel_type, uint16_t samples_per_pixel, ome::CompressionMode compress_mode, ome::ShuffleMode shuffle_mode,
+		int32_t parent_ifd_no = -1);
+	int32_t AddToPyramid(uint32_t base_ifd_no, uint32_t level, ome::OmeRect rect, const ImageInfo& image_info, const void* image_data, uint32_t stride);
+	int32_t SavePyramidTile(uint32_t base_ifd_no, uint32_t level, PyramidTile& tile);
+	int32_t FlushPyramid(uint32_t base_ifd_no);
+
+	int32_t SaveTileJpeg(void* image_data, uint32_t ifd_no, uint32_t block_no, int32_t image_width, int32_t image_height, uint16_t samples_per_pixel);
+	int32_t SaveTileLZW(void* image_data, uint32_t ifd_no, uint32_t block_no, uint64_t block_size, const ImageInfo& image_info);
+	int32_t SaveEncodedTile(uint32_t ifd_no, uint32_t block_no, void* tile, uint32_t tile_height, uint64_t tile_size, const ImageInfo& image_info);
 	//int32_t SaveTileLZ4(void* image_data, uint32_t ifd_no, uint32_t block_no, uint64_t block_size);
 	//int32_t SaveTileZlib(void* image_data, uint32_t ifd_no, uint32_t block_no, uint64_t block_size);
 
+	//Decode buffers kept by one thread from a tile to the next.
+	struct BlockDecodeBuffers
+	{
+		std::unique_ptr<uint8_t[]> row;
+		size_t row_size = 0;
+		std::unique_ptr<uint8_t[]> block;
+		size_t block_size = 0;
+		std::unique_ptr<uint8_t[]> shuffle;
+		size_t shuffle_size = 0;
+	};
+	int32_t DecodeBlockData(ome::OmeRect rect, const ImageInfo& image_info, uint8_t* block, uint64_t block_size,
+		void* image_data, uint32_t stride, ome::OmeSize paste_start, BlockDecodeBuffers& buffers);
 	int32_t GetOneBlockData(uint32_t ifd_no, ome::OmeRect rect, const ImageInfo& image_info, void* image_data, uint32_t stride, ome::OmeSize copy_start);
 
 	int32_t GetRectData(uint32_t ifd_no, ome::OmeRect rect, void* image_data, uint32_t stride);
+	int32_t GetResampledRectData(uint32_t ifd_no, ome::OmeSize dst_size, ome::OmeRect src_rect, void* image_data, uint32_t stride);
 	int32_t SaveTileData(uint32_t ifd_no, ome::OmeRect rect, const ImageInfo& image_info, void* image_data, uint32_t stride);
 
 public:
@@ -35,13 +106,18 @@ public:
 	int32_t RemoveFile();
 
 	int32_t SaveTileData(uint32_t ifd_no, uint32_t row, uint32_t column, void* image_data, uint32_t stride);
+	//Area of a tile in the image and the layout of the IFD.
+	int32_t GetTileRect(uint32_t ifd_no, uint32_t row, uint32_t column, ome::OmeRect& rect, ImageInfo& image_info);
 
 	int32_t LoadRectData(uint32_t ifd_no, ome::OmeSize dst_size, ome::OmeRect src_rect, void* image_data, uint32_t stride);
 	int32_t LoadTileData(uint32_t ifd_no, uint32_t row, uint32_t column, void* image_data, uint32_t stride);
 
 	int32_t CreateIFD(uint32_t width, uint32_t height, uint32_t block_width, uint32_t block_height,
-		ome::PixelType pixel_type, uint16_t samples_per_pixel, ome::CompressionMode compress_mode);
+		ome::PixelType pixel_type, uint16_t samples_per_pixel, ome::CompressionMode compress_mode,
+		ome::ShuffleMode shuffle_mode = ome::ShuffleMode::SHUFFLEMODE_NONE, uint32_t pyramid_levels = 0);
 	int32_t CloseIFD(uint32_t ifd_no);
+	//IFDs of the reduced resolution levels of "ifd_no", from the largest to the smallest.
+	int32_t GetPyramidIFDs(uint32_t ifd_no, std::vector<uint32_t>& level_ifds);
 
 	int32_t SetTag(uint32_t ifd_no, uint16_t tag_id, ome::TiffTagDataType tag_type, uint32_t tag_count, void* tag_value);
 	int32_t GetTag(uint32_t ifd_no, uint16_t tag_id, ome::TiffTagDataType& tag_type, uint32_t& tag_count, void* tag_value);
@@ -175,182 +175,443 @@ static TimeUnit convert_string_to_time_unit(const char* str)
 	return TimeUnit::TIME_UNDEFINED;
 }
 
-int32_t parse_ome_xml(const string& xml, OmeTiff* tiff_obj)
+//Pull parser of the OME-XML : tags are read one by one straight from the text, no document tree is built.
+//Text, comments, CDATA and declarations are skipped, only the start and end tags and their attributes are read.
+class OmeXmlReader
 {
-	tinyxml2::XMLDocument doc;
-	if (doc.Parse(xml.c_str(), xml.size()) != XMLError::XML_SUCCESS)
-		return ErrorCode::ERR_READ_OME_XML_FAILED;
+public:
+	enum { TAG_NONE = 0, TAG_START = 1, TAG_END = 2 };
 
-	const XMLElement* element_ome = doc.FirstChildElement("OME");
-	if (element_ome == nullptr)
-		return ErrorCode::ERR_XML_PARSE_FAILED;
+	OmeXmlReader(const char* xml, size_t size) : _cur(xml), _end(xml + size), _pending_end(false), _name(nullptr), _name_len(0)
+	{
+		if (size >= 3 && (uint8_t)xml[0] == 0xEF && (uint8_t)xml[1] == 0xBB && (uint8_t)xml[2] == 0xBF)
+			_cur += 3;
+	}
 
-	int32_t status = ErrorCode::STATUS_OK;
+	//Read the next tag, an empty element gives a start and an end tag.
+	//Return TAG_START, TAG_END, TAG_NONE at the end of the document or ERR_READ_OME_XML_FAILED when the XML is broken.
+	int32_t Next();
 
-	const XMLElement* element_image = element_ome->FirstChildElement("Image");
-	while (element_image)
+	bool NameIs(const char* name) const
 	{
-		const char* image_id_str = element_image->Attribute("ID");
-		uint32_t image_id = 0;
-		XML_SCANF(image_id_str, "Image:%u", &image_id);
-		//skip boot image which ID="Image:0"
-		if (image_id == 0)
-		{
-			element_image = element_image->NextSiblingElement("Image");
-			continue;
-		}
+		size_t len = strlen(name);
+		return len == _name_len && memcmp(name, _name, len) == 0;
+	}
 
-		Image* image = new Image();
-		image->_id = string(image_id_str);
-		if (element_image->Attribute("Name") != nullptr) {
-			image->_name = string(element_image->Attribute("Name"));
-		}
+	//Value of an attribute of the last start tag with its entities replaced, nullptr when it has none.
+	const char* Attribute(const char* name) const;
+
+	//Open elements, the element of the last start tag included.
+	size_t Depth() const { return _open.size(); }
 
-		const XMLElement* element_pixels = element_image->FirstChildElement("Pixels");
-		if (element_pixels == nullptr)
-			return ErrorCode::ERR_NO_PIXELS_IN_IMAGE;
+private:
+	struct XmlAttribute
+	{
+		const char* name;
+		size_t name_len;
+		size_t value;		//offset in _values
+	};
+
+	const char* _cur;
+	const char* _end;
+	bool _pending_end;
+	const char* _name;
+	size_t _name_len;
+	vector<pair<const char*, size_t>> _open;
+	vector<XmlAttribute> _attributes;
+	string _values;			//values of the attributes of the last start tag, reused from a tag to the next
+
+	bool StartsWith(const char* str) const
+	{
+		size_t len = strlen(str);
+		return (size_t)(_end - _cur) >= len && memcmp(_cur, str, len) == 0;
+	}
+	bool SkipPast(const char* terminator);
+	void SkipSpaces();
+	size_t ReadName();
+	bool ReadAttributes(bool& is_empty);
+	void AppendValue(const char* begin, const char* end);
+};
+
+static bool is_xml_space(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool OmeXmlReader::SkipPast(const char* terminator)
+{
+	size_t len = strlen(terminator);
+	for (; _cur + len <= _end; _cur++)
+	{
+		if (memcmp(_cur, terminator, len) == 0)
+		{
+			_cur += len;
+			return true;
+		}
+	}
+	return false;
+}
 
-		image->_pixels._info.id = string(element_pixels->Attribute("ID"));
-		image->_pixels._info.dimension_order = string(element_pixels->Attribute("DimensionOrder"));
+void OmeXmlReader::SkipSpaces()
+{
+	while (_cur < _end && is_xml_space(*_cur))
+		_cur++;
+}
 
-		XML_SCANF(element_pixels->Attribute("SizeX"), "%u", &image->_pixels._info.size_x);
-		XML_SCANF(element_pixels->Attribute("SizeY"), "%u", &image->_pixels._info.size_y);
-		XML_SCANF(element_pixels->Attribute("SizeZ"), "%u", &image->_pixels._info.size_z);
-		XML_SCANF(element_pixels->Attribute("SizeT"), "%u", &image->_pixels._info.size_t);
+size_t OmeXmlReader::ReadName()
+{
+	const char* begin = _cur;
+	while (_cur < _end && !is_xml_space(*_cur) && *_cur != '/' && *_cur != '>' && *_cur != '=')
+		_cur++;
+	return _cur - begin;
+}
 
-		XML_SCANF(element_pixels->Attribute("PhysicalSizeX"), "%f", &image->_pixels._info.physical_size_per_pixel_x);
-		XML_SCANF(element_pixels->Attribute("PhysicalSizeY"), "%f", &image->_pixels._info.physical_size_per_pixel_y);
-		XML_SCANF(element_pixels->Attribute("PhysicalSizeZ"), "%f", &image->_pixels._info.physical_size_per_pixel_z);
-		XML_SCANF(element_pixels->Attribute("TimeIncrement"), "%f", &image->_pixels._info.time_increment);
+int32_t OmeXmlReader::Next()
+{
+	_attributes.clear();
+	if (_pending_end)
+	{
+		_pending_end = false;
+		_name = _open.back().first;
+		_name_len = _open.back().second;
+		_open.pop_back();
+		return TAG_END;
+	}
 
-		image->_pixels._info.physical_x_unit = convert_string_to_distance_unit(element_pixels->Attribute("PhysicalSizeXUnit"));
-		image->_pixels._info.physical_y_unit = convert_string_to_distance_unit(element_pixels->Attribute("PhysicalSizeYUnit"));
-		image->_pixels._info.physical_z_unit = convert_string_to_distance_unit(element_pixels->Attribute("PhysicalSizeZUnit"));
-		if (element_pixels->Attribute("TimeIncrementUnit") != nullptr) {
-			image->_pixels._info.time_increment_unit = convert_string_to_time_unit(element_pixels->Attribute("TimeIncrementUnit"));
+	for (;;)
+	{
+		const char* tag = (const char*)memchr(_cur, '<', _end - _cur);
+		if (tag == nullptr)
+		{
+			if (!_open.empty())
+				return ErrorCode::ERR_READ_OME_XML_FAILED;
+			return TAG_NONE;
+		}
+		_cur = tag;
+
+		bool skipped = true;
+		if (StartsWith("<?"))
+			skipped = SkipPast("?>");
+		else if (StartsWith("<!--"))
+			skipped = SkipPast("-->");
+		else if (StartsWith("<![CDATA["))
+			skipped = SkipPast("]]>");
+		else if (StartsWith("<!"))
+		{
+			//DOCTYPE, its internal subset may hold '>'
+			int32_t brackets = 0;
+			for (_cur++; _cur < _end && (*_cur != '>' || brackets > 0); _cur++)
+				brackets += *_cur == '[' ? 1 : (*_cur == ']' ? -1 : 0);
+			skipped = _cur++ < _end;
+		}
+		else if (StartsWith("</"))
+		{
+			_cur += 2;
+			_name = _cur;
+			_name_len = ReadName();
+			SkipSpaces();
+			if (_cur >= _end || *_cur != '>' || _open.empty())
+				return ErrorCode::ERR_READ_OME_XML_FAILED;
+			_cur++;
+			if (_open.back().second != _name_len || memcmp(_open.back().first, _name, _name_len) != 0)
+				return ErrorCode::ERR_READ_OME_XML_FAILED;
+			_open.pop_back();
+			return TAG_END;
 		}
-		else {
-			image->_pixels._info.time_increment_unit = TimeUnit::TIME_UNDEFINED;
+		else
+		{
+			_cur++;
+			_name = _cur;
+			_name_len = ReadName();
+			bool is_empty = false;
+			if (_name_len == 0 || !ReadAttributes(is_empty))
+				return ErrorCode::ERR_READ_OME_XML_FAILED;
+			_open.emplace_back(_name, _name_len);
+			_pending_end = is_empty;
+			return TAG_START;
 		}
+		if (!skipped)
+			return ErrorCode::ERR_READ_OME_XML_FAILED;
+	}
+}
 
-		XML_SCANF(element_pixels->Attribute("TileWidth"), "%u", &image->_pixels._info.tile_pixel_width);
-		XML_SCANF(element_pixels->Attribute("TileHeight"), "%u", &image->_pixels._info.tile_pixel_height);
-		image->_pixels._info.pixel_type = convert_string_to_pixel_type(element_pixels->Attribute("Type"));
-
-		const char* attri_sig = element_pixels->Attribute("SignificantBits");
-		if (attri_sig == nullptr) {
-			if (image->_pixels._info.pixel_type == PixelType::PIXEL_INT8 || image->_pixels._info.pixel_type == PixelType::PIXEL_UINT8)
-				image->_pixels._info.significant_bits = 8;
-			else if (image->_pixels._info.pixel_type == PixelType::PIXEL_INT16 || image->_pixels._info.pixel_type == PixelType::PIXEL_UINT16)
-				image->_pixels._info.significant_bits = 16;
-			else if (image->_pixels._info.pixel_type == PixelType::PIXEL_FLOAT32)
-				image->_pixels._info.significant_bits = 32;
-			else
-				return ErrorCode::ERR_SIGNIFICATION_BITS;
+bool OmeXmlReader::ReadAttributes(bool& is_empty)
+{
+	_values.clear();
+	for (;;)
+	{
+		SkipSpaces();
+		if (_cur >= _end)
+			return false;
+		if (*_cur == '>')
+		{
+			_cur++;
+			is_empty = false;
+			return true;
+		}
+		if (*_cur == '/')
+		{
+			if (_cur + 1 >= _end || _cur[1] != '>')
+				return false;
+			_cur += 2;
+			is_empty = true;
+			return true;
 		}
-		else {
-			XML_SCANF(attri_sig, "%u", &image->_pixels._info.significant_bits);
+
+		XmlAttribute attribute;
+		attribute.name = _cur;
+		attribute.name_len = ReadName();
+		SkipSpaces();
+		if (attribute.name_len == 0 || _cur >= _end || *_cur != '=')
+			return false;
+		_cur++;
+		SkipSpaces();
+		if (_cur >= _end || (*_cur != '"' && *_cur != '\''))
+			return false;
+		const char* value_end = (const char*)memchr(_cur + 1, *_cur, _end - _cur - 1);
+		if (value_end == nullptr)
+			return false;
+
+		attribute.value = _values.size();
+		AppendValue(_cur + 1, value_end);
+		_values.push_back('\0');
+		_attributes.push_back(attribute);
+		_cur = value_end + 1;
+	}
+}
+
+static void append_utf8(string& str, uint32_t code)
+{
+	if (code < 0x80)
+		str.push_back((char)code);
+	else if (code < 0x800)
+	{
+		str.push_back((char)(0xC0 | (code >> 6)));
+		str.push_back((char)(0x80 | (code & 0x3F)));
+	}
+	else if (code < 0x10000)
+	{
+		str.push_back((char)(0xE0 | (code >> 12)));
+		str.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+		str.push_back((char)(0x80 | (code & 0x3F)));
+	}
+	else
+	{
+		str.push_back((char)(0xF0 | (code >> 18)));
+		str.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+		str.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+		str.push_back((char)(0x80 | (code & 0x3F)));
+	}
+}
+
+//Entities are replaced and line ends are normalized to '\n' like tinyxml2 does, unknown entities are kept as they are.
+void OmeXmlReader::AppendValue(const char* begin, const char* end)
+{
+	static const struct { const char* name; char value; } entities[] = {
+		{ "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&apos;", '\'' } };
+
+	while (begin < end)
+	{
+		const char* run = begin;
+		while (run < end && *run != '&' && *run != '\r')
+			run++;
+		_values.append(begin, run);
+		if (run == end)
+			return;
+
+		begin = run + 1;
+		if (*run == '\r')
+		{
+			if (begin < end && *begin == '\n')
+				begin++;
+			_values.push_back('\n');
+			continue;
 		}
 
-		vector<uint32_t> channel_ids;
-		const XMLElement* element_channel = element_pixels->FirstChildElement("Channel");
-		while (element_channel)
+		const char* semicolon = (const char*)memchr(run, ';', end - run);
+		bool replaced = false;
+		if (semicolon != nullptr && run[1] == '#')
 		{
-			ChannelInfo channel_info = { 0 };
-			const char* channel_id = element_channel->Attribute("ID");
-			XML_SCANF(channel_id, "Channel:%u", &channel_info.id);
-			const char* channel_name = element_channel->Attribute("Name");
-			if (channel_name)
+			char* number_end = nullptr;
+			unsigned long code = run[2] == 'x' ? strtoul(run + 3, &number_end, 16) : strtoul(run + 2, &number_end, 10);
+			if (number_end == semicolon && code > 0 && code <= 0x10FFFF)
 			{
-				fs::path p = fs::u8path(channel_name);
-				wstring wstr = p.wstring();
-				wmemcpy_s(channel_info.name, NAME_LEN, wstr.c_str(), wstr.size());
+				append_utf8(_values, (uint32_t)code);
+				replaced = true;
 			}
-			else
+		}
+		else if (semicolon != nullptr)
+		{
+			for (const auto& entity : entities)
 			{
-				fs::path p = fs::u8path(channel_id);
-				wstring wstr = p.wstring();
-				wmemcpy_s(channel_info.name, NAME_LEN, wstr.c_str(), wstr.size());
+				if ((size_t)(semicolon + 1 - run) == strlen(entity.name) && memcmp(run, entity.name, semicolon + 1 - run) == 0)
+				{
+					_values.push_back(entity.value);
+					replaced = true;
+					break;
+				}
 			}
+		}
+		if (replaced)
+			begin = semicolon + 1;
+		else
+			_values.push_back('&');
+	}
+}
 
-			XML_SCANF(element_channel->Attribute("SamplesPerPixel"), "%u", &channel_info.samples_per_pixel);
-			if (element_channel->Attribute("BinSize") != nullptr) {
-				XML_SCANF(element_channel->Attribute("BinSize"), "%u", &channel_info.bin_size);
-			}
-			else {
-				channel_info.bin_size = 1;
-			}
-			status = image->_pixels.add_channel(channel_info);
-			if (status != ErrorCode::STATUS_OK)
-				return status;
+const char* OmeXmlReader::Attribute(const char* name) const
+{
+	size_t len = strlen(name);
+	for (const XmlAttribute& attribute : _attributes)
+	{
+		if (attribute.name_len == len && memcmp(attribute.name, name, len) == 0)
+			return _values.c_str() + attribute.value;
+	}
+	return nullptr;
+}
 
-			channel_ids.push_back(channel_info.id);
-			element_channel = element_channel->NextSiblingElement("Channel");
-		}
+//Read until the end tag of the element of the last start tag.
+static int32_t skip_element(OmeXmlReader& reader)
+{
+	size_t depth = reader.Depth();
+	for (;;)
+	{
+		int32_t tag = reader.Next();
+		if (tag < 0 || tag == OmeXmlReader::TAG_NONE)
+			return ErrorCode::ERR_READ_OME_XML_FAILED;
+		if (tag == OmeXmlReader::TAG_END && reader.Depth() < depth)
+			return ErrorCode::STATUS_OK;
+	}
+}
 
-		vector<TiffData> tiff_datas;
-		const XMLElement* element_tiff_data = element_pixels->FirstChildElement("TiffData");
-		while (element_tiff_data)
-		{
-			const XMLElement* element_UUID = element_tiff_data->FirstChildElement("UUID");
-			if (element_UUID == nullptr)
-				return ErrorCode::ERR_TIFF_DATA_HAS_NO_UUID;
+//Next child start tag of the element at "depth", TAG_END once the element ends. Deeper elements are skipped.
+static int32_t next_child(OmeXmlReader& reader, size_t depth)
+{
+	for (;;)
+	{
+		int32_t tag = reader.Next();
+		if (tag < 0 || tag == OmeXmlReader::TAG_NONE)
+			return ErrorCode::ERR_READ_OME_XML_FAILED;
+		if (tag == OmeXmlReader::TAG_END && reader.Depth() < depth)
+			return OmeXmlReader::TAG_END;
+		if (tag == OmeXmlReader::TAG_START && reader.Depth() == depth + 1)
+			return tag;
+	}
+}
 
-			const char* UUID_file = element_UUID->Attribute("FileName");
+//Plates refer to images which may come after them, the regions and scans are added once the whole XML is read.
+struct OmeXmlWellSample
+{
+	uint32_t well_sample_id;
+	uint32_t image_id;
+	ScanRegionInfo info;
+};
 
-			TiffData tiff_data = { 0 };
-			XML_SCANF(element_tiff_data->Attribute("FirstC"), "%u", &tiff_data.FirstC);
-			XML_SCANF(element_tiff_data->Attribute("FirstT"), "%u", &tiff_data.FirstT);
-			XML_SCANF(element_tiff_data->Attribute("FirstZ"), "%u", &tiff_data.FirstZ);
-			XML_SCANF(element_tiff_data->Attribute("IFD"), "%u", &tiff_data.IFD);
-			tiff_data.FileName = UUID_file;
+struct OmeXmlWellSampleRef
+{
+	uint32_t region_id;
+	uint32_t well_id;
+	string id;
+};
+
+struct OmeXmlAcquisition
+{
+	uint32_t plate_id;
+	uint32_t acquisition_id;
+	vector<OmeXmlWellSampleRef> refs;
+};
+
+struct OmeXmlContext
+{
+	OmeTiff* tiff_obj;
+	map<string, bool> file_exists;		//key "UUID FileName", the frames are in a few files
+	map<string, OmeXmlWellSample> well_samples;		//key "WellSample ID"
+	vector<OmeXmlAcquisition> acquisitions;
+};
 
-			string full_path = tiff_obj->GetFullPathWithFileName(tiff_data.FileName);
+static int32_t parse_tiff_datas(OmeXmlContext& context, Image* image, vector<uint32_t>& channel_ids, vector<TiffData>& parsed_tiff_datas)
+{
+	int32_t status = ErrorCode::STATUS_OK;
+	vector<TiffData> tiff_datas;
+	for (TiffData& tiff_data : parsed_tiff_datas)
+	{
+		auto it_exists = context.file_exists.find(tiff_data.FileName);
+		if (it_exists == context.file_exists.end())
+		{
+			string full_path = context.tiff_obj->GetFullPathWithFileName(tiff_data.FileName);
 			fs::path p_full{ full_path };
-			if (!fs::exists(p_full))
-			{
-				image->_pixels.remove_channel(tiff_data.FirstC);
-				auto it_channel = find(channel_ids.begin(), channel_ids.end(), tiff_data.FirstC);
-				if (it_channel != channel_ids.end())
-					channel_ids.erase(it_channel);
-				element_tiff_data = element_tiff_data->NextSiblingElement("TiffData");
+			it_exists = context.file_exists.insert(make_pair(tiff_data.FileName, fs::exists(p_full))).first;
+		}
+		if (!it_exists->second)
+		{
+			image->_pixels.remove_channel(tiff_data.FirstC);
+			auto it_channel = find(channel_ids.begin(), channel_ids.end(), tiff_data.FirstC);
+			if (it_channel != channel_ids.end())
+				channel_ids.erase(it_channel);
+			continue;
+		}
+		else
+		{
+			auto it_channel = find(channel_ids.begin(), channel_ids.end(), tiff_data.FirstC);
+			if (it_channel == channel_ids.end())
 				continue;
-			}
-			else
+		}
+
+		status = image->_pixels.add_tiff_data(tiff_data);
+		if (status != ErrorCode::STATUS_OK)
+			return status;
+
+		tiff_datas.push_back(tiff_data);
+	}
+
+	uint32_t channel_size = (uint32_t)(channel_ids.size());
+	uint32_t total_tiff_count = image->_pixels._info.size_t * image->_pixels._info.size_z * channel_size;
+	uint32_t tiff_data_size = (uint32_t)tiff_datas.size();
+	if (tiff_data_size != total_tiff_count)
+	{
+		if (tiff_data_size == 1)
+		{
+			TiffData first_tiff = tiff_datas.front();
+			uint32_t ifd_no = first_tiff.IFD;
+			for (size_t i = 0; i < channel_ids.size(); i++)
 			{
-				auto it_channel = find(channel_ids.begin(), channel_ids.end(), tiff_data.FirstC);
-				if (it_channel == channel_ids.end())
+				uint32_t c = channel_ids[i];
+				for (uint32_t t = first_tiff.FirstT; t < image->_pixels._info.size_t; t++)
 				{
-					element_tiff_data = element_tiff_data->NextSiblingElement("TiffData");
-					continue;
-				}
-			}
+					for (uint32_t z = first_tiff.FirstZ; z < image->_pixels._info.size_z; z++)
+					{
+						if (first_tiff.FirstC == c && t == first_tiff.FirstT && z == first_tiff.FirstZ)
+							continue;
 
-			status = image->_pixels.add_tiff_data(tiff_data);
-			if (status != ErrorCode::STATUS_OK)
-				return status;
+						TiffData tiff_data = { 0 };
+						tiff_data.FirstC = c;
+						tiff_data.FirstT = t;
+						tiff_data.FirstZ = z;
+						tiff_data.IFD = ++ifd_no;
+						tiff_data.FileName = first_tiff.FileName;
 
-			tiff_datas.push_back(tiff_data);
-			element_tiff_data = element_tiff_data->NextSiblingElement("TiffData");
+						status = image->_pixels.add_tiff_data(tiff_data);
+						if (status != ErrorCode::STATUS_OK)
+							return status;
+					}
+				}
+			}
 		}
-
-		uint32_t channel_size = (uint32_t)(channel_ids.size());
-		uint32_t total_tiff_count = image->_pixels._info.size_t * image->_pixels._info.size_z * channel_size;
-		uint32_t tiff_data_size = (uint32_t)tiff_datas.size();
-		if (tiff_data_size != total_tiff_count)
+		else if (tiff_data_size == channel_size)
 		{
-			if (tiff_data_size == 1)
+			for (size_t i = 0; i < channel_ids.size(); i++)
 			{
-				TiffData first_tiff = tiff_datas.front();
-				uint32_t ifd_no = first_tiff.IFD;
-				for (size_t i = 0; i < channel_ids.size(); i++)
+				uint32_t c = channel_ids[i];
+				auto it = find_if(tiff_datas.begin(), tiff_datas.end(), [&](const TiffData& data) { return data.FirstC == c; });
+				if (it != tiff_datas.end())
 				{
-					uint32_t c = channel_ids[i];
-					for (uint32_t t = first_tiff.FirstT; t < image->_pixels._info.size_t; t++)
+					TiffData tiff_data_c = *it;
+					uint32_t ifd_no = tiff_data_c.IFD;
+					for (uint32_t t = tiff_data_c.FirstT; t < image->_pixels._info.size_t; t++)
 					{
-						for (uint32_t z = first_tiff.FirstZ; z < image->_pixels._info.size_z; z++)
+						for (uint32_t z = tiff_data_c.FirstZ; z < image->_pixels._info.size_z; z++)
 						{
-							if (first_tiff.FirstC == c && t == first_tiff.FirstT && z == first_tiff.FirstZ)
+							if (tiff_data_c.FirstC == c && t == tiff_data_c.FirstT && z == tiff_data_c.FirstZ)
 								continue;
 
 							TiffData tiff_data = { 0 };
@@ -358,7 +619,7 @@ int32_t parse_ome_xml(const string& xml, OmeTiff* tiff_obj)
 							tiff_data.FirstT = t;
 							tiff_data.FirstZ = z;
 							tiff_data.IFD = ++ifd_no;
-							tiff_data.FileName = first_tiff.FileName;
+							tiff_data.FileName = tiff_data_c.FileName;
 
 							status = image->_pixels.add_tiff_data(tiff_data);
 							if (status != ErrorCode::STATUS_OK)
@@ -367,402 +628,587 @@ int32_t parse_ome_xml(const string& xml, OmeTiff* tiff_obj)
 					}
 				}
 			}
-			else if (tiff_data_size == channel_size)
+		}
+		else
+			return ErrorCode::ERR_TIFF_DATA_CANNOT_PREDICT;
+	}
+	return ErrorCode::STATUS_OK;
+}
+
+static int32_t parse_pixels(OmeXmlReader& reader, OmeXmlContext& context, Image* image)
+{
+	const OmeXmlReader& element_pixels = reader;
+	image->_pixels._info.id = string(element_pixels.Attribute("ID"));
+	image->_pixels._info.dimension_order = string(element_pixels.Attribute("DimensionOrder"));
+
+	XML_SCANF(element_pixels.Attribute("SizeX"), "%u", &image->_pixels._info.size_x);
+	XML_SCANF(element_pixels.Attribute("SizeY"), "%u", &image->_pixels._info.size_y);
+	XML_SCANF(element_pixels.Attribute("SizeZ"), "%u", &image->_pixels._info.size_z);
+	XML_SCANF(element_pixels.Attribute("SizeT"), "%u", &image->_pixels._info.size_t);
+
+	XML_SCANF(element_pixels.Attribute("PhysicalSizeX"), "%f", &image->_pixels._info.physical_size_per_pixel_x);
+	XML_SCANF(element_pixels.Attribute("PhysicalSizeY"), "%f", &image->_pixels._info.physical_size_per_pixel_y);
+	XML_SCANF(element_pixels.Attribute("PhysicalSizeZ"), "%f", &image->_pixels._info.physical_size_per_pixel_z);
+	XML_SCANF(element_pixels.Attribute("TimeIncrement"), "%f", &image->_pixels._info.time_increment);
+
+	image->_pixels._info.physical_x_unit = convert_string_to_distance_unit(element_pixels.Attribute("PhysicalSizeXUnit"));
+	image->_pixels._info.physical_y_unit = convert_string_to_distance_unit(element_pixels.Attribute("PhysicalSizeYUnit"));
+	image->_pixels._info.physical_z_unit = convert_string_to_distance_unit(element_pixels.Attribute("PhysicalSizeZUnit"));
+	if (element_pixels.Attribute("TimeIncrementUnit") != nullptr) {
+		image->_pixels._info.time_increment_unit = convert_string_to_time_unit(element_pixels.Attribute("TimeIncrementUnit"));
+	}
+	else {
+		image->_pixels._info.time_increment_unit = TimeUnit::TIME_UNDEFINED;
+	}
+
+	XML_SCANF(element_pixels.Attribute("TileWidth"), "%u", &image->_pixels._info.tile_pixel_width);
+	XML_SCANF(element_pixels.Attribute("TileHeight"), "%u", &image->_pixels._info.tile_pixel_height);
+	image->_pixels._info.pixel_type = convert_string_to_pixel_type(element_pixels.Attribute("Type"));
+
+	const char* attri_sig = element_pixels.Attribute("SignificantBits");
+	if (attri_sig == nullptr) {
+		if (image->_pixels._info.pixel_type == PixelType::PIXEL_INT8 || image->_pixels._info.pixel_type == PixelType::PIXEL_UINT8)
+			image->_pixels._info.significant_bits = 8;
+		else if (image->_pixels._info.pixel_type == PixelType::PIXEL_INT16 || image->_pixels._info.pixel_type == PixelType::PIXEL_UINT16)
+			image->_pixels._info.significant_bits = 16;
+		else if (image->_pixels._info.pixel_type == PixelType::PIXEL_FLOAT32)
+			image->_pixels._info.significant_bits = 32;
+		else
+			return ErrorCode::ERR_SIGNIFICATION_BITS;
+	}
+	else {
+		XML_SCANF(attri_sig, "%u", &image->_pixels._info.significant_bits);
+	}
+
+	int32_t status = ErrorCode::STATUS_OK;
+	vector<uint32_t> channel_ids;
+	//channels are all known before the TiffData are checked
+	vector<TiffData> tiff_datas;
+	size_t depth = reader.Depth();
+	int32_t tag;
+	while ((tag = next_child(reader, depth)) == OmeXmlReader::TAG_START)
+	{
+		if (reader.NameIs("Channel"))
+		{
+			const OmeXmlReader& element_channel = reader;
+			ChannelInfo channel_info = { 0 };
+			const char* channel_id = element_channel.Attribute("ID");
+			XML_SCANF(channel_id, "Channel:%u", &channel_info.id);
+			const char* channel_name = element_channel.Attribute("Name");
+			if (channel_name)
+			{
+				fs::path p = fs::u8path(channel_name);
+				wstring wstr = p.wstring();
+				wmemcpy_s(channel_info.name, NAME_LEN, wstr.c_str(), wstr.size());
+			}
+			else
+			{
+				fs::path p = fs::u8path(channel_id);
+				wstring wstr = p.wstring();
+				wmemcpy_s(channel_info.name, NAME_LEN, wstr.c_str(), wstr.size());
+			}
+
+			XML_SCANF(element_channel.Attribute("SamplesPerPixel"), "%u", &channel_info.samples_per_pixel);
+			if (element_channel.Attribute("BinSize") != nullptr) {
+				XML_SCANF(element_channel.Attribute("BinSize"), "%u", &channel_info.bin_size);
+			}
+			else {
+				channel_info.bin_size = 1;
+			}
+			status = image->_pixels.add_channel(channel_info);
+			if (status != ErrorCode::STATUS_OK)
+				return status;
+
+			channel_ids.push_back(channel_info.id);
+		}
+		else if (reader.NameIs("TiffData"))
+		{
+			const OmeXmlReader& element_tiff_data = reader;
+			TiffData tiff_data = { 0 };
+			XML_SCANF(element_tiff_data.Attribute("FirstC"), "%u", &tiff_data.FirstC);
+			XML_SCANF(element_tiff_data.Attribute("FirstT"), "%u", &tiff_data.FirstT);
+			XML_SCANF(element_tiff_data.Attribute("FirstZ"), "%u", &tiff_data.FirstZ);
+			XML_SCANF(element_tiff_data.Attribute("IFD"), "%u", &tiff_data.IFD);
+
+			bool has_uuid = false;
+			size_t tiff_data_depth = reader.Depth();
+			while ((tag = next_child(reader, tiff_data_depth)) == OmeXmlReader::TAG_START)
 			{
-				for (size_t i = 0; i < channel_ids.size(); i++)
+				if (!has_uuid && reader.NameIs("UUID"))
 				{
-					uint32_t c = channel_ids[i];
-					auto it = find_if(tiff_datas.begin(), tiff_datas.end(), [&](const TiffData& data) { return data.FirstC == c; });
-					if (it != tiff_datas.end())
-					{
-						TiffData tiff_data_c = *it;
-						uint32_t ifd_no = tiff_data_c.IFD;
-						for (uint32_t t = tiff_data_c.FirstT; t < image->_pixels._info.size_t; t++)
-						{
-							for (uint32_t z = tiff_data_c.FirstZ; z < image->_pixels._info.size_z; z++)
-							{
-								if (tiff_data_c.FirstC == c && t == tiff_data_c.FirstT && z == tiff_data_c.FirstZ)
-									continue;
-
-								TiffData tiff_data = { 0 };
-								tiff_data.FirstC = c;
-								tiff_data.FirstT = t;
-								tiff_data.FirstZ = z;
-								tiff_data.IFD = ++ifd_no;
-								tiff_data.FileName = tiff_data_c.FileName;
-
-								status = image->_pixels.add_tiff_data(tiff_data);
-								if (status != ErrorCode::STATUS_OK)
-									return status;
-							}
-						}
-					}
+					const char* UUID_file = reader.Attribute("FileName");
+					tiff_data.FileName = UUID_file;
+					has_uuid = true;
 				}
 			}
-			else
-				return ErrorCode::ERR_TIFF_DATA_CANNOT_PREDICT;
+			if (tag < 0)
+				return ErrorCode::ERR_READ_OME_XML_FAILED;
+			if (!has_uuid)
+				return ErrorCode::ERR_TIFF_DATA_HAS_NO_UUID;
+			tiff_datas.push_back(std::move(tiff_data));
 		}
+	}
+	if (tag < 0)
+		return ErrorCode::ERR_READ_OME_XML_FAILED;
 
-		auto it_image = tiff_obj->_images.find(image_id);
-		if (it_image != tiff_obj->_images.end())
-			return ErrorCode::ERR_IMAGE_ID_EXIST;
+	return parse_tiff_datas(context, image, channel_ids, tiff_datas);
+}
 
-		tiff_obj->_images[image_id] = image;
-		element_image = element_image->NextSiblingElement("Image");
+static int32_t parse_image(OmeXmlReader& reader, OmeXmlContext& context)
+{
+	const char* image_id_str = reader.Attribute("ID");
+	uint32_t image_id = 0;
+	XML_SCANF(image_id_str, "Image:%u", &image_id);
+	//skip boot image which ID="Image:0"
+	if (image_id == 0)
+		return skip_element(reader);
+
+	unique_ptr<Image> image(new Image());
+	if (reader.Attribute("Name") != nullptr) {
+		image->_name = string(reader.Attribute("Name"));
 	}
 
-	map<string, ScanRegionInfo> scan_region_infos;
-	map<string, string> well_sample_id_image_ref_map;
-
-	const XMLElement* element_plate = element_ome->FirstChildElement("Plate");
-	while (element_plate)
+	bool has_pixels = false;
+	size_t depth = reader.Depth();
+	int32_t tag;
+	while ((tag = next_child(reader, depth)) == OmeXmlReader::TAG_START)
 	{
-		PlateInfo plate_info = { 0 };
-		XML_SCANF(element_plate->Attribute("ID"), "Plate:%u", &plate_info.id);
-		const char* name = element_plate->Attribute("Name");
-		fs::path p = fs::u8path(name);
-		wstring wstr = p.wstring();
-		wmemcpy_s(plate_info.name, NAME_LEN, wstr.c_str(), wstr.size());
-		XML_SCANF(element_plate->Attribute("Width"), "%f", &plate_info.width);
-		XML_SCANF(element_plate->Attribute("Height"), "%f", &plate_info.height);
-		plate_info.physicalsize_unit_x = convert_string_to_distance_unit(element_plate->Attribute("PhysicalSizeXUnit"));
-		plate_info.physicalsize_unit_y = convert_string_to_distance_unit(element_plate->Attribute("PhysicalSizeYUnit"));
-		if (element_plate->Attribute("Rows") != nullptr) {
-			XML_SCANF(element_plate->Attribute("Rows"), "%hu", &plate_info.row_size);
-			XML_SCANF(element_plate->Attribute("Columns"), "%hu", &plate_info.column_size);
-		}
-
-		status = tiff_obj->AddPlate(plate_info);
+		if (has_pixels || !reader.NameIs("Pixels"))
+			continue;
+		int32_t status = parse_pixels(reader, context, image.get());
 		if (status != ErrorCode::STATUS_OK)
 			return status;
+		has_pixels = true;
+	}
+	if (tag < 0)
+		return ErrorCode::ERR_READ_OME_XML_FAILED;
+	if (!has_pixels)
+		return ErrorCode::ERR_NO_PIXELS_IN_IMAGE;
+
+	auto it_image = context.tiff_obj->_images.find(image_id);
+	if (it_image != context.tiff_obj->_images.end())
+		return ErrorCode::ERR_IMAGE_ID_EXIST;
+
+	context.tiff_obj->_images[image_id] = image.release();
+	return ErrorCode::STATUS_OK;
+}
 
-		const XMLElement* element_well = element_plate->FirstChildElement("Well");
-		while (element_well)
+static int32_t parse_well_sample(OmeXmlReader& reader, OmeXmlContext& context)
+{
+	const OmeXmlReader& element_well_sample = reader;
+	WellSample well_sample = { 0 };
+	uint32_t well_sample_pure_id = 0;
+	string well_sample_id = element_well_sample.Attribute("ID") != nullptr ? element_well_sample.Attribute("ID") : "";
+	XML_SCANF(element_well_sample.Attribute("ID"), "WellSample:%*u.%*u.%u", &well_sample_pure_id);
+	XML_SCANF(element_well_sample.Attribute("PositionX"), "%f", &well_sample.position_x);
+	XML_SCANF(element_well_sample.Attribute("PositionY"), "%f", &well_sample.position_y);
+	XML_SCANF(element_well_sample.Attribute("PositionZ"), "%f", &well_sample.position_z);
+	well_sample.physicalsize_unit_x = convert_string_to_distance_unit(element_well_sample.Attribute("PositionXUnit"));
+	well_sample.physicalsize_unit_y = convert_string_to_distance_unit(element_well_sample.Attribute("PositionYUnit"));
+	well_sample.physicalsize_unit_z = convert_string_to_distance_unit(element_well_sample.Attribute("PositionZUnit"));
+
+	bool has_image_ref = false;
+	uint32_t image_id_u = 0;
+	size_t depth = reader.Depth();
+	int32_t tag;
+	while ((tag = next_child(reader, depth)) == OmeXmlReader::TAG_START)
+	{
+		if (has_image_ref || !reader.NameIs("ImageRef"))
+			continue;
+		const char* image_ref_id = reader.Attribute("ID");
+		XML_SCANF(image_ref_id, "Image:%u", &image_id_u);
+		has_image_ref = true;
+	}
+	if (tag < 0)
+		return ErrorCode::ERR_READ_OME_XML_FAILED;
+	if (!has_image_ref)
+		return ErrorCode::ERR_NO_IMAGE_REF_IN_WELL_SAMPLE;
+
+	OmeXmlWellSample sample = { 0 };
+	sample.well_sample_id = well_sample_pure_id;
+	sample.image_id = image_id_u;
+	sample.info.start_physical_x = well_sample.position_x;
+	sample.info.start_physical_y = well_sample.position_y;
+	sample.info.start_physical_z = well_sample.position_z;
+	sample.info.start_unit_x = well_sample.physicalsize_unit_x;
+	sample.info.start_unit_y = well_sample.physicalsize_unit_y;
+	sample.info.start_unit_z = well_sample.physicalsize_unit_z;
+	context.well_samples.insert(make_pair(well_sample_id, sample));
+	return ErrorCode::STATUS_OK;
+}
+
+static int32_t parse_plate(OmeXmlReader& reader, OmeXmlContext& context)
+{
+	const OmeXmlReader& element_plate = reader;
+	PlateInfo plate_info = { 0 };
+	XML_SCANF(element_plate.Attribute("ID"), "Plate:%u", &plate_info.id);
+	const char* name = element_plate.Attribute("Name");
+	fs::path p = fs::u8path(name);
+	wstring wstr = p.wstring();
+	wmemcpy_s(plate_info.name, NAME_LEN, wstr.c_str(), wstr.size());
+	XML_SCANF(element_plate.Attribute("Width"), "%f", &plate_info.width);
+	XML_SCANF(element_plate.Attribute("Height"), "%f", &plate_info.height);
+	plate_info.physicalsize_unit_x = convert_string_to_distance_unit(element_plate.Attribute("PhysicalSizeXUnit"));
+	plate_info.physicalsize_unit_y = convert_string_to_distance_unit(element_plate.Attribute("PhysicalSizeYUnit"));
+	if (element_plate.Attribute("Rows") != nullptr) {
+		XML_SCANF(element_plate.Attribute("Rows"), "%hu", &plate_info.row_size);
+		XML_SCANF(element_plate.Attribute("Columns"), "%hu", &plate_info.column_size);
+	}
+
+	int32_t status = context.tiff_obj->AddPlate(plate_info);
+	if (status != ErrorCode::STATUS_OK)
+		return status;
+
+	size_t depth = reader.Depth();
+	int32_t tag;
+	while ((tag = next_child(reader, depth)) == OmeXmlReader::TAG_START)
+	{
+		if (reader.NameIs("Well"))
 		{
+			const OmeXmlReader& element_well = reader;
 			WellInfo well_info = { 0 };
-			XML_SCANF(element_well->Attribute("ID"), "Well:%*u.%u", &well_info.id);
-			XML_SCANF(element_well->Attribute("PositionX"), "%f", &well_info.position_x);
-			XML_SCANF(element_well->Attribute("PositionY"), "%f", &well_info.position_y);
-			XML_SCANF(element_well->Attribute("Width"), "%f", &well_info.width);
-			XML_SCANF(element_well->Attribute("Height"), "%f", &well_info.height);
-			well_info.well_shape = convert_string_to_shape(element_well->Attribute("Shape"));
-			if (element_well->Attribute("Row") != nullptr) {
-				XML_SCANF(element_well->Attribute("Row"), "%hu", &well_info.row_index);
-				XML_SCANF(element_well->Attribute("Column"), "%hu", &well_info.column_index);
+			XML_SCANF(element_well.Attribute("ID"), "Well:%*u.%u", &well_info.id);
+			XML_SCANF(element_well.Attribute("PositionX"), "%f", &well_info.position_x);
+			XML_SCANF(element_well.Attribute("PositionY"), "%f", &well_info.position_y);
+			XML_SCANF(element_well.Attribute("Width"), "%f", &well_info.width);
+			XML_SCANF(element_well.Attribute("Height"), "%f", &well_info.height);
+			well_info.well_shape = convert_string_to_shape(element_well.Attribute("Shape"));
+			if (element_well.Attribute("Row") != nullptr) {
+				XML_SCANF(element_well.Attribute("Row"), "%hu", &well_info.row_index);
+				XML_SCANF(element_well.Attribute("Column"), "%hu", &well_info.column_index);
 			}
 
-			status = tiff_obj->AddWell(plate_info.id, well_info);
+			status = context.tiff_obj->AddWell(plate_info.id, well_info);
 			if (status != ErrorCode::STATUS_OK)
 				return status;
 
-			const XMLElement* element_well_sample = element_well->FirstChildElement("WellSample");
-			while (element_well_sample)
+			size_t well_depth = reader.Depth();
+			while ((tag = next_child(reader, well_depth)) == OmeXmlReader::TAG_START)
 			{
-				WellSample well_sample = { 0 };
-				uint32_t scan_id = 0;
-				const char* well_sample_id = element_well_sample->Attribute("ID");
-				well_sample.id = string(well_sample_id);
-				XML_SCANF(well_sample_id, "WellSample:%*u.%*u.%u", &scan_id);
-				XML_SCANF(element_well_sample->Attribute("PositionX"), "%f", &well_sample.position_x);
-				XML_SCANF(element_well_sample->Attribute("PositionY"), "%f", &well_sample.position_y);
-				XML_SCANF(element_well_sample->Attribute("PositionZ"), "%f", &well_sample.position_z);
-				well_sample.physicalsize_unit_x = convert_string_to_distance_unit(element_well_sample->Attribute("PositionXUnit"));
-				well_sample.physicalsize_unit_y = convert_string_to_distance_unit(element_well_sample->Attribute("PositionYUnit"));
-				well_sample.physicalsize_unit_z = convert_string_to_distance_unit(element_well_sample->Attribute("PositionZUnit"));
-
-				const XMLElement* element_image_ref = element_well_sample->FirstChildElement("ImageRef");
-				if (element_image_ref == nullptr)
-					return ErrorCode::ERR_NO_IMAGE_REF_IN_WELL_SAMPLE;
-
-				const char* image_ref_id = element_image_ref->Attribute("ID");
-				well_sample.image_ref_id = string(image_ref_id);
-
-				uint32_t image_id_u;
-				XML_SCANF(image_ref_id, "Image:%u", &image_id_u);
-
-				auto it_image = tiff_obj->_images.find(image_id_u);
-				if (it_image == tiff_obj->_images.end())
-					return ErrorCode::ERR_CANNOT_FIND_IMAGE;
-
-				Image* image = it_image->second;
-
-				ScanRegionInfo info = { 0 };
-				info.start_physical_x = well_sample.position_x;
-				info.start_physical_y = well_sample.position_y;
-				info.start_physical_z = well_sample.position_z;
-				info.start_unit_x = well_sample.physicalsize_unit_x;
-				info.start_unit_y = well_sample.physicalsize_unit_y;
-				info.start_unit_z = well_sample.physicalsize_unit_z;
-				info.pixel_size_x = image->_pixels._info.size_x;
-				info.pixel_size_y = image->_pixels._info.size_y;
-				info.pixel_size_z = image->_pixels._info.size_z;
-				info.size_t = image->_pixels._info.size_t;
-				scan_region_infos.insert(make_pair(well_sample_id, info));
-				well_sample_id_image_ref_map.insert(make_pair(well_sample_id, image_ref_id));
-
-				element_well_sample = element_well_sample->NextSiblingElement("WellSample");
+				if (!reader.NameIs("WellSample"))
+					continue;
+				status = parse_well_sample(reader, context);
+				if (status != ErrorCode::STATUS_OK)
+					return status;
 			}
-
-			element_well = element_well->NextSiblingElement("Well");
+			if (tag < 0)
+				return ErrorCode::ERR_READ_OME_XML_FAILED;
 		}
-
-		const XMLElement* element_plate_acquisition = element_plate->FirstChildElement("PlateAcquisition");
-		while (element_plate_acquisition)
+		else if (reader.NameIs("PlateAcquisition"))
 		{
-			const char* plate_acquisition_id = element_plate_acquisition->Attribute("ID");
-			uint32_t inner_plate_id = 0;
-			uint32_t acquisition_id = 0;
-			XML_SCANF(plate_acquisition_id, "PlateAcquisition:%u.%u", &inner_plate_id, &acquisition_id);
-			if (inner_plate_id != plate_info.id)
+			OmeXmlAcquisition acquisition = { 0, 0 };
+			const char* plate_acquisition_id = reader.Attribute("ID");
+			XML_SCANF(plate_acquisition_id, "PlateAcquisition:%u.%u", &acquisition.plate_id, &acquisition.acquisition_id);
+			if (acquisition.plate_id != plate_info.id)
 				return ErrorCode::ERR_PLATE_ID_NOT_MATCHED;
 
-			bool is_scan_set = false;
-			const XMLElement* element_well_sample_ref = element_plate_acquisition->FirstChildElement("WellSampleRef");
-			while (element_well_sample_ref)
+			size_t acquisition_depth = reader.Depth();
+			while ((tag = next_child(reader, acquisition_depth)) == OmeXmlReader::TAG_START)
 			{
-				uint32_t region_id = 0;
-				XML_SCANF(element_well_sample_ref->Attribute("RegionID"), "%u", &region_id);
-				const char* well_sample_ref_id = element_well_sample_ref->Attribute("ID");
+				if (!reader.NameIs("WellSampleRef"))
+					continue;
+				OmeXmlWellSampleRef ref = { 0, 0 };
+				XML_SCANF(reader.Attribute("RegionID"), "%u", &ref.region_id);
+				const char* well_sample_ref_id = reader.Attribute("ID");
 				if (well_sample_ref_id == nullptr)
 					return ErrorCode::ERR_WELL_SAMPLE_REF_ID_EMPTY;
+				XML_SCANF(well_sample_ref_id, "WellSample:%*u.%u.%*u", &ref.well_id);
+				ref.id = well_sample_ref_id;
+				acquisition.refs.push_back(std::move(ref));
+			}
+			if (tag < 0)
+				return ErrorCode::ERR_READ_OME_XML_FAILED;
+			context.acquisitions.push_back(std::move(acquisition));
+		}
+	}
+	return tag < 0 ? ErrorCode::ERR_READ_OME_XML_FAILED : ErrorCode::STATUS_OK;
+}
 
-				uint32_t well_id = 0;
-				XML_SCANF(well_sample_ref_id, "WellSample:%*u.%u.%*u", &well_id);
-				auto it_image_ref = well_sample_id_image_ref_map.find(well_sample_ref_id);
+//Scans, channels and regions of the plates, from the images they refer to.
+static int32_t add_plate_acquisitions(OmeXmlContext& context)
+{
+	OmeTiff* tiff_obj = context.tiff_obj;
+	for (auto it_sample = context.well_samples.begin(); it_sample != context.well_samples.end(); it_sample++)
+	{
+		auto it_image = tiff_obj->_images.find(it_sample->second.image_id);
+		if (it_image == tiff_obj->_images.end())
+			return ErrorCode::ERR_CANNOT_FIND_IMAGE;
 
-				if (!is_scan_set && it_image_ref != well_sample_id_image_ref_map.end())
-				{
-					uint32_t image_id_u;
-					XML_SCANF(it_image_ref->second.c_str(), "Image:%u", &image_id_u);
-
-					auto it_image = tiff_obj->_images.find(image_id_u);
-					if (it_image == tiff_obj->_images.end())
-						return ErrorCode::ERR_CANNOT_FIND_IMAGE;
-
-					Image* image = it_image->second;
-
-					ScanInfo scan_info = { 0 };
-					scan_info.id = acquisition_id;
-					memcpy_s(scan_info.dimension_order, NAME_LEN, image->_pixels._info.dimension_order.c_str(), image->_pixels._info.dimension_order.size());
-					scan_info.pixel_physical_size_x = image->_pixels._info.physical_size_per_pixel_x;
-					scan_info.pixel_physical_size_y = image->_pixels._info.physical_size_per_pixel_y;
-					scan_info.pixel_physical_size_z = image->_pixels._info.physical_size_per_pixel_z;
-					scan_info.time_increment = image->_pixels._info.time_increment;
-					scan_info.pixel_physical_uint_x = image->_pixels._info.physical_x_unit;
-					scan_info.pixel_physical_uint_y = image->_pixels._info.physical_y_unit;
-					scan_info.pixel_physical_uint_z = image->_pixels._info.physical_z_unit;
-					scan_info.time_increment_unit = image->_pixels._info.time_increment_unit;
-					scan_info.tile_pixel_size_width = image->_pixels._info.tile_pixel_width;
-					scan_info.tile_pixel_size_height = image->_pixels._info.tile_pixel_height;
-					scan_info.significant_bits = image->_pixels._info.significant_bits;
-					scan_info.pixel_type = image->_pixels._info.pixel_type;
-
-					status = tiff_obj->AddScan(inner_plate_id, scan_info);
-					if (status != ErrorCode::STATUS_OK)
-						return status;
+		Image* image = it_image->second;
+		ScanRegionInfo& info = it_sample->second.info;
+		info.pixel_size_x = image->_pixels._info.size_x;
+		info.pixel_size_y = image->_pixels._info.size_y;
+		info.pixel_size_z = image->_pixels._info.size_z;
+		info.size_t = image->_pixels._info.size_t;
+	}
 
-					for (auto it_channel = image->_pixels._channels.begin(); it_channel != image->_pixels._channels.end(); it_channel++)
-					{
-						status = tiff_obj->AddChannel(plate_info.id, acquisition_id, it_channel->second._info);
-						if (status != ErrorCode::STATUS_OK)
-							return status;
-					}
+	int32_t status = ErrorCode::STATUS_OK;
+	for (const OmeXmlAcquisition& acquisition : context.acquisitions)
+	{
+		bool is_scan_set = false;
+		for (const OmeXmlWellSampleRef& ref : acquisition.refs)
+		{
+			auto it_sample = context.well_samples.find(ref.id);
+			if (it_sample == context.well_samples.end())
+				continue;
 
-					is_scan_set = true;
-				}
+			if (!is_scan_set)
+			{
+				auto it_image = tiff_obj->_images.find(it_sample->second.image_id);
+				if (it_image == tiff_obj->_images.end())
+					return ErrorCode::ERR_CANNOT_FIND_IMAGE;
 
-				auto it_scan_region_info = scan_region_infos.find(well_sample_ref_id);
-				if (it_image_ref != well_sample_id_image_ref_map.end() && it_scan_region_info != scan_region_infos.end())
-				{
-					it_scan_region_info->second.id = region_id;
+				Image* image = it_image->second;
 
-					status = tiff_obj->AddScanRegion(plate_info.id, acquisition_id, well_id, it_scan_region_info->second, it_image_ref->first, it_image_ref->second);
+				ScanInfo scan_info = { 0 };
+				scan_info.id = acquisition.acquisition_id;
+				memcpy_s(scan_info.dimension_order, NAME_LEN, image->_pixels._info.dimension_order.c_str(), image->_pixels._info.dimension_order.size());
+				scan_info.pixel_physical_size_x = image->_pixels._info.physical_size_per_pixel_x;
+				scan_info.pixel_physical_size_y = image->_pixels._info.physical_size_per_pixel_y;
+				scan_info.pixel_physical_size_z = image->_pixels._info.physical_size_per_pixel_z;
+				scan_info.time_increment = image->_pixels._info.time_increment;
+				scan_info.pixel_physical_uint_x = image->_pixels._info.physical_x_unit;
+				scan_info.pixel_physical_uint_y = image->_pixels._info.physical_y_unit;
+				scan_info.pixel_physical_uint_z = image->_pixels._info.physical_z_unit;
+				scan_info.time_increment_unit = image->_pixels._info.time_increment_unit;
+				scan_info.tile_pixel_size_width = image->_pixels._info.tile_pixel_width;
+				scan_info.tile_pixel_size_height = image->_pixels._info.tile_pixel_height;
+				scan_info.significant_bits = image->_pixels._info.significant_bits;
+				scan_info.pixel_type = image->_pixels._info.pixel_type;
+
+				status = tiff_obj->AddScan(acquisition.plate_id, scan_info);
+				if (status != ErrorCode::STATUS_OK)
+					return status;
+
+				for (auto it_channel = image->_pixels._channels.begin(); it_channel != image->_pixels._channels.end(); it_channel++)
+				{
+					status = tiff_obj->AddChannel(acquisition.plate_id, acquisition.acquisition_id, it_channel->second._info);
 					if (status != ErrorCode::STATUS_OK)
 						return status;
 				}
 
-				element_well_sample_ref = element_well_sample_ref->NextSiblingElement("WellSampleRef");
+				is_scan_set = true;
 			}
-			element_plate_acquisition = element_plate_acquisition->NextSiblingElement("PlateAcquisition");
+
+			ScanRegionInfo info = it_sample->second.info;
+			info.id = ref.region_id;
+			status = tiff_obj->AddScanRegion(acquisition.plate_id, acquisition.acquisition_id, ref.well_id, info, it_sample->second.well_sample_id, it_sample->second.image_id);
+			if (status != ErrorCode::STATUS_OK)
+				return status;
 		}
+	}
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t parse_ome_xml(const string& xml, OmeTiff* tiff_obj, map<string, bool>* checked_files)
+{
+	OmeXmlReader reader(xml.c_str(), xml.size());
+	OmeXmlContext context;
+	context.tiff_obj = tiff_obj;
 
-		element_plate = element_plate->NextSiblingElement("Plate");
+	bool has_ome = false;
+	int32_t tag;
+	while ((tag = reader.Next()) != OmeXmlReader::TAG_NONE)
+	{
+		if (tag < 0)
+			return ErrorCode::ERR_READ_OME_XML_FAILED;
+		if (has_ome || tag != OmeXmlReader::TAG_START || reader.Depth() != 1 || !reader.NameIs("OME"))
+			continue;
+
+		has_ome = true;
+		while ((tag = next_child(reader, 1)) == OmeXmlReader::TAG_START)
+		{
+			int32_t status = ErrorCode::STATUS_OK;
+			if (reader.NameIs("Image"))
+				status = parse_image(reader, context);
+			else if (reader.NameIs("Plate"))
+				status = parse_plate(reader, context);
+			if (status != ErrorCode::STATUS_OK)
+				return status;
+		}
+		if (tag < 0)
+			return ErrorCode::ERR_READ_OME_XML_FAILED;
 	}
+	if (!has_ome)
+		return ErrorCode::ERR_XML_PARSE_FAILED;
 
-	return ErrorCode::STATUS_OK;
+	int32_t status = add_plate_acquisitions(context);
+	if (status == ErrorCode::STATUS_OK && checked_files != nullptr)
+		checked_files->swap(context.file_exists);
+	return status;
 }
 
+
+//The XML is printed element by element as the model is walked, no document tree is built.
 int32_t generate_ome_xml(string& xml, const OmeTiff* tiff_obj)
 {
-	tinyxml2::XMLDocument doc;
-	XMLDeclaration* bom = doc.NewDeclaration();
-	doc.InsertFirstChild(bom);
+	XMLPrinter printer;
+	printer.PushDeclaration("xml version=\"1.0\" encoding=\"UTF-8\"");
 	const char* comment = "Warning: this comment is an OME-XML metadata block, which contains crucial dimensional parameters and other important metadata. Please edit cautiously (if at all), and back up the original data before doing so. For more information, see the OME-TIFF web site: http://www.openmicroscopy.org/site/support/ome-model/ome-tiff/.";
-	doc.InsertEndChild(doc.NewComment(comment));
-
-	XMLElement* element_OME = doc.NewElement("OME");
-	element_OME->SetAttribute("xmlns", "http://www.openmicroscopy.org/Schemas/OME/2016-06");
-	element_OME->SetAttribute("xmlns:xsi", "http://www.w3.org/2001/XMLSchema-instance");
-	element_OME->SetAttribute("xsi:schemaLocation", "http://www.openmicroscopy.org/Schemas/OME/2016-06 http://www.openmicroscopy.org/Schemas/OME/2016-06/ome.xsd");
-	doc.InsertEndChild(element_OME);
-
-	XMLElement* element_boot_Image = doc.NewElement("Image");
-	element_OME->InsertEndChild(element_boot_Image);
-	element_boot_Image->SetAttribute("ID", "Image:0");
-	XMLElement* element_boot_Pixels = doc.NewElement("Pixels");
-	element_boot_Image->InsertEndChild(element_boot_Pixels);
-	element_boot_Pixels->SetAttribute("ID", "Pixels:0");
-	element_boot_Pixels->SetAttribute("DimensionOrder", "XYCZT");
-	element_boot_Pixels->SetAttribute("Type", "uint8");
-	element_boot_Pixels->SetAttribute("SizeC", 1);
-	element_boot_Pixels->SetAttribute("SizeT", 1);
-	element_boot_Pixels->SetAttribute("SizeX", HEADERIMAGESIZE);
-	element_boot_Pixels->SetAttribute("SizeY", HEADERIMAGESIZE);
-	element_boot_Pixels->SetAttribute("SizeZ", 1);
-	element_boot_Pixels->SetAttribute("SizeS", 1);
-	element_boot_Pixels->SetAttribute("TileWidth", HEADERIMAGESIZE);
-	element_boot_Pixels->SetAttribute("TileHeight", HEADERIMAGESIZE);
-	XMLElement* element_boot_channel = doc.NewElement("Channel");
-	element_boot_Pixels->InsertEndChild(element_boot_channel);
-	element_boot_channel->SetAttribute("ID", "Channel:0");
-	element_boot_channel->SetAttribute("SamplesPerPixel", 1);
-	XMLElement* element_boot_TiffData = doc.NewElement("TiffData");
-	element_boot_Pixels->InsertEndChild(element_boot_TiffData);
-	element_boot_TiffData->SetAttribute("FirstC", 0);
-	element_boot_TiffData->SetAttribute("FirstT", 0);
-	element_boot_TiffData->SetAttribute("FirstZ", 0);
-	element_boot_TiffData->SetAttribute("FirstS", 0);
-	element_boot_TiffData->SetAttribute("IFD", 0);
-	XMLElement* element_boot_UUID = doc.NewElement("UUID");
+	printer.PushComment(comment);
+
+	printer.OpenElement("OME");
+	printer.PushAttribute("xmlns", "http://www.openmicroscopy.org/Schemas/OME/2016-06");
+	printer.PushAttribute("xmlns:xsi", "http://www.w3.org/2001/XMLSchema-instance");
+	printer.PushAttribute("xsi:schemaLocation", "http://www.openmicroscopy.org/Schemas/OME/2016-06 http://www.openmicroscopy.org/Schemas/OME/2016-06/ome.xsd");
+
+	printer.OpenElement("Image");
+	printer.PushAttribute("ID", "Image:0");
+	printer.OpenElement("Pixels");
+	printer.PushAttribute("ID", "Pixels:0");
+	printer.PushAttribute("DimensionOrder", "XYCZT");
+	printer.PushAttribute("Type", "uint8");
+	printer.PushAttribute("SizeC", 1);
+	printer.PushAttribute("SizeT", 1);
+	printer.PushAttribute("SizeX", HEADERIMAGESIZE);
+	printer.PushAttribute("SizeY", HEADERIMAGESIZE);
+	printer.PushAttribute("SizeZ", 1);
+	printer.PushAttribute("SizeS", 1);
+	printer.PushAttribute("TileWidth", HEADERIMAGESIZE);
+	printer.PushAttribute("TileHeight", HEADERIMAGESIZE);
+	printer.OpenElement("Channel");
+	printer.PushAttribute("ID", "Channel:0");
+	printer.PushAttribute("SamplesPerPixel", 1);
+	printer.CloseElement();
+	printer.OpenElement("TiffData");
+	printer.PushAttribute("FirstC", 0);
+	printer.PushAttribute("FirstT", 0);
+	printer.PushAttribute("FirstZ", 0);
+	printer.PushAttribute("FirstS", 0);
+	printer.PushAttribute("IFD", 0);
+	printer.OpenElement("UUID");
 	string file_name = tiff_obj->GetUTF8FileName();
-	element_boot_UUID->SetAttribute("FileName", file_name.c_str());
-	element_boot_TiffData->InsertEndChild(element_boot_UUID);
+	printer.PushAttribute("FileName", file_name.c_str());
+	printer.CloseElement();
+	printer.CloseElement();
+	printer.CloseElement();
+	printer.CloseElement();
 
 	int32_t status = ErrorCode::STATUS_OK;
 	char tmp[_MAX_PATH] = { 0 };
 	for (auto it = tiff_obj->_plates.begin(); it != tiff_obj->_plates.end(); it++)
 	{
 		Plate* plate = it->second;
-		PlateInfo plate_info = plate->_info;
+		const PlateInfo& plate_info = plate->_info;
 
-		XMLElement* element_Plate = doc.NewElement("Plate");
-		element_OME->InsertEndChild(element_Plate);
-		memset(tmp, 0, _MAX_PATH);
+		printer.OpenElement("Plate");
 		sprintf_s(tmp, "Plate:%hd", plate_info.id);
-		element_Plate->SetAttribute("ID", tmp);
+		printer.PushAttribute("ID", tmp);
 		fs::path p(plate_info.name);
 		string plate_name_str = p.u8string();
-		element_Plate->SetAttribute("Name", plate_name_str.c_str());
-		element_Plate->SetAttribute("Width", convert_double_to_string(plate_info.width, tmp));
-		element_Plate->SetAttribute("Height", convert_double_to_string(plate_info.height, tmp));
-		element_Plate->SetAttribute("PhysicalSizeXUnit", convert_distance_unit_to_string(plate_info.physicalsize_unit_x));
-		element_Plate->SetAttribute("PhysicalSizeYUnit", convert_distance_unit_to_string(plate_info.physicalsize_unit_y));
-		element_Plate->SetAttribute("Rows", plate_info.row_size);
-		element_Plate->SetAttribute("Columns", plate_info.column_size);
+		printer.PushAttribute("Name", plate_name_str.c_str());
+		printer.PushAttribute("Width", convert_double_to_string(plate_info.width, tmp));
+		printer.PushAttribute("Height", convert_double_to_string(plate_info.height, tmp));
+		printer.PushAttribute("PhysicalSizeXUnit", convert_distance_unit_to_string(plate_info.physicalsize_unit_x));
+		printer.PushAttribute("PhysicalSizeYUnit", convert_distance_unit_to_string(plate_info.physicalsize_unit_y));
+		printer.PushAttribute("Rows", plate_info.row_size);
+		printer.PushAttribute("Columns", plate_info.column_size);
 
 		for (auto it_well = plate->_wells_array.begin(); it_well != plate->_wells_array.end(); it_well++)
 		{
-			WellInfo well_info = it_well->second._info;
-			XMLElement* element_Well = doc.NewElement("Well");
-			element_Plate->InsertEndChild(element_Well);
-			memset(tmp, 0, _MAX_PATH);
+			const WellInfo& well_info = it_well->second._info;
+			printer.OpenElement("Well");
 			sprintf_s(tmp, "Well:%u.%u", plate_info.id, well_info.id);
-			element_Well->SetAttribute("ID", tmp);
-			element_Well->SetAttribute("PositionX", convert_double_to_string(well_info.position_x, tmp));
-			element_Well->SetAttribute("PositionY", convert_double_to_string(well_info.position_y, tmp));
-			element_Well->SetAttribute("Width", convert_double_to_string(well_info.width, tmp));
-			element_Well->SetAttribute("Height", convert_double_to_string(well_info.height, tmp));
-			element_Well->SetAttribute("Shape", convert_shape_to_string(well_info.well_shape));
-			element_Well->SetAttribute("Row", well_info.row_index);
-			element_Well->SetAttribute("Column", well_info.column_index);
+			printer.PushAttribute("ID", tmp);
+			printer.PushAttribute("PositionX", convert_double_to_string(well_info.position_x, tmp));
+			printer.PushAttribute("PositionY", convert_double_to_string(well_info.position_y, tmp));
+			printer.PushAttribute("Width", convert_double_to_string(well_info.width, tmp));
+			printer.PushAttribute("Height", convert_double_to_string(well_info.height, tmp));
+			printer.PushAttribute("Shape", convert_shape_to_string(well_info.well_shape));
+			printer.PushAttribute("Row", well_info.row_index);
+			printer.PushAttribute("Column", well_info.column_index);
 
 			for (auto it_well_sample = it_well->second._well_sample_array.begin(); it_well_sample != it_well->second._well_sample_array.end(); it_well_sample++)
 			{
-				WellSample wellSample = it_well_sample->second;
-				XMLElement* element_WellSample = doc.NewElement("WellSample");
-				element_Well->InsertEndChild(element_WellSample);
-				element_WellSample->SetAttribute("ID", wellSample.id.c_str());
-				element_WellSample->SetAttribute("PositionX", convert_double_to_string(wellSample.position_x, tmp));
-				element_WellSample->SetAttribute("PositionY", convert_double_to_string(wellSample.position_y, tmp));
-				element_WellSample->SetAttribute("PositionZ", convert_double_to_string(wellSample.position_z, tmp));
-				element_WellSample->SetAttribute("PositionXUnit", convert_distance_unit_to_string(wellSample.physicalsize_unit_x));
-				element_WellSample->SetAttribute("PositionYUnit", convert_distance_unit_to_string(wellSample.physicalsize_unit_y));
-				element_WellSample->SetAttribute("PositionZUnit", convert_distance_unit_to_string(wellSample.physicalsize_unit_z));
-
-				XMLElement* element_imageref = doc.NewElement("ImageRef");
-				element_WellSample->InsertEndChild(element_imageref);
-				element_imageref->SetAttribute("ID", wellSample.image_ref_id.c_str());
+				const WellSample& wellSample = it_well_sample->second;
+				printer.OpenElement("WellSample");
+				sprintf_s(tmp, "WellSample:%u.%u.%u", plate_info.id, well_info.id, it_well_sample->first);
+				printer.PushAttribute("ID", tmp);
+				printer.PushAttribute("PositionX", convert_double_to_string(wellSample.position_x, tmp));
+				printer.PushAttribute("PositionY", convert_double_to_string(wellSample.position_y, tmp));
+				printer.PushAttribute("PositionZ", convert_double_to_string(wellSample.position_z, tmp));
+				printer.PushAttribute("PositionXUnit", convert_distance_unit_to_string(wellSample.physicalsize_unit_x));
+				printer.PushAttribute("PositionYUnit", convert_distance_unit_to_string(wellSample.physicalsize_unit_y));
+				printer.PushAttribute("PositionZUnit", convert_distance_unit_to_string(wellSample.physicalsize_unit_z));
+
+				printer.OpenElement("ImageRef");
+				sprintf_s(tmp, "Image:%u", wellSample.image_id);
+				printer.PushAttribute("ID", tmp);
+				printer.CloseElement();
+				printer.CloseElement();
 			}
+			printer.CloseElement();
 		}
 
 		for (auto it_plate_acquisition = plate->_plate_acquisition_array.begin(); it_plate_acquisition != plate->_plate_acquisition_array.end(); it_plate_acquisition++)
 		{
-			PlateAcquisition acquisition = it_plate_acquisition->second;
+			const PlateAcquisition& acquisition = it_plate_acquisition->second;
 
-			XMLElement* element_plate_acquisition = doc.NewElement("PlateAcquisition");
-			element_Plate->InsertEndChild(element_plate_acquisition);
-			element_plate_acquisition->SetAttribute("ID", acquisition._id.c_str());
+			printer.OpenElement("PlateAcquisition");
+			sprintf_s(tmp, "PlateAcquisition:%u.%u", plate_info.id, it_plate_acquisition->first);
+			printer.PushAttribute("ID", tmp);
 
 			for (auto it_ref = acquisition._well_sample_ref.begin(); it_ref != acquisition._well_sample_ref.end(); it_ref++)
 			{
-				XMLElement* element_wellsampleref = doc.NewElement("WellSampleRef");
-				element_wellsampleref->SetAttribute("ID", it_ref->second.c_str());
-				element_wellsampleref->SetAttribute("RegionID", it_ref->first);
-				element_plate_acquisition->InsertEndChild(element_wellsampleref);
+				printer.OpenElement("WellSampleRef");
+				sprintf_s(tmp, "WellSample:%u.%u.%u", plate_info.id, it_ref->second.well_id, it_ref->second.well_sample_id);
+				printer.PushAttribute("ID", tmp);
+				printer.PushAttribute("RegionID", it_ref->first);
+				printer.CloseElement();
 			}
+			printer.CloseElement();
 		}
+		printer.CloseElement();
 	}
 
 	for (auto it_image = tiff_obj->_images.begin(); it_image != tiff_obj->_images.end(); it_image++)
 	{
 		Image* image = it_image->second;
-		XMLElement* element_Image = doc.NewElement("Image");
-		element_OME->InsertEndChild(element_Image);
-		element_Image->SetAttribute("Name", image->_name.c_str());
-		element_Image->SetAttribute("ID", image->_id.c_str());
-		XMLElement* element_Pixels = doc.NewElement("Pixels");
-		element_Image->InsertEndChild(element_Pixels);
-
-		Pixels pixels = image->_pixels;
-		PixelsInfo pix = pixels._info;
+		Pixels& pixels = image->_pixels;
+		const PixelsInfo& pix = pixels._info;
 
 		uint32_t channel_size = (uint32_t)pixels._channels.size();
 		if (channel_size == 0)
 			return ErrorCode::ERR_NO_CHANNELS;
 
-		element_Pixels->SetAttribute("ID", pix.id.c_str());
-		element_Pixels->SetAttribute("DimensionOrder", pix.dimension_order.c_str());
-		element_Pixels->SetAttribute("PhysicalSizeX", convert_double_to_string(pix.physical_size_per_pixel_x != 0 ? pix.physical_size_per_pixel_x : 1, tmp));
-		element_Pixels->SetAttribute("PhysicalSizeY", convert_double_to_string(pix.physical_size_per_pixel_y != 0 ? pix.physical_size_per_pixel_y : 1, tmp));
-		element_Pixels->SetAttribute("PhysicalSizeZ", convert_double_to_string(pix.physical_size_per_pixel_z != 0 ? pix.physical_size_per_pixel_z : 1, tmp));
-		element_Pixels->SetAttribute("PhysicalSizeXUnit", convert_distance_unit_to_string(pix.physical_x_unit));
-		element_Pixels->SetAttribute("PhysicalSizeYUnit", convert_distance_unit_to_string(pix.physical_y_unit));
-		element_Pixels->SetAttribute("PhysicalSizeZUnit", convert_distance_unit_to_string(pix.physical_z_unit));
-		element_Pixels->SetAttribute("TimeIncrement", convert_double_to_string(pix.time_increment, tmp));
-		element_Pixels->SetAttribute("TimeIncrementUnit", convert_timeunit_to_string(pix.time_increment_unit));
-		element_Pixels->SetAttribute("Type", convert_pixel_type_to_string(pix.pixel_type));
-		element_Pixels->SetAttribute("SizeC", channel_size);
-		element_Pixels->SetAttribute("SizeT", pixels.get_t_size());
-		element_Pixels->SetAttribute("SizeX", pix.size_x);
-		element_Pixels->SetAttribute("SizeY", pix.size_y);
-		element_Pixels->SetAttribute("SizeZ", pix.size_z);
-		element_Pixels->SetAttribute("TileWidth", pix.tile_pixel_width);
-		element_Pixels->SetAttribute("TileHeight", pix.tile_pixel_height);
-		element_Pixels->SetAttribute("SignificantBits", pix.significant_bits);
+		printer.OpenElement("Image");
+		printer.PushAttribute("Name", image->_name.c_str());
+		sprintf_s(tmp, "Image:%u", it_image->first);
+		printer.PushAttribute("ID", tmp);
+
+		printer.OpenElement("Pixels");
+		printer.PushAttribute("ID", pix.id.c_str());
+		printer.PushAttribute("DimensionOrder", pix.dimension_order.c_str());
+		printer.PushAttribute("PhysicalSizeX", convert_double_to_string(pix.physical_size_per_pixel_x != 0 ? pix.physical_size_per_pixel_x : 1, tmp));
+		printer.PushAttribute("PhysicalSizeY", convert_double_to_string(pix.physical_size_per_pixel_y != 0 ? pix.physical_size_per_pixel_y : 1, tmp));
+		printer.PushAttribute("PhysicalSizeZ", convert_double_to_string(pix.physical_size_per_pixel_z != 0 ? pix.physical_size_per_pixel_z : 1, tmp));
+		printer.PushAttribute("PhysicalSizeXUnit", convert_distance_unit_to_string(pix.physical_x_unit));
+		printer.PushAttribute("PhysicalSizeYUnit", convert_distance_unit_to_string(pix.physical_y_unit));
+		printer.PushAttribute("PhysicalSizeZUnit", convert_distance_unit_to_string(pix.physical_z_unit));
+		printer.PushAttribute("TimeIncrement", convert_double_to_string(pix.time_increment, tmp));
+		printer.PushAttribute("TimeIncrementUnit", convert_timeunit_to_string(pix.time_increment_unit));
+		printer.PushAttribute("Type", convert_pixel_type_to_string(pix.pixel_type));
+		printer.PushAttribute("SizeC", channel_size);
+		printer.PushAttribute("SizeT", pixels.get_t_size());
+		printer.PushAttribute("SizeX", pix.size_x);
+		printer.PushAttribute("SizeY", pix.size_y);
+		printer.PushAttribute("SizeZ", pix.size_z);
+		printer.PushAttribute("TileWidth", pix.tile_pixel_width);
+		printer.PushAttribute("TileHeight", pix.tile_pixel_height);
+		printer.PushAttribute("SignificantBits", pix.significant_bits);
 
 		for (auto it_channel = pixels._channels.begin(); it_channel != pixels._channels.end(); it_channel++)
 		{
-			ChannelInfo channel_info = it_channel->second._info;
-			XMLElement* element_Channel = doc.NewElement("Channel");
-			element_Pixels->InsertEndChild(element_Channel);
-			memset(tmp, 0, _MAX_PATH);
+			const ChannelInfo& channel_info = it_channel->second._info;
+			printer.OpenElement("Channel");
 			sprintf_s(tmp, "Channel:%u", channel_info.id);
-			element_Channel->SetAttribute("ID", tmp);
+			printer.PushAttribute("ID", tmp);
 			fs::path p(channel_info.name);
 			string channel_name_str = p.u8string();
-			element_Channel->SetAttribute("Name", channel_name_str.c_str());
-			element_Channel->SetAttribute("SamplesPerPixel", channel_info.samples_per_pixel);
-			element_Channel->SetAttribute("BinSize", channel_info.bin_size);
+			printer.PushAttribute("Name", channel_name_str.c_str());
+			printer.PushAttribute("SamplesPerPixel", channel_info.samples_per_pixel);
+			printer.PushAttribute("BinSize", channel_info.bin_size);
+			printer.CloseElement();
 		}
 
 		bool is_ordered = false;
@@ -773,7 +1219,7 @@ int32_t generate_ome_xml(string& xml, const OmeTiff* tiff_obj)
 			for (auto it_channel = pixels._channels.begin(); it_channel != pixels._channels.end(); it_channel++)
 			{
 				uint32_t c_id = it_channel->second._info.id;
-				
+
 				TiffData tiff_data;
 				status = pixels.get_tiff_data(c_id, 0, 0, tiff_data);
 				if (status != ErrorCode::STATUS_OK)
@@ -805,18 +1251,18 @@ int32_t generate_ome_xml(string& xml, const OmeTiff* tiff_obj)
 			}
 		}
 
-		auto insertTiffDataFunc = [&doc, &element_Pixels](const TiffData& tiff_data)
+		auto insertTiffDataFunc = [&printer](const TiffData& tiff_data)
 			{
-				XMLElement* element_TiffData = doc.NewElement("TiffData");
-				element_Pixels->InsertEndChild(element_TiffData);
-				element_TiffData->SetAttribute("FirstC", tiff_data.FirstC);
-				element_TiffData->SetAttribute("FirstT", tiff_data.FirstT);
-				element_TiffData->SetAttribute("FirstZ", tiff_data.FirstZ);
-				element_TiffData->SetAttribute("IFD", tiff_data.IFD);
-
-				XMLElement* element_UUID = doc.NewElement("UUID");
-				element_TiffData->InsertEndChild(element_UUID);
-				element_UUID->SetAttribute("FileName", tiff_data.FileName.c_str());
+				printer.OpenElement("TiffData");
+				printer.PushAttribute("FirstC", tiff_data.FirstC);
+				printer.PushAttribute("FirstT", tiff_data.FirstT);
+				printer.PushAttribute("FirstZ", tiff_data.FirstZ);
+				printer.PushAttribute("IFD", tiff_data.IFD);
+
+				printer.OpenElement("UUID");
+				printer.PushAttribute("FileName", tiff_data.FileName.c_str());
+				printer.CloseElement();
+				printer.CloseElement();
 			};
 
 		if (is_ordered)
@@ -839,17 +1285,12 @@ int32_t generate_ome_xml(string& xml, const OmeTiff* tiff_obj)
 				insertTiffDataFunc(it_tiff_data->second);
 			}
 		}
+		printer.CloseElement();
+		printer.CloseElement();
 	}
+	printer.CloseElement();
 
-	XMLPrinter printer;
-	doc.Print(&printer);
-	//int dataSize = printer.CStrSize();
-	//*xml = (char*)calloc(dataSize, 1);
-	//if (*xml == nullptr)
-	//	return ErrorCode::TIFF_ERR_ALLOC_MEMORY_FAILED;
-	//memcpy(*xml, printer.CStr(), dataSize);
-
-	xml = printer.CStr();
+	xml.assign(printer.CStr(), printer.CStrSize() - 1);
 
 	return ErrorCode::STATUS_OK;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "ometiff.h"
 
-int32_t parse_ome_xml(const std::string& xml, OmeTiff* tiff_obj);
+//"checked_files" gets the container files looked for and whether they exist, the parsed model depends on them.
+int32_t parse_ome_xml(const std::string& xml, OmeTiff* tiff_obj, std::map<std::string, bool>* checked_files = nullptr);
 int32_t generate_ome_xml(std::string& xml, const OmeTiff* tiff_obj);
 
@@ -0,0 +1,151 @@
+#include "ometiff_queue.h"
+#include "../common/thread_pool.h"
+
+using namespace std;
+using namespace ome;
+
+#define DEFAULT_QUEUE_CAPACITY 64
+
+TileSaveQueue::TileSaveQueue()
+{
+	_capacity = DEFAULT_QUEUE_CAPACITY;
+	_worker_count = 0;
+	_full_mode = QueueFullMode::QUEUEFULL_BLOCK;
+	_workers = 0;
+	_busy = 0;
+	_next_ticket = 1;
+	_first_error = ErrorCode::STATUS_OK;
+}
+
+TileSaveQueue::~TileSaveQueue()
+{
+	Stop();
+}
+
+int32_t TileSaveQueue::Configure(uint32_t capacity, QueueFullMode full_mode, uint32_t workers)
+{
+	if (capacity == 0)
+		return ErrorCode::ERR_PARAMETER_INVALID;
+	if (full_mode != QueueFullMode::QUEUEFULL_BLOCK && full_mode != QueueFullMode::QUEUEFULL_FAIL)
+		return ErrorCode::ERR_PARAMETER_INVALID;
+
+	Stop();
+	lock_guard<mutex> lock(_mutex);
+	_capacity = capacity;
+	_full_mode = full_mode;
+	_worker_count = workers;
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t TileSaveQueue::Push(TiffContainer* container, uint32_t ifd_no, uint32_t row, uint32_t column,
+	unique_ptr<uint8_t[]> data, uint32_t stride, uint64_t& ticket)
+{
+	unique_lock<mutex> lock(_mutex);
+	if (_tasks.size() >= _capacity)
+	{
+		if (_full_mode == QueueFullMode::QUEUEFULL_FAIL)
+			return ErrorCode::ERR_SAVE_QUEUE_FULL;
+		_done_cv.wait(lock, [this] { return _tasks.size() < _capacity; });
+	}
+
+	SaveTask task;
+	task.ticket = _next_ticket++;
+	task.container = container;
+	task.ifd_no = ifd_no;
+	task.row = row;
+	task.column = column;
+	task.stride = stride;
+	task.data = std::move(data);
+	ticket = task.ticket;
+
+	_pending.insert(task.ticket);
+	_frame_pending[FrameKey(container, ifd_no)]++;
+	_tasks.push_back(std::move(task));
+
+	//the tiles are saved by the threads of the shared pool, so they share the thread limit of the process
+	//with the parallel loops of the codecs instead of adding threads of their own
+	if (_workers < thread_pool_get_threads(_worker_count))
+	{
+		_workers++;
+		thread_pool_submit([this]() { Work(); });
+	}
+	return ErrorCode::STATUS_OK;
+}
+
+int32_t TileSaveQueue::GetStatus(uint64_t ticket)
+{
+	lock_guard<mutex> lock(_mutex);
+	if (ticket == 0 || ticket >= _next_ticket)
+		return ErrorCode::ERR_SAVE_TICKET_NOT_EXIST;
+	if (_pending.count(ticket) != 0)
+		return ErrorCode::ERR_SAVE_PENDING;
+	auto it = _failed.find(ticket);
+	return it == _failed.end() ? ErrorCode::STATUS_OK : it->second;
+}
+
+void TileSaveQueue::WaitFrame(TiffContainer* container, uint32_t ifd_no)
+{
+	unique_lock<mutex> lock(_mutex);
+	FrameKey key(container, ifd_no);
+	_done_cv.wait(lock, [this, &key] { return _frame_pending.find(key) == _frame_pending.end(); });
+}
+
+int32_t TileSaveQueue::Flush()
+{
+	unique_lock<mutex> lock(_mutex);
+	WaitIdle(lock);
+	int32_t status = _first_error;
+	_first_error = ErrorCode::STATUS_OK;
+	return status;
+}
+
+void TileSaveQueue::Stop()
+{
+	//a push during the wait submits its own worker if needed, so no task is ever left without one
+	unique_lock<mutex> lock(_mutex);
+	_done_cv.wait(lock, [this] { return _tasks.empty() && _workers == 0; });
+}
+
+void TileSaveQueue::WaitIdle(unique_lock<mutex>& lock)
+{
+	_done_cv.wait(lock, [this] { return _tasks.empty() && _busy == 0; });
+}
+
+void TileSaveQueue::Work()
+{
+	unique_lock<mutex> lock(_mutex);
+	for (;;)
+	{
+		//the worker ends with the queue, the next push submits a new one
+		if (_tasks.empty())
+		{
+			_workers--;
+			_done_cv.notify_all();
+			return;
+		}
+
+		SaveTask task = std::move(_tasks.front());
+		_tasks.pop_front();
+		_busy++;
+		//room for a blocked push
+		_done_cv.notify_all();
+		lock.unlock();
+
+		int32_t status = task.container->SaveTileData(task.ifd_no, task.row, task.column, task.data.get(), task.stride);
+		task.data.reset();
+
+		lock.lock();
+		_busy--;
+		_pending.erase(task.ticket);
+		if (status != ErrorCode::STATUS_OK)
+		{
+			_failed[task.ticket] = status;
+			if (_first_error == ErrorCode::STATUS_OK)
+				_first_error = status;
+		}
+		auto it = _frame_pending.find(FrameKey(task.container, task.ifd_no));
+		if (it != _frame_pending.end() && --it->second == 0)
+			_frame_pending.erase(it);
+		_done_cv.notify_all();
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "ometiff_container.h"
+#include <condition_variable>
+#include <deque>
+#include <unordered_set>
+
+//Tiles saved asynchronously : the caller only copies the tile, the threads of the shared pool compress and write it.
+//Every tile gets a ticket, its result is kept until the file is closed.
+class TileSaveQueue
+{
+public:
+	TileSaveQueue();
+	~TileSaveQueue();
+
+	//Wait for the queued tiles, then apply the settings. "workers" is the most tiles saved at the same time,
+	//0 means the thread limit of the process (thread_pool_get_threads).
+	int32_t Configure(uint32_t capacity, ome::QueueFullMode full_mode, uint32_t workers);
+
+	//"data" is a copy of the tile, rows of "stride" bytes. Workers are submitted to the pool by the pushes.
+	int32_t Push(TiffContainer* container, uint32_t ifd_no, uint32_t row, uint32_t column,
+		std::unique_ptr<uint8_t[]> data, uint32_t stride, uint64_t& ticket);
+
+	//STATUS_OK, ERR_SAVE_PENDING, ERR_SAVE_TICKET_NOT_EXIST or the error of the save.
+	int32_t GetStatus(uint64_t ticket);
+
+	//Wait for the queued tiles of one frame, e.g. before the frame is closed.
+	void WaitFrame(TiffContainer* container, uint32_t ifd_no);
+
+	//Wait for all the queued tiles, return the first error since the previous flush.
+	int32_t Flush();
+
+	//Wait until the queue is empty and no worker runs anymore.
+	void Stop();
+
+private:
+	struct SaveTask
+	{
+		uint64_t ticket;
+		TiffContainer* container;
+		uint32_t ifd_no;
+		uint32_t row;
+		uint32_t column;
+		uint32_t stride;
+		std::unique_ptr<uint8_t[]> data;
+	};
+	typedef std::pair<TiffContainer*, uint32_t> FrameKey;
+
+	void Work();
+	void WaitIdle(std::unique_lock<std::mutex>& lock);
+
+	std::mutex _mutex;
+	std::condition_variable _done_cv;		//callers wait for room or for the end of tasks
+	std::deque<SaveTask> _tasks;
+	uint32_t _capacity;
+	uint32_t _worker_count;
+	ome::QueueFullMode _full_mode;
+	uint32_t _workers;						//workers submitted to the pool, they end when the queue is empty
+	uint32_t _busy;							//tasks being saved by the workers
+
+	uint64_t _next_ticket;
+	std::unordered_set<uint64_t> _pending;	//queued or being saved
+	std::map<uint64_t, int32_t> _failed;
+	std::map<FrameKey, uint32_t> _frame_pending;
+	int32_t _first_error;
+};
@@ -655,6 +655,185 @@ void continue_save(const wchar_t* name_ext, int count, tiff::CompressionMode com
 #endif
 }
 
+//Shared by the round trip tests below : 16 bits gray frames, saved then loaded back and compared.
+static void Round_Trip_Path(const wchar_t* name_ext, wchar_t (&path)[256])
+{
+	wchar_t* s_cwd = _wgetcwd(NULL, 0);
+	ASSERT_FALSE(s_cwd == NULL);
+	swprintf_s(path, 256, L"%s\\test\\%s.tif", s_cwd, name_ext);
+	free(s_cwd);
+}
+
+//"row_pixels" pixels per row, the ones past "width" are padding set to 0xDEAD.
+static vector<uint16_t> Round_Trip_Frame(uint32_t width, uint32_t height, uint32_t row_pixels, uint32_t frame)
+{
+	vector<uint16_t> image((size_t)row_pixels * height);
+	for (uint32_t y = 0; y < height; y++)
+		for (uint32_t x = 0; x < row_pixels; x++)
+			image[(size_t)y * row_pixels + x] = (uint16_t)(x < width ? x * 7 + y * 3 + frame * 1000 : 0xDEAD);
+	return image;
+}
+
+static SingleImageInfo Round_Trip_Info(uint32_t width, uint32_t height, tiff::CompressionMode compress_mode, uint32_t tile_width = 0, uint32_t tile_height = 0)
+{
+	return { width, height, 16, 1, tiff::PixelType::PIXEL_UINT16, tiff::ImageType::IMAGE_GRAY, compress_mode, tiff::ShuffleMode::SHUFFLEMODE_NONE, tile_width, tile_height };
+}
+
+//Every frame of the file must load back as "expected", into rows "stride" bytes apart whose padding is left untouched.
+static void Check_Round_Trip(const wchar_t* path, const vector<vector<uint16_t>>& expected, uint32_t stride = 0)
+{
+	int hdl = open_tiff(path, tiff::OpenMode::READ_ONLY_MODE);
+	ASSERT_GE(hdl, 0);
+	uint32_t image_count = 0;
+	ASSERT_EQ(get_image_count(hdl, &image_count), 0);
+	ASSERT_EQ(image_count, (uint32_t)expected.size());
+	for (uint32_t i = 0; i < image_count; i++)
+	{
+		vector<uint16_t> loaded(expected[i].size(), 0xDEAD);
+		ASSERT_EQ(load_image_data(hdl, i, loaded.data(), stride), 0);
+		ASSERT_EQ(loaded, expected[i]);
+	}
+	close_tiff(hdl);
+}
+
+//Save a 16 bits image from a buffer with padded rows, the buffer must be left untouched and the image must load back the same.
+void Save_Keeps_Caller_Buffer(const wchar_t* name_ext, tiff::CompressionMode compress_mode, uint32_t tile_width, uint32_t tile_height)
+{
+	const uint32_t width = 1000, height = 333, padding = 7;
+	const uint32_t stride = (width + padding) * sizeof(uint16_t);
+	vector<uint16_t> image = Round_Trip_Frame(width, height, width + padding, 0);
+	vector<uint16_t> original = image;
+
+	wchar_t single_path[256];
+	ASSERT_NO_FATAL_FAILURE(Round_Trip_Path(name_ext, single_path));
+
+	SingleImageInfo info = Round_Trip_Info(width, height, compress_mode, tile_width, tile_height);
+	int hdl = open_tiff(single_path, tiff::OpenMode::CREATE_MODE);
+	ASSERT_GE(hdl, 0);
+	long frame_number = create_image(hdl, info);
+	ASSERT_EQ(frame_number, 0);
+	ASSERT_EQ(save_image_data(hdl, frame_number, image.data(), stride), 0);
+	close_tiff(hdl);
+	ASSERT_EQ(image, original);
+
+	Check_Round_Trip(single_path, { original }, stride);
+}
+
+void Save_Stack(const wchar_t* name_ext, tiff::CompressionMode compress_mode)
+{
+	const uint32_t width = 1000, height = 333, count = 5;
+	vector<vector<uint16_t>> images(count);
+	vector<const void*> frames(count);
+	vector<SingleImageInfo> infos(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		images[i] = Round_Trip_Frame(width, height, width, i);
+		frames[i] = images[i].data();
+		infos[i] = Round_Trip_Info(width, height, compress_mode);
+	}
+
+	wchar_t single_path[256];
+	ASSERT_NO_FATAL_FAILURE(Round_Trip_Path(name_ext, single_path));
+
+	int hdl = open_tiff(single_path, tiff::OpenMode::CREATE_MODE);
+	ASSERT_GE(hdl, 0);
+	ASSERT_EQ(save_image_stack(hdl, infos.data(), frames.data(), nullptr, count), 0);
+	close_tiff(hdl);
+
+	Check_Round_Trip(single_path, images);
+}
+
+//The region is loaded into rows "stride" bytes apart, the padding must be left untouched.
+static void Check_Region(int hdl, const vector<uint16_t>& image, uint32_t image_width, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+	const uint32_t padding = 3;
+	vector<uint16_t> expected((size_t)(width + padding) * height, 0xDEAD);
+	for (uint32_t row = 0; row < height; row++)
+		copy_n(image.begin() + (size_t)(y + row) * image_width + x, width, expected.begin() + (size_t)row * (width + padding));
+
+	vector<uint16_t> loaded(expected.size(), 0xDEAD);
+	ASSERT_EQ(load_image_region(hdl, 0, x, y, width, height, loaded.data(), (width + padding) * sizeof(uint16_t)), 0);
+	ASSERT_EQ(loaded, expected);
+}
+
+//"tile_width" 0 gives strips of "tile_height" rows. Regions of a whole interior block, of several partial blocks,
+//and of the last block at the right and bottom edges, which is only partly inside the image.
+void Load_Region(const wchar_t* name_ext, tiff::CompressionMode compress_mode, uint32_t tile_width, uint32_t tile_height)
+{
+	const uint32_t width = 1000, height = 333;
+	vector<uint16_t> image = Round_Trip_Frame(width, height, width, 0);
+
+	wchar_t single_path[256];
+	ASSERT_NO_FATAL_FAILURE(Round_Trip_Path(name_ext, single_path));
+
+	SingleImageInfo info = Round_Trip_Info(width, height, compress_mode, tile_width, tile_height);
+	int hdl = open_tiff(single_path, tiff::OpenMode::CREATE_MODE);
+	ASSERT_GE(hdl, 0);
+	long frame_number = create_image(hdl, info);
+	ASSERT_EQ(frame_number, 0);
+	ASSERT_EQ(save_image_data(hdl, frame_number, image.data()), 0);
+	close_tiff(hdl);
+
+	Check_Round_Trip(single_path, { image });
+
+	uint32_t block_width = tile_width == 0 ? width : tile_width;
+	uint32_t block_height = tile_height;
+	uint32_t last_x = (width - 1) / block_width * block_width;
+	uint32_t last_y = (height - 1) / block_height * block_height;
+
+	hdl = open_tiff(single_path, tiff::OpenMode::READ_ONLY_MODE);
+	ASSERT_GE(hdl, 0);
+	ASSERT_NO_FATAL_FAILURE(Check_Region(hdl, image, width, tile_width == 0 ? 0 : block_width, block_height, block_width, block_height));
+	ASSERT_NO_FATAL_FAILURE(Check_Region(hdl, image, width, 201, block_height / 2 + 3, 397, block_height + 7));
+	ASSERT_NO_FATAL_FAILURE(Check_Region(hdl, image, width, last_x, last_y, width - last_x, height - last_y));
+	ASSERT_NO_FATAL_FAILURE(Check_Region(hdl, image, width, last_x + 5, height - 1, width - last_x - 5, 1));
+
+	vector<uint16_t> outside(16);
+	ASSERT_EQ(load_image_region(hdl, 0, width - 3, 0, 4, 1, outside.data()), tiff::ErrorCode::ERR_REGION_NOT_CORRECT);
+	ASSERT_EQ(load_image_region(hdl, 0, 0, height, 1, 1, outside.data()), tiff::ErrorCode::ERR_REGION_NOT_CORRECT);
+	close_tiff(hdl);
+}
+
+//The same frame saved row by row, in uneven bands of padded rows, must load back like the one saved with "save_image_data".
+void Save_Bands(const wchar_t* name_ext, tiff::CompressionMode compress_mode, uint32_t tile_width, uint32_t tile_height)
+{
+	const uint32_t width = 1000, height = 333, padding = 7;
+	const uint32_t stride = (width + padding) * sizeof(uint16_t);
+	vector<uint16_t> image = Round_Trip_Frame(width, height, width + padding, 0);
+	vector<uint16_t> expected = Round_Trip_Frame(width, height, width, 0);
+	SingleImageInfo info = Round_Trip_Info(width, height, compress_mode, tile_width, tile_height);
+
+	wstring whole_name = wstring(name_ext) + L"_WHOLE";
+	wchar_t whole_path[256], band_path[256];
+	ASSERT_NO_FATAL_FAILURE(Round_Trip_Path(whole_name.c_str(), whole_path));
+	ASSERT_NO_FATAL_FAILURE(Round_Trip_Path(name_ext, band_path));
+
+	int hdl = open_tiff(whole_path, tiff::OpenMode::CREATE_MODE);
+	ASSERT_GE(hdl, 0);
+	ASSERT_EQ(create_image(hdl, info), 0);
+	ASSERT_EQ(save_image_data(hdl, 0, image.data(), stride), 0);
+	close_tiff(hdl);
+
+	//bands smaller, larger and not multiple of the blocks
+	const uint32_t bands[] = { 1, 37, 100, 5, 128, 2 };
+	hdl = open_tiff(band_path, tiff::OpenMode::CREATE_MODE);
+	ASSERT_GE(hdl, 0);
+	ASSERT_EQ(create_image(hdl, info), 0);
+	ASSERT_EQ(begin_image(hdl, 0), 0);
+	uint32_t row = 0;
+	for (uint32_t band : bands)
+	{
+		ASSERT_EQ(append_rows(hdl, 0, image.data() + (size_t)row * (width + padding), band, stride), 0);
+		row += band;
+	}
+	ASSERT_EQ(append_rows(hdl, 0, image.data() + (size_t)row * (width + padding), height - row, stride), 0);
+	ASSERT_EQ(end_image(hdl, 0), 0);
+	close_tiff(hdl);
+
+	Check_Round_Trip(whole_path, { expected });
+	Check_Round_Trip(band_path, { expected });
+}
+
 namespace CLASSIC_SIMPLE_TEST_CASES
 {
 	TEST(Function_Test, Save_Single_LZW_Compress_RGB_Channels_Frame) { Load_File(L"TIFF_LZW_RGB", tiff::CompressionMode::COMPRESSIONMODE_LZW); }
@@ -670,6 +849,20 @@ namespace CLASSIC_SIMPLE_TEST_CASES
 	TEST(Function_Test, TEST_Change_Value_Of_Exist_Tag) { Change_Tag(L"TIFF_LZW_TAG_RGB", tiff::CompressionMode::COMPRESSIONMODE_LZW); }
 
 	TEST(Function_Test, Append_Single_JPEG_Compress_RGB_Channels_Frame) { Append_File(L"TIFF_LZW_RGB", tiff::CompressionMode::COMPRESSIONMODE_JPEG); }
+
+	TEST(Function_Test, Save_LZW_Strips_Keeps_Caller_Buffer) { Save_Keeps_Caller_Buffer(L"TIFF_LZW_STRIDE", tiff::CompressionMode::COMPRESSIONMODE_LZW, 0, 0); }
+	TEST(Function_Test, Save_LZW_Tiles_Keeps_Caller_Buffer) { Save_Keeps_Caller_Buffer(L"TIFF_LZW_TILE_STRIDE", tiff::CompressionMode::COMPRESSIONMODE_LZW, 256, 128); }
+	TEST(Function_Test, Save_Raw_Keeps_Caller_Buffer) { Save_Keeps_Caller_Buffer(L"TIFF_RAW_STRIDE", tiff::CompressionMode::COMPRESSIONMODE_NONE, 0, 0); }
+
+	TEST(Function_Test, Save_LZW_Stack) { Save_Stack(L"TIFF_LZW_STACK", tiff::CompressionMode::COMPRESSIONMODE_LZW); }
+
+	TEST(Function_Test, Load_LZW_Strips_Region) { Load_Region(L"TIFF_LZW_REGION", tiff::CompressionMode::COMPRESSIONMODE_LZW, 0, 32); }
+	TEST(Function_Test, Load_LZW_Tiles_Region) { Load_Region(L"TIFF_LZW_TILE_REGION", tiff::CompressionMode::COMPRESSIONMODE_LZW, 256, 128); }
+	TEST(Function_Test, Load_Raw_Tiles_Region) { Load_Region(L"TIFF_RAW_TILE_REGION", tiff::CompressionMode::COMPRESSIONMODE_NONE, 256, 128); }
+
+	TEST(Function_Test, Save_LZW_Strips_By_Bands) { Save_Bands(L"TIFF_LZW_BANDS", tiff::CompressionMode::COMPRESSIONMODE_LZW, 0, 0); }
+	TEST(Function_Test, Save_LZW_Tiles_By_Bands) { Save_Bands(L"TIFF_LZW_TILE_BANDS", tiff::CompressionMode::COMPRESSIONMODE_LZW, 256, 128); }
+	TEST(Function_Test, Save_Raw_Strips_By_Bands) { Save_Bands(L"TIFF_RAW_BANDS", tiff::CompressionMode::COMPRESSIONMODE_NONE, 0, 0); }
 }
 
 namespace CLASSIC_PERFORMAANCE_TEST_CASES
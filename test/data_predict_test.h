@@ -0,0 +1,66 @@
+﻿#pragma once
+#include <vector>
+#include <random>
+#include "..\..\src\common\data_predict.h"
+
+using namespace std;
+
+static const int simd_levels[] = { PREDICT_SIMD_SSE2, PREDICT_SIMD_AVX2, PREDICT_SIMD_AVX512, PREDICT_SIMD_NEON };
+
+//Compare every supported SIMD level with the scalar code, including rows which don't fill a whole register.
+void Compare_Predict_With_Scalar(unsigned short data_bytes, unsigned short samples_per_pixel, bool is_big_endian)
+{
+	const unsigned int widths[] = { 1, 2, 5, 15, 16, 17, 31, 64, 100, 333 };
+	const unsigned int heights[] = { 1, 3, 5, 8 };
+
+	mt19937 gen(data_bytes * 100 + samples_per_pixel);
+	uniform_int_distribution<int> dist(0, 255);
+
+	for (int level : simd_levels)
+	{
+		if (!predict_simd_supported(level))
+			continue;
+
+		for (unsigned int width : widths)
+		{
+			for (unsigned int height : heights)
+			{
+				size_t size = (size_t)width * height * data_bytes * samples_per_pixel;
+				vector<uint8_t> raw(size);
+				for (auto& v : raw)
+					v = (uint8_t)dist(gen);
+
+				vector<uint8_t> scalar = raw, simd = raw;
+				ASSERT_EQ(horizontal_differencing_with_level(scalar.data(), height, width, data_bytes, samples_per_pixel, is_big_endian, PREDICT_SIMD_SCALAR), 0);
+				ASSERT_EQ(horizontal_differencing_with_level(simd.data(), height, width, data_bytes, samples_per_pixel, is_big_endian, level), 0);
+				ASSERT_EQ(scalar, simd) << "differencing, level " << level << ", width " << width << ", height " << height;
+
+				ASSERT_EQ(horizontal_acc_with_level(scalar.data(), height, width, data_bytes, samples_per_pixel, is_big_endian, PREDICT_SIMD_SCALAR), 0);
+				ASSERT_EQ(horizontal_acc_with_level(simd.data(), height, width, data_bytes, samples_per_pixel, is_big_endian, level), 0);
+				ASSERT_EQ(scalar, simd) << "accumulation, level " << level << ", width " << width << ", height " << height;
+				ASSERT_EQ(raw, simd) << "round trip, level " << level << ", width " << width << ", height " << height;
+			}
+		}
+	}
+}
+
+namespace DATA_PREDICT_TEST_CASES
+{
+	TEST(Predict_Test, SIMD_Level_Detected) { ASSERT_TRUE(predict_simd_supported(predict_simd_level())); }
+
+	TEST(Predict_Test, Compare_8Bits_Gray) { Compare_Predict_With_Scalar(1, 1, false); }
+	TEST(Predict_Test, Compare_8Bits_RGB) { Compare_Predict_With_Scalar(1, 3, false); }
+	TEST(Predict_Test, Compare_8Bits_RGBA) { Compare_Predict_With_Scalar(1, 4, false); }
+
+	TEST(Predict_Test, Compare_16Bits_Gray) { Compare_Predict_With_Scalar(2, 1, false); }
+	TEST(Predict_Test, Compare_16Bits_RGB) { Compare_Predict_With_Scalar(2, 3, false); }
+	TEST(Predict_Test, Compare_16Bits_RGBA) { Compare_Predict_With_Scalar(2, 4, false); }
+	TEST(Predict_Test, Compare_16Bits_Gray_BigEndian) { Compare_Predict_With_Scalar(2, 1, true); }
+
+	TEST(Predict_Test, Compare_32Bits_Gray) { Compare_Predict_With_Scalar(4, 1, false); }
+	TEST(Predict_Test, Compare_32Bits_RGB) { Compare_Predict_With_Scalar(4, 3, false); }
+	TEST(Predict_Test, Compare_32Bits_RGBA) { Compare_Predict_With_Scalar(4, 4, false); }
+
+	//no SIMD kernel for accumulation, must still go through the scalar code
+	TEST(Predict_Test, Compare_16Bits_Two_Samples) { Compare_Predict_With_Scalar(2, 2, false); }
+}
@@ -0,0 +1,102 @@
+﻿#pragma once
+#include <cmath>
+#include <vector>
+#include <random>
+#include "..\..\src\common\image_reduce.h"
+#include "..\..\src\common\image_resample.h"
+
+using namespace std;
+
+//Compare with a plain 2x2 average, including odd sizes and rows which don't fill a whole register.
+template<typename T>
+void Compare_Reduce_With_Reference(unsigned short samples_per_pixel, int sample_format)
+{
+	const unsigned int widths[] = { 1, 2, 5, 15, 16, 17, 31, 64, 100, 333 };
+	const unsigned int heights[] = { 1, 2, 5, 8 };
+
+	mt19937 gen(sizeof(T) * 100 + samples_per_pixel);
+	uniform_int_distribution<int> dist(-30000, 30000);
+
+	for (unsigned int width : widths)
+	{
+		for (unsigned int height : heights)
+		{
+			vector<T> src((size_t)width * height * samples_per_pixel);
+			for (auto& v : src)
+				v = (T)(sample_format == IMAGE_REDUCE_FLOAT ? dist(gen) / 8.0 : dist(gen));
+
+			unsigned int dst_width = (width + 1) / 2, dst_height = (height + 1) / 2;
+			vector<T> dst((size_t)dst_width * dst_height * samples_per_pixel);
+			ASSERT_EQ(image_reduce_2x2(src.data(), width, height, width * samples_per_pixel * sizeof(T), sizeof(T), samples_per_pixel,
+				sample_format, dst.data(), dst_width * samples_per_pixel * sizeof(T)), 0);
+
+			for (unsigned int y = 0; y < dst_height; y++)
+			{
+				unsigned int y0 = y * 2, y1 = y * 2 + 1 < height ? y * 2 + 1 : y * 2;
+				for (unsigned int x = 0; x < dst_width; x++)
+				{
+					unsigned int x0 = x * 2, x1 = x * 2 + 1 < width ? x * 2 + 1 : x * 2;
+					for (unsigned short s = 0; s < samples_per_pixel; s++)
+					{
+						double sum = (double)src[((size_t)y0 * width + x0) * samples_per_pixel + s] + src[((size_t)y0 * width + x1) * samples_per_pixel + s]
+							+ src[((size_t)y1 * width + x0) * samples_per_pixel + s] + src[((size_t)y1 * width + x1) * samples_per_pixel + s];
+						T expected = (T)(sample_format == IMAGE_REDUCE_FLOAT ? sum / 4 : floor((sum + 2) / 4));
+						ASSERT_EQ(dst[((size_t)y * dst_width + x) * samples_per_pixel + s], expected) << "width " << width << ", height " << height << ", x " << x << ", y " << y;
+					}
+				}
+			}
+		}
+	}
+}
+
+//Resampling to half the size with the box filter must give the same result as the 2x2 reduction.
+template<typename T>
+void Compare_Resample_With_Reduce(unsigned short samples_per_pixel, int sample_format)
+{
+	const unsigned int width = 66, height = 10;
+	mt19937 gen(samples_per_pixel);
+	uniform_int_distribution<int> dist(0, 255);
+	vector<T> src((size_t)width * height * samples_per_pixel);
+	for (auto& v : src)
+		v = (T)dist(gen);
+
+	size_t row_samples = (size_t)width / 2 * samples_per_pixel;
+	vector<T> reduced(row_samples * height / 2), resampled(row_samples * height / 2);
+	ASSERT_EQ(image_reduce_2x2(src.data(), width, height, width * samples_per_pixel * sizeof(T), sizeof(T), samples_per_pixel,
+		sample_format, reduced.data(), row_samples * sizeof(T)), 0);
+
+	vector<image_resample_tap> taps_x(width / 2), taps_y(height / 2);
+	ASSERT_EQ(image_resample_axis(width, width / 2, taps_x.data()), 0);
+	ASSERT_EQ(image_resample_axis(height, height / 2, taps_y.data()), 0);
+	vector<float> row(row_samples), sum(row_samples);
+	for (unsigned int y = 0; y < height / 2; y++)
+	{
+		fill(sum.begin(), sum.end(), 0.0f);
+		for (unsigned int n = 0; n < taps_y[y].count; n++)
+		{
+			image_resample_row(&src[(size_t)(taps_y[y].first + n) * width * samples_per_pixel], sizeof(T), samples_per_pixel, sample_format,
+				taps_x.data(), width / 2, row.data());
+			image_resample_add(sum.data(), row.data(), n == 0 ? taps_y[y].first_weight : taps_y[y].weight, row_samples);
+		}
+		image_resample_store(sum.data(), row_samples, sizeof(T), sample_format, &resampled[y * row_samples]);
+	}
+	ASSERT_EQ(reduced, resampled);
+}
+
+namespace IMAGE_REDUCE_TEST_CASES
+{
+	TEST(Reduce_Test, Compare_8Bits_Gray) { Compare_Reduce_With_Reference<uint8_t>(1, IMAGE_REDUCE_UINT); }
+	TEST(Reduce_Test, Compare_8Bits_RGB) { Compare_Reduce_With_Reference<uint8_t>(3, IMAGE_REDUCE_UINT); }
+	TEST(Reduce_Test, Compare_Signed_8Bits_Gray) { Compare_Reduce_With_Reference<int8_t>(1, IMAGE_REDUCE_INT); }
+
+	TEST(Reduce_Test, Compare_16Bits_Gray) { Compare_Reduce_With_Reference<uint16_t>(1, IMAGE_REDUCE_UINT); }
+	TEST(Reduce_Test, Compare_16Bits_Two_Samples) { Compare_Reduce_With_Reference<uint16_t>(2, IMAGE_REDUCE_UINT); }
+	TEST(Reduce_Test, Compare_Signed_16Bits_Gray) { Compare_Reduce_With_Reference<int16_t>(1, IMAGE_REDUCE_INT); }
+
+	TEST(Reduce_Test, Compare_32Bits_Float_Gray) { Compare_Reduce_With_Reference<float>(1, IMAGE_REDUCE_FLOAT); }
+	TEST(Reduce_Test, Compare_32Bits_Float_RGB) { Compare_Reduce_With_Reference<float>(3, IMAGE_REDUCE_FLOAT); }
+
+	TEST(Resample_Test, Half_Size_8Bits_RGB) { Compare_Resample_With_Reduce<uint8_t>(3, IMAGE_REDUCE_UINT); }
+	TEST(Resample_Test, Half_Size_16Bits_Gray) { Compare_Resample_With_Reduce<uint16_t>(1, IMAGE_REDUCE_UINT); }
+	TEST(Resample_Test, Half_Size_32Bits_Float_Gray) { Compare_Resample_With_Reduce<float>(1, IMAGE_REDUCE_FLOAT); }
+}
@@ -0,0 +1,231 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <functional>
+#include <direct.h>
+#include "..\..\src\ome_tiff\ometiff.h"
+#include "..\..\src\ome_tiff\ometiff_info.h"
+
+using namespace std;
+using namespace ome;
+
+static const wchar_t* OME_XML_PLATE_NAME = L"Slide <A&B> \"1\" 'x'";
+static const wchar_t* OME_XML_CHANNEL_NAMES[] = { L"DAPI", L"Cy5 & <GFP>" };
+
+//The model is written with generate_ome_xml and read back with parse_ome_xml, the parsed one must generate the same XML.
+static void Ome_Xml_Path(const wchar_t* name, wchar_t (&path)[256])
+{
+	wchar_t* s_cwd = _wgetcwd(NULL, 0);
+	ASSERT_FALSE(s_cwd == NULL);
+	swprintf_s(path, 256, L"%s\\test\\%s.ome.tif", s_cwd, name);
+	free(s_cwd);
+}
+
+//A new file, broken XML parsed into it fails in the reader before any region is added.
+static void Ome_Xml_Open(const wchar_t* name, OmeTiff& tiff)
+{
+	wchar_t path[256];
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Path(name, path));
+	ASSERT_EQ(tiff.Init(path, OpenMode::CREATE_MODE, CompressionMode::COMPRESSIONMODE_NONE), ErrorCode::STATUS_OK);
+}
+
+//Names hold the characters escaped as entities. One tile is saved for each channel of each region,
+//the files of the TiffData have to exist or their channels are dropped when the XML is parsed.
+static void Ome_Xml_Build(OmeTiff& tiff)
+{
+	PlateInfo plate_info = { 0 };
+	plate_info.id = 1;
+	plate_info.width = 115;
+	plate_info.height = 70;
+	plate_info.physicalsize_unit_x = DistanceUnit::DISTANCE_MILLIMETER;
+	plate_info.physicalsize_unit_y = DistanceUnit::DISTANCE_MILLIMETER;
+	plate_info.row_size = 2;
+	plate_info.column_size = 3;
+	wmemcpy_s(plate_info.name, NAME_LEN, OME_XML_PLATE_NAME, wcslen(OME_XML_PLATE_NAME));
+	ASSERT_EQ(tiff.AddPlate(plate_info), ErrorCode::STATUS_OK);
+
+	for (uint32_t w = 0; w < 2; w++)
+	{
+		WellInfo well_info = { 0 };
+		well_info.id = w + 2;
+		well_info.position_x = 7.5f + w * 30;
+		well_info.position_y = 5;
+		well_info.width = 20;
+		well_info.height = 60;
+		well_info.well_shape = Shape::SHAPE_RECTANGLE;
+		well_info.row_index = (uint16_t)w;
+		well_info.column_index = (uint16_t)(w + 1);
+		ASSERT_EQ(tiff.AddWell(plate_info.id, well_info), ErrorCode::STATUS_OK);
+	}
+
+	ScanInfo scan_info = { 0 };
+	scan_info.id = 3;
+	scan_info.pixel_physical_size_x = 0.5f;
+	scan_info.pixel_physical_size_y = 0.25f;
+	scan_info.pixel_physical_size_z = 1;
+	scan_info.pixel_physical_uint_x = DistanceUnit::DISTANCE_MICROMETER;
+	scan_info.pixel_physical_uint_y = DistanceUnit::DISTANCE_MICROMETER;
+	scan_info.pixel_physical_uint_z = DistanceUnit::DISTANCE_MICROMETER;
+	scan_info.time_increment = 1;
+	scan_info.time_increment_unit = TimeUnit::TIME_SECOND;
+	scan_info.tile_pixel_size_width = 64;
+	scan_info.tile_pixel_size_height = 32;
+	scan_info.significant_bits = 14;
+	scan_info.pixel_type = PixelType::PIXEL_UINT16;
+	ASSERT_EQ(tiff.AddScan(plate_info.id, scan_info), ErrorCode::STATUS_OK);
+
+	for (uint32_t c = 0; c < 2; c++)
+	{
+		ChannelInfo channel_info = { 0 };
+		channel_info.id = c;
+		channel_info.samples_per_pixel = 1;
+		channel_info.bin_size = 1;
+		wmemcpy_s(channel_info.name, NAME_LEN, OME_XML_CHANNEL_NAMES[c], wcslen(OME_XML_CHANNEL_NAMES[c]));
+		ASSERT_EQ(tiff.AddChannel(plate_info.id, scan_info.id, channel_info), ErrorCode::STATUS_OK);
+	}
+
+	vector<uint16_t> tile((size_t)scan_info.tile_pixel_size_width * scan_info.tile_pixel_size_height, 100);
+	for (uint32_t r = 0; r < 2; r++)
+	{
+		ScanRegionInfo region_info = { 0 };
+		region_info.id = r;
+		region_info.pixel_size_x = 128 + r * 64;
+		region_info.pixel_size_y = 96;
+		region_info.pixel_size_z = 1;
+		region_info.start_physical_x = 8619.5f + r;
+		region_info.start_physical_y = 9828;
+		region_info.start_unit_x = DistanceUnit::DISTANCE_MICROMETER;
+		region_info.start_unit_y = DistanceUnit::DISTANCE_MICROMETER;
+		region_info.start_unit_z = DistanceUnit::DISTANCE_MICROMETER;
+		ASSERT_EQ(tiff.AddScanRegion(plate_info.id, scan_info.id, r + 2, region_info), ErrorCode::STATUS_OK);
+
+		for (uint32_t c = 0; c < 2; c++)
+		{
+			FrameInfo frame = { plate_info.id, scan_info.id, region_info.id, c, 0, 0 };
+			ASSERT_EQ(tiff.SaveTileData(frame, 0, 0, tile.data(), 0), ErrorCode::STATUS_OK);
+		}
+	}
+}
+
+//The generated XML, possibly edited by "decorate", is written as the description of the boot image and the file closed.
+static void Ome_Xml_Write(const wchar_t* name, string& xml, const function<void(string&)>& decorate)
+{
+	OmeTiff tiff;
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Open(name, tiff));
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Build(tiff));
+	ASSERT_EQ(generate_ome_xml(xml, &tiff), ErrorCode::STATUS_OK);
+	string header = xml;
+	if (decorate)
+		decorate(header);
+
+	FrameInfo header_frame = { 0 };
+	header_frame.plate_id = UINT32_MAX;
+	ASSERT_EQ(tiff.CreateOMEHeader(), ErrorCode::STATUS_OK);
+	ASSERT_EQ(tiff.SetTag(header_frame, TIFFTAG_IMAGEDESCRIPTION, TiffTagDataType::TIFF_ASCII, (uint32_t)header.size(), (void*)header.c_str()), ErrorCode::STATUS_OK);
+}
+
+//Opened again the description is parsed, the names are read back unescaped and the model generates the same XML.
+static void Ome_Xml_Check_Parsed(const wchar_t* name, const string& xml)
+{
+	wchar_t path[256];
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Path(name, path));
+	OmeTiff parsed;
+	ASSERT_EQ(parsed.Init(path, OpenMode::READ_ONLY_MODE, CompressionMode::COMPRESSIONMODE_NONE), ErrorCode::STATUS_OK);
+
+	ASSERT_EQ(parsed.GetPlatesSize(), 1);
+	PlateInfo plate_info;
+	parsed.GetPlates(&plate_info);
+	ASSERT_EQ(wstring(plate_info.name), wstring(OME_XML_PLATE_NAME));
+	ASSERT_EQ(parsed.GetWellsSize(plate_info.id), 2);
+	ASSERT_EQ(parsed.GetScansSize(plate_info.id), 1);
+
+	ChannelInfo channels[2];
+	ASSERT_EQ(parsed.GetChannelsSize(plate_info.id, 3), 2);
+	parsed.GetChannels(plate_info.id, 3, channels);
+	for (uint32_t c = 0; c < 2; c++)
+		ASSERT_EQ(wstring(channels[c].name), wstring(OME_XML_CHANNEL_NAMES[c]));
+	for (uint32_t w = 0; w < 2; w++)
+	{
+		ScanRegionInfo region_info;
+		ASSERT_EQ(parsed.GetScanRegionsSize(plate_info.id, 3, w + 2), 1);
+		parsed.GetScanRegions(plate_info.id, 3, w + 2, &region_info);
+		ASSERT_EQ(region_info.id, w);
+		ASSERT_EQ(region_info.pixel_size_x, 128 + w * 64);
+	}
+
+	string parsed_xml;
+	ASSERT_EQ(generate_ome_xml(parsed_xml, &parsed), ErrorCode::STATUS_OK);
+	ASSERT_EQ(parsed_xml, xml);
+}
+
+static void Ome_Xml_Round_Trip()
+{
+	string xml;
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Write(L"OME_XML_ROUND_TRIP", xml, nullptr));
+	ASSERT_NE(xml.find("&amp;"), string::npos);
+	ASSERT_NE(xml.find("&lt;"), string::npos);
+	ASSERT_NE(xml.find("&quot;"), string::npos);
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Check_Parsed(L"OME_XML_ROUND_TRIP", xml));
+}
+
+//Comments, CDATA and a DOCTYPE are skipped even when they hold tags, CRLF line ends and numeric entities are read like other writers save them.
+static void Ome_Xml_Decorated()
+{
+	string xml;
+	auto decorate = [](string& header)
+		{
+			header.insert(header.find("<Plate "), "<!-- <Plate ID=\"Plate:9\"> --><![CDATA[<Image ID=\"Image:9\"></Image>]]>\r\n");
+			size_t pos = header.find("Name=\"DAPI\"");
+			header.replace(pos, strlen("Name=\"DAPI\""), "Name=\"&#68;&#x41;PI\"");
+			header.insert(header.find("<OME"), "<!DOCTYPE OME [<!ENTITY skipped \"<Plate>\">]>\r\n");
+		};
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Write(L"OME_XML_DECORATED", xml, decorate));
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Check_Parsed(L"OME_XML_DECORATED", xml));
+}
+
+//An empty OME element is a valid document without plates.
+static void Ome_Xml_Empty()
+{
+	OmeTiff empty;
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Open(L"OME_XML_EMPTY", empty));
+	ASSERT_EQ(parse_ome_xml("<?xml version=\"1.0\" encoding=\"UTF-8\"?><OME xmlns=\"http://www.openmicroscopy.org/Schemas/OME/2016-06\"/>", &empty), ErrorCode::STATUS_OK);
+	ASSERT_EQ(empty.GetPlatesSize(), 0);
+	ASSERT_TRUE(empty._images.empty());
+
+	ASSERT_EQ(parse_ome_xml("<?xml version=\"1.0\"?><!-- no OME element -->", &empty), ErrorCode::ERR_XML_PARSE_FAILED);
+}
+
+//XML cut anywhere, in a tag, in a value or between the elements, is never taken for a complete document.
+static void Ome_Xml_Truncated()
+{
+	OmeTiff original;
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Open(L"OME_XML_TRUNCATED", original));
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Build(original));
+	string xml;
+	ASSERT_EQ(generate_ome_xml(xml, &original), ErrorCode::STATUS_OK);
+
+	vector<size_t> sizes = { xml.find("<OME") + 3, xml.find("<Plate ") + 10, xml.find("Name=\"DAPI\"") + 8,
+		xml.find("</Well>") + 1, xml.find("</Plate>") + strlen("</Plate>"), xml.rfind("</OME>"), xml.rfind("</OME>") + strlen("</OME>") - 1 };
+	for (size_t size : sizes)
+	{
+		OmeTiff truncated;
+		ASSERT_NO_FATAL_FAILURE(Ome_Xml_Open(L"OME_XML_TRUNCATED_PARSED", truncated));
+		ASSERT_EQ(parse_ome_xml(xml.substr(0, size), &truncated), ErrorCode::ERR_READ_OME_XML_FAILED);
+	}
+
+	//Elements closed in the wrong order are broken too
+	string crossed = xml;
+	size_t well_end = crossed.find("</Well>");
+	crossed.replace(well_end, strlen("</Well>"), "</Plate>");
+	OmeTiff crossed_parsed;
+	ASSERT_NO_FATAL_FAILURE(Ome_Xml_Open(L"OME_XML_CROSSED", crossed_parsed));
+	ASSERT_EQ(parse_ome_xml(crossed, &crossed_parsed), ErrorCode::ERR_READ_OME_XML_FAILED);
+}
+
+namespace OME_XML_TEST_CASES
+{
+	TEST(Ome_Xml_Test, Generate_Parse_Round_Trip) { Ome_Xml_Round_Trip(); }
+	TEST(Ome_Xml_Test, Parse_Comments_CDATA_Entities) { Ome_Xml_Decorated(); }
+	TEST(Ome_Xml_Test, Parse_Empty_OME) { Ome_Xml_Empty(); }
+	TEST(Ome_Xml_Test, Parse_Truncated) { Ome_Xml_Truncated(); }
+}